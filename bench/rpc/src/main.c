@@ -0,0 +1,18 @@
+/**
+ * @file main.c
+ * @brief RPC latency benchmark app.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+/* Includes ----------------------------------------------------------- */
+#include <zephyr/kernel.h>
+#include "rpc_bench.h"
+
+/* Public function definitions ---------------------------------------- */
+int main(void)
+{
+    return rpc_bench_run();
+}
@@ -0,0 +1,33 @@
+/**
+ * @file main.c
+ * @brief Storage benchmark app.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+/* Includes ----------------------------------------------------------- */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include "storage.h"
+#include "storage_bench.h"
+
+/* Public function definitions ---------------------------------------- */
+int main(void)
+{
+    int32_t ret;
+
+    ret = storage_init();
+    if (ret < 0)
+    {
+        printk("Failed to mount flash storage: %d\n", ret);
+        return ret;
+    }
+
+    ret = storage_bench_run();
+
+    storage_shutdown();
+
+    return ret;
+}
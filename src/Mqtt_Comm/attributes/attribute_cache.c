@@ -0,0 +1,1164 @@
+/* Includes ----------------------------------------------------------- */
+#include "attribute_cache.h"
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "json_writer.h"
+#include "storage.h"
+#include "storage_cache.h"
+#include "storage_async.h"
+#include "storage_kv.h"
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+#include "thingsboard_pb.h"
+#endif
+
+/* Private defines ---------------------------------------------------- */
+/* Value file of a key is "<scope>_<key>", epoch file keeps the session epoch */
+#define ATTRIBUTE_CACHE_FILE_PREFIX_LEN     2
+#define ATTRIBUTE_CACHE_FILE_NAME_SIZE      (ATTRIBUTE_CACHE_FILE_PREFIX_LEN + CONFIG_ATTRIBUTE_CACHE_KEY_MAX_LEN + 1)
+#define ATTRIBUTE_CACHE_EPOCH_FILE_NAME     "attrepoch"
+/* Other files of the config directory: username, boot counter and epoch */
+#define ATTRIBUTE_CACHE_SHARED_FILES        3
+
+/* Comma separated keys of one scope */
+#define ATTRIBUTE_CACHE_KEY_LIST_SIZE       (CONFIG_ATTRIBUTE_CACHE_MAX_KEYS * (CONFIG_ATTRIBUTE_CACHE_KEY_MAX_LEN + 1))
+#define ATTRIBUTE_CACHE_REQUEST_MAX_LEN     (sizeof("{\"clientKeys\":\"\",\"sharedKeys\":\"\"}") + \
+                                                (2 * ATTRIBUTE_CACHE_KEY_LIST_SIZE))
+#define ATTRIBUTE_CACHE_TOPIC_SIZE          (sizeof(ATTRIBUTE_CACHE_REQUEST_TOPIC_PREFIX) + ATTRIBUTE_CACHE_ID_MAX_LEN)
+
+/* JSON bytes around the keys and values of a one key request and its response, e.g.
+ * {"sharedKeys":"LED"} and {"shared":{"LED":true}}. Topics take the prefix and a short id */
+#define ATTRIBUTE_CACHE_REQUEST_OVERHEAD    (sizeof("{\"sharedKeys\":\"\"}") - 1 + \
+                                                sizeof(ATTRIBUTE_CACHE_REQUEST_TOPIC_PREFIX))
+#define ATTRIBUTE_CACHE_RESPONSE_OVERHEAD   (sizeof("{\"shared\":{\"\":}}") - 1 + \
+                                                sizeof(ATTRIBUTE_CACHE_RESPONSE_TOPIC) - 1)
+
+/* Private enumerate/structure ---------------------------------------- */
+/* Cached value as stored in flash. Value is JSON text, strings with their quotes */
+typedef struct
+{
+    uint32_t version;       // Session epoch the value was last valid in, 0 if never
+    uint8_t length;         // 0 if the key has no value
+    uint8_t value[CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN];
+}ATTRIBUTE_CACHE_RECORD_STRUCT;
+
+/* Registered key */
+typedef struct
+{
+    uint8_t key[CONFIG_ATTRIBUTE_CACHE_KEY_MAX_LEN + 1];
+    ATTRIBUTE_CACHE_SCOPE scope;
+    ATTRIBUTE_CACHE_HANDLER handler;
+    void *ctx;
+    bool isRequested;       // In the outstanding attribute request
+    ATTRIBUTE_CACHE_RECORD_STRUCT record;
+}ATTRIBUTE_CACHE_ENTRY_STRUCT;
+
+/* Values of a received message, applied once the whole message is valid */
+typedef struct
+{
+    uint32_t mask;
+    uint32_t skippedMask;   // Keys sent with a value the cache cannot keep
+    ATTRIBUTE_CACHE_RECORD_STRUCT records[CONFIG_ATTRIBUTE_CACHE_MAX_KEYS];
+}ATTRIBUTE_CACHE_STAGE_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+#define RECORD_SIZE(length) (offsetof(ATTRIBUTE_CACHE_RECORD_STRUCT, value) + (length))
+
+BUILD_ASSERT(CONFIG_ATTRIBUTE_CACHE_MAX_KEYS <= 32, "Staged keys are kept in a 32 bit mask");
+BUILD_ASSERT(CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN <= UINT8_MAX, "Value length is stored in one byte");
+BUILD_ASSERT(ATTRIBUTE_CACHE_FILE_NAME_SIZE <= (STORAGE_ASYNC_NAME_MAX_LEN + 1), "Key too long for a file name");
+BUILD_ASSERT(sizeof(ATTRIBUTE_CACHE_RECORD_STRUCT) <= CONFIG_STORAGE_ASYNC_DATA_MAX_LEN,
+                "Value record does not fit in a storage work queue request");
+#if defined(CONFIG_STORAGE_KV)
+BUILD_ASSERT((CONFIG_ATTRIBUTE_CACHE_MAX_KEYS + ATTRIBUTE_CACHE_SHARED_FILES) <= STORAGE_KV_MAX_KEYS,
+                "Config directory files do not fit in the key/value store");
+#endif
+
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Cache entries and stats Mutex to synchronize */
+K_MUTEX_DEFINE(AttributeCacheMutex);
+/* Given when the response of the outstanding request is applied */
+K_SEM_DEFINE(AttributeCacheSynced, 0, 1);
+
+static ATTRIBUTE_CACHE_PUBLISH publishRequest = NULL;
+
+static ATTRIBUTE_CACHE_ENTRY_STRUCT cacheEntries[CONFIG_ATTRIBUTE_CACHE_MAX_KEYS];
+static uint32_t entryCount = 0;
+
+/* Changes whenever the broker session is lost, shared values of older epochs may have missed updates */
+static uint32_t sessionEpoch = 1;
+
+/* One request at a time, it carries every stale key */
+static bool isRequestOutstanding = false;
+static uint32_t requestId = 0;
+static int32_t syncResult = 0;
+
+static ATTRIBUTE_CACHE_STATS_STRUCT cacheStats;
+
+/* Used by the MQTT thread only */
+static ATTRIBUTE_CACHE_STAGE_STRUCT receivedValues;
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+static TB_PB_ATTRIBUTE_KEY_STRUCT pbKeys[ATTRIBUTE_CACHE_SCOPE_COUNT][CONFIG_ATTRIBUTE_CACHE_MAX_KEYS];
+static uint32_t pbKeyCount[ATTRIBUTE_CACHE_SCOPE_COUNT];
+#endif
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to find a registered key.
+ *
+ * param[in]        key: Key, zero termination not needed.
+ * param[in]        keyLength: Key length.
+ * param[in]        scope: Key scope.
+ *
+ * @return          Entry index, -ENOENT if not registered.
+ *
+*/
+static int32_t findEntry(const uint8_t *key, uint32_t keyLength, ATTRIBUTE_CACHE_SCOPE scope)
+{
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        if ((cacheEntries[i].scope == scope) && (strlen(cacheEntries[i].key) == keyLength) &&
+            (memcmp(cacheEntries[i].key, key, keyLength) == 0))
+        {
+            return i;
+        }
+    }
+
+    return -ENOENT;
+}
+
+/**@brief           Function to check if a cached value is still valid.
+ *
+ * @details         Client values are written by the device, once known they stay valid. Shared
+ *                  values are valid in the epoch they were received in: the broker session
+ *                  keeps the updates sent while we are away, so they come in after the connect.
+ *                  Cache lock must be held by the caller.
+ *
+ * param[in]        entry: Cache entry.
+ *
+ * @return          true if the key does not need to be requested.
+ *
+*/
+static bool isEntryFresh(const ATTRIBUTE_CACHE_ENTRY_STRUCT *entry)
+{
+    if (entry->scope == ATTRIBUTE_CACHE_SCOPE_CLIENT)
+    {
+        return (entry->record.version != 0);
+    }
+
+    return (entry->record.version == sessionEpoch);
+}
+
+/**@brief           Function to get the bytes a one key request and its response would take.
+ *
+ * @details         JSON payloads and topics, without the MQTT and TLS framing. Cache lock must
+ *                  be held by the caller.
+ *
+ * param[in]        entry: Cache entry.
+ *
+ * @return          Bytes.
+ *
+*/
+static uint32_t roundTripBytes(const ATTRIBUTE_CACHE_ENTRY_STRUCT *entry)
+{
+    return ATTRIBUTE_CACHE_REQUEST_OVERHEAD + ATTRIBUTE_CACHE_RESPONSE_OVERHEAD + (2 * strlen(entry->key)) +
+            entry->record.length;
+}
+
+/**@brief           Function to get the file name of a key.
+ *
+ * param[in]        entry: Cache entry.
+ * param[in]        name: Output, ATTRIBUTE_CACHE_FILE_NAME_SIZE bytes.
+ *
+ * @return          None.
+ *
+*/
+static void getFileName(const ATTRIBUTE_CACHE_ENTRY_STRUCT *entry, uint8_t *name)
+{
+    snprintf(name, ATTRIBUTE_CACHE_FILE_NAME_SIZE, "%c_%s",
+                (entry->scope == ATTRIBUTE_CACHE_SCOPE_SHARED) ? 's' : 'c', entry->key);
+}
+
+/**@brief           Storage work queue completion callback.
+ *
+ * param[in]        result: Request result.
+ * param[in]        user_data: Request description.
+ *
+ * @return          None.
+ *
+*/
+static void storageRequestDone(int32_t result, void *user_data)
+{
+    if (result < 0)
+    {
+        printk("Attribute cache %s failed: %d\n", (const char *)user_data, result);
+    }
+}
+
+/**@brief           Function to queue the write of a cached value.
+ *
+ * @details         Cache lock must be held by the caller, the record is copied into the request.
+ *
+ * param[in]        entry: Cache entry.
+ *
+ * @return          0 if queued, negative otherwise.
+ *
+*/
+static int32_t saveEntry(const ATTRIBUTE_CACHE_ENTRY_STRUCT *entry)
+{
+    uint8_t name[ATTRIBUTE_CACHE_FILE_NAME_SIZE];
+
+    getFileName(entry, name);
+
+    return storage_async_write(name, (const uint8_t *)&entry->record, RECORD_SIZE(entry->record.length), DIRECTORY,
+                                storageRequestDone, "write");
+}
+
+/**@brief           Function to get the value of a key.
+ *
+ * @details         Counts a hit, or a miss when the key is not registered or has no value.
+ *
+ * param[in]        key: Key.
+ * param[in]        scope: Key scope.
+ * param[in]        json: Output for the value, JSON text, zero terminated.
+ * param[in]        size: Output size including the terminating zero.
+ *
+ * @return          Value length, -ENOENT if there is no value, -ENOMEM if the buffer is too small.
+ *
+*/
+static int32_t readValue(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, uint8_t *json, uint32_t size)
+{
+    ATTRIBUTE_CACHE_ENTRY_STRUCT *entry = NULL;
+    int32_t index = 0;
+    int32_t ret = 0;
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+
+    index = findEntry(key, strlen(key), scope);
+    if ((index < 0) || (cacheEntries[index].record.length == 0))
+    {
+        cacheStats.misses++;
+        ret = -ENOENT;
+    }
+    else if (cacheEntries[index].record.length >= size)
+    {
+        ret = -ENOMEM;
+    }
+    else
+    {
+        entry = &cacheEntries[index];
+        memcpy(json, entry->record.value, entry->record.length);
+        json[entry->record.length] = 0;
+        ret = entry->record.length;
+
+        cacheStats.hits++;
+        cacheStats.bytesSaved += roundTripBytes(entry);
+    }
+
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    return ret;
+}
+
+/**@brief           Function to keep a received value until the message is applied.
+ *
+ * @details         Values too long for the cache are skipped and their keys stay stale, the rest
+ *                  of the message is used.
+ *
+ * param[in]        index: Entry index.
+ * param[in]        json: Value, JSON text.
+ * param[in]        length: Value length.
+ *
+ * @return          0.
+ *
+*/
+static int32_t stageValue(int32_t index, const uint8_t *json, uint32_t length)
+{
+    ATTRIBUTE_CACHE_RECORD_STRUCT *record = &receivedValues.records[index];
+
+    if ((length == 0) || (length > CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN))
+    {
+        printk("Attribute %s skipped, %u B value does not fit\n", cacheEntries[index].key, length);
+        receivedValues.skippedMask |= BIT(index);
+        return 0;
+    }
+
+    memcpy(record->value, json, length);
+    record->length = length;
+    receivedValues.mask |= BIT(index);
+
+    return 0;
+}
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+/**@brief           Function to stage a protobuf attribute as JSON text.
+ *
+ * param[in]        attribute: Attribute.
+ * param[in]        scope: Attribute scope.
+ *
+ * @return          0 if successful, -EINVAL for an unknown value type.
+ *
+*/
+static int32_t stagePbAttribute(const TB_PB_ATTRIBUTE_STRUCT *attribute, ATTRIBUTE_CACHE_SCOPE scope)
+{
+    uint8_t string[CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN + 1];
+    uint8_t json[CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN + 1];
+    JSON_WRITER_STRUCT writer;
+    int32_t index = findEntry(attribute->key, attribute->keyLength, scope);
+    int32_t length = 0;
+
+    if (index < 0)
+    {
+        return 0;
+    }
+
+    json_writer_init(&writer, json, sizeof(json));
+
+    switch (attribute->type)
+    {
+        case TB_PB_VALUE_BOOL:
+            json_writer_bool(&writer, attribute->boolValue);
+            break;
+
+        case TB_PB_VALUE_LONG:
+            json_writer_int(&writer, attribute->longValue);
+            break;
+
+        case TB_PB_VALUE_DOUBLE:
+            json_writer_float(&writer, attribute->doubleValue, JSON_WRITER_MAX_DECIMALS);
+            break;
+
+        case TB_PB_VALUE_STRING:
+            if (attribute->stringLength >= sizeof(string))
+            {
+                // Skipped as too long
+                return stageValue(index, attribute->stringValue, attribute->stringLength);
+            }
+            // Escaped by the writer, it wants a zero terminated string
+            memcpy(string, attribute->stringValue, attribute->stringLength);
+            string[attribute->stringLength] = 0;
+            json_writer_string(&writer, string, sizeof(string));
+            break;
+
+        case TB_PB_VALUE_JSON:
+            return stageValue(index, attribute->stringValue, attribute->stringLength);
+
+        default:
+            return -EINVAL;
+    }
+
+    length = json_writer_finish(&writer);
+
+    return stageValue(index, json, (length < 0) ? 0 : length);
+}
+
+/**@brief           Handler of a client attribute in a protobuf message.
+ *
+ * param[in]        attribute: Attribute.
+ * param[in]        ctx: Unused.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t onClientAttributePb(const TB_PB_ATTRIBUTE_STRUCT *attribute, void *ctx)
+{
+    ARG_UNUSED(ctx);
+
+    return stagePbAttribute(attribute, ATTRIBUTE_CACHE_SCOPE_CLIENT);
+}
+
+/**@brief           Handler of a shared attribute in a protobuf message.
+ *
+ * param[in]        attribute: Attribute.
+ * param[in]        ctx: Unused.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t onSharedAttributePb(const TB_PB_ATTRIBUTE_STRUCT *attribute, void *ctx)
+{
+    ARG_UNUSED(ctx);
+
+    return stagePbAttribute(attribute, ATTRIBUTE_CACHE_SCOPE_SHARED);
+}
+#else
+/**@brief           Function to stage a JSON member.
+ *
+ * param[in]        key: Member key.
+ * param[in]        value: Member value.
+ * param[in]        scope: Attribute scope.
+ *
+ * @return          0.
+ *
+*/
+static int32_t stageJsonMember(const JSON_READER_VALUE_STRUCT *key, const JSON_READER_VALUE_STRUCT *value,
+                                ATTRIBUTE_CACHE_SCOPE scope)
+{
+    int32_t index = findEntry(key->start, key->length, scope);
+
+    if (index < 0)
+    {
+        return 0;
+    }
+
+    // Keep the quotes of a string, they are right around its content
+    if (value->type == JSON_READER_TYPE_STRING)
+    {
+        return stageValue(index, value->start - 1, value->length + 2);
+    }
+
+    return stageValue(index, value->start, value->length);
+}
+
+/**@brief           Handler of a client attribute member.
+ *
+ * param[in]        key: Member key.
+ * param[in]        value: Member value.
+ * param[in]        ctx: Unused.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onClientMember(const JSON_READER_VALUE_STRUCT *key, const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    ARG_UNUSED(ctx);
+
+    return stageJsonMember(key, value, ATTRIBUTE_CACHE_SCOPE_CLIENT);
+}
+
+/**@brief           Handler of a shared attribute member.
+ *
+ * param[in]        key: Member key.
+ * param[in]        value: Member value.
+ * param[in]        ctx: Unused.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onSharedMember(const JSON_READER_VALUE_STRUCT *key, const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    ARG_UNUSED(ctx);
+
+    return stageJsonMember(key, value, ATTRIBUTE_CACHE_SCOPE_SHARED);
+}
+
+/**@brief           Handler of the client object of an attribute response.
+ *
+ * param[in]        value: Client attributes.
+ * param[in]        ctx: Unused.
+ *
+ * @return          0 if successful, -EBADMSG if not an object.
+ *
+*/
+static int32_t onClientObject(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    int32_t ret = 0;
+
+    if (value->type != JSON_READER_TYPE_OBJECT)
+    {
+        return -EBADMSG;
+    }
+
+    ret = json_reader_parse_members(value->start, value->length, onClientMember, ctx);
+
+    return (ret < 0) ? ret : 0;
+}
+
+/**@brief           Handler of the shared object of an attribute response.
+ *
+ * param[in]        value: Shared attributes.
+ * param[in]        ctx: Unused.
+ *
+ * @return          0 if successful, -EBADMSG if not an object.
+ *
+*/
+static int32_t onSharedObject(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    int32_t ret = 0;
+
+    if (value->type != JSON_READER_TYPE_OBJECT)
+    {
+        return -EBADMSG;
+    }
+
+    ret = json_reader_parse_members(value->start, value->length, onSharedMember, ctx);
+
+    return (ret < 0) ? ret : 0;
+}
+#endif
+
+/**@brief           Function to apply the staged values and notify the handlers.
+ *
+ * @details         Applied values become valid in the current epoch and are saved. Keys of the
+ *                  outstanding request without a staged value are not set on the server: shared
+ *                  values are dropped, client values are kept. Skipped values are not applied and
+ *                  their keys stay stale. Handlers are called without the
+ *                  cache lock, for every pushed value and for requested values that changed.
+ *
+ * param[in]        isResponse: Staged values are the response of the outstanding request.
+ *
+ * @return          None.
+ *
+*/
+static void applyStagedValues(bool isResponse)
+{
+    ATTRIBUTE_CACHE_ENTRY_STRUCT *entry = NULL;
+    ATTRIBUTE_CACHE_RECORD_STRUCT *staged = NULL;
+    JSON_READER_VALUE_STRUCT value;
+    uint8_t json[CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN];
+    ATTRIBUTE_CACHE_HANDLER handler = NULL;
+    uint32_t notifyMask = 0;
+    uint32_t length = 0;
+    bool isChanged = false;
+    bool isSaved = false;
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        entry = &cacheEntries[i];
+        staged = &receivedValues.records[i];
+
+        if (receivedValues.mask & BIT(i))
+        {
+            isChanged = (staged->length != entry->record.length) ||
+                        (memcmp(staged->value, entry->record.value, staged->length) != 0);
+            if (!isResponse)
+            {
+                cacheStats.updates++;
+            }
+            if ((!isResponse || isChanged) && (entry->handler != NULL))
+            {
+                notifyMask |= BIT(i);
+            }
+
+            memcpy(entry->record.value, staged->value, staged->length);
+            entry->record.length = staged->length;
+        }
+        else if (receivedValues.skippedMask & BIT(i))
+        {
+            // Set on the server but not cacheable, not a deletion. Old value is kept but stale
+            entry->isRequested = false;
+            entry->record.version = 0;
+            continue;
+        }
+        else if (isResponse && entry->isRequested)
+        {
+            if (entry->scope == ATTRIBUTE_CACHE_SCOPE_SHARED)
+            {
+                entry->record.length = 0;
+            }
+        }
+        else
+        {
+            continue;
+        }
+
+        entry->isRequested = false;
+        entry->record.version = sessionEpoch;
+        isSaved = (saveEntry(entry) >= 0) || isSaved;
+    }
+
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    // An acked update lost in a reset would not come again, do not wait for the flush policy
+    if (isSaved && (storage_async_flush(storageRequestDone, "flush") < 0))
+    {
+        printk("Failed to queue attribute cache flush\n");
+    }
+
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        if ((notifyMask & BIT(i)) == 0)
+        {
+            continue;
+        }
+
+        k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+        entry = &cacheEntries[i];
+        length = entry->record.length;
+        memcpy(json, entry->record.value, length);
+        handler = entry->handler;
+        k_mutex_unlock(&AttributeCacheMutex);
+
+        if (json_reader_parse_value(json, length, &value) >= 0)
+        {
+            handler(&value, entry->ctx);
+        }
+    }
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to start the attribute cache.
+ *
+ * @details         Reads the session epoch from flash. Call before registering the keys.
+ *
+ * param[in]        publish: Sends the attribute request.
+ *
+ * @return          0 if successful, -EINVAL without a publish function.
+ *
+*/
+int32_t attribute_cache_init(ATTRIBUTE_CACHE_PUBLISH publish)
+{
+    uint32_t epoch = 0;
+
+    if (publish == NULL)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+
+    publishRequest = publish;
+    if ((storage_cache_read(ATTRIBUTE_CACHE_EPOCH_FILE_NAME, (uint8_t *)&epoch, sizeof(epoch), DIRECTORY) ==
+            sizeof(epoch)) && (epoch != 0))
+    {
+        sessionEpoch = epoch;
+    }
+
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    return 0;
+}
+
+/**@brief           Function to register an attribute key.
+ *
+ * @details         The last value saved in flash is loaded, reads are served from it right
+ *                  away. Key is copied.
+ *
+ * param[in]        key: Attribute key, up to CONFIG_ATTRIBUTE_CACHE_KEY_MAX_LEN characters.
+ * param[in]        scope: Client or shared.
+ * param[in]        handler: Called with the values the server sends, NULL for none.
+ * param[in]        ctx: Passed to the handler.
+ *
+ * @return          0 if successful, -EINVAL for a key too long, -EEXIST if registered,
+ *                  -ENOMEM if the cache is full.
+ *
+*/
+int32_t attribute_cache_register(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, ATTRIBUTE_CACHE_HANDLER handler,
+                                    void *ctx)
+{
+    ATTRIBUTE_CACHE_ENTRY_STRUCT *entry = NULL;
+    uint8_t name[ATTRIBUTE_CACHE_FILE_NAME_SIZE];
+    int32_t ret = 0;
+
+    if ((key == NULL) || (strlen(key) == 0) || (strlen(key) > CONFIG_ATTRIBUTE_CACHE_KEY_MAX_LEN) ||
+        (scope >= ATTRIBUTE_CACHE_SCOPE_COUNT))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+
+    if (findEntry(key, strlen(key), scope) >= 0)
+    {
+        ret = -EEXIST;
+    }
+    else if (entryCount >= CONFIG_ATTRIBUTE_CACHE_MAX_KEYS)
+    {
+        printk("No room for attribute %s\n", key);
+        ret = -ENOMEM;
+    }
+    else
+    {
+        entry = &cacheEntries[entryCount];
+        memset(entry, 0, sizeof(*entry));
+        strcpy(entry->key, key);
+        entry->scope = scope;
+        entry->handler = handler;
+        entry->ctx = ctx;
+
+        getFileName(entry, name);
+        ret = storage_cache_read(name, (uint8_t *)&entry->record, sizeof(entry->record), DIRECTORY);
+        if ((ret < (int32_t)RECORD_SIZE(0)) || (ret != (int32_t)RECORD_SIZE(entry->record.length)))
+        {
+            memset(&entry->record, 0, sizeof(entry->record));
+        }
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+        pbKeys[scope][pbKeyCount[scope]].key = entry->key;
+        pbKeys[scope][pbKeyCount[scope]].handler = (scope == ATTRIBUTE_CACHE_SCOPE_SHARED) ? onSharedAttributePb :
+                                                                                            onClientAttributePb;
+        pbKeyCount[scope]++;
+#endif
+        entryCount++;
+        ret = 0;
+    }
+
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    return ret;
+}
+
+/**@brief           Function to set a value written by the device.
+ *
+ * @details         For client attributes the device publishes itself, so later reads and
+ *                  connects do not ask the server. Value is saved with the flush policy.
+ *
+ * param[in]        key: Attribute key.
+ * param[in]        scope: Key scope.
+ * param[in]        json: Value, JSON text.
+ * param[in]        length: Value length.
+ *
+ * @return          0 if successful, -ENOENT if not registered, -EINVAL if not one JSON value or
+ *                  too long.
+ *
+*/
+int32_t attribute_cache_set(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, const uint8_t *json, uint32_t length)
+{
+    ATTRIBUTE_CACHE_ENTRY_STRUCT *entry = NULL;
+    JSON_READER_VALUE_STRUCT value;
+    int32_t index = 0;
+    int32_t ret = 0;
+
+    if ((length > CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN) || (json_reader_parse_value(json, length, &value) < 0))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+
+    index = findEntry(key, strlen(key), scope);
+    if (index < 0)
+    {
+        ret = -ENOENT;
+    }
+    else
+    {
+        entry = &cacheEntries[index];
+        if ((entry->record.length != length) || (memcmp(entry->record.value, json, length) != 0) ||
+            !isEntryFresh(entry))
+        {
+            memcpy(entry->record.value, json, length);
+            entry->record.length = length;
+            entry->record.version = sessionEpoch;
+            ret = saveEntry(entry);
+        }
+    }
+
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    return (ret < 0) ? ret : 0;
+}
+
+/**@brief           Function to read a cached value.
+ *
+ * @details         Served from RAM, no request is sent. Value is the last one known, it can
+ *                  be from before the last connect until attribute_cache_sync is answered.
+ *
+ * param[in]        key: Attribute key.
+ * param[in]        scope: Key scope.
+ * param[in]        json: Output for the value, JSON text, zero terminated.
+ * param[in]        size: Output size including the terminating zero.
+ *
+ * @return          Value length, -ENOENT if there is no value, -ENOMEM if the buffer is too small.
+ *
+*/
+int32_t attribute_cache_read(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, uint8_t *json, uint32_t size)
+{
+    return readValue(key, scope, json, size);
+}
+
+/**@brief           Function to read a cached bool value.
+ *
+ * param[in]        key: Attribute key.
+ * param[in]        scope: Key scope.
+ * param[in]        out: Read value.
+ *
+ * @return          0 if successful, -ENOENT if there is no value, -EINVAL if not a bool.
+ *
+*/
+int32_t attribute_cache_get_bool(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, bool *out)
+{
+    uint8_t json[CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN + 1];
+    JSON_READER_VALUE_STRUCT value;
+    int32_t ret = 0;
+
+    ret = readValue(key, scope, json, sizeof(json));
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    if ((json_reader_parse_value(json, ret, &value) < 0) || (json_reader_get_bool(&value, out) < 0))
+    {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/**@brief           Function to read a cached integer value.
+ *
+ * param[in]        key: Attribute key.
+ * param[in]        scope: Key scope.
+ * param[in]        out: Read value.
+ *
+ * @return          0 if successful, -ENOENT if there is no value, -EINVAL if not an integer.
+ *
+*/
+int32_t attribute_cache_get_int(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, int64_t *out)
+{
+    uint8_t json[CONFIG_ATTRIBUTE_CACHE_VALUE_MAX_LEN + 1];
+    JSON_READER_VALUE_STRUCT value;
+    int32_t ret = 0;
+
+    ret = readValue(key, scope, json, sizeof(json));
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    if ((json_reader_parse_value(json, ret, &value) < 0) || (json_reader_get_int(&value, out) < 0))
+    {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/**@brief           Function to track the broker session.
+ *
+ * @details         Called on every accepted connection. A new session has none of the updates
+ *                  sent while we were away, so a new epoch starts and every shared value is
+ *                  stale. The epoch is flushed at once: a value saved in the new epoch must not
+ *                  be read back with the old one after a reset.
+ *
+ * param[in]        isSessionPresent: Broker kept our session.
+ *
+ * @return          None.
+ *
+*/
+void attribute_cache_on_connection(bool isSessionPresent)
+{
+    uint32_t epoch = 0;
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+
+    if (isRequestOutstanding)
+    {
+        // Response of the last connection will not come
+        isRequestOutstanding = false;
+        syncResult = -ECONNRESET;
+        k_sem_give(&AttributeCacheSynced);
+    }
+
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        cacheEntries[i].isRequested = false;
+    }
+
+    if (!isSessionPresent)
+    {
+        sessionEpoch++;
+        if (sessionEpoch == 0)
+        {
+            sessionEpoch = 1;
+        }
+        epoch = sessionEpoch;
+    }
+
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    if ((epoch != 0) &&
+        ((storage_async_write(ATTRIBUTE_CACHE_EPOCH_FILE_NAME, (const uint8_t *)&epoch, sizeof(epoch), DIRECTORY,
+                                storageRequestDone, "epoch write") < 0) ||
+         (storage_async_flush(storageRequestDone, "epoch flush") < 0)))
+    {
+        printk("Failed to queue attribute epoch write\n");
+    }
+}
+
+/**@brief           Function to request the stale keys.
+ *
+ * @details         Every stale key of both scopes goes in one attribute request. Nothing is sent
+ *                  when all keys are valid. Wait for the response with attribute_cache_wait.
+ *
+ * @return          Number of requested keys, 0 if nothing was sent, negative if the request
+ *                  was not sent.
+ *
+*/
+int32_t attribute_cache_sync(void)
+{
+    static uint8_t keyLists[ATTRIBUTE_CACHE_SCOPE_COUNT][ATTRIBUTE_CACHE_KEY_LIST_SIZE];
+    static uint8_t payload[ATTRIBUTE_CACHE_REQUEST_MAX_LEN + 1];
+    static uint8_t topic[ATTRIBUTE_CACHE_TOPIC_SIZE];
+    ATTRIBUTE_CACHE_ENTRY_STRUCT *entry = NULL;
+    uint32_t listLength[ATTRIBUTE_CACHE_SCOPE_COUNT] = {0};
+    uint32_t requested = 0;
+    uint32_t skipped = 0;
+    uint32_t skippedBytes = 0;
+    int32_t length = 0;
+    int32_t ret = 0;
+#if !defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    JSON_WRITER_STRUCT writer;
+#endif
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+
+    if (publishRequest == NULL)
+    {
+        k_mutex_unlock(&AttributeCacheMutex);
+        return -EINVAL;
+    }
+
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        entry = &cacheEntries[i];
+        entry->isRequested = !isEntryFresh(entry);
+        if (!entry->isRequested)
+        {
+            // Key in the list and its member in the response
+            skipped++;
+            skippedBytes += (2 * strlen(entry->key)) + entry->record.length + sizeof(",\"\":,") - 1;
+            continue;
+        }
+
+        listLength[entry->scope] += snprintf(&keyLists[entry->scope][listLength[entry->scope]],
+                                                ATTRIBUTE_CACHE_KEY_LIST_SIZE - listLength[entry->scope], "%s%s",
+                                                (listLength[entry->scope] > 0) ? "," : "", entry->key);
+        requested++;
+    }
+
+    for (uint32_t i = 0; i < ATTRIBUTE_CACHE_SCOPE_COUNT; i++)
+    {
+        keyLists[i][listLength[i]] = 0;
+    }
+
+    cacheStats.keysSkipped += skipped;
+    cacheStats.bytesSaved += skippedBytes;
+
+    if (requested == 0)
+    {
+        // Whole round trip saved
+        if (entryCount > 0)
+        {
+            cacheStats.bytesSaved += ATTRIBUTE_CACHE_REQUEST_OVERHEAD + ATTRIBUTE_CACHE_RESPONSE_OVERHEAD;
+        }
+        k_mutex_unlock(&AttributeCacheMutex);
+        return 0;
+    }
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    length = tb_pb_encode_attributes_request(keyLists[ATTRIBUTE_CACHE_SCOPE_CLIENT], keyLists[ATTRIBUTE_CACHE_SCOPE_SHARED],
+                                                ATTRIBUTE_CACHE_KEY_LIST_SIZE, payload, sizeof(payload));
+#else
+    json_writer_init(&writer, payload, sizeof(payload));
+    json_writer_object_start(&writer);
+    if (listLength[ATTRIBUTE_CACHE_SCOPE_CLIENT] > 0)
+    {
+        json_writer_key(&writer, "clientKeys");
+        json_writer_string(&writer, keyLists[ATTRIBUTE_CACHE_SCOPE_CLIENT], ATTRIBUTE_CACHE_KEY_LIST_SIZE);
+    }
+    if (listLength[ATTRIBUTE_CACHE_SCOPE_SHARED] > 0)
+    {
+        json_writer_key(&writer, "sharedKeys");
+        json_writer_string(&writer, keyLists[ATTRIBUTE_CACHE_SCOPE_SHARED], ATTRIBUTE_CACHE_KEY_LIST_SIZE);
+    }
+    json_writer_object_end(&writer);
+    length = json_writer_finish(&writer);
+#endif
+
+    if (length >= 0)
+    {
+        requestId++;
+        snprintf(topic, sizeof(topic), "%s%u", ATTRIBUTE_CACHE_REQUEST_TOPIC_PREFIX, requestId);
+        k_sem_reset(&AttributeCacheSynced);
+        isRequestOutstanding = true;
+        syncResult = 0;
+        cacheStats.syncRequests++;
+        cacheStats.keysRequested += requested;
+    }
+
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    if (length < 0)
+    {
+        printk("Failed to encode attribute request: %d\n", length);
+        return length;
+    }
+
+    // Response can come in before the publish returns
+    ret = publishRequest(topic, payload, length);
+    if (ret < 0)
+    {
+        k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+        isRequestOutstanding = false;
+        cacheStats.syncFailures++;
+        k_mutex_unlock(&AttributeCacheMutex);
+        return ret;
+    }
+
+    return requested;
+}
+
+/**@brief           Function to wait for the response of the attribute request.
+ *
+ * @details         Keys of a request not answered in time stay stale, they are requested again
+ *                  with the next connection.
+ *
+ * param[in]        timeout: Max wait time.
+ *
+ * @return          0 if the response is applied, -EAGAIN if not answered in time, negative if
+ *                  the response was not valid or the connection was lost. Result of the last
+ *                  request if nothing is outstanding.
+ *
+*/
+int32_t attribute_cache_wait(k_timeout_t timeout)
+{
+    int32_t ret = 0;
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+    ret = isRequestOutstanding ? 1 : syncResult;
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    if (ret <= 0)
+    {
+        return ret;
+    }
+
+    if (k_sem_take(&AttributeCacheSynced, timeout) != 0)
+    {
+        k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+        // Late response is ignored
+        if (isRequestOutstanding)
+        {
+            isRequestOutstanding = false;
+            cacheStats.syncFailures++;
+        }
+        k_mutex_unlock(&AttributeCacheMutex);
+        return -EAGAIN;
+    }
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+    ret = syncResult;
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    return ret;
+}
+
+/**@brief           Attribute update route handler.
+ *
+ * @details         Shared values pushed by the server. Nothing is applied if the message is
+ *                  not valid JSON, or protobuf in the protobuf mode. Unregistered keys and
+ *                  deleted attributes are skipped.
+ *
+ * param[in]        message: Received message.
+ * param[in]        ctx: Unused.
+ *
+ * @return          None.
+ *
+*/
+void attribute_cache_on_update(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx)
+{
+    int32_t ret = 0;
+
+    ARG_UNUSED(ctx);
+
+    receivedValues.mask = 0;
+    receivedValues.skippedMask = 0;
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    ret = tb_pb_parse_attribute_update(message->payload, message->payloadLength, pbKeys[ATTRIBUTE_CACHE_SCOPE_SHARED],
+                                        pbKeyCount[ATTRIBUTE_CACHE_SCOPE_SHARED], NULL);
+#else
+    ret = json_reader_parse_members(message->payload, message->payloadLength, onSharedMember, NULL);
+#endif
+    if (ret < 0)
+    {
+        printk("Invalid attribute update: %d\n", ret);
+        return;
+    }
+
+    applyStagedValues(false);
+}
+
+/**@brief           Attribute response route handler.
+ *
+ * @details         Only the response of the outstanding request is applied, the waiting
+ *                  attribute_cache_wait returns when it is.
+ *
+ * param[in]        message: Received message.
+ * param[in]        ctx: Unused.
+ *
+ * @return          None.
+ *
+*/
+void attribute_cache_on_response(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx)
+{
+#if !defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    static const JSON_READER_KEY_STRUCT keys[] = {
+        {.key = "client", .handler = onClientObject},
+        {.key = "shared", .handler = onSharedObject},
+    };
+#endif
+    const TOPIC_ROUTER_LEVEL_STRUCT *id = &message->wildcards[0];
+    uint8_t expectedId[ATTRIBUTE_CACHE_ID_MAX_LEN + 1];
+    bool isExpected = false;
+    int32_t ret = 0;
+
+    ARG_UNUSED(ctx);
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+    snprintf(expectedId, sizeof(expectedId), "%u", requestId);
+    isExpected = isRequestOutstanding && (message->wildcardCount > 0) && (id->length == strlen(expectedId)) &&
+                    (memcmp(id->ptr, expectedId, id->length) == 0);
+    k_mutex_unlock(&AttributeCacheMutex);
+
+    if (!isExpected)
+    {
+        printk("Unexpected attribute response\n");
+        return;
+    }
+
+    receivedValues.mask = 0;
+    receivedValues.skippedMask = 0;
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    ret = tb_pb_parse_attributes_response(message->payload, message->payloadLength,
+                                            pbKeys[ATTRIBUTE_CACHE_SCOPE_CLIENT], pbKeyCount[ATTRIBUTE_CACHE_SCOPE_CLIENT],
+                                            pbKeys[ATTRIBUTE_CACHE_SCOPE_SHARED], pbKeyCount[ATTRIBUTE_CACHE_SCOPE_SHARED],
+                                            NULL);
+#else
+    ret = json_reader_parse_object(message->payload, message->payloadLength, keys, ARRAY_SIZE(keys), NULL);
+#endif
+    if (ret < 0)
+    {
+        printk("Invalid attribute response: %d\n", ret);
+    }
+    else
+    {
+        applyStagedValues(true);
+    }
+
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+    if (ret < 0)
+    {
+        cacheStats.syncFailures++;
+    }
+    isRequestOutstanding = false;
+    syncResult = (ret < 0) ? ret : 0;
+    k_sem_give(&AttributeCacheSynced);
+    k_mutex_unlock(&AttributeCacheMutex);
+}
+
+/**@brief           Function to get the cache totals.
+ *
+ * param[in]        stats: Totals to fill.
+ *
+ * @return          None.
+ *
+*/
+void attribute_cache_get_stats(ATTRIBUTE_CACHE_STATS_STRUCT *stats)
+{
+    k_mutex_lock(&AttributeCacheMutex, K_FOREVER);
+    *stats = cacheStats;
+    k_mutex_unlock(&AttributeCacheMutex);
+}
+/* End of file -------------------------------------------------------- */
@@ -0,0 +1,84 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ATTRIBUTE_CACHE_H
+#define __ATTRIBUTE_CACHE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#include "json_reader.h"
+#include "topic_router.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    ATTRIBUTE_CACHE_SCOPE_CLIENT = 0,   // Written by the device
+    ATTRIBUTE_CACHE_SCOPE_SHARED,       // Written by the server
+    ATTRIBUTE_CACHE_SCOPE_COUNT,
+}ATTRIBUTE_CACHE_SCOPE;
+
+/* Called from the MQTT thread with a value the server sent. Value is valid during the call only */
+typedef void (*ATTRIBUTE_CACHE_HANDLER)(const JSON_READER_VALUE_STRUCT *value, void *ctx);
+
+/* Sends the attribute request, called from the thread running attribute_cache_sync */
+typedef int32_t (*ATTRIBUTE_CACHE_PUBLISH)(uint8_t *topic, const uint8_t *payload, uint32_t length);
+
+/* Cache totals */
+typedef struct
+{
+    uint32_t hits;              // Reads served from the cache
+    uint32_t misses;            // Reads of keys without a value
+    uint32_t updates;           // Values pushed by the server
+    uint32_t syncRequests;      // Attribute requests sent on connect
+    uint32_t keysRequested;
+    uint32_t keysSkipped;       // Keys still valid on connect, not requested
+    uint32_t syncFailures;      // Requests not answered in time or not valid
+    uint64_t bytesSaved;        // Request and response bytes not sent for hits and skipped keys
+}ATTRIBUTE_CACHE_STATS_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+#define ATTRIBUTE_CACHE_UPDATE_TOPIC            "v1/devices/me/attributes"
+#define ATTRIBUTE_CACHE_REQUEST_TOPIC_PREFIX    "v1/devices/me/attributes/request/"
+#define ATTRIBUTE_CACHE_RESPONSE_TOPIC          "v1/devices/me/attributes/response/+"
+
+/* Longest request id, a uint32 */
+#define ATTRIBUTE_CACHE_ID_MAX_LEN              10
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t attribute_cache_init(ATTRIBUTE_CACHE_PUBLISH publish);
+int32_t attribute_cache_register(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, ATTRIBUTE_CACHE_HANDLER handler,
+                                    void *ctx);
+int32_t attribute_cache_set(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, const uint8_t *json, uint32_t length);
+int32_t attribute_cache_read(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, uint8_t *json, uint32_t size);
+int32_t attribute_cache_get_bool(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, bool *out);
+int32_t attribute_cache_get_int(const uint8_t *key, ATTRIBUTE_CACHE_SCOPE scope, int64_t *out);
+void attribute_cache_on_connection(bool isSessionPresent);
+int32_t attribute_cache_sync(void);
+int32_t attribute_cache_wait(k_timeout_t timeout);
+void attribute_cache_on_update(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx);
+void attribute_cache_on_response(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx);
+void attribute_cache_get_stats(ATTRIBUTE_CACHE_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ATTRIBUTE_CACHE_H */
@@ -8,28 +8,68 @@
 #include <stdlib.h>
 #include "user_app.h"
 #include "storage.h"
+#include "storage_async.h"
+#include "thingsboard_schema.h"
+#include "thingsboard_pb.h"
+#include "topic_router.h"
+#include "mqtt_subscriptions.h"
+#include "mqtt_conn_state.h"
+#include "mqtt_reconnect.h"
+#include "rpc_server.h"
+#include "attribute_cache.h"
+#include <zephyr/net/socket.h>
 
 /* Private defines ---------------------------------------------------- */
 #define PUBLISH_TOPIC "v1/devices/me/telemetry"
-#define ATTRIBUTE_TOPIC "v1/devices/me/attributes"
 
-#define PROVISION_REQUEST_TOPIC  "/provision/request"
 #define PROVISION_RESPONSE_TOPIC  "/provision/response"
 
-/* ID for subscribe topic - Used to verify that a subscription succeeded in on_mqtt_suback(). */
-#define SUBSCRIBE_TOPIC_ID 2469
+/* Topics with their own publish policy */
+#define MQTT_TOPIC_POLICY_COUNT 8
 
 /* Private enumerate/structure ---------------------------------------- */
+/* Caller waiting for the PUBACK of its publish */
+typedef struct
+{
+    struct k_sem done;
+    int32_t result;
+}MQTT_PUBLISH_WAIT_STRUCT;
+
+/* Publish policy of a topic */
+typedef struct
+{
+    const uint8_t *topic;
+    MQTT_PUBLISH_POLICY_STRUCT policy;
+}MQTT_TOPIC_POLICY_STRUCT;
+
 /* Private macros ----------------------------------------------------- */
 /* Public variables --------------------------------------------------- */
 // K_WORK_DELAYABLE_DEFINE(mqtt_work, mqtt_comm_start);
 
 /* Private variables -------------------------------------------------- */
+/* Topics without a policy are published acked and not retained */
+static const MQTT_PUBLISH_POLICY_STRUCT defaultPublishPolicy = {
+    .qos = MQTT_QOS_1_AT_LEAST_ONCE,
+    .isRetained = false,
+};
+
+static MQTT_TOPIC_POLICY_STRUCT topicPolicies[MQTT_TOPIC_POLICY_COUNT];
+static uint32_t topicPolicyCount = 0;
 
 /* Private function prototypes ---------------------------------------- */
 static void MqttOnConnection(enum mqtt_conn_return_code return_code, bool session_present);
 static void MqttOnDisconnection(int result);
+static void MqttOnPublishAck(uint16_t message_id, int result);
+static void MqttOnSubscribeAck(uint16_t message_id, int result);
+static void MqttOnPublishDone(uint16_t messageId, int32_t result, void *ctx);
 static void MqttReceivedPublishedMessage(struct mqtt_helper_buf topic_buf, struct mqtt_helper_buf payload_buf);
+static void MqttOnProvisionResponse(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx);
+static const MQTT_PUBLISH_POLICY_STRUCT *MqttGetTopicPolicy(const uint8_t *topic);
+static int32_t MqttPublishAtMostOnce(uint8_t *topic, const uint8_t *payload, uint32_t length, bool isRetained);
+static int32_t MqttPublishAndWait(uint8_t *topic, const uint8_t *payload, uint32_t length,
+                                    const MQTT_PUBLISH_POLICY_STRUCT *policy);
+static int32_t MqttResolveBroker(void);
+static int32_t MqttPublishNoWait(uint8_t *topic, const uint8_t *payload, uint32_t length);
 
 /* Private function definitions ---------------------------------------- */
 /**@brief           MQTT connection callback.
@@ -44,8 +84,12 @@ static void MqttOnConnection(enum mqtt_conn_return_code return_code, bool sessio
 {
     if (return_code == MQTT_CONNECTION_ACCEPTED)
     {
-        printk("MQTT connection accepted\n");
+        printk("MQTT connection accepted, session present: %d\n", session_present);
+        mqtt_subscriptions_on_connection(true, session_present);
+        attribute_cache_on_connection(session_present);
         systemConfig.isBrokerConnected = 1;
+        mqtt_inflight_on_connection(true);
+        mqtt_conn_state_set(MQTT_CONN_STATE_READY);
     }
     else if(return_code == MQTT_NOT_AUTHORIZED)
     {
@@ -53,11 +97,19 @@ static void MqttOnConnection(enum mqtt_conn_return_code return_code, bool sessio
         systemConfig.isBrokerConnected = 0;
         systemConfig.isProvisioned = 0;
         memset(systemConfig.deviceUsername, 0, sizeof(systemConfig.deviceUsername));
-        eraseFile(MQTT_USERNAME_FILE_NAME, DIRECTORY);
+        // Session of the new credentials has none of our subscriptions
+        mqtt_subscriptions_reset();
+        // Runs in the MQTT helper thread, leave the flash erase to the storage work queue
+        if (storage_async_erase(MQTT_USERNAME_FILE_NAME, DIRECTORY, NULL, NULL) < 0)
+        {
+            printk("Failed to queue username erase\n");
+        }
+        mqtt_conn_state_set(MQTT_CONN_STATE_DISCONNECTED);
     }
     else
     {
         printk("MQTT connection failed: %d\n", return_code);
+        mqtt_conn_state_set(MQTT_CONN_STATE_DISCONNECTED);
     }
 }
 
@@ -72,6 +124,54 @@ static void MqttOnDisconnection(int result)
 {
     printk("MQTT disconnected: %d\n", result);
     systemConfig.isBrokerConnected = 0;
+    mqtt_inflight_on_connection(false);
+    mqtt_subscriptions_on_connection(false, false);
+    mqtt_conn_state_set(MQTT_CONN_STATE_DISCONNECTED);
+}
+
+/**@brief           MQTT PUBACK callback.
+ * 
+ * param[in]        message_id: Acked message id.
+ * param[in]        result: PUBACK result.
+ * 
+ * @return          None.
+ * 
+*/
+static void MqttOnPublishAck(uint16_t message_id, int result)
+{
+    mqtt_inflight_on_puback(message_id, result);
+}
+
+/**@brief           MQTT SUBACK callback.
+ * 
+ * param[in]        message_id: Acked SUBSCRIBE message id.
+ * param[in]        result: SUBACK result.
+ * 
+ * @return          None.
+ * 
+*/
+static void MqttOnSubscribeAck(uint16_t message_id, int result)
+{
+    mqtt_subscriptions_on_suback(message_id, result);
+}
+
+/**@brief           Delivery result of a publish waited for in MqttPublishMessage.
+ * 
+ * param[in]        messageId: Message id.
+ * param[in]        result: 0 if acked, negative otherwise.
+ * param[in]        ctx: Waiting caller.
+ * 
+ * @return          None.
+ * 
+*/
+static void MqttOnPublishDone(uint16_t messageId, int32_t result, void *ctx)
+{
+    MQTT_PUBLISH_WAIT_STRUCT *wait = ctx;
+
+    ARG_UNUSED(messageId);
+
+    wait->result = result;
+    k_sem_give(&wait->done);
 }
 
 
@@ -86,27 +186,212 @@ static void MqttOnDisconnection(int result)
 static void MqttReceivedPublishedMessage(struct mqtt_helper_buf topic_buf, struct mqtt_helper_buf payload_buf)
 {
     printk("Received message on topic: %s\n", topic_buf.ptr);
-    printk("Payload: %s\n", payload_buf.ptr);
+    printk("Payload: %u B\n", payload_buf.size);
+
+    if (topic_router_dispatch(topic_buf.ptr, topic_buf.size, payload_buf.ptr, payload_buf.size) <= 0)
+    {
+        printk("Unknown topic\n");
+    }
+}
+
+/**@brief           Provisioning response route handler.
+ * 
+ * param[in]        message: Received message.
+ * param[in]        ctx: Unused.
+ * 
+ * @return          None.
+ * 
+ */
+static void MqttOnProvisionResponse(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx)
+{
+    struct mqtt_helper_buf payload_buf = {.ptr = (char *)message->payload, .size = message->payloadLength};
+    int32_t ret = 0;
+
+    ARG_UNUSED(ctx);
 
-    if (strncmp(topic_buf.ptr, ATTRIBUTE_TOPIC, topic_buf.size) == 0)
+    ret = parseProvisionResponse(&payload_buf);
+    if (ret < 0)
     {
-        parseAttributeRxMessage(&topic_buf, &payload_buf);
+        printk("Provisioning failed\n");
     }
-    else if (strncmp(topic_buf.ptr, PROVISION_RESPONSE_TOPIC, topic_buf.size) == 0)
+
+    mqtt_conn_state_provision_done((ret < 0) ? ret : 0);
+}
+
+
+
+/**@brief           Get the publish policy of a topic.
+ * 
+ * param[in]        topic: Topic.
+ * 
+ * @return          Topic policy, default policy if the topic has none.
+ * 
+ */
+static const MQTT_PUBLISH_POLICY_STRUCT *MqttGetTopicPolicy(const uint8_t *topic)
+{
+    for (uint32_t i = 0; i < topicPolicyCount; i++)
     {
-        if(strstr(payload_buf.ptr, "\"status\":\"SUCCESS\"") != NULL)
+        if (strcmp(topicPolicies[i].topic, topic) == 0)
         {
-            systemConfig.isProvisioned = 1;
-            parseJsonGetStringObject(payload_buf.ptr, "credentialsValue", systemConfig.deviceUsername);
+            return &topicPolicies[i].policy;
         }
     }
+
+    return &defaultPublishPolicy;
+}
+
+/**@brief           Publish a message with QoS 0.
+ * 
+ * @details         Done once the message is handed to the socket, no PUBACK comes back.
+ * 
+ * param[in]        topic: Topic to publish to.
+ * param[in]        payload: Payload to publish.
+ * param[in]        length: Payload length.
+ * param[in]        isRetained: Broker keeps the message for new subscribers.
+ * 
+ * @return          0 if sent, otherwise a negative value.
+ * 
+ */
+static int32_t MqttPublishAtMostOnce(uint8_t *topic, const uint8_t *payload, uint32_t length, bool isRetained)
+{
+    int32_t ret = 0;
+    struct mqtt_publish_param publish_param = {
+        .message.topic.qos = MQTT_QOS_0_AT_MOST_ONCE,
+        .message.topic.topic = {
+            .utf8 = topic,
+            .size = strlen(topic),
+        },
+        .message.payload = {
+            .data = (uint8_t *)payload,
+            .len = length,
+        },
+        .retain_flag = isRetained ? 1 : 0,
+    };
+
+    ret = mqtt_helper_publish(&publish_param);
+    if (ret != 0)
+    {
+        printk("Failed to publish message: %d\n", ret);
+    }
     else
     {
-        printk("Unknown topic\n");
+        printk("Published message\n");
+        printk("Topic: %s\n", topic);
+        printk("Payload: %u B\n", length);
+    }
+
+    return ret;
+}
+
+/**@brief           Publish a message with the given policy and wait for the delivery.
+ * 
+ * @details         QoS 0 returns once the message is sent. QoS 1 waits for the PUBACK, the
+ *                  publish is retransmitted until acked or its retries run out.
+ * 
+ * param[in]        topic: Topic to publish to.
+ * param[in]        payload: Payload to publish, text or binary.
+ * param[in]        length: Payload length.
+ * param[in]        policy: QoS and retain flag of this publish.
+ * 
+ * @return          0 if sent (QoS 0) or acked (QoS 1), -ETIMEDOUT if not acked in
+ *                  MQTT_PUBLISH_TIMEOUT, otherwise a negative value.
+ * 
+ */
+static int32_t MqttPublishAndWait(uint8_t *topic, const uint8_t *payload, uint32_t length,
+                                    const MQTT_PUBLISH_POLICY_STRUCT *policy)
+{
+    MQTT_PUBLISH_WAIT_STRUCT wait = {.result = 0};
+    int32_t messageId = 0;
+    int32_t ret = 0;
+
+    if (policy->qos == MQTT_QOS_0_AT_MOST_ONCE)
+    {
+        return MqttPublishAtMostOnce(topic, payload, length, policy->isRetained);
+    }
+
+    k_sem_init(&wait.done, 0, 1);
+
+    messageId = mqtt_inflight_publish(topic, payload, length, policy->isRetained, MqttOnPublishDone, &wait,
+                                        K_MSEC(MQTT_PUBLISH_TIMEOUT));
+    if (messageId < 0)
+    {
+        printk("Failed to publish message: %d\n", messageId);
+        return messageId;
+    }
+
+    if (k_sem_take(&wait.done, K_MSEC(MQTT_PUBLISH_TIMEOUT)) == 0)
+    {
+        ret = wait.result;
+    }
+    // No callback after the cancel
+    else if (mqtt_inflight_cancel(messageId) == 0)
+    {
+        ret = -ETIMEDOUT;
+    }
+    else
+    {
+        // Publish was already released, its callback runs right after. Wait for it, wait is on this stack
+        (void)k_sem_take(&wait.done, K_FOREVER);
+        ret = wait.result;
+    }
+
+    if (ret < 0)
+    {
+        printk("Publish %d not delivered: %d\n", messageId, ret);
+    }
+
+    return ret;
+}
+
+/**@brief           Resolve the broker hostname.
+ * 
+ * @details         Times the lookup on its own. The modem keeps the answer, the lookup done
+ *                  by mqtt_helper_connect right after is served from its cache.
+ * 
+ * @return          0 if resolved, -EADDRNOTAVAIL otherwise. Not a network error, a lookup
+ *                  failure backs off instead of taking the fast retries.
+ * 
+ */
+static int32_t MqttResolveBroker(void)
+{
+    struct zsock_addrinfo *result = NULL;
+    struct zsock_addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    int32_t ret = 0;
+
+    ret = zsock_getaddrinfo(CONFIG_MQTT_BROKER_HOSTNAME, NULL, &hints, &result);
+    if (ret != 0)
+    {
+        printk("Failed to resolve %s: %d\n", CONFIG_MQTT_BROKER_HOSTNAME, ret);
+        return -EADDRNOTAVAIL;
     }
+
+    zsock_freeaddrinfo(result);
+
+    return 0;
 }
 
+/**@brief           Publish an RPC response or an attribute request.
+ * 
+ * @details         Does not wait for the PUBACK, nor for a window slot. The RPC thread is free for
+ *                  the next request as soon as the response is sent, the attribute response tells
+ *                  the request came in.
+ * 
+ * param[in]        topic: Topic.
+ * param[in]        payload: Payload.
+ * param[in]        length: Payload length.
+ * 
+ * @return          0 if sent, otherwise a negative value.
+ * 
+ */
+static int32_t MqttPublishNoWait(uint8_t *topic, const uint8_t *payload, uint32_t length)
+{
+    int32_t ret = MqttPublishPayloadAsync(topic, payload, length, NULL, NULL, K_NO_WAIT);
 
+    return (ret < 0) ? ret : 0;
+}
 
 /* Global Function definitions ----------------------------------------------- */
 /**@brief           Initialize MQTT communication.
@@ -121,8 +406,85 @@ int32_t mqtt_comm_init(void)
         .cb.on_connack = MqttOnConnection,
         .cb.on_disconnect = MqttOnDisconnection,
         .cb.on_publish = MqttReceivedPublishedMessage,
+        .cb.on_puback = MqttOnPublishAck,
+        .cb.on_suback = MqttOnSubscribeAck,
+    };
+
+    MQTT_PUBLISH_POLICY_STRUCT telemetryPolicy = {
+        .qos = CONFIG_MQTT_TELEMETRY_QOS,
+        .isRetained = false,
     };
 
+    ret = mqtt_inflight_init();
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ret = MqttSetTopicPolicy(PUBLISH_TOPIC, &telemetryPolicy);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ret = topic_router_register(ATTRIBUTE_CACHE_UPDATE_TOPIC, attribute_cache_on_update, NULL);
+    if (ret >= 0)
+    {
+        ret = topic_router_register(ATTRIBUTE_CACHE_RESPONSE_TOPIC, attribute_cache_on_response, NULL);
+    }
+    if (ret >= 0)
+    {
+        ret = topic_router_register(PROVISION_RESPONSE_TOPIC, MqttOnProvisionResponse, NULL);
+    }
+    if (ret >= 0)
+    {
+        // Requests are answered from the RPC thread, not from the publish loop
+        ret = topic_router_register(RPC_SERVER_REQUEST_TOPIC, rpc_server_on_request, NULL);
+    }
+    if (ret < 0)
+    {
+        printk("Failed to register topic routes: %d\n", ret);
+        return ret;
+    }
+
+    ret = attribute_cache_init(MqttPublishNoWait);
+    if (ret >= 0)
+    {
+        ret = registerAttributes();
+    }
+    if (ret < 0)
+    {
+        printk("Failed to start the attribute cache: %d\n", ret);
+        return ret;
+    }
+
+    ret = rpc_server_init(MqttPublishNoWait);
+    if (ret >= 0)
+    {
+        ret = registerRpcMethods();
+    }
+    if (ret < 0)
+    {
+        printk("Failed to start the RPC server: %d\n", ret);
+        return ret;
+    }
+
+    // QoS 1 keeps the attribute updates and RPC requests sent while we are away in the broker session
+    ret = mqtt_subscriptions_add(ATTRIBUTE_CACHE_UPDATE_TOPIC, MQTT_QOS_1_AT_LEAST_ONCE);
+    if (ret >= 0)
+    {
+        ret = mqtt_subscriptions_add(ATTRIBUTE_CACHE_RESPONSE_TOPIC, MQTT_QOS_1_AT_LEAST_ONCE);
+    }
+    if (ret >= 0)
+    {
+        ret = mqtt_subscriptions_add(RPC_SERVER_REQUEST_TOPIC, MQTT_QOS_1_AT_LEAST_ONCE);
+    }
+    if (ret < 0)
+    {
+        printk("Failed to register subscriptions: %d\n", ret);
+        return ret;
+    }
+
     ret = mqtt_helper_init(&cfg);
     if (ret != 0)
     {
@@ -135,15 +497,19 @@ int32_t mqtt_comm_init(void)
 
 
 /**@brief           Connect to the MQTT broker.
+ * 
+ * @details         Returns when the CONNACK comes in, or after MQTT_CONNECT_TIMEOUT.
  * 
  * @param[in]       username: Username.
  * 
- * @return          0 if successful, otherwise a negative value.
+ * @return          0 if connected, -ECONNREFUSED if the broker refused the connection,
+ *                  -ETIMEDOUT if no CONNACK came in time, otherwise a negative value.
  * 
  */
 int32_t MqttConnect(uint8_t *username)
 {
     int32_t ret = 0;
+    int64_t phaseTime = 0;
     struct mqtt_helper_conn_params conn_params = {
         .hostname = {
             .ptr = CONFIG_MQTT_BROKER_HOSTNAME,
@@ -163,20 +529,49 @@ int32_t MqttConnect(uint8_t *username)
         },
     };
 
-     // connect to the broker if not connected, and subscribe to attribute topic
-    if(systemConfig.isBrokerConnected == 1) {
-        ret = 0;
+    if (systemConfig.isBrokerConnected == 1)
+    {
+        return 0;
     }
-    else {
-        ret = mqtt_helper_connect(&conn_params);
-        if (ret != 0)
-        {
-            printk("Failed to connect to MQTT broker: %d\n", ret);
-        }
+
+    mqtt_conn_state_set(MQTT_CONN_STATE_CONNECTING);
+
+    phaseTime = k_uptime_get();
+    ret = MqttResolveBroker();
+    if (ret < 0)
+    {
+        mqtt_conn_state_set(MQTT_CONN_STATE_DISCONNECTED);
+        return ret;
     }
+    mqtt_reconnect_record_phase(MQTT_CONNECT_PHASE_DNS, (uint32_t)(k_uptime_get() - phaseTime));
 
+    phaseTime = k_uptime_get();
+    ret = mqtt_helper_connect(&conn_params);
+    if (ret != 0)
+    {
+        printk("Failed to connect to MQTT broker: %d\n", ret);
+        mqtt_conn_state_set(MQTT_CONN_STATE_DISCONNECTED);
+        return ret;
+    }
+    mqtt_reconnect_record_phase(MQTT_CONNECT_PHASE_TLS, (uint32_t)(k_uptime_get() - phaseTime));
 
-    return ret;
+    // Woken by the CONNACK callback, not polled
+    phaseTime = k_uptime_get();
+    ret = mqtt_conn_state_wait(MQTT_CONN_STATE_CONNECTED_MASK | MQTT_CONN_STATE_BIT(MQTT_CONN_STATE_DISCONNECTED),
+                                K_MSEC(MQTT_CONNECT_TIMEOUT));
+    if (ret == MQTT_CONN_STATE_DISCONNECTED)
+    {
+        return -ECONNREFUSED;
+    }
+    else if (ret < 0)
+    {
+        printk("No CONNACK in %d ms\n", MQTT_CONNECT_TIMEOUT);
+        (void)MqttDisconnect();
+        return ret;
+    }
+    mqtt_reconnect_record_phase(MQTT_CONNECT_PHASE_CONNACK, (uint32_t)(k_uptime_get() - phaseTime));
+
+    return 0;
 }
 
 /**@brief           Provision the device with the MQTT broker.
@@ -189,25 +584,26 @@ int32_t MqttConnect(uint8_t *username)
 int32_t MqttProvisionRequest(void )
 {
     int32_t ret = 0;
+    int32_t length = 0;
     static uint8_t provisionRequestPayload[MQTT_PROVISION_BUFF_SIZE + 1] = {0};
-
-    snprintf(provisionRequestPayload, MQTT_PROVISION_BUFF_SIZE, "{\"deviceName\": \"%s\", \"provisionDeviceKey\": \"%s\", \"provisionDeviceSecret\": \"%s\"}",
-                                                                systemConfig.DeviceIMEI, CONFIG_MQTT_DEVICE_PROVISIONING_KEY, CONFIG_MQTT_DEVICE_PROVISIONING_SECRET);
-    printk("Provisioning request payload: %s\n", provisionRequestPayload);
-
-    struct mqtt_publish_param publish_param = {
-        .message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE,
-        .message.topic.topic = {
-            .utf8 = PROVISION_REQUEST_TOPIC,
-            .size = strlen(PROVISION_REQUEST_TOPIC),
-        },
-        .message.payload = {
-            .data = provisionRequestPayload,
-            .len = strlen(provisionRequestPayload),
-        },
-        .message_id = 85,
+    SCHEMA_PROVISION_REQUEST_STRUCT request = {
+        .deviceName = systemConfig.DeviceIMEI,
+        .provisionDeviceKey = CONFIG_MQTT_DEVICE_PROVISIONING_KEY,
+        .provisionDeviceSecret = CONFIG_MQTT_DEVICE_PROVISIONING_SECRET,
     };
 
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    length = tb_pb_encode_provision_request(&request, provisionRequestPayload, sizeof(provisionRequestPayload));
+#else
+    length = schema_encode_provision_request(&request, provisionRequestPayload, sizeof(provisionRequestPayload));
+#endif
+    if (length < 0)
+    {
+        printk("Failed to encode provisioning request: %d\n", length);
+        return length;
+    }
+    printk("Provisioning request payload: %d B\n", length);
+
     // Update the subscription topic list
     struct mqtt_topic mqtt_sub_topics[] = {
         {
@@ -221,7 +617,7 @@ int32_t MqttProvisionRequest(void )
     struct mqtt_subscription_list sub_list = {
         .list = mqtt_sub_topics,
         .list_count = ARRAY_SIZE(mqtt_sub_topics),
-        .message_id = SUBSCRIBE_TOPIC_ID,
+        .message_id = mqtt_helper_msg_id_get(),
     };
 
     ret = mqtt_helper_subscribe(&sub_list);
@@ -231,107 +627,245 @@ int32_t MqttProvisionRequest(void )
         return ret;
     }
 
-    ret = mqtt_helper_publish(&publish_param);
-    if (ret != 0)
+    mqtt_conn_state_provision_start();
+
+    // Response on the subscribed topic tells the outcome, no need to wait for the PUBACK
+    ret = MqttPublishPayloadAsync(SCHEMA_PROVISION_REQUEST_TOPIC, provisionRequestPayload, length, NULL, NULL,
+                                    K_MSEC(MQTT_PUBLISH_TIMEOUT));
+    if (ret >= 0)
     {
-        printk("Failed to publish message: %d\n", ret);
+        // Woken by the response handler as soon as it comes in
+        ret = mqtt_conn_state_provision_wait(K_MSEC(MQTT_PROVISION_TIMEOUT));
+        if (ret == -ETIMEDOUT)
+        {
+            printk("Provisioning timeout\n");
+        }
     }
-    else
+
+    if (mqtt_conn_state_get() == MQTT_CONN_STATE_PROVISIONING)
     {
-        printk("Published message\n");
-        printk("Topic: %s\n", PROVISION_REQUEST_TOPIC);
-        printk("Payload: %s\n", provisionRequestPayload);
+        mqtt_conn_state_set(MQTT_CONN_STATE_READY);
     }
 
-    uint32_t refTime = k_uptime_get_32();
-    while (systemConfig.isProvisioned == 0)
+    if (ret >= 0)
     {
-        k_sleep(K_SECONDS(1));
+        printk("Provisioned username: %s\n", systemConfig.deviceUsername);
+    }
 
-        if (k_uptime_get_32() - refTime > MQTT_CONNECT_TIMEOUT)
-        {
-            printk("Provisioning timeout\n");
-            ret = -1;
-            break;
-        }
+    return ret;
+}
+
+/**@brief           Subscribe to the registered topics the broker session does not have.
+ * 
+ * @details         Pending topics go in one SUBSCRIBE. Nothing is sent when the broker kept
+ *                  the session with every subscription.
+ * 
+ * @return          0 if every subscription is active, otherwise a negative value.
+ * 
+ */
+int32_t MqttSubscribe(void)
+{
+    int32_t ret = 0;
+
+    ret = mqtt_subscriptions_send();
+    if (ret < 0)
+    {
+        return ret;
     }
 
-    if (systemConfig.isProvisioned == 1)
+    ret = mqtt_subscriptions_wait(K_MSEC(MQTT_SUBSCRIBE_TIMEOUT));
+    if (ret < 0)
     {
-        printk("Provisioned username: %s\n", systemConfig.deviceUsername);
+        printk("Subscriptions not acked: %d\n", ret);
     }
 
     return ret;
 }
 
-/**@brief           Subscribe to MQTT topics.
+/**@brief           Request the attributes the cache does not have a valid value of.
  * 
- * @param[in]       topics: Array of topics to subscribe to.
- * @param[in]       topicCount: Number of topics in the array.
+ * @details         Stale keys go in one attribute request. Nothing is sent when every key is
+ *                  still valid, reads are served from the cache.
  * 
- * @return          0 if successful, otherwise a negative value.
+ * @return          0 if every key is valid, otherwise a negative value.
  * 
  */
-int32_t MqttTopicsSubscribe(MQTT_TOPIC_STRUCT *topics, uint8_t topicCount)
+int32_t MqttSyncAttributes(void)
 {
     int32_t ret = 0;
-    struct mqtt_subscription_list sub_list = {
-        .list = topics,
-        .list_count = topicCount,
-        .message_id = SUBSCRIBE_TOPIC_ID,
-    };
 
-    ret = mqtt_helper_subscribe(&sub_list);
-    if (ret != 0)
+    ret = attribute_cache_sync();
+    if (ret <= 0)
     {
-        printk("Failed to subscribe to topic: %d\n", ret);
         return ret;
     }
 
+    ret = attribute_cache_wait(K_MSEC(MQTT_ATTRIBUTE_SYNC_TIMEOUT));
+    if (ret < 0)
+    {
+        printk("Attribute request not answered: %d\n", ret);
+    }
+
     return ret;
 }
 
-/**@brief           Publish a message to a topic.
+/**@brief           Set the publish policy of a topic.
+ * 
+ * @details         Used by MqttPublishMessage and MqttPublishMessageAsync. Topic is kept by
+ *                  reference, it must be a static string. Set the policies before publishing.
+ * 
+ * @param[in]       topic: Topic.
+ * @param[in]       policy: QoS and retain flag of the topic.
+ * 
+ * @return          0 if successful, -EINVAL for an unsupported QoS, -ENOMEM if the table is full.
+ * 
+ */
+int32_t MqttSetTopicPolicy(const uint8_t *topic, const MQTT_PUBLISH_POLICY_STRUCT *policy)
+{
+    if (policy->qos > MQTT_QOS_1_AT_LEAST_ONCE)
+    {
+        return -EINVAL;
+    }
+
+    for (uint32_t i = 0; i < topicPolicyCount; i++)
+    {
+        if (strcmp(topicPolicies[i].topic, topic) == 0)
+        {
+            topicPolicies[i].policy = *policy;
+            return 0;
+        }
+    }
+
+    if (topicPolicyCount >= MQTT_TOPIC_POLICY_COUNT)
+    {
+        printk("No room for the publish policy of %s\n", topic);
+        return -ENOMEM;
+    }
+
+    topicPolicies[topicPolicyCount].topic = topic;
+    topicPolicies[topicPolicyCount].policy = *policy;
+    topicPolicyCount++;
+
+    return 0;
+}
+
+/**@brief           Publish a message to a topic with the topic policy.
  * 
  * @param[in]       topic: Topic to publish to.
  * @param[in]       payload: Payload to publish.
  * 
- * @return          0 if successful, otherwise a negative value.
+ * @return          0 if delivered, otherwise a negative value. See MqttPublishMessageWithPolicy.
  * 
  */
 int32_t MqttPublishMessage(uint8_t *topic, uint8_t *payload)
 {
+    return MqttPublishAndWait(topic, payload, strlen(payload), MqttGetTopicPolicy(topic));
+}
+
+/**@brief           Publish a message to a topic with the given policy.
+ * 
+ * @details         QoS 0 returns once the message is sent. QoS 1 waits for the PUBACK, the
+ *                  publish is retransmitted until acked or its retries run out.
+ * 
+ * @param[in]       topic: Topic to publish to.
+ * @param[in]       payload: Payload to publish.
+ * @param[in]       policy: QoS and retain flag of this publish.
+ * 
+ * @return          0 if sent (QoS 0) or acked (QoS 1), -ETIMEDOUT if not acked in
+ *                  MQTT_PUBLISH_TIMEOUT, otherwise a negative value.
+ * 
+ */
+int32_t MqttPublishMessageWithPolicy(uint8_t *topic, uint8_t *payload, const MQTT_PUBLISH_POLICY_STRUCT *policy)
+{
+    return MqttPublishAndWait(topic, payload, strlen(payload), policy);
+}
+
+/**@brief           Publish a binary payload to a topic with the topic policy.
+ * 
+ * @param[in]       topic: Topic to publish to.
+ * @param[in]       payload: Payload to publish, can hold zero bytes.
+ * @param[in]       length: Payload length.
+ * 
+ * @return          0 if delivered, otherwise a negative value. See MqttPublishMessageWithPolicy.
+ * 
+ */
+int32_t MqttPublishPayload(uint8_t *topic, const uint8_t *payload, uint32_t length)
+{
+    return MqttPublishAndWait(topic, payload, length, MqttGetTopicPolicy(topic));
+}
+
+/**@brief           Publish a message to a topic with the topic policy, without waiting for a PUBACK.
+ * 
+ * @details         QoS 1 publishes are pipelined, up to CONFIG_MQTT_INFLIGHT_WINDOW in flight.
+ *                  Waits only when the window is full, up to the timeout. Work items and callbacks
+ *                  should pass K_NO_WAIT, the window may stay full while the broker is away. Payload
+ *                  is copied. QoS 0 publishes report to the callback before returning.
+ * 
+ * @param[in]       topic: Topic to publish to.
+ * @param[in]       payload: Payload to publish.
+ * @param[in]       callback: Called with the delivery result, can be NULL.
+ * @param[in]       ctx: Passed to the callback.
+ * @param[in]       timeout: Max wait for a free window slot.
+ * 
+ * @return          Message id if sent with QoS 1, 0 if sent with QoS 0, -EBUSY if the window stayed
+ *                  full, otherwise a negative value.
+ * 
+ */
+int32_t MqttPublishMessageAsync(uint8_t *topic, uint8_t *payload, MQTT_INFLIGHT_CALLBACK callback, void *ctx,
+                                k_timeout_t timeout)
+{
+    return MqttPublishPayloadAsync(topic, payload, strlen(payload), callback, ctx, timeout);
+}
+
+/**@brief           Publish a binary payload to a topic with the topic policy, without waiting for a PUBACK.
+ * 
+ * @details         See MqttPublishMessageAsync.
+ * 
+ * @param[in]       topic: Topic to publish to.
+ * @param[in]       payload: Payload to publish, can hold zero bytes.
+ * @param[in]       length: Payload length.
+ * @param[in]       callback: Called with the delivery result, can be NULL.
+ * @param[in]       ctx: Passed to the callback.
+ * @param[in]       timeout: Max wait for a free window slot.
+ * 
+ * @return          Message id if sent with QoS 1, 0 if sent with QoS 0, -EBUSY if the window stayed
+ *                  full, otherwise a negative value.
+ * 
+ */
+int32_t MqttPublishPayloadAsync(uint8_t *topic, const uint8_t *payload, uint32_t length, MQTT_INFLIGHT_CALLBACK callback,
+                                void *ctx, k_timeout_t timeout)
+{
+    const MQTT_PUBLISH_POLICY_STRUCT *policy = MqttGetTopicPolicy(topic);
     int32_t ret = 0;
-    static uint16_t id = 0;
-    struct mqtt_publish_param publish_param = {
-        .message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE,
-        .message.topic.topic = {
-            .utf8 = topic,
-            .size = strlen(topic),
-        },
-        .message.payload = {
-            .data = payload,
-            .len = strlen(payload),
-        },
-        .message_id = ++id,
-    };
 
-    ret = mqtt_helper_publish(&publish_param);
-    if (ret != 0)
+    if (policy->qos == MQTT_QOS_0_AT_MOST_ONCE)
+    {
+        ret = MqttPublishAtMostOnce(topic, payload, length, policy->isRetained);
+        if ((ret == 0) && (callback != NULL))
+        {
+            callback(0, 0, ctx);
+        }
+        return ret;
+    }
+
+    ret = mqtt_inflight_publish(topic, payload, length, policy->isRetained, callback, ctx, timeout);
+    if (ret < 0)
     {
         printk("Failed to publish message: %d\n", ret);
     }
     else
     {
-        printk("Published message\n");
+        printk("Published message %d\n", ret);
         printk("Topic: %s\n", topic);
-        printk("Payload: %s\n", payload);
+        printk("Payload: %u B\n", length);
     }
 
     return ret;
 }
 
 /**@brief           Disconnect from the MQTT broker.
+ * 
+ * @details         Returns when the connection is closed, or after MQTT_DISCONNECT_TIMEOUT.
  * 
  * @return          0 if successful, otherwise a negative value.
  * 
@@ -339,12 +873,23 @@ int32_t MqttPublishMessage(uint8_t *topic, uint8_t *payload)
 int32_t MqttDisconnect()
 {
     int32_t ret = 0;
+
+    mqtt_conn_state_set(MQTT_CONN_STATE_DRAINING);
+
     ret = mqtt_helper_disconnect();
     if (ret != 0)
     {
         printk("Failed to disconnect from MQTT broker: %d\n", ret);
     }
+    // Socket is closed when the disconnect callback comes in
+    else if (mqtt_conn_state_wait(MQTT_CONN_STATE_BIT(MQTT_CONN_STATE_DISCONNECTED),
+                                    K_MSEC(MQTT_DISCONNECT_TIMEOUT)) < 0)
+    {
+        printk("No disconnect callback in %d ms\n", MQTT_DISCONNECT_TIMEOUT);
+    }
+
     systemConfig.isBrokerConnected = 0;
+    mqtt_conn_state_set(MQTT_CONN_STATE_DISCONNECTED);
 
     return ret;
 }
@@ -10,14 +10,28 @@ extern "C"
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include <stdbool.h>
+#include "mqtt_inflight.h"
 /* Exported types ------------------------------------------------------------*/
-typedef struct mqtt_topic MQTT_TOPIC_STRUCT;
+/* Delivery of a publish. QoS 0 saves the PUBACK round trip, for data that can be lost */
+typedef struct
+{
+    uint8_t qos;        // MQTT_QOS_0_AT_MOST_ONCE or MQTT_QOS_1_AT_LEAST_ONCE
+    bool isRetained;
+}MQTT_PUBLISH_POLICY_STRUCT;
 
 /* Exported constants --------------------------------------------------------*/
 #define MQTT_PUB_BUFF_SIZE 1024
 #define MQTT_PROVISION_BUFF_SIZE 512
 
 #define MQTT_CONNECT_TIMEOUT 5000
+#define MQTT_SUBSCRIBE_TIMEOUT 5000
+#define MQTT_PROVISION_TIMEOUT 5000
+#define MQTT_DISCONNECT_TIMEOUT 2000
+#define MQTT_ATTRIBUTE_SYNC_TIMEOUT 5000
+
+/* Publish waits for its PUBACK through every retransmit */
+#define MQTT_PUBLISH_TIMEOUT (CONFIG_MQTT_INFLIGHT_RETRY_MS * (CONFIG_MQTT_INFLIGHT_MAX_RETRIES + 1) + 1000)
 /* Exported macro ------------------------------------------------------------*/
 
 /*
@@ -34,8 +48,16 @@ typedef struct mqtt_topic MQTT_TOPIC_STRUCT;
 int32_t mqtt_comm_init(void);
 int32_t MqttConnect(uint8_t *username);
 int32_t MqttProvisionRequest(void);
-int32_t MqttTopicsSubscribe(MQTT_TOPIC_STRUCT *topics, uint8_t topicCount);
+int32_t MqttSubscribe(void);
+int32_t MqttSyncAttributes(void);
+int32_t MqttSetTopicPolicy(const uint8_t *topic, const MQTT_PUBLISH_POLICY_STRUCT *policy);
 int32_t MqttPublishMessage(uint8_t *topic, uint8_t *payload);
+int32_t MqttPublishMessageWithPolicy(uint8_t *topic, uint8_t *payload, const MQTT_PUBLISH_POLICY_STRUCT *policy);
+int32_t MqttPublishMessageAsync(uint8_t *topic, uint8_t *payload, MQTT_INFLIGHT_CALLBACK callback, void *ctx,
+                                k_timeout_t timeout);
+int32_t MqttPublishPayload(uint8_t *topic, const uint8_t *payload, uint32_t length);
+int32_t MqttPublishPayloadAsync(uint8_t *topic, const uint8_t *payload, uint32_t length, MQTT_INFLIGHT_CALLBACK callback,
+                                void *ctx, k_timeout_t timeout);
 int32_t MqttDisconnect();
 
 #ifdef __cplusplus
@@ -0,0 +1,218 @@
+/* Includes ----------------------------------------------------------- */
+#include "mqtt_conn_state.h"
+#include <zephyr/init.h>
+#include <zephyr/sys/printk.h>
+#include <errno.h>
+
+/* Private defines ---------------------------------------------------- */
+/* Private enumerate/structure ---------------------------------------- */
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Connection state Mutex to synchronize */
+K_MUTEX_DEFINE(MqttConnStateMutex);
+/* Only the bit of the current state is set, waiters wake on the transition */
+K_EVENT_DEFINE(MqttConnStateEvent);
+/* Given when the provisioning response comes in */
+K_SEM_DEFINE(MqttProvisionResponse, 0, 1);
+
+static const char *stateNames[MQTT_CONN_STATE_COUNT] = {
+    [MQTT_CONN_STATE_DISCONNECTED] = "disconnected",
+    [MQTT_CONN_STATE_CONNECTING] = "connecting",
+    [MQTT_CONN_STATE_PROVISIONING] = "provisioning",
+    [MQTT_CONN_STATE_READY] = "ready",
+    [MQTT_CONN_STATE_DRAINING] = "draining",
+};
+
+static MQTT_CONN_STATE currentState = MQTT_CONN_STATE_DISCONNECTED;
+static int64_t stateEnterTime = 0;
+static MQTT_CONN_STATE_TIMING_STRUCT stateTimings[MQTT_CONN_STATE_COUNT];
+
+static int32_t provisionResult = 0;
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to post the initial state before any thread can wait for it.
+ *
+ * @details         Event starts with no bit set, a wait for the disconnected state would
+ *                  otherwise block until the first connect fails.
+ *
+ * @return          0.
+ *
+*/
+static int mqttConnStateInit(void)
+{
+    k_event_set(&MqttConnStateEvent, MQTT_CONN_STATE_BIT(MQTT_CONN_STATE_DISCONNECTED));
+
+    return 0;
+}
+
+SYS_INIT(mqttConnStateInit, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to change the connection state.
+ *
+ * @details         Closes the timing of the left state and wakes the threads waiting for the
+ *                  new one. Called from the MQTT helper callbacks and the application thread.
+ *
+ * param[in]        state: New state.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_conn_state_set(MQTT_CONN_STATE state)
+{
+    MQTT_CONN_STATE_TIMING_STRUCT *timing = NULL;
+    int64_t now = 0;
+    uint32_t elapsedMs = 0;
+
+    if (state >= MQTT_CONN_STATE_COUNT)
+    {
+        return;
+    }
+
+    k_mutex_lock(&MqttConnStateMutex, K_FOREVER);
+
+    if (state == currentState)
+    {
+        k_mutex_unlock(&MqttConnStateMutex);
+        return;
+    }
+
+    now = k_uptime_get();
+    elapsedMs = (uint32_t)(now - stateEnterTime);
+    timing = &stateTimings[currentState];
+    timing->lastMs = elapsedMs;
+    timing->totalMs += elapsedMs;
+    if (elapsedMs > timing->maxMs)
+    {
+        timing->maxMs = elapsedMs;
+    }
+
+    printk("MQTT %s -> %s after %u ms\n", stateNames[currentState], stateNames[state], elapsedMs);
+
+    // Response can not come anymore, end the provisioning wait now
+    if ((currentState == MQTT_CONN_STATE_PROVISIONING) && (state == MQTT_CONN_STATE_DISCONNECTED))
+    {
+        mqtt_conn_state_provision_done(-ECONNRESET);
+    }
+
+    currentState = state;
+    stateEnterTime = now;
+    stateTimings[state].entries++;
+
+    k_event_set(&MqttConnStateEvent, MQTT_CONN_STATE_BIT(state));
+
+    k_mutex_unlock(&MqttConnStateMutex);
+}
+
+/**@brief           Function to get the connection state.
+ *
+ * @return          Current state.
+ *
+*/
+MQTT_CONN_STATE mqtt_conn_state_get(void)
+{
+    return currentState;
+}
+
+/**@brief           Function to wait for one of the given states.
+ *
+ * @details         Returns at once if the current state is in the mask.
+ *
+ * param[in]        stateMask: MQTT_CONN_STATE_BIT of the waited states.
+ * param[in]        timeout: Wait time.
+ *
+ * @return          Reached state, -ETIMEDOUT if none was reached in time.
+ *
+*/
+int32_t mqtt_conn_state_wait(uint32_t stateMask, k_timeout_t timeout)
+{
+    uint32_t events = k_event_wait(&MqttConnStateEvent, stateMask, false, timeout);
+
+    if (events == 0)
+    {
+        return -ETIMEDOUT;
+    }
+
+    return find_lsb_set(events) - 1;
+}
+
+/**@brief           Function to enter the provisioning state before sending the request.
+ *
+ * @details         A response of an earlier request is dropped.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_conn_state_provision_start(void)
+{
+    k_sem_reset(&MqttProvisionResponse);
+    mqtt_conn_state_set(MQTT_CONN_STATE_PROVISIONING);
+}
+
+/**@brief           Function to report the provisioning response.
+ *
+ * param[in]        result: 0 if the credentials were accepted, negative otherwise.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_conn_state_provision_done(int32_t result)
+{
+    provisionResult = result;
+    k_sem_give(&MqttProvisionResponse);
+}
+
+/**@brief           Function to wait for the provisioning response.
+ *
+ * param[in]        timeout: Wait time.
+ *
+ * @return          Provisioning result, -ECONNRESET if the connection was lost meanwhile,
+ *                  -ETIMEDOUT if no response came in time.
+ *
+*/
+int32_t mqtt_conn_state_provision_wait(k_timeout_t timeout)
+{
+    if (k_sem_take(&MqttProvisionResponse, timeout) != 0)
+    {
+        return -ETIMEDOUT;
+    }
+
+    return provisionResult;
+}
+
+/**@brief           Function to get the name of a state.
+ *
+ * param[in]        state: State.
+ *
+ * @return          Name.
+ *
+*/
+const char *mqtt_conn_state_name(MQTT_CONN_STATE state)
+{
+    return (state < MQTT_CONN_STATE_COUNT) ? stateNames[state] : "unknown";
+}
+
+/**@brief           Function to get the time spent in a state.
+ *
+ * param[in]        state: State.
+ * param[in]        timing: Copy of the state timing.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_conn_state_get_timing(MQTT_CONN_STATE state, MQTT_CONN_STATE_TIMING_STRUCT *timing)
+{
+    if (state >= MQTT_CONN_STATE_COUNT)
+    {
+        return;
+    }
+
+    k_mutex_lock(&MqttConnStateMutex, K_FOREVER);
+    *timing = stateTimings[state];
+    k_mutex_unlock(&MqttConnStateMutex);
+}
+/* End of file -------------------------------------------------------- */
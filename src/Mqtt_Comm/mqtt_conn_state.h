@@ -0,0 +1,68 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MQTT_CONN_STATE_H
+#define __MQTT_CONN_STATE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    MQTT_CONN_STATE_DISCONNECTED = 0,   // No broker connection
+    MQTT_CONN_STATE_CONNECTING,         // CONNECT sent, waiting for the CONNACK
+    MQTT_CONN_STATE_PROVISIONING,       // Provision request sent, waiting for the response
+    MQTT_CONN_STATE_READY,              // Connection accepted
+    MQTT_CONN_STATE_DRAINING,           // DISCONNECT sent, waiting for the socket to close
+    MQTT_CONN_STATE_COUNT,
+}MQTT_CONN_STATE;
+
+/* Time spent in a state */
+typedef struct
+{
+    uint32_t entries;
+    uint32_t lastMs;        // Last completed stay
+    uint32_t maxMs;
+    uint64_t totalMs;
+}MQTT_CONN_STATE_TIMING_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+/* Waited state masks */
+#define MQTT_CONN_STATE_BIT(state)      BIT(state)
+#define MQTT_CONN_STATE_CONNECTED_MASK  (MQTT_CONN_STATE_BIT(MQTT_CONN_STATE_PROVISIONING) | \
+                                        MQTT_CONN_STATE_BIT(MQTT_CONN_STATE_READY))
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+void mqtt_conn_state_set(MQTT_CONN_STATE state);
+MQTT_CONN_STATE mqtt_conn_state_get(void);
+int32_t mqtt_conn_state_wait(uint32_t stateMask, k_timeout_t timeout);
+void mqtt_conn_state_provision_start(void);
+void mqtt_conn_state_provision_done(int32_t result);
+int32_t mqtt_conn_state_provision_wait(k_timeout_t timeout);
+const char *mqtt_conn_state_name(MQTT_CONN_STATE state);
+void mqtt_conn_state_get_timing(MQTT_CONN_STATE state, MQTT_CONN_STATE_TIMING_STRUCT *timing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MQTT_CONN_STATE_H */
@@ -0,0 +1,501 @@
+/* Includes ----------------------------------------------------------- */
+#include "mqtt_inflight.h"
+#include <zephyr/sys/printk.h>
+#include <net/mqtt_helper.h>
+#include <string.h>
+#include "mqtt_comm.h"
+
+/* Private defines ---------------------------------------------------- */
+/* Private enumerate/structure ---------------------------------------- */
+/* Publish waiting for its PUBACK. Topic and payload are copied for the retransmit */
+typedef struct
+{
+    bool isUsed;
+    uint16_t messageId;
+    uint8_t retries;
+    bool isRetained;
+    int64_t firstSentTime;
+    int64_t sentTime;
+    MQTT_INFLIGHT_CALLBACK callback;
+    void *ctx;
+    uint32_t topicLength;
+    uint32_t payloadLength;
+    uint8_t topic[MQTT_INFLIGHT_TOPIC_SIZE];
+    uint8_t payload[MQTT_PUB_BUFF_SIZE];
+}MQTT_INFLIGHT_ENTRY_STRUCT;
+
+/* Delivery result, reported once the in-flight lock is released */
+typedef struct
+{
+    MQTT_INFLIGHT_CALLBACK callback;
+    void *ctx;
+    uint16_t messageId;
+    int32_t result;
+}MQTT_INFLIGHT_RESULT_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* In-flight table Mutex to synchronize */
+K_MUTEX_DEFINE(MqttInflightMutex);
+/* Free window slots, publishers wait here when the window is full */
+K_SEM_DEFINE(MqttInflightSlots, CONFIG_MQTT_INFLIGHT_WINDOW, CONFIG_MQTT_INFLIGHT_WINDOW);
+
+/* Retransmits run in their own thread, a publisher blocked on a full window in the
+ * system work queue must not hold back the retransmit that frees its slot */
+static K_THREAD_STACK_DEFINE(mqtt_inflight_stack_area, CONFIG_MQTT_INFLIGHT_STACK_SIZE);
+static struct k_work_q inflightQueue;
+static bool isInflightStarted = false;
+
+static MQTT_INFLIGHT_ENTRY_STRUCT inflightEntries[CONFIG_MQTT_INFLIGHT_WINDOW];
+static uint32_t inflightCount = 0;
+static bool isInflightConnected = false;
+
+static MQTT_INFLIGHT_STATS_STRUCT inflightStats;
+static uint64_t ackLatencyTotalMs = 0;
+
+/* Private function prototypes ---------------------------------------- */
+static void retryWorkHandler(struct k_work *work);
+
+K_WORK_DELAYABLE_DEFINE(inflightRetryWork, retryWorkHandler);
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to send an in-flight publish.
+ *
+ * param[in]        entry: In-flight publish.
+ * param[in]        isDuplicate: Retransmit, DUP flag is set.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t sendEntry(MQTT_INFLIGHT_ENTRY_STRUCT *entry, bool isDuplicate)
+{
+    struct mqtt_publish_param publish_param = {
+        .message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE,
+        .message.topic.topic = {
+            .utf8 = entry->topic,
+            .size = entry->topicLength,
+        },
+        .message.payload = {
+            .data = entry->payload,
+            .len = entry->payloadLength,
+        },
+        .message_id = entry->messageId,
+        .dup_flag = isDuplicate ? 1 : 0,
+        .retain_flag = entry->isRetained ? 1 : 0,
+    };
+
+    entry->sentTime = k_uptime_get();
+
+    return mqtt_helper_publish(&publish_param);
+}
+
+/**@brief           Function to find an in-flight publish.
+ *
+ * param[in]        messageId: Publish message id.
+ *
+ * @return          In-flight publish, NULL if not found.
+ *
+*/
+static MQTT_INFLIGHT_ENTRY_STRUCT *findEntry(uint16_t messageId)
+{
+    for (uint32_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++)
+    {
+        if (inflightEntries[i].isUsed && (inflightEntries[i].messageId == messageId))
+        {
+            return &inflightEntries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**@brief           Function to free an in-flight publish.
+ *
+ * @details         In-flight lock must be held by the caller. Callback is not called here, a
+ *                  callback publishing again would take the lock it is called under. Caller
+ *                  reports the result with reportResults once the lock is released.
+ *
+ * param[in]        entry: In-flight publish.
+ * param[in]        result: 0 if acked, negative otherwise.
+ * param[out]       report: Result to report, NULL if cancelled.
+ *
+ * @return          None.
+ *
+*/
+static void releaseEntry(MQTT_INFLIGHT_ENTRY_STRUCT *entry, int32_t result, MQTT_INFLIGHT_RESULT_STRUCT *report)
+{
+    if (report != NULL)
+    {
+        report->callback = entry->callback;
+        report->ctx = entry->ctx;
+        report->messageId = entry->messageId;
+        report->result = result;
+    }
+
+    entry->isUsed = false;
+    inflightCount--;
+    k_sem_give(&MqttInflightSlots);
+}
+
+/**@brief           Function to call the callbacks of released publishes.
+ *
+ * @details         In-flight lock must not be held.
+ *
+ * param[in]        reports: Results of the released publishes.
+ * param[in]        count: Number of results.
+ *
+ * @return          None.
+ *
+*/
+static void reportResults(const MQTT_INFLIGHT_RESULT_STRUCT *reports, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (reports[i].callback != NULL)
+        {
+            reports[i].callback(reports[i].messageId, reports[i].result, reports[i].ctx);
+        }
+    }
+}
+
+/**@brief           Function to schedule the next retransmit check.
+ *
+ * @details         In-flight lock must be held by the caller.
+ *
+ * param[in]        None.
+ *
+ * @return          None.
+ *
+*/
+static void scheduleRetry(void)
+{
+    int64_t now = k_uptime_get();
+    int64_t nextTime = INT64_MAX;
+
+    if (!isInflightConnected)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++)
+    {
+        if (inflightEntries[i].isUsed)
+        {
+            nextTime = MIN(nextTime, inflightEntries[i].sentTime + CONFIG_MQTT_INFLIGHT_RETRY_MS);
+        }
+    }
+
+    if (nextTime != INT64_MAX)
+    {
+        (void)k_work_reschedule_for_queue(&inflightQueue, &inflightRetryWork, K_MSEC(MAX(nextTime - now, 0)));
+    }
+}
+
+/**@brief           Function to retransmit the publishes not acked in time.
+ *
+ * @details         Publish fails with -ETIMEDOUT when its retries ran out.
+ *
+ * param[in]        work: Retry work.
+ *
+ * @return          None.
+ *
+*/
+static void retryWorkHandler(struct k_work *work)
+{
+    MQTT_INFLIGHT_RESULT_STRUCT reports[CONFIG_MQTT_INFLIGHT_WINDOW];
+    MQTT_INFLIGHT_ENTRY_STRUCT *entry = NULL;
+    uint32_t reportCount = 0;
+    int64_t now = k_uptime_get();
+
+    ARG_UNUSED(work);
+
+    k_mutex_lock(&MqttInflightMutex, K_FOREVER);
+
+    for (uint32_t i = 0; isInflightConnected && (i < CONFIG_MQTT_INFLIGHT_WINDOW); i++)
+    {
+        entry = &inflightEntries[i];
+        if (!entry->isUsed || ((now - entry->sentTime) < CONFIG_MQTT_INFLIGHT_RETRY_MS))
+        {
+            continue;
+        }
+
+        if (entry->retries >= CONFIG_MQTT_INFLIGHT_MAX_RETRIES)
+        {
+            printk("Publish %u not acked after %u retries\n", entry->messageId, entry->retries);
+            inflightStats.failed++;
+            releaseEntry(entry, -ETIMEDOUT, &reports[reportCount++]);
+            continue;
+        }
+
+        entry->retries++;
+        inflightStats.retransmits++;
+        if (sendEntry(entry, true) < 0)
+        {
+            printk("Failed to retransmit publish %u\n", entry->messageId);
+        }
+    }
+
+    scheduleRetry();
+
+    k_mutex_unlock(&MqttInflightMutex);
+
+    reportResults(reports, reportCount);
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to start the retransmit thread.
+ *
+ * @details         Must run before the first publish. Later calls do nothing.
+ *
+ * param[in]        None.
+ *
+ * @return          0.
+ *
+*/
+int32_t mqtt_inflight_init(void)
+{
+    struct k_work_queue_config config = {.name = "mqtt_inflight"};
+
+    if (isInflightStarted)
+    {
+        return 0;
+    }
+
+    k_work_queue_init(&inflightQueue);
+    k_work_queue_start(&inflightQueue, mqtt_inflight_stack_area, K_THREAD_STACK_SIZEOF(mqtt_inflight_stack_area),
+                        CONFIG_MQTT_INFLIGHT_PRIORITY, &config);
+    isInflightStarted = true;
+
+    return 0;
+}
+
+/**@brief           Function to publish with QoS 1 and track the PUBACK.
+ *
+ * @details         Returns once the publish is sent, without waiting for the PUBACK, so up to
+ *                  CONFIG_MQTT_INFLIGHT_WINDOW publishes can be in flight. When the window is
+ *                  full it waits for a free slot up to the timeout. Slots are only freed by
+ *                  PUBACKs and retry timeouts, so callers in a work queue or a callback should
+ *                  pass K_NO_WAIT and handle -EBUSY. Topic and payload are copied.
+ *                  Publish is retransmitted with the DUP flag every CONFIG_MQTT_INFLIGHT_RETRY_MS
+ *                  until acked, and after a reconnect. Result is reported to the callback.
+ *
+ * param[in]        topic: Topic.
+ * param[in]        payload: Payload.
+ * param[in]        length: Payload length.
+ * param[in]        isRetained: Broker keeps the message for new subscribers.
+ * param[in]        callback: Called with the delivery result, can be NULL.
+ * param[in]        ctx: Passed to the callback.
+ * param[in]        timeout: Max wait for a free window slot.
+ *
+ * @return          Message id, -EBUSY if the window stayed full, -EMSGSIZE if the message does
+ *                  not fit, negative publish error otherwise. Callback is not called on error.
+ *
+*/
+int32_t mqtt_inflight_publish(const uint8_t *topic, const uint8_t *payload, uint32_t length, bool isRetained,
+                                MQTT_INFLIGHT_CALLBACK callback, void *ctx, k_timeout_t timeout)
+{
+    MQTT_INFLIGHT_ENTRY_STRUCT *entry = NULL;
+    uint32_t topicLength = strlen(topic);
+    uint16_t messageId = 0;
+    int32_t ret = 0;
+
+    if ((topicLength >= MQTT_INFLIGHT_TOPIC_SIZE) || (length > MQTT_PUB_BUFF_SIZE))
+    {
+        return -EMSGSIZE;
+    }
+
+    if (k_sem_take(&MqttInflightSlots, timeout) != 0)
+    {
+        return -EBUSY;
+    }
+
+    k_mutex_lock(&MqttInflightMutex, K_FOREVER);
+
+    for (uint32_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++)
+    {
+        if (!inflightEntries[i].isUsed)
+        {
+            entry = &inflightEntries[i];
+            break;
+        }
+    }
+
+    // Id must not be in use by a publish still waiting for its PUBACK
+    do
+    {
+        messageId = mqtt_helper_msg_id_get();
+    } while ((messageId == 0) || (findEntry(messageId) != NULL));
+
+    entry->isUsed = true;
+    entry->messageId = messageId;
+    entry->retries = 0;
+    entry->isRetained = isRetained;
+    entry->callback = callback;
+    entry->ctx = ctx;
+    entry->topicLength = topicLength;
+    entry->payloadLength = length;
+    memcpy(entry->topic, topic, topicLength);
+    memcpy(entry->payload, payload, length);
+    inflightCount++;
+
+    ret = sendEntry(entry, false);
+    if (ret != 0)
+    {
+        releaseEntry(entry, ret, NULL);
+    }
+    else
+    {
+        entry->firstSentTime = entry->sentTime;
+        inflightStats.published++;
+        inflightStats.maxInFlight = MAX(inflightStats.maxInFlight, inflightCount);
+        scheduleRetry();
+        ret = messageId;
+    }
+
+    k_mutex_unlock(&MqttInflightMutex);
+
+    return ret;
+}
+
+/**@brief           Function to stop tracking a publish.
+ *
+ * @details         Callback is not called. A PUBACK received later is ignored.
+ *
+ * param[in]        messageId: Publish message id.
+ *
+ * @return          0 if successful, -ENOENT if the publish is no longer in flight. Its callback
+ *                  was then called, or is about to be called once the in-flight lock is free.
+ *
+*/
+int32_t mqtt_inflight_cancel(uint16_t messageId)
+{
+    MQTT_INFLIGHT_ENTRY_STRUCT *entry = NULL;
+    int32_t ret = -ENOENT;
+
+    k_mutex_lock(&MqttInflightMutex, K_FOREVER);
+
+    entry = findEntry(messageId);
+    if (entry != NULL)
+    {
+        releaseEntry(entry, 0, NULL);
+        ret = 0;
+    }
+
+    k_mutex_unlock(&MqttInflightMutex);
+
+    return ret;
+}
+
+/**@brief           Function to complete a publish on its PUBACK.
+ *
+ * @details         Called from the MQTT helper PUBACK callback.
+ *
+ * param[in]        messageId: Acked message id.
+ * param[in]        result: PUBACK result, 0 if successful.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_inflight_on_puback(uint16_t messageId, int32_t result)
+{
+    MQTT_INFLIGHT_RESULT_STRUCT report = {.callback = NULL};
+    MQTT_INFLIGHT_ENTRY_STRUCT *entry = NULL;
+    uint32_t latency = 0;
+
+    k_mutex_lock(&MqttInflightMutex, K_FOREVER);
+
+    entry = findEntry(messageId);
+    if (entry != NULL)
+    {
+        if (result == 0)
+        {
+            latency = (uint32_t)(k_uptime_get() - entry->firstSentTime);
+            inflightStats.acked++;
+            inflightStats.ackLatencyMaxMs = MAX(inflightStats.ackLatencyMaxMs, latency);
+            ackLatencyTotalMs += latency;
+        }
+        else
+        {
+            inflightStats.failed++;
+        }
+
+        releaseEntry(entry, result, &report);
+    }
+
+    k_mutex_unlock(&MqttInflightMutex);
+
+    reportResults(&report, 1);
+}
+
+/**@brief           Function to update the broker connection state.
+ *
+ * @details         Retransmits are paused while disconnected. On connection every publish
+ *                  in flight is sent again with the DUP flag.
+ *
+ * param[in]        isConnected: Broker connection accepted.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_inflight_on_connection(bool isConnected)
+{
+    k_mutex_lock(&MqttInflightMutex, K_FOREVER);
+
+    isInflightConnected = isConnected;
+
+    if (!isConnected)
+    {
+        (void)k_work_cancel_delayable(&inflightRetryWork);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++)
+        {
+            if (inflightEntries[i].isUsed && (sendEntry(&inflightEntries[i], true) < 0))
+            {
+                printk("Failed to resend publish %u\n", inflightEntries[i].messageId);
+            }
+        }
+        scheduleRetry();
+    }
+
+    k_mutex_unlock(&MqttInflightMutex);
+}
+
+/**@brief           Function to get the number of publishes waiting for a PUBACK.
+ *
+ * param[in]        None.
+ *
+ * @return          Publishes in flight.
+ *
+*/
+uint32_t mqtt_inflight_count(void)
+{
+    uint32_t count = 0;
+
+    k_mutex_lock(&MqttInflightMutex, K_FOREVER);
+    count = inflightCount;
+    k_mutex_unlock(&MqttInflightMutex);
+
+    return count;
+}
+
+/**@brief           Function to get the QoS 1 delivery totals.
+ *
+ * param[in]        stats: Totals output.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_inflight_get_stats(MQTT_INFLIGHT_STATS_STRUCT *stats)
+{
+    k_mutex_lock(&MqttInflightMutex, K_FOREVER);
+
+    *stats = inflightStats;
+    stats->ackLatencyAvgMs = (inflightStats.acked > 0) ? (uint32_t)(ackLatencyTotalMs / inflightStats.acked) : 0;
+
+    k_mutex_unlock(&MqttInflightMutex);
+}
+/* End of file -------------------------------------------------------- */
@@ -0,0 +1,63 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MQTT_INFLIGHT_H
+#define __MQTT_INFLIGHT_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* Called once per publish: 0 on PUBACK, -ETIMEDOUT when the retries ran out, or the PUBACK error.
+ * Runs in the MQTT thread or the retransmit thread without the in-flight lock, may publish
+ * again with K_NO_WAIT but must not block */
+typedef void (*MQTT_INFLIGHT_CALLBACK)(uint16_t messageId, int32_t result, void *ctx);
+
+/* QoS 1 delivery totals. Ack latency is from the first transmission to the PUBACK */
+typedef struct
+{
+    uint32_t published;
+    uint32_t acked;
+    uint32_t failed;
+    uint32_t retransmits;
+    uint32_t maxInFlight;
+    uint32_t ackLatencyAvgMs;
+    uint32_t ackLatencyMaxMs;
+}MQTT_INFLIGHT_STATS_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+#define MQTT_INFLIGHT_TOPIC_SIZE 64
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t mqtt_inflight_init(void);
+int32_t mqtt_inflight_publish(const uint8_t *topic, const uint8_t *payload, uint32_t length, bool isRetained,
+                                MQTT_INFLIGHT_CALLBACK callback, void *ctx, k_timeout_t timeout);
+int32_t mqtt_inflight_cancel(uint16_t messageId);
+void mqtt_inflight_on_puback(uint16_t messageId, int32_t result);
+void mqtt_inflight_on_connection(bool isConnected);
+uint32_t mqtt_inflight_count(void);
+void mqtt_inflight_get_stats(MQTT_INFLIGHT_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MQTT_INFLIGHT_H */
@@ -0,0 +1,235 @@
+/* Includes ----------------------------------------------------------- */
+#include "mqtt_reconnect.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/random/random.h>
+#include <errno.h>
+
+/* Private defines ---------------------------------------------------- */
+/* Backoff ceiling stops growing after this many doublings */
+#define MAX_BACKOFF_EXPONENT 16
+
+/* Private enumerate/structure ---------------------------------------- */
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Upper limits of the histogram buckets in milliseconds, the last one has no limit */
+static const uint32_t bucketLimits[MQTT_RECONNECT_HISTOGRAM_BUCKETS] = {
+    100, 250, 500, 1000, 2000, 5000, 10000, UINT32_MAX,
+};
+
+/* Reconnect schedule, used from the data communication thread only */
+static int64_t nextAttemptTime = 0;
+static uint32_t fastRetryCount = 0;
+static uint32_t backoffExponent = 0;
+
+static MQTT_RECONNECT_STATS_STRUCT reconnectStats;
+static MQTT_CONNECT_PHASE_STATS_STRUCT phaseStats[MQTT_CONNECT_PHASE_COUNT];
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to tell if an error can go away by itself within seconds.
+ *
+ * param[in]        error: Negative connect error.
+ *
+ * @return          True for timeouts and lost or unreachable network, false for refused
+ *                  connections, failed provisioning and DNS errors (-EADDRNOTAVAIL): a broker
+ *                  hostname that did not resolve gets the same answer on a fast retry.
+ *
+*/
+static bool isTransientError(int32_t error)
+{
+    switch (error)
+    {
+        case -ETIMEDOUT:
+        case -ECONNRESET:
+        case -ECONNABORTED:
+        case -EAGAIN:
+        case -ENETDOWN:
+        case -ENETUNREACH:
+        case -EHOSTUNREACH:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**@brief           Function to schedule the next connect attempt.
+ *
+ * @details         Delay is drawn uniformly between 0 and the ceiling (full jitter), so
+ *                  devices that lost the broker together do not come back together.
+ *                  Transient errors get CONFIG_MQTT_RECONNECT_FAST_RETRIES retries with a
+ *                  CONFIG_MQTT_RECONNECT_FAST_MS ceiling. Otherwise the ceiling doubles from
+ *                  CONFIG_MQTT_RECONNECT_BASE_MS up to CONFIG_MQTT_RECONNECT_MAX_MS.
+ *
+ * param[in]        isTransient: Failure can go away by itself.
+ *
+ * @return          None.
+ *
+*/
+static void scheduleRetry(bool isTransient)
+{
+    uint64_t ceiling = 0;
+    uint32_t delayMs = 0;
+
+    if (isTransient && (fastRetryCount < CONFIG_MQTT_RECONNECT_FAST_RETRIES))
+    {
+        ceiling = CONFIG_MQTT_RECONNECT_FAST_MS;
+        fastRetryCount++;
+        reconnectStats.fastRetries++;
+    }
+    else
+    {
+        ceiling = MIN((uint64_t)CONFIG_MQTT_RECONNECT_BASE_MS << backoffExponent, CONFIG_MQTT_RECONNECT_MAX_MS);
+        if (backoffExponent < MAX_BACKOFF_EXPONENT)
+        {
+            backoffExponent++;
+        }
+        reconnectStats.backoffs++;
+    }
+
+    delayMs = (uint32_t)(sys_rand32_get() % (ceiling + 1));
+    nextAttemptTime = k_uptime_get() + delayMs;
+
+    reconnectStats.lastDelayMs = delayMs;
+    if (delayMs > reconnectStats.maxDelayMs)
+    {
+        reconnectStats.maxDelayMs = delayMs;
+    }
+
+    printk("Broker reconnect in %u ms\n", delayMs);
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to report the result of a connect or provisioning attempt.
+ *
+ * param[in]        result: 0 if connected, negative error otherwise.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_reconnect_on_result(int32_t result)
+{
+    reconnectStats.attempts++;
+
+    if (result >= 0)
+    {
+        fastRetryCount = 0;
+        backoffExponent = 0;
+        nextAttemptTime = 0;
+        return;
+    }
+
+    reconnectStats.failures++;
+    scheduleRetry(isTransientError(result));
+}
+
+/**@brief           Function to report a connection dropped by the broker or the network.
+ *
+ * @details         First reconnect is a jittered fast retry.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_reconnect_on_connection_lost(void)
+{
+    reconnectStats.connectionsLost++;
+    scheduleRetry(true);
+}
+
+/**@brief           Function to tell if the next connect attempt can start.
+ *
+ * @return          True when the backoff delay is over.
+ *
+*/
+bool mqtt_reconnect_is_due(void)
+{
+    return k_uptime_get() >= nextAttemptTime;
+}
+
+/**@brief           Function to get when the next connect attempt can start.
+ *
+ * @return          Uptime in milliseconds.
+ *
+*/
+int64_t mqtt_reconnect_next_time(void)
+{
+    return nextAttemptTime;
+}
+
+/**@brief           Function to record the latency of a successful connect phase.
+ *
+ * param[in]        phase: Connect phase.
+ * param[in]        elapsedMs: Phase time.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_reconnect_record_phase(MQTT_CONNECT_PHASE phase, uint32_t elapsedMs)
+{
+    MQTT_CONNECT_PHASE_STATS_STRUCT *stats = NULL;
+    uint32_t bucket = 0;
+
+    if (phase >= MQTT_CONNECT_PHASE_COUNT)
+    {
+        return;
+    }
+
+    stats = &phaseStats[phase];
+    stats->count++;
+    stats->totalMs += elapsedMs;
+    if (elapsedMs > stats->maxMs)
+    {
+        stats->maxMs = elapsedMs;
+    }
+
+    while (elapsedMs > bucketLimits[bucket])
+    {
+        bucket++;
+    }
+    stats->buckets[bucket]++;
+}
+
+/**@brief           Function to get the upper limit of a histogram bucket.
+ *
+ * param[in]        bucket: Bucket index.
+ *
+ * @return          Limit in milliseconds, UINT32_MAX for the last bucket.
+ *
+*/
+uint32_t mqtt_reconnect_bucket_limit(uint32_t bucket)
+{
+    return (bucket < MQTT_RECONNECT_HISTOGRAM_BUCKETS) ? bucketLimits[bucket] : UINT32_MAX;
+}
+
+/**@brief           Function to get the reconnect totals.
+ *
+ * param[in]        stats: Copy of the totals.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_reconnect_get_stats(MQTT_RECONNECT_STATS_STRUCT *stats)
+{
+    *stats = reconnectStats;
+}
+
+/**@brief           Function to get the latency of a connect phase.
+ *
+ * param[in]        phase: Connect phase.
+ * param[in]        stats: Copy of the phase latency.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_reconnect_get_phase_stats(MQTT_CONNECT_PHASE phase, MQTT_CONNECT_PHASE_STATS_STRUCT *stats)
+{
+    if (phase < MQTT_CONNECT_PHASE_COUNT)
+    {
+        *stats = phaseStats[phase];
+    }
+}
+/* End of file -------------------------------------------------------- */
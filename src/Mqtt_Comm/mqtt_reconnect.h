@@ -0,0 +1,76 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MQTT_RECONNECT_H
+#define __MQTT_RECONNECT_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* Timed phases of a broker connection */
+typedef enum
+{
+    MQTT_CONNECT_PHASE_DNS = 0,     // Broker hostname lookup
+    MQTT_CONNECT_PHASE_TLS,         // TCP connect and TLS handshake, CONNECT sent
+    MQTT_CONNECT_PHASE_CONNACK,     // CONNECT to CONNACK
+    MQTT_CONNECT_PHASE_COUNT,
+}MQTT_CONNECT_PHASE;
+
+/* Exported constants --------------------------------------------------------*/
+/* Latency histogram buckets, see mqtt_reconnect_bucket_limit */
+#define MQTT_RECONNECT_HISTOGRAM_BUCKETS 8
+
+/* Latency of the successful phases */
+typedef struct
+{
+    uint32_t count;
+    uint32_t maxMs;
+    uint64_t totalMs;
+    uint32_t buckets[MQTT_RECONNECT_HISTOGRAM_BUCKETS];
+}MQTT_CONNECT_PHASE_STATS_STRUCT;
+
+/* Reconnect scheduler totals */
+typedef struct
+{
+    uint32_t attempts;
+    uint32_t failures;
+    uint32_t connectionsLost;
+    uint32_t fastRetries;       // Transient errors retried after a short delay
+    uint32_t backoffs;          // Retries after an exponential backoff
+    uint32_t lastDelayMs;
+    uint32_t maxDelayMs;
+}MQTT_RECONNECT_STATS_STRUCT;
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+void mqtt_reconnect_on_result(int32_t result);
+void mqtt_reconnect_on_connection_lost(void);
+bool mqtt_reconnect_is_due(void);
+int64_t mqtt_reconnect_next_time(void);
+void mqtt_reconnect_record_phase(MQTT_CONNECT_PHASE phase, uint32_t elapsedMs);
+uint32_t mqtt_reconnect_bucket_limit(uint32_t bucket);
+void mqtt_reconnect_get_stats(MQTT_RECONNECT_STATS_STRUCT *stats);
+void mqtt_reconnect_get_phase_stats(MQTT_CONNECT_PHASE phase, MQTT_CONNECT_PHASE_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MQTT_RECONNECT_H */
@@ -0,0 +1,420 @@
+/* Includes ----------------------------------------------------------- */
+#include "mqtt_subscriptions.h"
+#include <zephyr/sys/printk.h>
+#include <net/mqtt_helper.h>
+#include <string.h>
+#include "SystemConfig.h"
+
+/* Private defines ---------------------------------------------------- */
+/* Private enumerate/structure ---------------------------------------- */
+/* Registered subscription */
+typedef struct
+{
+    const uint8_t *topic;
+    uint8_t qos;            // Requested QoS
+    uint8_t grantedQos;     // Valid when active
+    MQTT_SUBSCRIPTION_STATE state;
+}MQTT_SUBSCRIPTION_ENTRY_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Subscription registry Mutex to synchronize */
+K_MUTEX_DEFINE(MqttSubscriptionsMutex);
+/* Given when the SUBACK of the outstanding SUBSCRIBE comes in */
+K_SEM_DEFINE(MqttSubscriptionsAcked, 0, 1);
+
+static MQTT_SUBSCRIPTION_ENTRY_STRUCT subscriptionEntries[MAX_SUBSCRIBE_TOPIC_COUNT];
+static uint32_t subscriptionCount = 0;
+
+/* One SUBSCRIBE at a time, it carries every pending topic */
+static bool isSubscribeOutstanding = false;
+static uint16_t subscribeMessageId = 0;
+static int32_t subscribeResult = 0;
+
+static MQTT_SUBSCRIPTIONS_STATS_STRUCT subscriptionStats;
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to find a registered subscription.
+ *
+ * param[in]        topic: Topic filter.
+ *
+ * @return          Subscription, NULL if not registered.
+ *
+*/
+static MQTT_SUBSCRIPTION_ENTRY_STRUCT *findEntry(const uint8_t *topic)
+{
+    for (uint32_t i = 0; i < subscriptionCount; i++)
+    {
+        if (strcmp(subscriptionEntries[i].topic, topic) == 0)
+        {
+            return &subscriptionEntries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**@brief           Function to move the subscriptions in a state to another state.
+ *
+ * @details         Registry lock must be held by the caller.
+ *
+ * param[in]        from: State to change.
+ * param[in]        to: New state.
+ *
+ * @return          Number of changed subscriptions.
+ *
+*/
+static uint32_t changeState(MQTT_SUBSCRIPTION_STATE from, MQTT_SUBSCRIPTION_STATE to)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < subscriptionCount; i++)
+    {
+        if (subscriptionEntries[i].state == from)
+        {
+            subscriptionEntries[i].state = to;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to register a subscription.
+ *
+ * @details         Topic is kept by reference, it must be a static string. Subscription is
+ *                  sent by the next mqtt_subscriptions_send().
+ *
+ * param[in]        topic: Topic filter.
+ * param[in]        qos: Requested QoS.
+ *
+ * @return          0 if successful, -EINVAL for an unsupported QoS, -ENOMEM if the registry is full.
+ *
+*/
+int32_t mqtt_subscriptions_add(const uint8_t *topic, uint8_t qos)
+{
+    MQTT_SUBSCRIPTION_ENTRY_STRUCT *entry = NULL;
+    int32_t ret = 0;
+
+    if (qos > MQTT_QOS_1_AT_LEAST_ONCE)
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+
+    entry = findEntry(topic);
+    if (entry == NULL)
+    {
+        if (subscriptionCount >= MAX_SUBSCRIBE_TOPIC_COUNT)
+        {
+            ret = -ENOMEM;
+        }
+        else
+        {
+            entry = &subscriptionEntries[subscriptionCount++];
+            entry->topic = topic;
+            entry->qos = qos;
+            entry->state = MQTT_SUBSCRIPTION_PENDING;
+        }
+    }
+    // A new QoS is only granted by a new SUBSCRIBE
+    else if (entry->qos != qos)
+    {
+        entry->qos = qos;
+        entry->state = MQTT_SUBSCRIPTION_PENDING;
+    }
+
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+
+    return ret;
+}
+
+/**@brief           Function to send the pending subscriptions.
+ *
+ * @details         All pending topics go in one SUBSCRIBE packet. Nothing is sent while an
+ *                  earlier SUBSCRIBE waits for its SUBACK or nothing is pending.
+ *
+ * param[in]        None.
+ *
+ * @return          Number of topics sent, 0 if none, negative on error. Topics stay pending
+ *                  if the send fails.
+ *
+*/
+int32_t mqtt_subscriptions_send(void)
+{
+    struct mqtt_topic topics[MAX_SUBSCRIBE_TOPIC_COUNT];
+    struct mqtt_subscription_list subscriptionList = {
+        .list = topics,
+        .list_count = 0,
+    };
+    int32_t ret = 0;
+
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+
+    if (isSubscribeOutstanding)
+    {
+        k_mutex_unlock(&MqttSubscriptionsMutex);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < subscriptionCount; i++)
+    {
+        if (subscriptionEntries[i].state == MQTT_SUBSCRIPTION_PENDING)
+        {
+            topics[subscriptionList.list_count].topic.utf8 = subscriptionEntries[i].topic;
+            topics[subscriptionList.list_count].topic.size = strlen(subscriptionEntries[i].topic);
+            topics[subscriptionList.list_count].qos = subscriptionEntries[i].qos;
+            subscriptionList.list_count++;
+        }
+    }
+
+    if (subscriptionList.list_count == 0)
+    {
+        k_mutex_unlock(&MqttSubscriptionsMutex);
+        return 0;
+    }
+
+    subscriptionList.message_id = mqtt_helper_msg_id_get();
+    subscribeMessageId = subscriptionList.message_id;
+    subscribeResult = 0;
+    isSubscribeOutstanding = true;
+    k_sem_reset(&MqttSubscriptionsAcked);
+    (void)changeState(MQTT_SUBSCRIPTION_PENDING, MQTT_SUBSCRIPTION_REQUESTED);
+
+    ret = mqtt_helper_subscribe(&subscriptionList);
+    if (ret != 0)
+    {
+        printk("Failed to subscribe: %d\n", ret);
+        isSubscribeOutstanding = false;
+        (void)changeState(MQTT_SUBSCRIPTION_REQUESTED, MQTT_SUBSCRIPTION_PENDING);
+    }
+    else
+    {
+        subscriptionStats.subscribePackets++;
+        ret = subscriptionList.list_count;
+        printk("Subscribing to %d topics, message %u\n", ret, subscribeMessageId);
+    }
+
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+
+    return ret;
+}
+
+/**@brief           Function to wait for the SUBACK of the outstanding SUBSCRIBE.
+ *
+ * param[in]        timeout: Max wait.
+ *
+ * @return          0 if every subscription is active, -EAGAIN on timeout, -ECONNRESET if the
+ *                  connection was lost, negative SUBACK result otherwise.
+ *
+*/
+int32_t mqtt_subscriptions_wait(k_timeout_t timeout)
+{
+    int32_t ret = 0;
+
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+    if (!isSubscribeOutstanding)
+    {
+        ret = subscribeResult;
+        k_mutex_unlock(&MqttSubscriptionsMutex);
+        return ret;
+    }
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+
+    if (k_sem_take(&MqttSubscriptionsAcked, timeout) != 0)
+    {
+        return -EAGAIN;
+    }
+
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+    ret = subscribeResult;
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+
+    return ret;
+}
+
+/**@brief           Function to check that every registered subscription is active.
+ *
+ * param[in]        None.
+ *
+ * @return          true if nothing is pending or waiting for a SUBACK.
+ *
+*/
+bool mqtt_subscriptions_is_ready(void)
+{
+    bool isReady = true;
+
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+    for (uint32_t i = 0; i < subscriptionCount; i++)
+    {
+        if (subscriptionEntries[i].state != MQTT_SUBSCRIPTION_ACTIVE)
+        {
+            isReady = false;
+            break;
+        }
+    }
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+
+    return isReady;
+}
+
+/**@brief           Function to get the granted QoS of a subscription.
+ *
+ * param[in]        topic: Topic filter.
+ *
+ * @return          Granted QoS, -ENOENT if not registered, -EAGAIN if not active.
+ *
+*/
+int32_t mqtt_subscriptions_granted_qos(const uint8_t *topic)
+{
+    MQTT_SUBSCRIPTION_ENTRY_STRUCT *entry = NULL;
+    int32_t ret = 0;
+
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+
+    entry = findEntry(topic);
+    if (entry == NULL)
+    {
+        ret = -ENOENT;
+    }
+    else
+    {
+        ret = (entry->state == MQTT_SUBSCRIPTION_ACTIVE) ? entry->grantedQos : -EAGAIN;
+    }
+
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+
+    return ret;
+}
+
+/**@brief           SUBACK handler, called from the MQTT thread.
+ *
+ * @details         MQTT helper reports one result for the whole SUBACK, not the return code
+ *                  of every topic. Requested QoS is taken as granted when it succeeds.
+ *
+ * param[in]        messageId: Acked SUBSCRIBE message id.
+ * param[in]        result: 0 if accepted, negative otherwise.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_subscriptions_on_suback(uint16_t messageId, int32_t result)
+{
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+
+    if (!isSubscribeOutstanding || (messageId != subscribeMessageId))
+    {
+        k_mutex_unlock(&MqttSubscriptionsMutex);
+        return;
+    }
+
+    for (uint32_t i = 0; i < subscriptionCount; i++)
+    {
+        if (subscriptionEntries[i].state != MQTT_SUBSCRIPTION_REQUESTED)
+        {
+            continue;
+        }
+
+        if (result == 0)
+        {
+            subscriptionEntries[i].state = MQTT_SUBSCRIPTION_ACTIVE;
+            subscriptionEntries[i].grantedQos = subscriptionEntries[i].qos;
+            subscriptionStats.topicsSubscribed++;
+        }
+        else
+        {
+            subscriptionEntries[i].state = MQTT_SUBSCRIPTION_PENDING;
+        }
+    }
+
+    if (result != 0)
+    {
+        printk("SUBACK %u failed: %d\n", messageId, result);
+        subscriptionStats.subackFailures++;
+    }
+
+    subscribeResult = (result > 0) ? -result : result;
+    isSubscribeOutstanding = false;
+    k_sem_give(&MqttSubscriptionsAcked);
+
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+}
+
+/**@brief           Function to update the registry on a connection change.
+ *
+ * @details         With session present the broker still has the subscriptions acked in this
+ *                  session, only the others are sent again. Without it every subscription is
+ *                  pending. A lost connection fails the outstanding SUBSCRIBE.
+ *
+ * param[in]        isConnected: Broker accepted the connection, false when disconnected.
+ * param[in]        isSessionPresent: Session present flag of the CONNACK.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_subscriptions_on_connection(bool isConnected, bool isSessionPresent)
+{
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+
+    if (isSubscribeOutstanding)
+    {
+        isSubscribeOutstanding = false;
+        subscribeResult = -ECONNRESET;
+        (void)changeState(MQTT_SUBSCRIPTION_REQUESTED, MQTT_SUBSCRIPTION_PENDING);
+        k_sem_give(&MqttSubscriptionsAcked);
+    }
+
+    if (isConnected)
+    {
+        subscribeResult = 0;
+
+        if (isSessionPresent)
+        {
+            subscriptionStats.sessionsResumed++;
+        }
+        else
+        {
+            (void)changeState(MQTT_SUBSCRIPTION_ACTIVE, MQTT_SUBSCRIPTION_PENDING);
+        }
+    }
+
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+}
+
+/**@brief           Function to mark every subscription pending.
+ *
+ * @details         Used when the device credentials change, the broker session of the old
+ *                  ones is not ours.
+ *
+ * param[in]        None.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_subscriptions_reset(void)
+{
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+    (void)changeState(MQTT_SUBSCRIPTION_ACTIVE, MQTT_SUBSCRIPTION_PENDING);
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+}
+
+/**@brief           Function to get the subscription totals.
+ *
+ * param[in]        stats: Totals to fill.
+ *
+ * @return          None.
+ *
+*/
+void mqtt_subscriptions_get_stats(MQTT_SUBSCRIPTIONS_STATS_STRUCT *stats)
+{
+    k_mutex_lock(&MqttSubscriptionsMutex, K_FOREVER);
+    memcpy(stats, &subscriptionStats, sizeof(subscriptionStats));
+    k_mutex_unlock(&MqttSubscriptionsMutex);
+}
+/* End of file -------------------------------------------------------- */
@@ -0,0 +1,61 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MQTT_SUBSCRIPTIONS_H
+#define __MQTT_SUBSCRIPTIONS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    MQTT_SUBSCRIPTION_PENDING = 0,      // Must be sent in the next SUBSCRIBE
+    MQTT_SUBSCRIPTION_REQUESTED,        // Sent, waiting for the SUBACK
+    MQTT_SUBSCRIPTION_ACTIVE,           // Acked, kept by the broker session
+}MQTT_SUBSCRIPTION_STATE;
+
+/* Subscription totals */
+typedef struct
+{
+    uint32_t subscribePackets;
+    uint32_t topicsSubscribed;
+    uint32_t subackFailures;
+    uint32_t sessionsResumed;       // Connections where the broker kept the subscriptions
+}MQTT_SUBSCRIPTIONS_STATS_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t mqtt_subscriptions_add(const uint8_t *topic, uint8_t qos);
+int32_t mqtt_subscriptions_send(void);
+int32_t mqtt_subscriptions_wait(k_timeout_t timeout);
+bool mqtt_subscriptions_is_ready(void);
+int32_t mqtt_subscriptions_granted_qos(const uint8_t *topic);
+void mqtt_subscriptions_on_suback(uint16_t messageId, int32_t result);
+void mqtt_subscriptions_on_connection(bool isConnected, bool isSessionPresent);
+void mqtt_subscriptions_reset(void);
+void mqtt_subscriptions_get_stats(MQTT_SUBSCRIPTIONS_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MQTT_SUBSCRIPTIONS_H */
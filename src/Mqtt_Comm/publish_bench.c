@@ -0,0 +1,205 @@
+/* Includes ----------------------------------------------------------- */
+#include "publish_bench.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <net/mqtt_helper.h>
+#include "mqtt_comm.h"
+#include "mqtt_inflight.h"
+#include "lte_network.h"
+#include "thingsboard_schema.h"
+
+/* Private defines ---------------------------------------------------- */
+#define PUBLISH_BENCH_TOPIC             SCHEMA_TELEMETRY_SAMPLE_TOPIC
+#define PUBLISH_BENCH_IDLE_TIMEOUT_MS   (120 * 1000)
+#define PUBLISH_BENCH_IDLE_POLL_MS      200
+
+/* Private enumerate/structure ---------------------------------------- */
+typedef enum
+{
+    PUBLISH_BENCH_QOS_0 = 0,        // QoS 0, no PUBACK
+    PUBLISH_BENCH_QOS_1,            // QoS 1, each publish waits for its PUBACK
+    PUBLISH_BENCH_QOS_1_PIPELINED,  // QoS 1, up to the in-flight window before waiting
+}PUBLISH_BENCH_MODE;
+
+typedef struct
+{
+    const char *name;
+    PUBLISH_BENCH_MODE mode;
+}PUBLISH_BENCH_CASE_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+static atomic_t benchDelivered = ATOMIC_INIT(0);
+static atomic_t benchFailed = ATOMIC_INIT(0);
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Delivery result of a pipelined publish.
+ *
+ * param[in]        messageId: Message id.
+ * param[in]        result: 0 if acked, negative otherwise.
+ * param[in]        ctx: Unused.
+ *
+ * @return          None.
+ *
+*/
+static void onBenchPublishDone(uint16_t messageId, int32_t result, void *ctx)
+{
+    ARG_UNUSED(messageId);
+    ARG_UNUSED(ctx);
+
+    atomic_inc((result == 0) ? &benchDelivered : &benchFailed);
+}
+
+/**@brief           Function to wait until the network releases the RRC connection.
+ *
+ * @details         Radio on time of a policy then covers its publishes and the inactivity
+ *                  timer after them, not the tail of the previous policy.
+ *
+ * param[in]        None.
+ *
+ * @return          0 if idle, -ETIMEDOUT otherwise.
+ *
+*/
+static int32_t waitRadioIdle(void)
+{
+    int64_t startTime = k_uptime_get();
+
+    while (lte_network_is_radio_on())
+    {
+        if ((k_uptime_get() - startTime) > PUBLISH_BENCH_IDLE_TIMEOUT_MS)
+        {
+            return -ETIMEDOUT;
+        }
+        k_sleep(K_MSEC(PUBLISH_BENCH_IDLE_POLL_MS));
+    }
+
+    return 0;
+}
+
+/**@brief           Function to publish the benchmark messages with one policy.
+ *
+ * param[in]        benchCase: Publish policy under test.
+ *
+ * @return          0 if every message was delivered, negative otherwise.
+ *
+*/
+static int32_t runCase(const PUBLISH_BENCH_CASE_STRUCT *benchCase)
+{
+    static uint8_t payload[SCHEMA_TELEMETRY_SAMPLE_MAX_LEN + 1];
+    MQTT_PUBLISH_POLICY_STRUCT policy = {
+        .qos = (benchCase->mode == PUBLISH_BENCH_QOS_0) ? MQTT_QOS_0_AT_MOST_ONCE : MQTT_QOS_1_AT_LEAST_ONCE,
+        .isRetained = false,
+    };
+    SCHEMA_TELEMETRY_SAMPLE_STRUCT sample = {0};
+    MQTT_INFLIGHT_STATS_STRUCT startStats;
+    MQTT_INFLIGHT_STATS_STRUCT endStats;
+    uint32_t count = CONFIG_MQTT_PUBLISH_BENCHMARK_COUNT;
+    uint32_t startRadioOnMs = 0;
+    uint32_t radioOnMs = 0;
+    uint32_t publishMs = 0;
+    uint32_t delivered = 0;
+    int64_t startTime = 0;
+    int32_t ret = 0;
+
+    if (waitRadioIdle() < 0)
+    {
+        printk("Publish %s: radio did not go idle, radio on time includes other traffic\n", benchCase->name);
+    }
+
+    atomic_set(&benchDelivered, 0);
+    atomic_set(&benchFailed, 0);
+    mqtt_inflight_get_stats(&startStats);
+    startRadioOnMs = lte_network_radio_on_ms();
+    startTime = k_uptime_get();
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        sample.temperature = (int32_t)i;
+        ret = schema_encode_telemetry_sample(&sample, payload, sizeof(payload));
+        if (ret < 0)
+        {
+            return ret;
+        }
+
+        if (benchCase->mode == PUBLISH_BENCH_QOS_1_PIPELINED)
+        {
+            ret = mqtt_inflight_publish(PUBLISH_BENCH_TOPIC, payload, ret, false, onBenchPublishDone, NULL,
+                                        K_MSEC(MQTT_PUBLISH_TIMEOUT));
+        }
+        else
+        {
+            ret = MqttPublishMessageWithPolicy(PUBLISH_BENCH_TOPIC, payload, &policy);
+            if (ret == 0)
+            {
+                delivered++;
+            }
+        }
+
+        if (ret < 0)
+        {
+            printk("Publish %s: message %u failed: %d\n", benchCase->name, i, ret);
+        }
+    }
+
+    // Pipelined publishes are done when the last PUBACK is in
+    while ((benchCase->mode == PUBLISH_BENCH_QOS_1_PIPELINED) && (mqtt_inflight_count() > 0) &&
+            ((k_uptime_get() - startTime) < MQTT_PUBLISH_TIMEOUT))
+    {
+        k_sleep(K_MSEC(10));
+    }
+    publishMs = (uint32_t)(k_uptime_get() - startTime);
+
+    (void)waitRadioIdle();
+    radioOnMs = lte_network_radio_on_ms() - startRadioOnMs;
+    mqtt_inflight_get_stats(&endStats);
+
+    if (benchCase->mode == PUBLISH_BENCH_QOS_1_PIPELINED)
+    {
+        delivered = atomic_get(&benchDelivered);
+    }
+
+    printk("Publish %-14s %3u/%u sent  %5u ms/msg  %3u PUBACKs  %2u retransmits  radio on %6u ms/msg\n",
+            benchCase->name, delivered, count, publishMs / count, endStats.acked - startStats.acked,
+            endStats.retransmits - startStats.retransmits, radioOnMs / count);
+
+    return (delivered == count) ? 0 : -EIO;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to compare the publish QoS policies.
+ *
+ * @details         Same telemetry samples are published with QoS 0, with QoS 1 waiting for each
+ *                  PUBACK and with pipelined QoS 1. Radio on time is measured from RRC idle to
+ *                  RRC idle around each policy. Broker must be connected.
+ *
+ * param[in]        None.
+ *
+ * @return          0 if successful, negative if a message was not delivered.
+ *
+*/
+int32_t publish_bench_run(void)
+{
+    static const PUBLISH_BENCH_CASE_STRUCT cases[] = {
+        {.name = "QoS 0", .mode = PUBLISH_BENCH_QOS_0},
+        {.name = "QoS 1", .mode = PUBLISH_BENCH_QOS_1},
+        {.name = "QoS 1 pipeline", .mode = PUBLISH_BENCH_QOS_1_PIPELINED},
+    };
+    int32_t ret = 0;
+    int32_t err = 0;
+
+    printk("Publish policy benchmark, %u messages per policy, in-flight window %u\n",
+            CONFIG_MQTT_PUBLISH_BENCHMARK_COUNT, CONFIG_MQTT_INFLIGHT_WINDOW);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(cases); i++)
+    {
+        err = runCase(&cases[i]);
+        ret = (err < 0) ? err : ret;
+    }
+
+    return ret;
+}
+/* End of file -------------------------------------------------------- */
@@ -0,0 +1,264 @@
+/* Includes ----------------------------------------------------------- */
+#include "router_bench.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <stdio.h>
+#include <string.h>
+#include "topic_router.h"
+
+/* Private defines ---------------------------------------------------- */
+#define ROUTER_BENCH_ITERATIONS     1000
+#define ROUTER_BENCH_FILTER_SIZE    48
+
+/* Three routes per device: attributes, RPC requests and everything else */
+#define ROUTER_BENCH_ROUTES_PER_DEVICE  3
+#define ROUTER_BENCH_DEVICES            (CONFIG_TOPIC_ROUTER_MAX_ROUTES / ROUTER_BENCH_ROUTES_PER_DEVICE)
+
+BUILD_ASSERT(ROUTER_BENCH_DEVICES > 0, "Router benchmark needs at least 3 routes");
+
+/* Private enumerate/structure ---------------------------------------- */
+typedef struct
+{
+    const char *name;
+    const uint8_t *topic;
+}ROUTER_BENCH_CASE_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Router keeps the filters by reference */
+static uint8_t benchFilters[ROUTER_BENCH_DEVICES * ROUTER_BENCH_ROUTES_PER_DEVICE][ROUTER_BENCH_FILTER_SIZE];
+static uint32_t benchFilterCount = 0;
+static uint32_t benchCalls = 0;
+
+static uint8_t benchFirstTopic[ROUTER_BENCH_FILTER_SIZE];
+static uint8_t benchLastTopic[ROUTER_BENCH_FILTER_SIZE];
+static uint8_t benchDeepTopic[ROUTER_BENCH_FILTER_SIZE];
+static const uint8_t benchMissTopic[] = "v1/gateway/attributes";
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Handler of every benchmark route.
+ *
+ * param[in]        message: Received message.
+ * param[in]        ctx: Unused.
+ *
+ * @return          None.
+ *
+*/
+static void onBenchMessage(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx)
+{
+    ARG_UNUSED(message);
+    ARG_UNUSED(ctx);
+
+    benchCalls++;
+}
+
+/**@brief           Function to match a topic against a filter, one character at a time.
+ *
+ * param[in]        filter: Topic filter, zero terminated.
+ * param[in]        topic: Topic.
+ * param[in]        length: Topic length.
+ *
+ * @return          true if the topic matches.
+ *
+*/
+static bool matchFilter(const uint8_t *filter, const uint8_t *topic, uint32_t length)
+{
+    uint32_t i = 0;
+
+    if ((length > 0) && (topic[0] == '$') && ((filter[0] == '+') || (filter[0] == '#')))
+    {
+        return false;
+    }
+
+    while (*filter != 0)
+    {
+        if (*filter == '#')
+        {
+            return true;
+        }
+
+        if (*filter == '+')
+        {
+            while ((i < length) && (topic[i] != '/'))
+            {
+                i++;
+            }
+            filter++;
+            continue;
+        }
+
+        if ((i >= length) || (topic[i] != *filter))
+        {
+            // "a/#" also matches "a"
+            return (i == length) && (strcmp(filter, "/#") == 0);
+        }
+        i++;
+        filter++;
+    }
+
+    return (i == length);
+}
+
+/**@brief           Function to dispatch by matching every filter in registration order.
+ *
+ * param[in]        topic: Topic.
+ * param[in]        length: Topic length.
+ *
+ * @return          Number of matching filters.
+ *
+*/
+static int32_t dispatchLinear(const uint8_t *topic, uint32_t length)
+{
+    int32_t called = 0;
+
+    for (uint32_t i = 0; i < benchFilterCount; i++)
+    {
+        if (matchFilter(benchFilters[i], topic, length))
+        {
+            onBenchMessage(NULL, NULL);
+            called++;
+        }
+    }
+
+    return called;
+}
+
+/**@brief           Function to register a benchmark route.
+ *
+ * param[in]        format: Filter format with the device number.
+ * param[in]        device: Device number.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t addRoute(const char *format, uint32_t device)
+{
+    uint8_t *filter = benchFilters[benchFilterCount];
+    int32_t ret = 0;
+
+    snprintf(filter, ROUTER_BENCH_FILTER_SIZE, format, device);
+
+    ret = topic_router_register(filter, onBenchMessage, NULL);
+    if (ret < 0)
+    {
+        printk("Route %s register failed: %d\n", filter, ret);
+        return ret;
+    }
+
+    benchFilterCount++;
+
+    return 0;
+}
+
+/**@brief           Function to time one topic with both dispatchers.
+ *
+ * param[in]        benchCase: Topic under test.
+ *
+ * @return          0 if successful, -EINVAL if the dispatchers disagree.
+ *
+*/
+static int32_t runCase(const ROUTER_BENCH_CASE_STRUCT *benchCase)
+{
+    uint32_t length = strlen(benchCase->topic);
+    uint32_t startCycles = 0;
+    uint64_t routerNs = 0;
+    uint64_t linearNs = 0;
+    int32_t routerCalls = 0;
+    int32_t linearCalls = 0;
+
+    routerCalls = topic_router_dispatch(benchCase->topic, length, NULL, 0);
+    linearCalls = dispatchLinear(benchCase->topic, length);
+    if (routerCalls != linearCalls)
+    {
+        printk("Route %s: router called %d handlers, linear %d\n", benchCase->topic, routerCalls, linearCalls);
+        return -EINVAL;
+    }
+
+    startCycles = k_cycle_get_32();
+    for (uint32_t n = 0; n < ROUTER_BENCH_ITERATIONS; n++)
+    {
+        (void)topic_router_dispatch(benchCase->topic, length, NULL, 0);
+    }
+    routerNs = k_cyc_to_ns_floor64(k_cycle_get_32() - startCycles);
+
+    startCycles = k_cycle_get_32();
+    for (uint32_t n = 0; n < ROUTER_BENCH_ITERATIONS; n++)
+    {
+        (void)dispatchLinear(benchCase->topic, length);
+    }
+    linearNs = k_cyc_to_ns_floor64(k_cycle_get_32() - startCycles);
+
+    printk("Route  %-6s %2d handlers  router %6u ns/dispatch  linear %6u ns/dispatch  %s\n", benchCase->name,
+            routerCalls, (uint32_t)(routerNs / ROUTER_BENCH_ITERATIONS), (uint32_t)(linearNs / ROUTER_BENCH_ITERATIONS),
+            benchCase->topic);
+
+    return 0;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to run the topic router benchmark.
+ *
+ * @details         Registers three ThingsBoard style routes per device up to the route limit,
+ *                  then dispatches a topic of the first device, a topic of the last device, a
+ *                  topic deeper than the max levels and a topic matching nothing. Trie dispatch
+ *                  is compared with matching every filter in turn. Routes are removed at the end.
+ *
+ * param[in]        None.
+ *
+ * @return          0 if successful, negative if a route failed or the dispatchers disagree.
+ *
+*/
+int32_t router_bench_run(void)
+{
+    const ROUTER_BENCH_CASE_STRUCT cases[] = {
+        {.name = "first", .topic = benchFirstTopic},
+        {.name = "last", .topic = benchLastTopic},
+        {.name = "deep", .topic = benchDeepTopic},
+        {.name = "miss", .topic = benchMissTopic},
+    };
+    int32_t ret = 0;
+    int32_t err = 0;
+
+    topic_router_reset();
+    benchFilterCount = 0;
+    benchCalls = 0;
+
+    for (uint32_t device = 0; device < ROUTER_BENCH_DEVICES; device++)
+    {
+        ret = addRoute("v1/devices/dev%03u/attributes", device);
+        if (ret == 0)
+        {
+            ret = addRoute("v1/devices/dev%03u/rpc/request/+", device);
+        }
+        if (ret == 0)
+        {
+            ret = addRoute("v1/devices/dev%03u/#", device);
+        }
+        if (ret < 0)
+        {
+            topic_router_reset();
+            return ret;
+        }
+    }
+
+    snprintf(benchFirstTopic, sizeof(benchFirstTopic), "v1/devices/dev%03u/attributes", 0);
+    snprintf(benchLastTopic, sizeof(benchLastTopic), "v1/devices/dev%03u/rpc/request/42", ROUTER_BENCH_DEVICES - 1);
+    snprintf(benchDeepTopic, sizeof(benchDeepTopic), "v1/devices/dev%03u/a/b/c/d/e/f/g/h", ROUTER_BENCH_DEVICES - 1);
+
+    printk("Topic router benchmark, %u routes, %u runs per case\n", benchFilterCount, ROUTER_BENCH_ITERATIONS);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(cases); i++)
+    {
+        err = runCase(&cases[i]);
+        ret = (err < 0) ? err : ret;
+    }
+
+    topic_router_reset();
+
+    return ret;
+}
+/* End of file -------------------------------------------------------- */
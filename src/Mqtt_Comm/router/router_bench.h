@@ -0,0 +1,28 @@
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ROUTER_BENCH_H
+#define __ROUTER_BENCH_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t router_bench_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ROUTER_BENCH_H */
@@ -0,0 +1,516 @@
+/* Includes ----------------------------------------------------------- */
+#include "topic_router.h"
+#include <zephyr/kernel.h>
+#include <string.h>
+
+/* Private defines ---------------------------------------------------- */
+/* Child lookup table, half full at most */
+#define TOPIC_ROUTER_TABLE_SIZE     (2 * CONFIG_TOPIC_ROUTER_MAX_NODES)
+#define TOPIC_ROUTER_ROOT           0
+#define TOPIC_ROUTER_NONE           (-1)
+
+/* Match walk: every level pushes the exact and the '+' branch at most */
+#define TOPIC_ROUTER_STACK_SIZE     (2 * CONFIG_TOPIC_ROUTER_MAX_LEVELS + 1)
+
+/* Private enumerate/structure ---------------------------------------- */
+/* Filter trie node, one per distinct filter level */
+typedef struct
+{
+    const uint8_t *level;       // Points into the registered filter
+    uint16_t levelLength;
+    uint16_t parent;
+    uint32_t hash;
+    int16_t plusChild;          // '+' level below this node
+    int16_t exactRoutes;        // Routes of filters ending at this node
+    int16_t hashRoutes;         // Routes of filters ending with '#' below this node
+}TOPIC_ROUTER_NODE_STRUCT;
+
+typedef struct
+{
+    TOPIC_ROUTER_HANDLER handler;
+    void *ctx;
+    int16_t next;
+}TOPIC_ROUTER_ROUTE_STRUCT;
+
+/* Pending branch of the match walk */
+typedef struct
+{
+    uint16_t node;
+    uint8_t level;
+    uint32_t plusLevels;        // Bit n set if topic level n matched a '+'
+}TOPIC_ROUTER_BRANCH_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Topic router Mutex to synchronize */
+K_MUTEX_DEFINE(TopicRouterMutex);
+
+static TOPIC_ROUTER_NODE_STRUCT routerNodes[CONFIG_TOPIC_ROUTER_MAX_NODES];
+static TOPIC_ROUTER_ROUTE_STRUCT routerRoutes[CONFIG_TOPIC_ROUTER_MAX_ROUTES];
+static uint16_t routerNodeCount = 0;
+static uint16_t routerRouteCount = 0;
+
+// (parent, level) to child node. 0 is empty, the root is never a child
+static uint16_t routerChildTable[TOPIC_ROUTER_TABLE_SIZE];
+
+BUILD_ASSERT(CONFIG_TOPIC_ROUTER_MAX_LEVELS <= 32, "Wildcard levels are kept in a 32 bit mask");
+BUILD_ASSERT(CONFIG_TOPIC_ROUTER_MAX_NODES <= INT16_MAX, "Nodes are indexed with int16_t");
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to hash a topic level.
+ *
+ * param[in]        level: Level bytes.
+ * param[in]        length: Level length.
+ *
+ * @return          FNV-1a hash.
+ *
+*/
+static uint32_t hashLevel(const uint8_t *level, uint32_t length)
+{
+    uint32_t hash = 2166136261U;
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ level[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+/**@brief           Function to get the first child table slot of a level.
+ *
+ * param[in]        parent: Parent node.
+ * param[in]        hash: Level hash.
+ *
+ * @return          Table slot.
+ *
+*/
+static uint32_t tableSlot(uint16_t parent, uint32_t hash)
+{
+    return (hash ^ (parent * 0x9E3779B1U)) % TOPIC_ROUTER_TABLE_SIZE;
+}
+
+/**@brief           Function to find the child node of a level.
+ *
+ * param[in]        parent: Parent node.
+ * param[in]        hash: Level hash.
+ * param[in]        level: Level bytes.
+ * param[in]        length: Level length.
+ *
+ * @return          Child node, TOPIC_ROUTER_NONE if not found.
+ *
+*/
+static int32_t findChild(uint16_t parent, uint32_t hash, const uint8_t *level, uint32_t length)
+{
+    uint32_t slot = tableSlot(parent, hash);
+    TOPIC_ROUTER_NODE_STRUCT *node = NULL;
+
+    for (uint32_t i = 0; i < TOPIC_ROUTER_TABLE_SIZE; i++)
+    {
+        if (routerChildTable[slot] == 0)
+        {
+            return TOPIC_ROUTER_NONE;
+        }
+
+        node = &routerNodes[routerChildTable[slot]];
+        if ((node->parent == parent) && (node->hash == hash) && (node->levelLength == length) &&
+            (memcmp(node->level, level, length) == 0))
+        {
+            return routerChildTable[slot];
+        }
+
+        slot = (slot + 1) % TOPIC_ROUTER_TABLE_SIZE;
+    }
+
+    return TOPIC_ROUTER_NONE;
+}
+
+/**@brief           Function to add a trie node.
+ *
+ * @details         Node is added to the child table unless it is a '+' level.
+ *
+ * param[in]        parent: Parent node.
+ * param[in]        level: Level bytes, kept by reference.
+ * param[in]        length: Level length.
+ * param[in]        isPlus: Level is '+'.
+ *
+ * @return          New node, -ENOMEM if the node table is full.
+ *
+*/
+static int32_t addNode(uint16_t parent, const uint8_t *level, uint32_t length, bool isPlus)
+{
+    TOPIC_ROUTER_NODE_STRUCT *node = NULL;
+    uint16_t index = routerNodeCount;
+    uint32_t slot = 0;
+
+    if (index >= CONFIG_TOPIC_ROUTER_MAX_NODES)
+    {
+        return -ENOMEM;
+    }
+
+    node = &routerNodes[index];
+    node->level = level;
+    node->levelLength = length;
+    node->parent = parent;
+    node->hash = hashLevel(level, length);
+    node->plusChild = TOPIC_ROUTER_NONE;
+    node->exactRoutes = TOPIC_ROUTER_NONE;
+    node->hashRoutes = TOPIC_ROUTER_NONE;
+    routerNodeCount++;
+
+    if (isPlus)
+    {
+        routerNodes[parent].plusChild = index;
+        return index;
+    }
+
+    // Table has twice the node count, a free slot is always found
+    slot = tableSlot(parent, node->hash);
+    while (routerChildTable[slot] != 0)
+    {
+        slot = (slot + 1) % TOPIC_ROUTER_TABLE_SIZE;
+    }
+    routerChildTable[slot] = index;
+
+    return index;
+}
+
+/**@brief           Function to append a route to a route list.
+ *
+ * param[in]        list: Head of the list.
+ * param[in]        route: Route to append.
+ *
+ * @return          None.
+ *
+*/
+static void appendRoute(int16_t *list, int16_t route)
+{
+    while (*list != TOPIC_ROUTER_NONE)
+    {
+        list = &routerRoutes[*list].next;
+    }
+
+    *list = route;
+}
+
+/**@brief           Function to call the handlers of a route list.
+ *
+ * param[in]        route: Head of the list.
+ * param[in]        message: Message with the topic and payload.
+ * param[in]        levels: Topic levels.
+ * param[in]        plusLevels: Topic levels matched by '+'.
+ * param[in]        rest: Topic levels matched by '#', NULL if none.
+ *
+ * @return          Number of handlers called.
+ *
+*/
+static int32_t callRoutes(int16_t route, TOPIC_ROUTER_MESSAGE_STRUCT *message, const TOPIC_ROUTER_LEVEL_STRUCT *levels,
+                            uint32_t plusLevels, const TOPIC_ROUTER_LEVEL_STRUCT *rest)
+{
+    int32_t called = 0;
+
+    message->wildcardCount = 0;
+    for (uint32_t i = 0; plusLevels != 0; i++, plusLevels >>= 1)
+    {
+        if ((plusLevels & 1) != 0)
+        {
+            message->wildcards[message->wildcardCount++] = levels[i];
+        }
+    }
+
+    if (rest != NULL)
+    {
+        message->wildcards[message->wildcardCount++] = *rest;
+    }
+
+    for (; route != TOPIC_ROUTER_NONE; route = routerRoutes[route].next)
+    {
+        routerRoutes[route].handler(message, routerRoutes[route].ctx);
+        called++;
+    }
+
+    return called;
+}
+
+/**@brief           Function to empty the router.
+ *
+ * @details         Router lock must be held by the caller.
+ *
+ * param[in]        None.
+ *
+ * @return          None.
+ *
+*/
+static void resetRouter(void)
+{
+    memset(routerChildTable, 0, sizeof(routerChildTable));
+    routerRouteCount = 0;
+    routerNodeCount = 0;
+
+    (void)addNode(TOPIC_ROUTER_ROOT, "", 0, true);
+    routerNodes[TOPIC_ROUTER_ROOT].plusChild = TOPIC_ROUTER_NONE;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to register a handler for a topic filter.
+ *
+ * @details         Filter is an MQTT topic filter: exact levels, '+' for one level and a last
+ *                  '#' for any number of levels, including none. Filter levels are kept by
+ *                  reference, the filter must be a static string. Several handlers can be
+ *                  registered for the same filter, they are called in registration order.
+ *
+ * param[in]        filter: Topic filter.
+ * param[in]        handler: Called for every received message matching the filter.
+ * param[in]        ctx: Passed to the handler.
+ *
+ * @return          Route id, -EINVAL for a malformed filter, -ENOMEM if the tables are full.
+ *
+*/
+int32_t topic_router_register(const uint8_t *filter, TOPIC_ROUTER_HANDLER handler, void *ctx)
+{
+    const uint8_t *level = filter;
+    const uint8_t *end = NULL;
+    int16_t *routes = NULL;
+    uint32_t length = 0;
+    uint32_t levelCount = 0;
+    int32_t node = TOPIC_ROUTER_ROOT;
+    int32_t route = 0;
+    bool isPlus = false;
+
+    if ((filter == NULL) || (filter[0] == 0) || (handler == NULL))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&TopicRouterMutex, K_FOREVER);
+
+    if (routerNodeCount == 0)
+    {
+        resetRouter();
+    }
+
+    while (routes == NULL)
+    {
+        end = strchr(level, '/');
+        length = (end != NULL) ? (uint32_t)(end - level) : strlen(level);
+
+        if ((length == 1) && (level[0] == '#'))
+        {
+            // '#' must be the last level
+            if (end != NULL)
+            {
+                route = -EINVAL;
+                break;
+            }
+            routes = &routerNodes[node].hashRoutes;
+            break;
+        }
+
+        isPlus = (length == 1) && (level[0] == '+');
+        if ((!isPlus && ((memchr(level, '+', length) != NULL) || (memchr(level, '#', length) != NULL))) ||
+            (levelCount >= CONFIG_TOPIC_ROUTER_MAX_LEVELS))
+        {
+            route = -EINVAL;
+            break;
+        }
+
+        if (isPlus)
+        {
+            if (routerNodes[node].plusChild == TOPIC_ROUTER_NONE)
+            {
+                node = addNode(node, level, length, true);
+            }
+            else
+            {
+                node = routerNodes[node].plusChild;
+            }
+        }
+        else
+        {
+            route = findChild(node, hashLevel(level, length), level, length);
+            node = (route >= 0) ? route : addNode(node, level, length, false);
+        }
+
+        if (node < 0)
+        {
+            route = node;
+            break;
+        }
+        levelCount++;
+
+        if (end == NULL)
+        {
+            routes = &routerNodes[node].exactRoutes;
+        }
+        else
+        {
+            level = end + 1;
+        }
+    }
+
+    if (routes != NULL)
+    {
+        if (routerRouteCount >= CONFIG_TOPIC_ROUTER_MAX_ROUTES)
+        {
+            route = -ENOMEM;
+        }
+        else
+        {
+            route = routerRouteCount++;
+            routerRoutes[route].handler = handler;
+            routerRoutes[route].ctx = ctx;
+            routerRoutes[route].next = TOPIC_ROUTER_NONE;
+            appendRoute(routes, route);
+        }
+    }
+
+    k_mutex_unlock(&TopicRouterMutex);
+
+    return route;
+}
+
+/**@brief           Function to call the handlers of a received message.
+ *
+ * @details         Topic is split and its levels hashed in one pass, then the filter trie is
+ *                  walked one hash lookup per level. Only '+' levels add a branch. Wildcards do
+ *                  not match topics starting with '$' at the first level. Handlers run in the
+ *                  calling thread.
+ *
+ * param[in]        topic: Received topic, zero termination not needed.
+ * param[in]        topicLength: Topic length.
+ * param[in]        payload: Received payload.
+ * param[in]        payloadLength: Payload length.
+ *
+ * @return          Number of handlers called, -EINVAL for an empty topic.
+ *
+*/
+int32_t topic_router_dispatch(const uint8_t *topic, uint32_t topicLength, const uint8_t *payload, uint32_t payloadLength)
+{
+    TOPIC_ROUTER_LEVEL_STRUCT levels[CONFIG_TOPIC_ROUTER_MAX_LEVELS + 1];
+    uint32_t hashes[CONFIG_TOPIC_ROUTER_MAX_LEVELS];
+    TOPIC_ROUTER_BRANCH_STRUCT stack[TOPIC_ROUTER_STACK_SIZE];
+    TOPIC_ROUTER_MESSAGE_STRUCT message;
+    TOPIC_ROUTER_LEVEL_STRUCT rest;
+    TOPIC_ROUTER_BRANCH_STRUCT branch;
+    TOPIC_ROUTER_NODE_STRUCT *node = NULL;
+    uint32_t levelCount = 0;
+    uint32_t hash = 2166136261U;
+    uint32_t start = 0;
+    uint32_t depth = 0;
+    int32_t child = 0;
+    int32_t called = 0;
+    bool isSystem = false;
+
+    if ((topic == NULL) || (topicLength == 0))
+    {
+        return -EINVAL;
+    }
+
+    // Split and hash. Levels past the max can only match a '#'
+    for (uint32_t i = 0; i <= topicLength; i++)
+    {
+        if ((i < topicLength) && (topic[i] != '/'))
+        {
+            hash = (hash ^ topic[i]) * 16777619U;
+            continue;
+        }
+
+        if (levelCount < CONFIG_TOPIC_ROUTER_MAX_LEVELS)
+        {
+            levels[levelCount].ptr = &topic[start];
+            levels[levelCount].length = i - start;
+            hashes[levelCount] = hash;
+        }
+        else if (levelCount == CONFIG_TOPIC_ROUTER_MAX_LEVELS)
+        {
+            levels[levelCount].ptr = &topic[start];
+            levels[levelCount].length = topicLength - start;
+        }
+        levelCount++;
+        hash = 2166136261U;
+        start = i + 1;
+    }
+
+    isSystem = (topic[0] == '$');
+
+    message.topic = topic;
+    message.topicLength = topicLength;
+    message.payload = payload;
+    message.payloadLength = payloadLength;
+
+    k_mutex_lock(&TopicRouterMutex, K_FOREVER);
+
+    if (routerNodeCount > 0)
+    {
+        stack[depth++] = (TOPIC_ROUTER_BRANCH_STRUCT){.node = TOPIC_ROUTER_ROOT, .level = 0, .plusLevels = 0};
+    }
+
+    while (depth > 0)
+    {
+        branch = stack[--depth];
+        node = &routerNodes[branch.node];
+        bool isWildcardAllowed = !(isSystem && (branch.level == 0));
+
+        if ((node->hashRoutes != TOPIC_ROUTER_NONE) && isWildcardAllowed)
+        {
+            if (branch.level < levelCount)
+            {
+                rest.ptr = levels[branch.level].ptr;
+                rest.length = topicLength - (rest.ptr - topic);
+            }
+            else
+            {
+                rest.ptr = &topic[topicLength];
+                rest.length = 0;
+            }
+            called += callRoutes(node->hashRoutes, &message, levels, branch.plusLevels, &rest);
+        }
+
+        if (branch.level == levelCount)
+        {
+            called += callRoutes(node->exactRoutes, &message, levels, branch.plusLevels, NULL);
+            continue;
+        }
+
+        if (branch.level >= CONFIG_TOPIC_ROUTER_MAX_LEVELS)
+        {
+            continue;
+        }
+
+        if ((node->plusChild != TOPIC_ROUTER_NONE) && isWildcardAllowed)
+        {
+            stack[depth++] = (TOPIC_ROUTER_BRANCH_STRUCT){.node = node->plusChild, .level = branch.level + 1,
+                                                            .plusLevels = branch.plusLevels | (1UL << branch.level)};
+        }
+
+        child = findChild(branch.node, hashes[branch.level], levels[branch.level].ptr, levels[branch.level].length);
+        if (child != TOPIC_ROUTER_NONE)
+        {
+            stack[depth++] = (TOPIC_ROUTER_BRANCH_STRUCT){.node = child, .level = branch.level + 1,
+                                                            .plusLevels = branch.plusLevels};
+        }
+    }
+
+    k_mutex_unlock(&TopicRouterMutex);
+
+    return called;
+}
+
+/**@brief           Function to remove all routes.
+ *
+ * param[in]        None.
+ *
+ * @return          None.
+ *
+*/
+void topic_router_reset(void)
+{
+    k_mutex_lock(&TopicRouterMutex, K_FOREVER);
+    resetRouter();
+    k_mutex_unlock(&TopicRouterMutex);
+}
+/* End of file -------------------------------------------------------- */
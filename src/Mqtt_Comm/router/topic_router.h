@@ -0,0 +1,59 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TOPIC_ROUTER_H
+#define __TOPIC_ROUTER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* Part of the received topic */
+typedef struct
+{
+    const uint8_t *ptr;
+    uint32_t length;
+}TOPIC_ROUTER_LEVEL_STRUCT;
+
+/* Received message passed to a handler. Valid during the handler call only */
+typedef struct
+{
+    const uint8_t *topic;
+    uint32_t topicLength;
+    const uint8_t *payload;
+    uint32_t payloadLength;
+    uint8_t wildcardCount;
+    // Topic levels matched by '+' in filter order, then the rest matched by '#'
+    TOPIC_ROUTER_LEVEL_STRUCT wildcards[CONFIG_TOPIC_ROUTER_MAX_LEVELS + 1];
+}TOPIC_ROUTER_MESSAGE_STRUCT;
+
+typedef void (*TOPIC_ROUTER_HANDLER)(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx);
+
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t topic_router_register(const uint8_t *filter, TOPIC_ROUTER_HANDLER handler, void *ctx);
+int32_t topic_router_dispatch(const uint8_t *topic, uint32_t topicLength, const uint8_t *payload, uint32_t payloadLength);
+void topic_router_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TOPIC_ROUTER_H */
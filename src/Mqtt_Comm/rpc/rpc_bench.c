@@ -0,0 +1,252 @@
+/* Includes ----------------------------------------------------------- */
+#include "rpc_bench.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rpc_server.h"
+#include "topic_router.h"
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+#include "pb_writer.h"
+#endif
+
+/* Private defines ---------------------------------------------------- */
+#define RPC_BENCH_TOPIC_SIZE        64
+#define RPC_BENCH_RESPONSE_TIMEOUT  1000
+/* Nearest rank of the 99th percentile in the sorted latencies, below the max from 100 requests on */
+#define RPC_BENCH_P99_INDEX         (((CONFIG_RPC_BENCHMARK_COUNT * 99) + 99) / 100 - 1)
+
+/* Private enumerate/structure ---------------------------------------- */
+typedef struct
+{
+    const char *name;
+    const uint8_t *method;
+    const uint8_t *params;      // JSON text
+}RPC_BENCH_CASE_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Given by the broker stand-in when a response comes out */
+K_SEM_DEFINE(RpcBenchResponse, 0, 1);
+
+static uint8_t benchRequestTopic[RPC_BENCH_TOPIC_SIZE];
+static uint8_t benchExpectedTopic[RPC_BENCH_TOPIC_SIZE];
+static uint8_t benchRequest[CONFIG_RPC_REQUEST_MAX_LEN];
+static uint32_t benchResponseCycles = 0;
+static bool isBenchTopicValid = false;
+static uint32_t benchLatencyUs[CONFIG_RPC_BENCHMARK_COUNT];
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Broker stand-in, takes the responses instead of the MQTT client.
+ *
+ * param[in]        topic: Response topic.
+ * param[in]        payload: Response.
+ * param[in]        length: Response length.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onBenchResponse(uint8_t *topic, const uint8_t *payload, uint32_t length)
+{
+    ARG_UNUSED(payload);
+    ARG_UNUSED(length);
+
+    benchResponseCycles = k_cycle_get_32();
+    isBenchTopicValid = (strcmp(topic, benchExpectedTopic) == 0);
+    k_sem_give(&RpcBenchResponse);
+
+    return 0;
+}
+
+/**@brief           Benchmark method, answers with its params.
+ *
+ * param[in]        request: Request.
+ * param[in]        response: Response writer.
+ * param[in]        ctx: Unused.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onEchoMethod(const RPC_SERVER_REQUEST_STRUCT *request, JSON_WRITER_STRUCT *response, void *ctx)
+{
+    ARG_UNUSED(ctx);
+
+    json_writer_object_start(response);
+    json_writer_key(response, "params");
+    json_writer_uint(response, request->params.length);
+    json_writer_object_end(response);
+
+    return 0;
+}
+
+/**@brief           Function to encode a request as the server sends it.
+ *
+ * param[in]        benchCase: Method and params.
+ * param[in]        requestId: Request id.
+ *
+ * @return          Request length, negative if it does not fit.
+ *
+*/
+static int32_t encodeRequest(const RPC_BENCH_CASE_STRUCT *benchCase, uint32_t requestId)
+{
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    PB_WRITER_STRUCT writer;
+
+    pb_writer_init(&writer, benchRequest, sizeof(benchRequest));
+    pb_writer_string(&writer, 1, benchCase->method, CONFIG_RPC_METHOD_MAX_LEN);
+    pb_writer_int(&writer, 2, requestId);
+    pb_writer_string(&writer, 3, benchCase->params, CONFIG_RPC_REQUEST_MAX_LEN);
+
+    return pb_writer_finish(&writer);
+#else
+    int32_t length = snprintf(benchRequest, sizeof(benchRequest), "{\"method\":\"%s\",\"params\":%s}",
+                                benchCase->method, benchCase->params);
+
+    ARG_UNUSED(requestId);
+
+    return (length < (int32_t)sizeof(benchRequest)) ? length : -ENOMEM;
+#endif
+}
+
+/**@brief           Function to compare two latencies for qsort.
+ *
+ * param[in]        a: First latency.
+ * param[in]        b: Second latency.
+ *
+ * @return          Order of a and b.
+ *
+*/
+static int compareLatency(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**@brief           Function to time the requests of one case.
+ *
+ * @details         Every request goes through the topic router, the RPC queue, the RPC thread
+ *                  and the response encoder, and is answered before the next one is sent.
+ *
+ * param[in]        benchCase: Method under test.
+ *
+ * @return          0 if successful, -ETIMEDOUT if a response did not come, -EINVAL if it came on
+ *                  the wrong topic.
+ *
+*/
+static int32_t runCase(const RPC_BENCH_CASE_STRUCT *benchCase)
+{
+    uint64_t totalUs = 0;
+    uint32_t startCycles = 0;
+    int32_t length = 0;
+
+    for (uint32_t n = 0; n < CONFIG_RPC_BENCHMARK_COUNT; n++)
+    {
+        snprintf(benchRequestTopic, sizeof(benchRequestTopic), "v1/devices/me/rpc/request/%u", n);
+        snprintf(benchExpectedTopic, sizeof(benchExpectedTopic), "%s%u", RPC_SERVER_RESPONSE_TOPIC_PREFIX, n);
+
+        length = encodeRequest(benchCase, n);
+        if (length < 0)
+        {
+            return length;
+        }
+
+        k_sem_reset(&RpcBenchResponse);
+        startCycles = k_cycle_get_32();
+        (void)topic_router_dispatch(benchRequestTopic, strlen(benchRequestTopic), benchRequest, length);
+
+        if (k_sem_take(&RpcBenchResponse, K_MSEC(RPC_BENCH_RESPONSE_TIMEOUT)) != 0)
+        {
+            printk("RPC %s: no response to request %u\n", benchCase->name, n);
+            return -ETIMEDOUT;
+        }
+
+        if (!isBenchTopicValid)
+        {
+            printk("RPC %s: response %u on the wrong topic\n", benchCase->name, n);
+            return -EINVAL;
+        }
+
+        benchLatencyUs[n] = k_cyc_to_us_floor32(benchResponseCycles - startCycles);
+        totalUs += benchLatencyUs[n];
+    }
+
+    qsort(benchLatencyUs, CONFIG_RPC_BENCHMARK_COUNT, sizeof(benchLatencyUs[0]), compareLatency);
+
+    printk("RPC  %-7s request %3d B  min %5u us  avg %5u us  p99 %5u us  max %5u us\n", benchCase->name, length,
+            benchLatencyUs[0], (uint32_t)(totalUs / CONFIG_RPC_BENCHMARK_COUNT),
+            benchLatencyUs[RPC_BENCH_P99_INDEX], benchLatencyUs[CONFIG_RPC_BENCHMARK_COUNT - 1]);
+
+    return 0;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to run the RPC latency benchmark.
+ *
+ * @details         Local broker stand-in: requests are dispatched as the MQTT helper does
+ *                  with a received message and responses are taken from the RPC publish
+ *                  function. Measures request received to response ready for the socket, the
+ *                  device side of the command round trip. Methods and the route are removed at
+ *                  the end, the publish function is left to the next rpc_server_init().
+ *
+ * param[in]        None.
+ *
+ * @return          0 if successful, negative if a request was not answered.
+ *
+*/
+int32_t rpc_bench_run(void)
+{
+    const RPC_BENCH_CASE_STRUCT cases[] = {
+        {.name = "empty", .method = "echo", .params = "{}"},
+        {.name = "params", .method = "echo",
+            .params = "{\"pin\":23,\"value\":true,\"label\":\"relay\",\"delayMs\":1500,\"mode\":\"pulse\"}"},
+        {.name = "unknown", .method = "reboot", .params = "null"},
+    };
+    RPC_SERVER_STATS_STRUCT stats;
+    int32_t ret = 0;
+    int32_t err = 0;
+
+    topic_router_reset();
+    rpc_server_reset();
+
+    ret = rpc_server_init(onBenchResponse);
+    if (ret == 0)
+    {
+        ret = rpc_server_register("echo", onEchoMethod, NULL);
+    }
+    if (ret == 0)
+    {
+        ret = topic_router_register(RPC_SERVER_REQUEST_TOPIC, rpc_server_on_request, NULL);
+    }
+    if (ret < 0)
+    {
+        printk("RPC benchmark setup failed: %d\n", ret);
+        topic_router_reset();
+        rpc_server_reset();
+        return ret;
+    }
+
+    printk("RPC benchmark, %u requests per case\n", CONFIG_RPC_BENCHMARK_COUNT);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(cases); i++)
+    {
+        err = runCase(&cases[i]);
+        ret = (err < 0) ? err : ret;
+    }
+
+    rpc_server_get_stats(&stats);
+    printk("RPC  received %u  responded %u  unknown %u  failed %u  dropped %u\n", stats.received, stats.responded,
+            stats.unknownMethods, stats.failed, stats.dropped);
+
+    topic_router_reset();
+    rpc_server_reset();
+
+    return ret;
+}
+/* End of file -------------------------------------------------------- */
@@ -0,0 +1,514 @@
+/* Includes ----------------------------------------------------------- */
+#include "rpc_server.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+#include "thingsboard_pb.h"
+#endif
+
+/* Private defines ---------------------------------------------------- */
+#define RPC_SERVER_TOPIC_SIZE   (sizeof(RPC_SERVER_RESPONSE_TOPIC_PREFIX) + RPC_SERVER_ID_MAX_LEN)
+
+/* Private enumerate/structure ---------------------------------------- */
+/* Registered method */
+typedef struct
+{
+    const uint8_t *method;
+    RPC_SERVER_HANDLER handler;
+    void *ctx;
+}RPC_SERVER_METHOD_STRUCT;
+
+/* Received request, copied out of the MQTT helper buffer */
+typedef struct
+{
+    struct k_work work;
+    uint8_t requestId[RPC_SERVER_ID_MAX_LEN + 1];
+    uint8_t payload[CONFIG_RPC_REQUEST_MAX_LEN];
+    uint32_t length;
+    uint32_t receiveCycles;
+}RPC_SERVER_SLOT_STRUCT;
+
+/* Request members found by the JSON parse */
+typedef struct
+{
+    JSON_READER_VALUE_STRUCT method;
+    JSON_READER_VALUE_STRUCT params;
+}RPC_SERVER_JSON_REQUEST_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Method registry and stats Mutex to synchronize */
+K_MUTEX_DEFINE(RpcServerMutex);
+K_MEM_SLAB_DEFINE_STATIC(rpcRequestSlab, sizeof(RPC_SERVER_SLOT_STRUCT), CONFIG_RPC_QUEUE_DEPTH, 4);
+static K_THREAD_STACK_DEFINE(rpc_server_stack_area, CONFIG_RPC_STACK_SIZE);
+
+static struct k_work_q rpcServerQueue;
+static bool isServerStarted = false;
+static RPC_SERVER_PUBLISH publishResponse = NULL;
+
+static RPC_SERVER_METHOD_STRUCT methods[CONFIG_RPC_MAX_METHODS];
+static uint32_t methodCount = 0;
+
+static RPC_SERVER_STATS_STRUCT serverStats;
+
+/* Used by the RPC thread only */
+static uint8_t methodName[CONFIG_RPC_METHOD_MAX_LEN + 1];
+static uint8_t responseTopic[RPC_SERVER_TOPIC_SIZE];
+static uint8_t responseJson[CONFIG_RPC_RESPONSE_MAX_LEN + 1];
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+static uint8_t responsePayload[CONFIG_RPC_RESPONSE_MAX_LEN + PB_VARINT_MAX_LEN + 1];
+#endif
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+/**@brief           Function to type the params JSON text of a protobuf request.
+ *
+ * param[in]        text: Params text.
+ * param[in]        length: Text length.
+ * param[in]        value: Params value, as json_reader gives it.
+ *
+ * @return          None.
+ *
+*/
+static void setParamsValue(const uint8_t *text, uint32_t length, JSON_READER_VALUE_STRUCT *value)
+{
+    value->start = text;
+    value->length = length;
+
+    if (length == 0)
+    {
+        value->type = JSON_READER_TYPE_NULL;
+        return;
+    }
+
+    switch (text[0])
+    {
+        case '{':
+            value->type = JSON_READER_TYPE_OBJECT;
+            break;
+
+        case '[':
+            value->type = JSON_READER_TYPE_ARRAY;
+            break;
+
+        case '"':
+            // String content without the quotes
+            value->type = JSON_READER_TYPE_STRING;
+            value->start = text + 1;
+            value->length = (length >= 2) ? (length - 2) : 0;
+            break;
+
+        case 't':
+        case 'f':
+            value->type = JSON_READER_TYPE_BOOL;
+            break;
+
+        case 'n':
+            value->type = JSON_READER_TYPE_NULL;
+            break;
+
+        default:
+            value->type = JSON_READER_TYPE_NUMBER;
+            break;
+    }
+}
+#else
+/**@brief           Handler of the request method.
+ *
+ * param[in]        value: Method value.
+ * param[in]        ctx: Request members.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onRequestMethod(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    RPC_SERVER_JSON_REQUEST_STRUCT *members = ctx;
+
+    members->method = *value;
+
+    return 0;
+}
+
+/**@brief           Handler of the request params.
+ *
+ * param[in]        value: Params value.
+ * param[in]        ctx: Request members.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onRequestParams(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    RPC_SERVER_JSON_REQUEST_STRUCT *members = ctx;
+
+    members->params = *value;
+
+    return 0;
+}
+#endif
+
+/**@brief           Function to parse a request payload.
+ *
+ * @details         JSON {"method":...,"params":...}, or RpcRequestMsg in the protobuf mode.
+ *
+ * param[in]        slot: Received request.
+ * param[in]        request: Method and params, the method is copied to methodName.
+ *
+ * @return          0 if successful, negative if not valid or the method name is too long.
+ *
+*/
+static int32_t parseRequest(const RPC_SERVER_SLOT_STRUCT *slot, RPC_SERVER_REQUEST_STRUCT *request)
+{
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    TB_PB_RPC_REQUEST_STRUCT message;
+    int32_t ret = 0;
+
+    ret = tb_pb_parse_rpc_request(slot->payload, slot->length, &message);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    if (message.methodLength >= sizeof(methodName))
+    {
+        return -ENOMEM;
+    }
+
+    memcpy(methodName, message.method, message.methodLength);
+    methodName[message.methodLength] = 0;
+    setParamsValue(message.params, message.paramsLength, &request->params);
+#else
+    static const JSON_READER_KEY_STRUCT keys[] = {
+        {.key = "method", .handler = onRequestMethod},
+        {.key = "params", .handler = onRequestParams},
+    };
+    RPC_SERVER_JSON_REQUEST_STRUCT members = {
+        .method.type = JSON_READER_TYPE_NULL,
+        .params.type = JSON_READER_TYPE_NULL,
+    };
+    int32_t ret = 0;
+
+    ret = json_reader_parse_object(slot->payload, slot->length, keys, ARRAY_SIZE(keys), &members);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ret = json_reader_get_string(&members.method, methodName, sizeof(methodName));
+    if (ret <= 0)
+    {
+        return (ret < 0) ? ret : -EINVAL;
+    }
+
+    request->params = members.params;
+#endif
+
+    request->method = methodName;
+
+    return 0;
+}
+
+/**@brief           Function to find a registered method.
+ *
+ * param[in]        method: Method name.
+ * param[in]        entry: Copy of the registered method.
+ *
+ * @return          0 if found, -ENOENT otherwise.
+ *
+*/
+static int32_t findMethod(const uint8_t *method, RPC_SERVER_METHOD_STRUCT *entry)
+{
+    int32_t ret = -ENOENT;
+
+    k_mutex_lock(&RpcServerMutex, K_FOREVER);
+
+    for (uint32_t i = 0; i < methodCount; i++)
+    {
+        if (strcmp(methods[i].method, method) == 0)
+        {
+            *entry = methods[i];
+            ret = 0;
+            break;
+        }
+    }
+
+    k_mutex_unlock(&RpcServerMutex);
+
+    return ret;
+}
+
+/**@brief           Function to serve one request.
+ *
+ * @details         Runs in the RPC thread. Slot goes back to the pool before the response is
+ *                  published, so the next request can be queued meanwhile.
+ *
+ * param[in]        work: Work item of the request.
+ *
+ * @return          None.
+ *
+*/
+static void requestWorkHandler(struct k_work *work)
+{
+    RPC_SERVER_SLOT_STRUCT *slot = CONTAINER_OF(work, RPC_SERVER_SLOT_STRUCT, work);
+    RPC_SERVER_REQUEST_STRUCT request = {.requestId = slot->requestId};
+    RPC_SERVER_METHOD_STRUCT entry;
+    JSON_WRITER_STRUCT writer;
+    const uint8_t *payload = responseJson;
+    uint32_t receiveCycles = slot->receiveCycles;
+    uint32_t latencyUs = 0;
+    bool isUnknown = false;
+    int32_t length = 0;
+    int32_t ret = 0;
+
+    ret = parseRequest(slot, &request);
+    if ((ret >= 0) && (findMethod(request.method, &entry) < 0))
+    {
+        ret = -ENOENT;
+        isUnknown = true;
+        printk("Unknown RPC method %s\n", request.method);
+    }
+
+    json_writer_init(&writer, responseJson, sizeof(responseJson));
+    if (ret >= 0)
+    {
+        ret = entry.handler(&request, &writer, entry.ctx);
+    }
+    if (ret >= 0)
+    {
+        ret = json_writer_finish(&writer);
+    }
+
+    if (ret < 0)
+    {
+        json_writer_init(&writer, responseJson, sizeof(responseJson));
+        json_writer_object_start(&writer);
+        json_writer_key(&writer, "error");
+        json_writer_int(&writer, ret);
+        json_writer_object_end(&writer);
+        (void)json_writer_finish(&writer);
+    }
+
+    snprintf(responseTopic, sizeof(responseTopic), "%s%s", RPC_SERVER_RESPONSE_TOPIC_PREFIX, slot->requestId);
+    k_mem_slab_free(&rpcRequestSlab, (void *)slot);
+
+    length = writer.length;
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    length = tb_pb_encode_rpc_response(responseJson, CONFIG_RPC_RESPONSE_MAX_LEN, responsePayload,
+                                        sizeof(responsePayload));
+    payload = responsePayload;
+#endif
+
+    if ((length >= 0) && (publishResponse != NULL))
+    {
+        length = publishResponse(responseTopic, payload, length);
+    }
+
+    latencyUs = k_cyc_to_us_floor32(k_cycle_get_32() - receiveCycles);
+
+    k_mutex_lock(&RpcServerMutex, K_FOREVER);
+    if (isUnknown)
+    {
+        serverStats.unknownMethods++;
+    }
+    else if (ret < 0)
+    {
+        serverStats.failed++;
+    }
+
+    if (length >= 0)
+    {
+        serverStats.responded++;
+        serverStats.totalLatencyUs += latencyUs;
+        if (latencyUs > serverStats.maxLatencyUs)
+        {
+            serverStats.maxLatencyUs = latencyUs;
+        }
+    }
+    k_mutex_unlock(&RpcServerMutex);
+
+    if (length < 0)
+    {
+        printk("Failed to send RPC %s response: %d\n", responseTopic, length);
+    }
+}
+
+/**@brief           Function to count a dropped request.
+ *
+ * param[in]        reason: Why it was dropped.
+ *
+ * @return          None.
+ *
+*/
+static void dropRequest(const char *reason)
+{
+    k_mutex_lock(&RpcServerMutex, K_FOREVER);
+    serverStats.dropped++;
+    k_mutex_unlock(&RpcServerMutex);
+
+    printk("RPC request dropped: %s\n", reason);
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to start the RPC thread.
+ *
+ * @details         Later calls only replace the publish function.
+ *
+ * param[in]        publish: Sends a response.
+ *
+ * @return          0.
+ *
+*/
+int32_t rpc_server_init(RPC_SERVER_PUBLISH publish)
+{
+    struct k_work_queue_config config = {.name = "rpc_server"};
+
+    publishResponse = publish;
+
+    if (isServerStarted)
+    {
+        return 0;
+    }
+
+    k_work_queue_init(&rpcServerQueue);
+    k_work_queue_start(&rpcServerQueue, rpc_server_stack_area, K_THREAD_STACK_SIZEOF(rpc_server_stack_area),
+                        CONFIG_RPC_PRIORITY, &config);
+    isServerStarted = true;
+
+    return 0;
+}
+
+/**@brief           Function to register a method.
+ *
+ * @details         Method name is kept by reference, it must be a static string.
+ *
+ * param[in]        method: Method name.
+ * param[in]        handler: Handler, runs in the RPC thread.
+ * param[in]        ctx: Passed to the handler.
+ *
+ * @return          0 if successful, -EINVAL if the name is too long, -EALREADY if registered,
+ *                  -ENOMEM if the registry is full.
+ *
+*/
+int32_t rpc_server_register(const uint8_t *method, RPC_SERVER_HANDLER handler, void *ctx)
+{
+    int32_t ret = 0;
+
+    if ((strlen(method) > CONFIG_RPC_METHOD_MAX_LEN) || (handler == NULL))
+    {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&RpcServerMutex, K_FOREVER);
+
+    for (uint32_t i = 0; i < methodCount; i++)
+    {
+        if (strcmp(methods[i].method, method) == 0)
+        {
+            ret = -EALREADY;
+            break;
+        }
+    }
+
+    if ((ret == 0) && (methodCount >= CONFIG_RPC_MAX_METHODS))
+    {
+        ret = -ENOMEM;
+    }
+
+    if (ret == 0)
+    {
+        methods[methodCount].method = method;
+        methods[methodCount].handler = handler;
+        methods[methodCount].ctx = ctx;
+        methodCount++;
+    }
+
+    k_mutex_unlock(&RpcServerMutex);
+
+    return ret;
+}
+
+/**@brief           Topic router handler of RPC_SERVER_REQUEST_TOPIC.
+ *
+ * @details         Runs in the MQTT helper thread. Request is only copied and queued to the
+ *                  RPC thread, which parses it, calls the method and publishes the response.
+ *
+ * param[in]        message: Received request, the request id is the '+' level.
+ * param[in]        ctx: Unused.
+ *
+ * @return          None.
+ *
+*/
+void rpc_server_on_request(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx)
+{
+    const TOPIC_ROUTER_LEVEL_STRUCT *id = &message->wildcards[0];
+    RPC_SERVER_SLOT_STRUCT *slot = NULL;
+
+    ARG_UNUSED(ctx);
+
+    k_mutex_lock(&RpcServerMutex, K_FOREVER);
+    serverStats.received++;
+    k_mutex_unlock(&RpcServerMutex);
+
+    if ((message->wildcardCount == 0) || (id->length == 0) || (id->length > RPC_SERVER_ID_MAX_LEN))
+    {
+        dropRequest("request id");
+        return;
+    }
+
+    if (message->payloadLength > CONFIG_RPC_REQUEST_MAX_LEN)
+    {
+        dropRequest("too long");
+        return;
+    }
+
+    if (!isServerStarted || (k_mem_slab_alloc(&rpcRequestSlab, (void **)&slot, K_NO_WAIT) != 0))
+    {
+        dropRequest("queue full");
+        return;
+    }
+
+    memcpy(slot->requestId, id->ptr, id->length);
+    slot->requestId[id->length] = 0;
+    memcpy(slot->payload, message->payload, message->payloadLength);
+    slot->length = message->payloadLength;
+    slot->receiveCycles = k_cycle_get_32();
+
+    k_work_init(&slot->work, requestWorkHandler);
+    (void)k_work_submit_to_queue(&rpcServerQueue, &slot->work);
+}
+
+/**@brief           Function to remove every method and clear the totals.
+ *
+ * @return          None.
+ *
+*/
+void rpc_server_reset(void)
+{
+    k_mutex_lock(&RpcServerMutex, K_FOREVER);
+    methodCount = 0;
+    memset(&serverStats, 0, sizeof(serverStats));
+    k_mutex_unlock(&RpcServerMutex);
+}
+
+/**@brief           Function to get the RPC totals.
+ *
+ * param[in]        stats: Copy of the totals.
+ *
+ * @return          None.
+ *
+*/
+void rpc_server_get_stats(RPC_SERVER_STATS_STRUCT *stats)
+{
+    k_mutex_lock(&RpcServerMutex, K_FOREVER);
+    *stats = serverStats;
+    k_mutex_unlock(&RpcServerMutex);
+}
+/* End of file -------------------------------------------------------- */
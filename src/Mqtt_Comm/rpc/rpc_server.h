@@ -0,0 +1,76 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __RPC_SERVER_H
+#define __RPC_SERVER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "json_reader.h"
+#include "json_writer.h"
+#include "topic_router.h"
+
+/* Exported types ------------------------------------------------------------*/
+/* Request passed to a method handler. Valid during the handler call only */
+typedef struct
+{
+    const uint8_t *method;              // Zero terminated
+    const uint8_t *requestId;           // Zero terminated, from the request topic
+    JSON_READER_VALUE_STRUCT params;    // JSON_READER_TYPE_NULL when not sent
+}RPC_SERVER_REQUEST_STRUCT;
+
+/* Writes the response value, any JSON value. Negative return answers {"error":<return>} instead */
+typedef int32_t (*RPC_SERVER_HANDLER)(const RPC_SERVER_REQUEST_STRUCT *request, JSON_WRITER_STRUCT *response,
+                                        void *ctx);
+
+/* Sends a response, called from the RPC thread */
+typedef int32_t (*RPC_SERVER_PUBLISH)(uint8_t *topic, const uint8_t *payload, uint32_t length);
+
+/* RPC totals */
+typedef struct
+{
+    uint32_t received;
+    uint32_t responded;
+    uint32_t unknownMethods;
+    uint32_t failed;            // Handler errors and not valid requests
+    uint32_t dropped;           // Queue full or request too long, no response
+    uint32_t maxLatencyUs;      // Request received to response handed to the publish
+    uint64_t totalLatencyUs;
+}RPC_SERVER_STATS_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+#define RPC_SERVER_REQUEST_TOPIC            "v1/devices/me/rpc/request/+"
+#define RPC_SERVER_RESPONSE_TOPIC_PREFIX    "v1/devices/me/rpc/response/"
+
+/* Longest request id, an int32 */
+#define RPC_SERVER_ID_MAX_LEN               11
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t rpc_server_init(RPC_SERVER_PUBLISH publish);
+int32_t rpc_server_register(const uint8_t *method, RPC_SERVER_HANDLER handler, void *ctx);
+void rpc_server_on_request(const TOPIC_ROUTER_MESSAGE_STRUCT *message, void *ctx);
+void rpc_server_reset(void);
+void rpc_server_get_stats(RPC_SERVER_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RPC_SERVER_H */
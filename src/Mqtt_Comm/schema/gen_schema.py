@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) A9S Inc. - All Rights Reserved.
+#
+# Generates typed message structs and allocation-free JSON and protobuf encoders from a message schema.
+#   gen_schema.py <schema.json> <output dir>
+#
+# Every message gives SCHEMA_<NAME>_STRUCT, SCHEMA_<NAME>_TOPIC, SCHEMA_<NAME>_MAX_LEN (worst
+# case encoded length without the terminating zero), schema_write_<name>() to add the fields
+# to an open object and schema_encode_<name>() to encode the whole object into a buffer.
+#
+# Protobuf side: SCHEMA_<NAME>_PB_MAX_LEN, SCHEMA_<NAME>_<KEY>_PB_FIELD, schema_pb_write_<name>()
+# and schema_pb_encode_<name>(). thingsboard.proto has the matching messages for the ThingsBoard
+# device profile. Field numbers come from "field", or the position in the field list. Append new
+# fields at the end so the numbers of the old ones do not change.
+#
+# Field types:
+#   bool, int32, uint32, int64, uint64
+#   float   "decimals": digits after the point, max 6
+#   string  "max_len": max length, longer strings fail the encode
+#
+
+import json
+import os
+import re
+import sys
+
+MAX_DECIMALS = 6
+
+# C type, writer call and worst case encoded length of every type
+TYPES = {
+    "bool":   ("bool",            "json_writer_bool(writer, msg->{name})",   5),
+    "int32":  ("int32_t",         "json_writer_int(writer, msg->{name})",    11),
+    "uint32": ("uint32_t",        "json_writer_uint(writer, msg->{name})",   10),
+    "int64":  ("int64_t",         "json_writer_int(writer, msg->{name})",    20),
+    "uint64": ("uint64_t",        "json_writer_uint(writer, msg->{name})",   20),
+    "float":  ("double",          "json_writer_float(writer, msg->{name}, {decimals})", None),
+    "string": ("const uint8_t *", "json_writer_string(writer, msg->{name}, {max_len})", None),
+}
+
+# Proto type, writer call and worst case value length of every type
+PB_TYPES = {
+    "bool":   ("bool",   "pb_writer_bool(writer, {field}, msg->{name})",   1),
+    "int32":  ("int32",  "pb_writer_int(writer, {field}, msg->{name})",    10),
+    "uint32": ("uint32", "pb_writer_uint(writer, {field}, msg->{name})",   5),
+    "int64":  ("int64",  "pb_writer_int(writer, {field}, msg->{name})",    10),
+    "uint64": ("uint64", "pb_writer_uint(writer, {field}, msg->{name})",   10),
+    "float":  ("double", "pb_writer_double(writer, {field}, msg->{name})", 8),
+    "string": ("string", "pb_writer_string(writer, {field}, msg->{name}, {max_len})", None),
+}
+
+# Largest field number of proto
+PB_MAX_FIELD = (1 << 29) - 1
+
+IDENTIFIER = re.compile(r"^[A-Za-z_][A-Za-z0-9_]*$")
+
+
+def fail(message):
+    sys.exit("gen_schema: " + message)
+
+
+def value_max_len(name, field):
+    kind = field["type"]
+    if kind == "float":
+        decimals = field.get("decimals", 2)
+        if not 0 <= decimals <= MAX_DECIMALS:
+            fail(f"{name}.{field['key']}: decimals must be 0 to {MAX_DECIMALS}")
+        # Sign, 19 integer digits of the int64 range, point and decimals
+        return 1 + 19 + (1 if decimals > 0 else 0) + decimals
+    if kind == "string":
+        if "max_len" not in field:
+            fail(f"{name}.{field['key']}: string needs max_len")
+        # Quotes, every byte escaped as \u00XX in the worst case
+        return 2 + 6 * field["max_len"]
+    return TYPES[kind][2]
+
+
+def varint_len(value):
+    length = 1
+    while value >= 0x80:
+        value >>= 7
+        length += 1
+    return length
+
+
+def pb_value_max_len(field):
+    if field["type"] == "string":
+        return varint_len(field["max_len"]) + field["max_len"]
+    return PB_TYPES[field["type"]][2]
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        schema = json.load(f)
+
+    messages = []
+    for name, message in schema["messages"].items():
+        if not IDENTIFIER.match(name):
+            fail(f"{name}: message name must be a C identifier")
+        keys = set()
+        numbers = set()
+        fields = []
+        for index, field in enumerate(message["fields"]):
+            key = field["key"]
+            if field["type"] not in TYPES:
+                fail(f"{name}.{key}: unknown type {field['type']}")
+            # Key is the struct member, no escaping needed in the output
+            if not IDENTIFIER.match(key):
+                fail(f"{name}.{key}: key must be a C identifier")
+            if key in keys:
+                fail(f"{name}.{key}: duplicate key")
+            keys.add(key)
+            number = field.get("field", index + 1)
+            if not 1 <= number <= PB_MAX_FIELD or 19000 <= number <= 19999:
+                fail(f"{name}.{key}: field number {number} not allowed")
+            if number in numbers:
+                fail(f"{name}.{key}: duplicate field number {number}")
+            numbers.add(number)
+            field = dict(field, value_max_len=value_max_len(name, field), field=number)
+            fields.append(dict(field, pb_max_len=varint_len(number << 3) + pb_value_max_len(field)))
+        if not fields:
+            fail(f"{name}: no fields")
+        messages.append((name, message["topic"], fields))
+
+    return messages
+
+
+def max_len(fields):
+    # Braces, commas between members and "key": of every member
+    length = 2 + len(fields) - 1
+    for field in fields:
+        length += len(field["key"]) + 3 + field["value_max_len"]
+    return length
+
+
+def pb_max_len(fields):
+    return sum(field["pb_max_len"] for field in fields)
+
+
+def pb_field_define(name, field):
+    return f"SCHEMA_{name.upper()}_{field['key'].upper()}_PB_FIELD"
+
+
+def proto_name(name):
+    return "".join(part.capitalize() for part in name.split("_"))
+
+
+def header(messages, source):
+    out = []
+    out.append(f"/* Generated by gen_schema.py from {source}, do not edit */\n")
+    out.append("/* Define to prevent recursive inclusion -------------------------------------*/")
+    out.append("#ifndef __THINGSBOARD_SCHEMA_H")
+    out.append("#define __THINGSBOARD_SCHEMA_H\n")
+    out.append("#ifdef __cplusplus")
+    out.append('extern "C"\n{')
+    out.append("#endif\n")
+    out.append("/* Includes ------------------------------------------------------------------*/")
+    out.append("#include <stdint.h>")
+    out.append("#include <stdbool.h>")
+    out.append('#include "json_writer.h"')
+    out.append('#include "pb_writer.h"\n')
+    out.append("/* Exported types ------------------------------------------------------------*/")
+    for name, topic, fields in messages:
+        out.append("typedef struct\n{")
+        for field in fields:
+            ctype = TYPES[field["type"]][0]
+            sep = "" if ctype.endswith("*") else " "
+            comment = f"    // Max {field['max_len']} bytes" if field["type"] == "string" else ""
+            out.append(f"    {ctype}{sep}{field['key']};{comment}")
+        out.append(f"}}SCHEMA_{name.upper()}_STRUCT;\n")
+    out.append("/* Exported constants --------------------------------------------------------*/")
+    for name, topic, fields in messages:
+        out.append(f'#define SCHEMA_{name.upper()}_TOPIC "{topic}"')
+        out.append(f"#define SCHEMA_{name.upper()}_MAX_LEN {max_len(fields)}")
+        out.append(f"#define SCHEMA_{name.upper()}_PB_MAX_LEN {pb_max_len(fields)}")
+        for field in fields:
+            out.append(f"#define {pb_field_define(name, field)} {field['field']}")
+    out.append("")
+    out.append("/*")
+    out.append("******************************************************************************")
+    out.append("* GLOBAL Functions")
+    out.append("******************************************************************************")
+    out.append("*/")
+    for name, topic, fields in messages:
+        struct = f"SCHEMA_{name.upper()}_STRUCT"
+        out.append(f"void schema_write_{name}(JSON_WRITER_STRUCT *writer, const {struct} *msg);")
+        out.append(f"int32_t schema_encode_{name}(const {struct} *msg, uint8_t *buffer, uint32_t size);")
+        out.append(f"void schema_pb_write_{name}(PB_WRITER_STRUCT *writer, const {struct} *msg);")
+        out.append(f"int32_t schema_pb_encode_{name}(const {struct} *msg, uint8_t *buffer, uint32_t size);")
+    out.append("")
+    out.append("#ifdef __cplusplus\n}\n#endif\n")
+    out.append("#endif /* __THINGSBOARD_SCHEMA_H */")
+    return "\n".join(out) + "\n"
+
+
+def source(messages, source_name):
+    out = []
+    out.append(f"/* Generated by gen_schema.py from {source_name}, do not edit */\n")
+    out.append("/* Includes ----------------------------------------------------------- */")
+    out.append('#include "thingsboard_schema.h"\n')
+    out.append("/* Global Function definitions ----------------------------------------------- */")
+    for name, topic, fields in messages:
+        struct = f"SCHEMA_{name.upper()}_STRUCT"
+        out.append(f"void schema_write_{name}(JSON_WRITER_STRUCT *writer, const {struct} *msg)\n{{")
+        for field in fields:
+            member = f'"\\"{field["key"]}\\":"'
+            out.append(f"    json_writer_member(writer, {member}, {len(field['key']) + 3});")
+            call = TYPES[field["type"]][1].format(name=field["key"], decimals=field.get("decimals", 2),
+                                                  max_len=field.get("max_len", 0))
+            out.append(f"    {call};")
+        out.append("}\n")
+        out.append(f"int32_t schema_encode_{name}(const {struct} *msg, uint8_t *buffer, uint32_t size)\n{{")
+        out.append("    JSON_WRITER_STRUCT writer;\n")
+        out.append("    json_writer_init(&writer, buffer, size);")
+        out.append("    json_writer_object_start(&writer);")
+        out.append(f"    schema_write_{name}(&writer, msg);")
+        out.append("    json_writer_object_end(&writer);\n")
+        out.append("    return json_writer_finish(&writer);")
+        out.append("}\n")
+        out.append(f"void schema_pb_write_{name}(PB_WRITER_STRUCT *writer, const {struct} *msg)\n{{")
+        for field in fields:
+            call = PB_TYPES[field["type"]][1].format(field=pb_field_define(name, field), name=field["key"],
+                                                     max_len=field.get("max_len", 0))
+            out.append(f"    {call};")
+        out.append("}\n")
+        out.append(f"int32_t schema_pb_encode_{name}(const {struct} *msg, uint8_t *buffer, uint32_t size)\n{{")
+        out.append("    PB_WRITER_STRUCT writer;\n")
+        out.append("    pb_writer_init(&writer, buffer, size);")
+        out.append(f"    schema_pb_write_{name}(&writer, msg);\n")
+        out.append("    return pb_writer_finish(&writer);")
+        out.append("}\n")
+    out.append("/* End of file -------------------------------------------------------- */")
+    return "\n".join(out) + "\n"
+
+
+def proto(messages, source_name):
+    out = []
+    out.append(f"// Generated by gen_schema.py from {source_name}, do not edit")
+    out.append("// Telemetry and attributes proto schema of the ThingsBoard device profile")
+    out.append('syntax = "proto3";\n')
+    out.append("package thingsboard;\n")
+    for name, topic, fields in messages:
+        out.append(f"// {topic}")
+        out.append(f"message {proto_name(name)} {{")
+        for field in fields:
+            # Every field is written, optional keeps them present in the JSON ThingsBoard makes of it
+            out.append(f"  optional {PB_TYPES[field['type']][0]} {field['key']} = {field['field']};")
+        out.append("}\n")
+    return "\n".join(out)
+
+
+def write_if_changed(path, text):
+    # Keep the timestamp when nothing changed, so dependents are not rebuilt
+    if os.path.exists(path):
+        with open(path, encoding="utf-8") as f:
+            if f.read() == text:
+                return
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+
+
+def main():
+    if len(sys.argv) != 3:
+        fail("usage: gen_schema.py <schema.json> <output dir>")
+
+    messages = load(sys.argv[1])
+    name = os.path.basename(sys.argv[1])
+    os.makedirs(sys.argv[2], exist_ok=True)
+    write_if_changed(os.path.join(sys.argv[2], "thingsboard_schema.h"), header(messages, name))
+    write_if_changed(os.path.join(sys.argv[2], "thingsboard_schema.c"), source(messages, name))
+    write_if_changed(os.path.join(sys.argv[2], "thingsboard.proto"), proto(messages, name))
+
+
+if __name__ == "__main__":
+    main()
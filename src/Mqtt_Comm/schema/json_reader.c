@@ -0,0 +1,745 @@
+/* Includes ----------------------------------------------------------- */
+#include "json_reader.h"
+#include <errno.h>
+#include <string.h>
+
+/* Private defines ---------------------------------------------------- */
+/* Private enumerate/structure ---------------------------------------- */
+/* Parse position */
+typedef struct
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+}JSON_READER_CURSOR_STRUCT;
+
+/* Container parse state */
+typedef enum
+{
+    CONTAINER_STATE_FIRST = 0,      // After the open bracket, close allowed
+    CONTAINER_STATE_NEXT,           // After a comma, value required
+    CONTAINER_STATE_AFTER_VALUE,    // Comma or close required
+}CONTAINER_STATE;
+
+/* Key table dispatch of json_reader_parse_object */
+typedef struct
+{
+    const JSON_READER_KEY_STRUCT *keys;
+    uint32_t keyCount;
+    void *ctx;
+    int32_t handled;
+}JSON_READER_DISPATCH_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+#define IS_DIGIT(c) (((c) >= '0') && ((c) <= '9'))
+
+/* Public variables --------------------------------------------------- */
+/* Private variables -------------------------------------------------- */
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to skip whitespace.
+ *
+ * param[in]        cursor: Parse position.
+ *
+ * @return          Next byte, 0 at the end of the input.
+ *
+*/
+static uint8_t skipWhitespace(JSON_READER_CURSOR_STRUCT *cursor)
+{
+    while ((cursor->pos < cursor->end) &&
+            ((*cursor->pos == ' ') || (*cursor->pos == '\t') || (*cursor->pos == '\n') || (*cursor->pos == '\r')))
+    {
+        cursor->pos++;
+    }
+
+    return (cursor->pos < cursor->end) ? *cursor->pos : 0;
+}
+
+/**@brief           Function to get the value of a hex digit.
+ *
+ * param[in]        c: Hex digit.
+ *
+ * @return          Digit value, negative if not a hex digit.
+ *
+*/
+static int32_t hexValue(uint8_t c)
+{
+    if (IS_DIGIT(c))
+    {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+
+    return -EBADMSG;
+}
+
+/**@brief           Function to read the 4 hex digits of a \u escape.
+ *
+ * param[in]        hex: First digit.
+ *
+ * @return          Code unit, negative if not 4 hex digits.
+ *
+*/
+static int32_t readCodeUnit(const uint8_t *hex)
+{
+    int32_t unit = 0;
+    int32_t digit = 0;
+
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        digit = hexValue(hex[i]);
+        if (digit < 0)
+        {
+            return digit;
+        }
+        unit = (unit << 4) | digit;
+    }
+
+    return unit;
+}
+
+/**@brief           Function to scan a string.
+ *
+ * @details         Escapes are checked, not decoded.
+ *
+ * param[in]        cursor: Parse position at the opening quote.
+ * param[in]        value: String content.
+ *
+ * @return          0 if successful, -EBADMSG otherwise.
+ *
+*/
+static int32_t scanString(JSON_READER_CURSOR_STRUCT *cursor, JSON_READER_VALUE_STRUCT *value)
+{
+    const uint8_t *p = cursor->pos + 1;
+
+    value->type = JSON_READER_TYPE_STRING;
+    value->start = p;
+
+    while (p < cursor->end)
+    {
+        if (*p == '"')
+        {
+            value->length = p - value->start;
+            cursor->pos = p + 1;
+            return 0;
+        }
+
+        if (*p < 0x20)
+        {
+            return -EBADMSG;
+        }
+
+        if (*p == '\\')
+        {
+            p++;
+            if (p >= cursor->end)
+            {
+                return -EBADMSG;
+            }
+
+            if (*p == 'u')
+            {
+                if (((cursor->end - p) < 5) || (readCodeUnit(p + 1) < 0))
+                {
+                    return -EBADMSG;
+                }
+                p += 4;
+            }
+            else if (strchr("\"\\/bfnrt", *p) == NULL)
+            {
+                return -EBADMSG;
+            }
+        }
+        p++;
+    }
+
+    return -EBADMSG;
+}
+
+/**@brief           Function to scan a number, true, false or null.
+ *
+ * param[in]        cursor: Parse position at the first byte.
+ * param[in]        value: Scalar value.
+ *
+ * @return          0 if successful, -EBADMSG otherwise.
+ *
+*/
+static int32_t scanScalar(JSON_READER_CURSOR_STRUCT *cursor, JSON_READER_VALUE_STRUCT *value)
+{
+    static const struct
+    {
+        const char *text;
+        uint8_t length;
+        JSON_READER_TYPE type;
+    } literals[] = {
+        {"true", 4, JSON_READER_TYPE_BOOL},
+        {"false", 5, JSON_READER_TYPE_BOOL},
+        {"null", 4, JSON_READER_TYPE_NULL},
+    };
+    const uint8_t *p = cursor->pos;
+    const uint8_t *end = cursor->end;
+
+    value->start = p;
+
+    for (uint8_t i = 0; i < (sizeof(literals) / sizeof(literals[0])); i++)
+    {
+        if (((uint32_t)(end - p) >= literals[i].length) && (memcmp(p, literals[i].text, literals[i].length) == 0))
+        {
+            value->type = literals[i].type;
+            value->length = literals[i].length;
+            cursor->pos = p + literals[i].length;
+            return 0;
+        }
+    }
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if ((p < end) && (*p == '-'))
+    {
+        p++;
+    }
+
+    if ((p < end) && (*p == '0'))
+    {
+        p++;
+    }
+    else if ((p < end) && IS_DIGIT(*p))
+    {
+        while ((p < end) && IS_DIGIT(*p))
+        {
+            p++;
+        }
+    }
+    else
+    {
+        return -EBADMSG;
+    }
+
+    if ((p < end) && (*p == '.'))
+    {
+        p++;
+        if ((p >= end) || !IS_DIGIT(*p))
+        {
+            return -EBADMSG;
+        }
+        while ((p < end) && IS_DIGIT(*p))
+        {
+            p++;
+        }
+    }
+
+    if ((p < end) && ((*p == 'e') || (*p == 'E')))
+    {
+        p++;
+        if ((p < end) && ((*p == '+') || (*p == '-')))
+        {
+            p++;
+        }
+        if ((p >= end) || !IS_DIGIT(*p))
+        {
+            return -EBADMSG;
+        }
+        while ((p < end) && IS_DIGIT(*p))
+        {
+            p++;
+        }
+    }
+
+    value->type = JSON_READER_TYPE_NUMBER;
+    value->length = p - value->start;
+    cursor->pos = p;
+
+    return 0;
+}
+
+/**@brief           Function to scan an object or an array.
+ *
+ * @details         Nested containers are checked without recursion, the bracket types are kept
+ *                  in a bit stack of JSON_READER_MAX_DEPTH levels.
+ *
+ * param[in]        cursor: Parse position at the open bracket.
+ * param[in]        value: Container with its brackets.
+ *
+ * @return          0 if successful, -EBADMSG if malformed or nested too deep.
+ *
+*/
+static int32_t scanContainer(JSON_READER_CURSOR_STRUCT *cursor, JSON_READER_VALUE_STRUCT *value)
+{
+    JSON_READER_VALUE_STRUCT item;
+    CONTAINER_STATE state = CONTAINER_STATE_FIRST;
+    uint32_t objectBits = 0;    // Bit n set if level n is an object
+    uint32_t depth = 0;
+    bool isObject = false;
+    uint8_t c = 0;
+
+    value->type = (*cursor->pos == '{') ? JSON_READER_TYPE_OBJECT : JSON_READER_TYPE_ARRAY;
+    value->start = cursor->pos;
+
+    objectBits = (value->type == JSON_READER_TYPE_OBJECT) ? 1 : 0;
+    depth = 1;
+    cursor->pos++;
+
+    while (depth > 0)
+    {
+        isObject = (objectBits & (1UL << (depth - 1))) != 0;
+        c = skipWhitespace(cursor);
+
+        if (state == CONTAINER_STATE_AFTER_VALUE)
+        {
+            if (c == ',')
+            {
+                state = CONTAINER_STATE_NEXT;
+            }
+            else if (c == (isObject ? '}' : ']'))
+            {
+                depth--;
+            }
+            else
+            {
+                return -EBADMSG;
+            }
+            cursor->pos++;
+            continue;
+        }
+
+        if ((state == CONTAINER_STATE_FIRST) && (c == (isObject ? '}' : ']')))
+        {
+            cursor->pos++;
+            depth--;
+            state = CONTAINER_STATE_AFTER_VALUE;
+            continue;
+        }
+
+        if (isObject)
+        {
+            if ((c != '"') || (scanString(cursor, &item) < 0) || (skipWhitespace(cursor) != ':'))
+            {
+                return -EBADMSG;
+            }
+            cursor->pos++;
+            c = skipWhitespace(cursor);
+        }
+
+        if ((c == '{') || (c == '['))
+        {
+            if (depth >= JSON_READER_MAX_DEPTH)
+            {
+                return -EBADMSG;
+            }
+            objectBits = (c == '{') ? (objectBits | (1UL << depth)) : (objectBits & ~(1UL << depth));
+            depth++;
+            cursor->pos++;
+            state = CONTAINER_STATE_FIRST;
+            continue;
+        }
+
+        if (((c == '"') ? scanString(cursor, &item) : scanScalar(cursor, &item)) < 0)
+        {
+            return -EBADMSG;
+        }
+        state = CONTAINER_STATE_AFTER_VALUE;
+    }
+
+    value->length = cursor->pos - value->start;
+
+    return 0;
+}
+
+/**@brief           Function to scan any value.
+ *
+ * param[in]        cursor: Parse position at the first byte.
+ * param[in]        value: Scanned value.
+ *
+ * @return          0 if successful, -EBADMSG otherwise.
+ *
+*/
+static int32_t scanValue(JSON_READER_CURSOR_STRUCT *cursor, JSON_READER_VALUE_STRUCT *value)
+{
+    uint8_t c = skipWhitespace(cursor);
+
+    if (c == '"')
+    {
+        return scanString(cursor, value);
+    }
+
+    if ((c == '{') || (c == '['))
+    {
+        return scanContainer(cursor, value);
+    }
+
+    return scanScalar(cursor, value);
+}
+
+/**@brief           Function to write a code point as UTF-8.
+ *
+ * param[in]        codePoint: Unicode code point.
+ * param[in]        out: Output, 4 bytes free.
+ *
+ * @return          Number of bytes written.
+ *
+*/
+static uint32_t writeUtf8(uint32_t codePoint, uint8_t *out)
+{
+    if (codePoint < 0x80)
+    {
+        out[0] = codePoint;
+        return 1;
+    }
+    if (codePoint < 0x800)
+    {
+        out[0] = 0xC0 | (codePoint >> 6);
+        out[1] = 0x80 | (codePoint & 0x3F);
+        return 2;
+    }
+    if (codePoint < 0x10000)
+    {
+        out[0] = 0xE0 | (codePoint >> 12);
+        out[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+        out[2] = 0x80 | (codePoint & 0x3F);
+        return 3;
+    }
+
+    out[0] = 0xF0 | (codePoint >> 18);
+    out[1] = 0x80 | ((codePoint >> 12) & 0x3F);
+    out[2] = 0x80 | ((codePoint >> 6) & 0x3F);
+    out[3] = 0x80 | (codePoint & 0x3F);
+    return 4;
+}
+
+/**@brief           Function to check that nothing but whitespace is left.
+ *
+ * param[in]        cursor: Parse position.
+ *
+ * @return          0 if at the end, -EBADMSG otherwise.
+ *
+*/
+static int32_t checkEnd(JSON_READER_CURSOR_STRUCT *cursor)
+{
+    return (skipWhitespace(cursor) != 0) ? -EBADMSG : 0;
+}
+
+/**@brief           Member handler of json_reader_parse_object, dispatches to the key table.
+ *
+ * param[in]        key: Member key.
+ * param[in]        value: Member value.
+ * param[in]        ctx: Key table dispatch.
+ *
+ * @return          0 if successful, handler error otherwise.
+ *
+*/
+static int32_t dispatchMember(const JSON_READER_VALUE_STRUCT *key, const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    JSON_READER_DISPATCH_STRUCT *dispatch = ctx;
+    int32_t ret = 0;
+
+    for (uint32_t i = 0; i < dispatch->keyCount; i++)
+    {
+        if ((strlen(dispatch->keys[i].key) == key->length) && (memcmp(dispatch->keys[i].key, key->start, key->length) == 0))
+        {
+            ret = dispatch->keys[i].handler(value, dispatch->ctx);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            dispatch->handled++;
+        }
+    }
+
+    return 0;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to parse a JSON object and dispatch its members.
+ *
+ * @details         Message is parsed in place without heap or token array. For every member
+ *                  the handlers of the matching keys are called with the value, in message order,
+ *                  so keys can come in any order and any number. Other members are checked and
+ *                  skipped. Handlers run while parsing: keep the results in ctx and apply them
+ *                  once the parse succeeds.
+ *
+ * param[in]        json: Message, zero termination not needed.
+ * param[in]        length: Message length.
+ * param[in]        keys: Key to handler table.
+ * param[in]        keyCount: Number of table entries.
+ * param[in]        ctx: Passed to the handlers.
+ *
+ * @return          Number of handled members, -EBADMSG if the message is not a valid object,
+ *                  handler error otherwise.
+ *
+*/
+int32_t json_reader_parse_object(const uint8_t *json, uint32_t length, const JSON_READER_KEY_STRUCT *keys,
+                                    uint32_t keyCount, void *ctx)
+{
+    JSON_READER_DISPATCH_STRUCT dispatch = {.keys = keys, .keyCount = keyCount, .ctx = ctx, .handled = 0};
+    int32_t ret = 0;
+
+    ret = json_reader_parse_members(json, length, dispatchMember, &dispatch);
+
+    return (ret < 0) ? ret : dispatch.handled;
+}
+
+/**@brief           Function to parse a JSON object and pass every member to one handler.
+ *
+ * @details         For objects whose keys are not known at build time. Parsed in place like
+ *                  json_reader_parse_object, the handler gets the key, still escaped, with the value.
+ *
+ * param[in]        json: Message, zero termination not needed.
+ * param[in]        length: Message length.
+ * param[in]        handler: Called for every member, in message order.
+ * param[in]        ctx: Passed to the handler.
+ *
+ * @return          Number of members, -EBADMSG if the message is not a valid object,
+ *                  handler error otherwise.
+ *
+*/
+int32_t json_reader_parse_members(const uint8_t *json, uint32_t length, JSON_READER_MEMBER_HANDLER handler, void *ctx)
+{
+    JSON_READER_CURSOR_STRUCT cursor = {.pos = json, .end = json + length};
+    JSON_READER_VALUE_STRUCT key;
+    JSON_READER_VALUE_STRUCT value;
+    int32_t members = 0;
+    int32_t ret = 0;
+    bool isClosed = false;
+    uint8_t c = 0;
+
+    if ((json == NULL) || (skipWhitespace(&cursor) != '{'))
+    {
+        return -EBADMSG;
+    }
+    cursor.pos++;
+
+    c = skipWhitespace(&cursor);
+    if (c == '}')
+    {
+        cursor.pos++;
+        isClosed = true;
+    }
+
+    while (!isClosed)
+    {
+        // A member is required here, also after a comma: {"a":1,} is not valid
+        if ((c != '"') || (scanString(&cursor, &key) < 0) || (skipWhitespace(&cursor) != ':'))
+        {
+            return -EBADMSG;
+        }
+        cursor.pos++;
+
+        if (scanValue(&cursor, &value) < 0)
+        {
+            return -EBADMSG;
+        }
+
+        ret = handler(&key, &value, ctx);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        members++;
+
+        c = skipWhitespace(&cursor);
+        if ((c != ',') && (c != '}'))
+        {
+            return -EBADMSG;
+        }
+        cursor.pos++;
+
+        isClosed = (c == '}');
+        c = skipWhitespace(&cursor);
+    }
+
+    // Nothing but whitespace after the object
+    if (checkEnd(&cursor) < 0)
+    {
+        return -EBADMSG;
+    }
+
+    return members;
+}
+
+/**@brief           Function to parse a single JSON value.
+ *
+ * param[in]        json: Value text, zero termination not needed.
+ * param[in]        length: Text length.
+ * param[in]        value: Parsed value, points into the text.
+ *
+ * @return          0 if successful, -EBADMSG if the text is not one valid value.
+ *
+*/
+int32_t json_reader_parse_value(const uint8_t *json, uint32_t length, JSON_READER_VALUE_STRUCT *value)
+{
+    JSON_READER_CURSOR_STRUCT cursor = {.pos = json, .end = json + length};
+
+    if ((json == NULL) || (scanValue(&cursor, value) < 0) || (checkEnd(&cursor) < 0))
+    {
+        return -EBADMSG;
+    }
+
+    return 0;
+}
+
+/**@brief           Function to copy a string value with the escapes decoded.
+ *
+ * param[in]        value: String value.
+ * param[in]        out: Output buffer, zero terminated.
+ * param[in]        size: Output buffer size including the terminating zero.
+ *
+ * @return          String length, -EINVAL if not a valid string, -ENOMEM if the buffer is too small.
+ *
+*/
+int32_t json_reader_get_string(const JSON_READER_VALUE_STRUCT *value, uint8_t *out, uint32_t size)
+{
+    const uint8_t *p = value->start;
+    const uint8_t *end = value->start + value->length;
+    uint8_t utf8[4];
+    uint32_t utf8Length = 0;
+    uint32_t length = 0;
+    int32_t unit = 0;
+    int32_t low = 0;
+
+    if ((value->type != JSON_READER_TYPE_STRING) || (size == 0))
+    {
+        return -EINVAL;
+    }
+
+    while (p < end)
+    {
+        if (*p != '\\')
+        {
+            utf8[0] = *p++;
+            utf8Length = 1;
+        }
+        else
+        {
+            // Escapes were checked by the parse
+            p++;
+            switch (*p)
+            {
+                case 'b': utf8[0] = '\b'; utf8Length = 1; break;
+                case 'f': utf8[0] = '\f'; utf8Length = 1; break;
+                case 'n': utf8[0] = '\n'; utf8Length = 1; break;
+                case 'r': utf8[0] = '\r'; utf8Length = 1; break;
+                case 't': utf8[0] = '\t'; utf8Length = 1; break;
+
+                case 'u':
+                    unit = readCodeUnit(p + 1);
+                    p += 4;
+                    if ((unit >= 0xD800) && (unit <= 0xDBFF))
+                    {
+                        // Surrogate pair, the low half must follow
+                        if (((end - p) < 7) || (p[1] != '\\') || (p[2] != 'u'))
+                        {
+                            return -EINVAL;
+                        }
+                        low = readCodeUnit(p + 3);
+                        if ((low < 0xDC00) || (low > 0xDFFF))
+                        {
+                            return -EINVAL;
+                        }
+                        unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                    else if ((unit >= 0xDC00) && (unit <= 0xDFFF))
+                    {
+                        return -EINVAL;
+                    }
+                    utf8Length = writeUtf8(unit, utf8);
+                    break;
+
+                default:
+                    utf8[0] = *p;
+                    utf8Length = 1;
+                    break;
+            }
+            p++;
+        }
+
+        if ((length + utf8Length) >= size)
+        {
+            out[0] = 0;
+            return -ENOMEM;
+        }
+        memcpy(&out[length], utf8, utf8Length);
+        length += utf8Length;
+    }
+
+    out[length] = 0;
+
+    return length;
+}
+
+/**@brief           Function to get a bool value.
+ *
+ * param[in]        value: Bool value.
+ * param[in]        out: Value.
+ *
+ * @return          0 if successful, -EINVAL if not a bool.
+ *
+*/
+int32_t json_reader_get_bool(const JSON_READER_VALUE_STRUCT *value, bool *out)
+{
+    if (value->type != JSON_READER_TYPE_BOOL)
+    {
+        return -EINVAL;
+    }
+
+    *out = (value->start[0] == 't');
+
+    return 0;
+}
+
+/**@brief           Function to get an integer value.
+ *
+ * param[in]        value: Number value.
+ * param[in]        out: Value.
+ *
+ * @return          0 if successful, -EINVAL if not an integer, -ERANGE if out of the int64 range.
+ *
+*/
+int32_t json_reader_get_int(const JSON_READER_VALUE_STRUCT *value, int64_t *out)
+{
+    const uint8_t *p = value->start;
+    const uint8_t *end = value->start + value->length;
+    bool isNegative = false;
+    uint64_t limit = INT64_MAX;
+    uint64_t magnitude = 0;
+    uint8_t digit = 0;
+
+    if (value->type != JSON_READER_TYPE_NUMBER)
+    {
+        return -EINVAL;
+    }
+
+    if (*p == '-')
+    {
+        isNegative = true;
+        limit = (uint64_t)INT64_MAX + 1;
+        p++;
+    }
+
+    for (; p < end; p++)
+    {
+        if (!IS_DIGIT(*p))
+        {
+            // Fraction or exponent
+            return -EINVAL;
+        }
+
+        digit = *p - '0';
+        if (magnitude > ((limit - digit) / 10))
+        {
+            return -ERANGE;
+        }
+        magnitude = (magnitude * 10) + digit;
+    }
+
+    *out = isNegative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+
+    return 0;
+}
+/* End of file -------------------------------------------------------- */
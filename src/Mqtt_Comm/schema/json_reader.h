@@ -0,0 +1,77 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __JSON_READER_H
+#define __JSON_READER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+    JSON_READER_TYPE_STRING = 0,
+    JSON_READER_TYPE_NUMBER,
+    JSON_READER_TYPE_BOOL,
+    JSON_READER_TYPE_NULL,
+    JSON_READER_TYPE_OBJECT,
+    JSON_READER_TYPE_ARRAY,
+}JSON_READER_TYPE;
+
+/* Member value, points into the parsed buffer */
+typedef struct
+{
+    JSON_READER_TYPE type;
+    const uint8_t *start;   // String content without quotes, still escaped. Objects and arrays with brackets
+    uint32_t length;
+}JSON_READER_VALUE_STRUCT;
+
+/* Called for a member with a matching key. Negative return stops the parse with that error */
+typedef int32_t (*JSON_READER_HANDLER)(const JSON_READER_VALUE_STRUCT *value, void *ctx);
+
+/* Called for every member by json_reader_parse_members. Key is still escaped. Negative return stops the parse */
+typedef int32_t (*JSON_READER_MEMBER_HANDLER)(const JSON_READER_VALUE_STRUCT *key, const JSON_READER_VALUE_STRUCT *value,
+                                                void *ctx);
+
+/* Key to handler table entry. Key is compared as written in the message, without unescaping */
+typedef struct
+{
+    const uint8_t *key;
+    JSON_READER_HANDLER handler;
+}JSON_READER_KEY_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+/* Max nesting of skipped objects and arrays */
+#define JSON_READER_MAX_DEPTH 32
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t json_reader_parse_object(const uint8_t *json, uint32_t length, const JSON_READER_KEY_STRUCT *keys,
+                                    uint32_t keyCount, void *ctx);
+int32_t json_reader_parse_members(const uint8_t *json, uint32_t length, JSON_READER_MEMBER_HANDLER handler, void *ctx);
+int32_t json_reader_parse_value(const uint8_t *json, uint32_t length, JSON_READER_VALUE_STRUCT *value);
+int32_t json_reader_get_string(const JSON_READER_VALUE_STRUCT *value, uint8_t *out, uint32_t size);
+int32_t json_reader_get_bool(const JSON_READER_VALUE_STRUCT *value, bool *out);
+int32_t json_reader_get_int(const JSON_READER_VALUE_STRUCT *value, int64_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __JSON_READER_H */
@@ -0,0 +1,435 @@
+/* Includes ----------------------------------------------------------- */
+#include "json_writer.h"
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+/* Private defines ---------------------------------------------------- */
+/* Digits of UINT64_MAX */
+#define JSON_WRITER_MAX_DIGITS 20
+
+/* Private enumerate/structure ---------------------------------------- */
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+static const uint8_t hexDigits[] = "0123456789abcdef";
+
+/* 10^n for the float decimals */
+static const uint32_t decimalScale[JSON_WRITER_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to reserve space in the output.
+ *
+ * @details         One byte is always kept for the terminating zero.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        length: Number of bytes to write.
+ *
+ * @return          Pointer to write to, NULL if the output is full or in error.
+ *
+*/
+static uint8_t *reserve(JSON_WRITER_STRUCT *writer, uint32_t length)
+{
+    uint8_t *out = NULL;
+
+    if (writer->error != 0)
+    {
+        return NULL;
+    }
+
+    if (length >= (writer->size - writer->length))
+    {
+        writer->error = -ENOMEM;
+        return NULL;
+    }
+
+    out = &writer->buffer[writer->length];
+    writer->length += length;
+
+    return out;
+}
+
+/**@brief           Function to write raw bytes.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        data: Bytes to write.
+ * param[in]        length: Number of bytes.
+ *
+ * @return          None.
+ *
+*/
+static void writeRaw(JSON_WRITER_STRUCT *writer, const uint8_t *data, uint32_t length)
+{
+    uint8_t *out = reserve(writer, length);
+
+    if (out != NULL)
+    {
+        memcpy(out, data, length);
+    }
+}
+
+/**@brief           Function to write one byte.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        c: Byte to write.
+ *
+ * @return          None.
+ *
+*/
+static void writeChar(JSON_WRITER_STRUCT *writer, uint8_t c)
+{
+    uint8_t *out = reserve(writer, 1);
+
+    if (out != NULL)
+    {
+        *out = c;
+    }
+}
+
+/**@brief           Function to write decimal digits of an unsigned value.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        value: Value to write.
+ * param[in]        minDigits: Zero padded width.
+ *
+ * @return          None.
+ *
+*/
+static void writeDigits(JSON_WRITER_STRUCT *writer, uint64_t value, uint8_t minDigits)
+{
+    uint8_t digits[JSON_WRITER_MAX_DIGITS];
+    uint8_t count = 0;
+
+    do
+    {
+        digits[JSON_WRITER_MAX_DIGITS - 1 - count] = '0' + (value % 10);
+        value /= 10;
+        count++;
+    } while ((value > 0) || (count < minDigits));
+
+    writeRaw(writer, &digits[JSON_WRITER_MAX_DIGITS - count], count);
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to start writing JSON into a buffer.
+ *
+ * @details         Nothing is allocated. Output is terminated by json_writer_finish().
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size including the terminating zero.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_init(JSON_WRITER_STRUCT *writer, uint8_t *buffer, uint32_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->error = (size == 0) ? -ENOMEM : 0;
+    writer->isFirstMember = true;
+}
+
+/**@brief           Function to open an object.
+ *
+ * param[in]        writer: JSON writer.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_object_start(JSON_WRITER_STRUCT *writer)
+{
+    writeChar(writer, '{');
+    writer->isFirstMember = true;
+}
+
+/**@brief           Function to close an object.
+ *
+ * param[in]        writer: JSON writer.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_object_end(JSON_WRITER_STRUCT *writer)
+{
+    writeChar(writer, '}');
+    writer->isFirstMember = false;
+}
+
+/**@brief           Function to write a member name known at build time.
+ *
+ * @details         Key is written as is, used by the generated encoders.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        quotedKey: Quoted and escaped key with the colon, "\"key\":".
+ * param[in]        length: Key length.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_member(JSON_WRITER_STRUCT *writer, const uint8_t *quotedKey, uint32_t length)
+{
+    if (!writer->isFirstMember)
+    {
+        writeChar(writer, ',');
+    }
+    writer->isFirstMember = false;
+
+    writeRaw(writer, quotedKey, length);
+}
+
+/**@brief           Function to write a member name known at run time.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        key: Key, escaped as needed.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_key(JSON_WRITER_STRUCT *writer, const uint8_t *key)
+{
+    if (!writer->isFirstMember)
+    {
+        writeChar(writer, ',');
+    }
+    writer->isFirstMember = false;
+
+    json_writer_string(writer, key, UINT32_MAX);
+    writeChar(writer, ':');
+}
+
+/**@brief           Function to write a signed integer.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        value: Value to write.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_int(JSON_WRITER_STRUCT *writer, int64_t value)
+{
+    if (value < 0)
+    {
+        writeChar(writer, '-');
+        // Negate as unsigned, INT64_MIN has no positive counterpart
+        writeDigits(writer, (uint64_t)0 - (uint64_t)value, 1);
+    }
+    else
+    {
+        writeDigits(writer, (uint64_t)value, 1);
+    }
+}
+
+/**@brief           Function to write an unsigned integer.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        value: Value to write.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_uint(JSON_WRITER_STRUCT *writer, uint64_t value)
+{
+    writeDigits(writer, value, 1);
+}
+
+/**@brief           Function to write a boolean.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        value: Value to write.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_bool(JSON_WRITER_STRUCT *writer, bool value)
+{
+    if (value)
+    {
+        writeRaw(writer, "true", 4);
+    }
+    else
+    {
+        writeRaw(writer, "false", 5);
+    }
+}
+
+/**@brief           Function to write a number with fixed decimals.
+ *
+ * @details         Value is rounded to the decimals and written with integer math, no printf
+ *                  float support is needed. NaN, infinity and values out of the int64 range
+ *                  after scaling are an error, JSON can not carry them.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        value: Value to write.
+ * param[in]        decimals: Digits after the point, max JSON_WRITER_MAX_DECIMALS.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_float(JSON_WRITER_STRUCT *writer, double value, uint8_t decimals)
+{
+    uint64_t scaled = 0;
+    uint32_t scale = 0;
+    double magnitude = 0;
+
+    if (decimals > JSON_WRITER_MAX_DECIMALS)
+    {
+        decimals = JSON_WRITER_MAX_DECIMALS;
+    }
+    scale = decimalScale[decimals];
+
+    magnitude = fabs(value) * scale;
+    if (!isfinite(magnitude) || (magnitude >= 9.2e18))
+    {
+        if (writer->error == 0)
+        {
+            writer->error = -EINVAL;
+        }
+        return;
+    }
+
+    scaled = (uint64_t)(magnitude + 0.5);
+
+    // Negative zero after rounding is written as 0
+    if ((value < 0) && (scaled > 0))
+    {
+        writeChar(writer, '-');
+    }
+
+    writeDigits(writer, scaled / scale, 1);
+
+    if (decimals > 0)
+    {
+        writeChar(writer, '.');
+        writeDigits(writer, scaled % scale, decimals);
+    }
+}
+
+/**@brief           Function to write a quoted and escaped string.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        value: String to write. NULL is written as an empty string.
+ * param[in]        maxLength: Max string length, longer strings are an error.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_string(JSON_WRITER_STRUCT *writer, const uint8_t *value, uint32_t maxLength)
+{
+    const uint8_t *start = value;
+    uint8_t escape[6] = {'\\', 'u', '0', '0', 0, 0};
+    uint32_t length = 0;
+    uint8_t c = 0;
+
+    writeChar(writer, '"');
+
+    for (length = 0; (value != NULL) && (value[length] != 0); length++)
+    {
+        if (length >= maxLength)
+        {
+            if (writer->error == 0)
+            {
+                writer->error = -EINVAL;
+            }
+            return;
+        }
+
+        c = value[length];
+        if ((c >= 0x20) && (c != '"') && (c != '\\'))
+        {
+            continue;
+        }
+
+        // Copy the plain run before the escaped byte
+        writeRaw(writer, start, &value[length] - start);
+        start = &value[length + 1];
+
+        switch (c)
+        {
+            case '"':
+            case '\\':
+                escape[1] = c;
+                writeRaw(writer, escape, 2);
+                break;
+
+            case '\n':
+                writeRaw(writer, "\\n", 2);
+                break;
+
+            case '\r':
+                writeRaw(writer, "\\r", 2);
+                break;
+
+            case '\t':
+                writeRaw(writer, "\\t", 2);
+                break;
+
+            default:
+                escape[1] = 'u';
+                escape[4] = hexDigits[c >> 4];
+                escape[5] = hexDigits[c & 0x0F];
+                writeRaw(writer, escape, 6);
+                break;
+        }
+    }
+
+    if (value != NULL)
+    {
+        writeRaw(writer, start, &value[length] - start);
+    }
+
+    writeChar(writer, '"');
+}
+
+/**@brief           Function to drop the output after a length.
+ *
+ * @details         Used to drop trailing members that did not fit. Clears a full buffer error,
+ *                  other errors stay.
+ *
+ * param[in]        writer: JSON writer.
+ * param[in]        length: Output length to keep, from writer->length before the members.
+ *
+ * @return          None.
+ *
+*/
+void json_writer_truncate(JSON_WRITER_STRUCT *writer, uint32_t length)
+{
+    if (length < writer->length)
+    {
+        writer->length = length;
+    }
+
+    if (writer->error == -ENOMEM)
+    {
+        writer->error = 0;
+    }
+}
+
+/**@brief           Function to terminate the output.
+ *
+ * param[in]        writer: JSON writer.
+ *
+ * @return          Output length without the terminating zero, -ENOMEM if the buffer was too
+ *                  small, -EINVAL if a value could not be written.
+ *
+*/
+int32_t json_writer_finish(JSON_WRITER_STRUCT *writer)
+{
+    if (writer->error != 0)
+    {
+        if (writer->size > 0)
+        {
+            writer->buffer[0] = 0;
+        }
+        return writer->error;
+    }
+
+    writer->buffer[writer->length] = 0;
+
+    return writer->length;
+}
+/* End of file -------------------------------------------------------- */
@@ -0,0 +1,60 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __JSON_WRITER_H
+#define __JSON_WRITER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* JSON output into a caller buffer. First error sticks, later writes do nothing */
+typedef struct
+{
+    uint8_t *buffer;
+    uint32_t size;
+    uint32_t length;
+    int32_t error;
+    bool isFirstMember;
+}JSON_WRITER_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+/* Max decimals of json_writer_float() */
+#define JSON_WRITER_MAX_DECIMALS 6
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+void json_writer_init(JSON_WRITER_STRUCT *writer, uint8_t *buffer, uint32_t size);
+void json_writer_object_start(JSON_WRITER_STRUCT *writer);
+void json_writer_object_end(JSON_WRITER_STRUCT *writer);
+void json_writer_member(JSON_WRITER_STRUCT *writer, const uint8_t *quotedKey, uint32_t length);
+void json_writer_key(JSON_WRITER_STRUCT *writer, const uint8_t *key);
+void json_writer_int(JSON_WRITER_STRUCT *writer, int64_t value);
+void json_writer_uint(JSON_WRITER_STRUCT *writer, uint64_t value);
+void json_writer_bool(JSON_WRITER_STRUCT *writer, bool value);
+void json_writer_float(JSON_WRITER_STRUCT *writer, double value, uint8_t decimals);
+void json_writer_string(JSON_WRITER_STRUCT *writer, const uint8_t *value, uint32_t maxLength);
+void json_writer_truncate(JSON_WRITER_STRUCT *writer, uint32_t length);
+int32_t json_writer_finish(JSON_WRITER_STRUCT *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __JSON_WRITER_H */
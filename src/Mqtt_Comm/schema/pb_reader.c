@@ -0,0 +1,273 @@
+/* Includes ----------------------------------------------------------- */
+#include "pb_reader.h"
+#include "pb_writer.h"
+#include <errno.h>
+#include <string.h>
+
+/* Private defines ---------------------------------------------------- */
+/* Private enumerate/structure ---------------------------------------- */
+/* Parse position */
+typedef struct
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+}PB_READER_CURSOR_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+/* Private variables -------------------------------------------------- */
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to read a base 128 varint.
+ *
+ * param[in]        cursor: Parse position.
+ * param[in]        value: Read value.
+ *
+ * @return          0 if successful, -EBADMSG if truncated or longer than PB_VARINT_MAX_LEN bytes.
+ *
+*/
+static int32_t readVarint(PB_READER_CURSOR_STRUCT *cursor, uint64_t *value)
+{
+    uint8_t c = 0;
+
+    *value = 0;
+
+    for (uint32_t i = 0; i < PB_VARINT_MAX_LEN; i++)
+    {
+        if (cursor->pos >= cursor->end)
+        {
+            return -EBADMSG;
+        }
+
+        c = *cursor->pos++;
+        *value |= (uint64_t)(c & 0x7F) << (7 * i);
+        if ((c & 0x80) == 0)
+        {
+            return 0;
+        }
+    }
+
+    return -EBADMSG;
+}
+
+/**@brief           Function to read a little endian fixed value.
+ *
+ * param[in]        cursor: Parse position.
+ * param[in]        size: 4 or 8 bytes.
+ * param[in]        value: Read value.
+ *
+ * @return          0 if successful, -EBADMSG if truncated.
+ *
+*/
+static int32_t readFixed(PB_READER_CURSOR_STRUCT *cursor, uint32_t size, uint64_t *value)
+{
+    if ((uint32_t)(cursor->end - cursor->pos) < size)
+    {
+        return -EBADMSG;
+    }
+
+    *value = 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+        *value |= (uint64_t)cursor->pos[i] << (8 * i);
+    }
+    cursor->pos += size;
+
+    return 0;
+}
+
+/**@brief           Function to read a field value.
+ *
+ * param[in]        cursor: Parse position, after the field key.
+ * param[in]        value: Value with the wire type set, filled here.
+ *
+ * @return          0 if successful, -EBADMSG if not valid.
+ *
+*/
+static int32_t readValue(PB_READER_CURSOR_STRUCT *cursor, PB_READER_VALUE_STRUCT *value)
+{
+    uint64_t length = 0;
+
+    value->number = 0;
+    value->start = NULL;
+    value->length = 0;
+
+    switch (value->wireType)
+    {
+        case PB_WIRE_VARINT:
+            return readVarint(cursor, &value->number);
+
+        case PB_WIRE_FIXED64:
+            return readFixed(cursor, 8, &value->number);
+
+        case PB_WIRE_FIXED32:
+            return readFixed(cursor, 4, &value->number);
+
+        case PB_WIRE_LENGTH:
+            if ((readVarint(cursor, &length) < 0) || (length > (uint64_t)(cursor->end - cursor->pos)))
+            {
+                return -EBADMSG;
+            }
+            value->start = cursor->pos;
+            value->length = (uint32_t)length;
+            cursor->pos += length;
+            return 0;
+
+        default:
+            // Groups are not used by proto3
+            return -EBADMSG;
+    }
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to parse a protobuf message and dispatch its fields.
+ *
+ * @details         Message is parsed in place without heap. For every field the handlers of
+ *                  the matching field number are called with the value, in message order, so
+ *                  repeated fields call the handler once per entry. Unknown fields are skipped.
+ *                  Nested messages are parsed by calling this again on the value from a handler.
+ *
+ * param[in]        message: Message.
+ * param[in]        length: Message length.
+ * param[in]        fields: Field number to handler table.
+ * param[in]        fieldCount: Number of table entries.
+ * param[in]        ctx: Passed to the handlers.
+ *
+ * @return          Number of handled fields, -EBADMSG if the message is not valid, handler
+ *                  error otherwise.
+ *
+*/
+int32_t pb_reader_parse_message(const uint8_t *message, uint32_t length, const PB_READER_FIELD_STRUCT *fields,
+                                uint32_t fieldCount, void *ctx)
+{
+    PB_READER_CURSOR_STRUCT cursor = {.pos = message, .end = message + length};
+    PB_READER_VALUE_STRUCT value;
+    uint64_t key = 0;
+    uint32_t field = 0;
+    int32_t handled = 0;
+    int32_t ret = 0;
+
+    if ((message == NULL) && (length > 0))
+    {
+        return -EBADMSG;
+    }
+
+    while (cursor.pos < cursor.end)
+    {
+        if (readVarint(&cursor, &key) < 0)
+        {
+            return -EBADMSG;
+        }
+
+        field = (uint32_t)(key >> 3);
+        value.wireType = (uint8_t)(key & 0x07);
+        if ((field == 0) || (readValue(&cursor, &value) < 0))
+        {
+            return -EBADMSG;
+        }
+
+        for (uint32_t i = 0; i < fieldCount; i++)
+        {
+            if (fields[i].field == field)
+            {
+                ret = fields[i].handler(&value, ctx);
+                if (ret < 0)
+                {
+                    return ret;
+                }
+                handled++;
+            }
+        }
+    }
+
+    return handled;
+}
+
+/**@brief           Function to copy a string value.
+ *
+ * param[in]        value: String value.
+ * param[in]        out: Output buffer, zero terminated.
+ * param[in]        size: Output buffer size including the terminating zero.
+ *
+ * @return          String length, -EINVAL if not a string, -ENOMEM if the buffer is too small.
+ *
+*/
+int32_t pb_reader_get_string(const PB_READER_VALUE_STRUCT *value, uint8_t *out, uint32_t size)
+{
+    if (value->wireType != PB_WIRE_LENGTH)
+    {
+        return -EINVAL;
+    }
+
+    if (value->length >= size)
+    {
+        return -ENOMEM;
+    }
+
+    memcpy(out, value->start, value->length);
+    out[value->length] = 0;
+
+    return value->length;
+}
+
+/**@brief           Function to get a bool value.
+ *
+ * param[in]        value: Bool value.
+ * param[in]        out: Read value.
+ *
+ * @return          0 if successful, -EINVAL if not a varint.
+ *
+*/
+int32_t pb_reader_get_bool(const PB_READER_VALUE_STRUCT *value, bool *out)
+{
+    if (value->wireType != PB_WIRE_VARINT)
+    {
+        return -EINVAL;
+    }
+
+    *out = (value->number != 0);
+
+    return 0;
+}
+
+/**@brief           Function to get an int32, int64, uint32 or enum value.
+ *
+ * param[in]        value: Integer value.
+ * param[in]        out: Read value.
+ *
+ * @return          0 if successful, -EINVAL if not a varint.
+ *
+*/
+int32_t pb_reader_get_int(const PB_READER_VALUE_STRUCT *value, int64_t *out)
+{
+    if (value->wireType != PB_WIRE_VARINT)
+    {
+        return -EINVAL;
+    }
+
+    *out = (int64_t)value->number;
+
+    return 0;
+}
+
+/**@brief           Function to get a double value.
+ *
+ * param[in]        value: Double value.
+ * param[in]        out: Read value.
+ *
+ * @return          0 if successful, -EINVAL if not a fixed64.
+ *
+*/
+int32_t pb_reader_get_double(const PB_READER_VALUE_STRUCT *value, double *out)
+{
+    if (value->wireType != PB_WIRE_FIXED64)
+    {
+        return -EINVAL;
+    }
+
+    memcpy(out, &value->number, sizeof(*out));
+
+    return 0;
+}
+/* End of file -------------------------------------------------------- */
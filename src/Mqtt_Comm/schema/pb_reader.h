@@ -0,0 +1,60 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PB_READER_H
+#define __PB_READER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* Field value, points into the parsed buffer */
+typedef struct
+{
+    uint8_t wireType;       // PB_WIRE_*
+    uint64_t number;        // Varint and fixed values
+    const uint8_t *start;   // Strings, bytes and nested messages
+    uint32_t length;
+}PB_READER_VALUE_STRUCT;
+
+/* Called for a field with a matching number. Negative return stops the parse with that error */
+typedef int32_t (*PB_READER_HANDLER)(const PB_READER_VALUE_STRUCT *value, void *ctx);
+
+/* Field number to handler table entry */
+typedef struct
+{
+    uint32_t field;
+    PB_READER_HANDLER handler;
+}PB_READER_FIELD_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t pb_reader_parse_message(const uint8_t *message, uint32_t length, const PB_READER_FIELD_STRUCT *fields,
+                                uint32_t fieldCount, void *ctx);
+int32_t pb_reader_get_string(const PB_READER_VALUE_STRUCT *value, uint8_t *out, uint32_t size);
+int32_t pb_reader_get_bool(const PB_READER_VALUE_STRUCT *value, bool *out);
+int32_t pb_reader_get_int(const PB_READER_VALUE_STRUCT *value, int64_t *out);
+int32_t pb_reader_get_double(const PB_READER_VALUE_STRUCT *value, double *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PB_READER_H */
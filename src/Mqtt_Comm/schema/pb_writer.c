@@ -0,0 +1,278 @@
+/* Includes ----------------------------------------------------------- */
+#include "pb_writer.h"
+#include <errno.h>
+#include <string.h>
+
+/* Private defines ---------------------------------------------------- */
+/* Private enumerate/structure ---------------------------------------- */
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+/* Private variables -------------------------------------------------- */
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to reserve space in the output.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        length: Number of bytes to write.
+ *
+ * @return          Pointer to write to, NULL if the output is full or in error.
+ *
+*/
+static uint8_t *reserve(PB_WRITER_STRUCT *writer, uint32_t length)
+{
+    uint8_t *out = NULL;
+
+    if (writer->error != 0)
+    {
+        return NULL;
+    }
+
+    if (length > (writer->size - writer->length))
+    {
+        writer->error = -ENOMEM;
+        return NULL;
+    }
+
+    out = &writer->buffer[writer->length];
+    writer->length += length;
+
+    return out;
+}
+
+/**@brief           Function to write a base 128 varint.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        value: Value to write.
+ *
+ * @return          None.
+ *
+*/
+static void writeVarint(PB_WRITER_STRUCT *writer, uint64_t value)
+{
+    uint8_t bytes[PB_VARINT_MAX_LEN];
+    uint8_t *out = NULL;
+    uint32_t count = 0;
+
+    do
+    {
+        bytes[count] = (uint8_t)(value & 0x7F);
+        value >>= 7;
+        if (value > 0)
+        {
+            bytes[count] |= 0x80;
+        }
+        count++;
+    } while (value > 0);
+
+    out = reserve(writer, count);
+    if (out != NULL)
+    {
+        memcpy(out, bytes, count);
+    }
+}
+
+/**@brief           Function to write a field key.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        field: Field number.
+ * param[in]        wireType: Wire type of the value.
+ *
+ * @return          None.
+ *
+*/
+static void writeKey(PB_WRITER_STRUCT *writer, uint32_t field, uint8_t wireType)
+{
+    writeVarint(writer, ((uint64_t)field << 3) | wireType);
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to start writing a protobuf message into a buffer.
+ *
+ * @details         Nothing is allocated. Fields are written in call order, also the ones with
+ *                  the default value, so the receiver sees every field as present.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          None.
+ *
+*/
+void pb_writer_init(PB_WRITER_STRUCT *writer, uint8_t *buffer, uint32_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->error = (size == 0) ? -ENOMEM : 0;
+}
+
+/**@brief           Function to write an int32 or int64 field.
+ *
+ * @details         Negative values take PB_VARINT_MAX_LEN bytes, as for the proto int types.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        field: Field number.
+ * param[in]        value: Value to write.
+ *
+ * @return          None.
+ *
+*/
+void pb_writer_int(PB_WRITER_STRUCT *writer, uint32_t field, int64_t value)
+{
+    writeKey(writer, field, PB_WIRE_VARINT);
+    writeVarint(writer, (uint64_t)value);
+}
+
+/**@brief           Function to write a uint32 or uint64 field.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        field: Field number.
+ * param[in]        value: Value to write.
+ *
+ * @return          None.
+ *
+*/
+void pb_writer_uint(PB_WRITER_STRUCT *writer, uint32_t field, uint64_t value)
+{
+    writeKey(writer, field, PB_WIRE_VARINT);
+    writeVarint(writer, value);
+}
+
+/**@brief           Function to write a bool field.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        field: Field number.
+ * param[in]        value: Value to write.
+ *
+ * @return          None.
+ *
+*/
+void pb_writer_bool(PB_WRITER_STRUCT *writer, uint32_t field, bool value)
+{
+    writeKey(writer, field, PB_WIRE_VARINT);
+    writeVarint(writer, value ? 1 : 0);
+}
+
+/**@brief           Function to write a double field.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        field: Field number.
+ * param[in]        value: Value to write.
+ *
+ * @return          None.
+ *
+*/
+void pb_writer_double(PB_WRITER_STRUCT *writer, uint32_t field, double value)
+{
+    uint64_t bits = 0;
+    uint8_t *out = NULL;
+
+    writeKey(writer, field, PB_WIRE_FIXED64);
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    out = reserve(writer, sizeof(bits));
+    if (out != NULL)
+    {
+        // Little endian on the wire
+        for (uint32_t i = 0; i < sizeof(bits); i++)
+        {
+            out[i] = (uint8_t)(bits >> (8 * i));
+        }
+    }
+}
+
+/**@brief           Function to write a string field.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        field: Field number.
+ * param[in]        value: String to write. NULL is written as an empty string.
+ * param[in]        maxLength: Max string length, longer strings are an error.
+ *
+ * @return          None.
+ *
+*/
+void pb_writer_string(PB_WRITER_STRUCT *writer, uint32_t field, const uint8_t *value, uint32_t maxLength)
+{
+    uint32_t length = (value != NULL) ? strnlen(value, maxLength + 1) : 0;
+    uint8_t *out = NULL;
+
+    if (length > maxLength)
+    {
+        if (writer->error == 0)
+        {
+            writer->error = -EINVAL;
+        }
+        return;
+    }
+
+    writeKey(writer, field, PB_WIRE_LENGTH);
+    writeVarint(writer, length);
+
+    out = reserve(writer, length);
+    if ((out != NULL) && (length > 0))
+    {
+        memcpy(out, value, length);
+    }
+}
+
+/**@brief           Function to open a nested message field.
+ *
+ * @details         Length is written when the message is closed, in PB_NESTED_LENGTH_SIZE
+ *                  bytes. Short lengths are padded with a continuation byte, which decoders
+ *                  accept, so the nested fields are not moved.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        field: Field number.
+ *
+ * @return          Start of the message, to pass to pb_writer_message_end().
+ *
+*/
+uint32_t pb_writer_message_start(PB_WRITER_STRUCT *writer, uint32_t field)
+{
+    writeKey(writer, field, PB_WIRE_LENGTH);
+    (void)reserve(writer, PB_NESTED_LENGTH_SIZE);
+
+    return writer->length;
+}
+
+/**@brief           Function to close a nested message field.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        start: Value from pb_writer_message_start().
+ *
+ * @return          None.
+ *
+*/
+void pb_writer_message_end(PB_WRITER_STRUCT *writer, uint32_t start)
+{
+    uint32_t length = writer->length - start;
+
+    if (writer->error != 0)
+    {
+        return;
+    }
+
+    if (length >= (1U << (7 * PB_NESTED_LENGTH_SIZE)))
+    {
+        writer->error = -EMSGSIZE;
+        return;
+    }
+
+    writer->buffer[start - 2] = (uint8_t)((length & 0x7F) | 0x80);
+    writer->buffer[start - 1] = (uint8_t)(length >> 7);
+}
+
+/**@brief           Function to finish the message.
+ *
+ * param[in]        writer: Protobuf writer.
+ *
+ * @return          Message length, -ENOMEM if it did not fit, -EINVAL if a string was too long.
+ *
+*/
+int32_t pb_writer_finish(PB_WRITER_STRUCT *writer)
+{
+    return (writer->error != 0) ? writer->error : (int32_t)writer->length;
+}
+/* End of file -------------------------------------------------------- */
@@ -0,0 +1,65 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PB_WRITER_H
+#define __PB_WRITER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* Protobuf wire format output into a caller buffer. First error sticks, later writes do nothing */
+typedef struct
+{
+    uint8_t *buffer;
+    uint32_t size;
+    uint32_t length;
+    int32_t error;
+}PB_WRITER_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+/* Wire types */
+#define PB_WIRE_VARINT      0
+#define PB_WIRE_FIXED64     1
+#define PB_WIRE_LENGTH      2
+#define PB_WIRE_FIXED32     5
+
+/* Longest varint, a negative int32 or int64 */
+#define PB_VARINT_MAX_LEN   10
+
+/* Nested message length is written in this many bytes, max length 16383 */
+#define PB_NESTED_LENGTH_SIZE 2
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+void pb_writer_init(PB_WRITER_STRUCT *writer, uint8_t *buffer, uint32_t size);
+void pb_writer_int(PB_WRITER_STRUCT *writer, uint32_t field, int64_t value);
+void pb_writer_uint(PB_WRITER_STRUCT *writer, uint32_t field, uint64_t value);
+void pb_writer_bool(PB_WRITER_STRUCT *writer, uint32_t field, bool value);
+void pb_writer_double(PB_WRITER_STRUCT *writer, uint32_t field, double value);
+void pb_writer_string(PB_WRITER_STRUCT *writer, uint32_t field, const uint8_t *value, uint32_t maxLength);
+uint32_t pb_writer_message_start(PB_WRITER_STRUCT *writer, uint32_t field);
+void pb_writer_message_end(PB_WRITER_STRUCT *writer, uint32_t start);
+int32_t pb_writer_finish(PB_WRITER_STRUCT *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PB_WRITER_H */
@@ -0,0 +1,888 @@
+/* Includes ----------------------------------------------------------- */
+#include "schema_bench.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <stdio.h>
+#include <string.h>
+#include <cJSON.h>
+#include "thingsboard_schema.h"
+#include "thingsboard_pb.h"
+#include "json_reader.h"
+
+/* Private defines ---------------------------------------------------- */
+#define SCHEMA_BENCH_ITERATIONS     1000
+#define SCHEMA_BENCH_BUFFER_SIZE    512
+#define SCHEMA_BENCH_USERNAME_SIZE  32
+
+/* Private enumerate/structure ---------------------------------------- */
+/* Encoder under test, returns the payload length or negative on error */
+typedef int32_t (*SCHEMA_BENCH_ENCODER)(uint8_t *buffer, uint32_t size);
+
+typedef struct
+{
+    const char *name;
+    SCHEMA_BENCH_ENCODER encoder;
+}SCHEMA_BENCH_CASE_STRUCT;
+
+/* Parser under test, writes the parsed result as text to the buffer */
+typedef int32_t (*SCHEMA_BENCH_PARSER)(const uint8_t *json, uint32_t length, uint8_t *result, uint32_t size);
+
+typedef struct
+{
+    const char *name;
+    SCHEMA_BENCH_PARSER parser;
+}SCHEMA_BENCH_PARSE_CASE_STRUCT;
+
+/* Heap use of a parse, counted through the cJSON allocation hooks */
+typedef struct
+{
+    uint32_t allocations;
+    uint32_t currentBytes;
+    uint32_t peakBytes;
+}SCHEMA_BENCH_HEAP_STRUCT;
+
+/* Provisioning response fields */
+typedef struct
+{
+    bool isSuccess;
+    uint8_t *username;
+    uint32_t size;
+}SCHEMA_BENCH_PROVISION_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+/* Typical wear report, every field near its usual size */
+static const SCHEMA_WEAR_REPORT_STRUCT benchWearReport = {
+    .flashEraseMax = 1532,
+    .flashEraseMaxSector = "lfs17",
+    .flashEraseTotal = 48211,
+    .flashBootErases = 12,
+    .flashBootProgBytes = 20480,
+    .storageQueueMax = 3,
+    .storageFailed = 0,
+    .storageServiceMaxUs = 48113,
+    .storageServiceAvgUs = 2210,
+    .bootCounter = 871,
+    .warmBoots = 4,
+    .resetCause = 2,
+    .publishFailures = 1,
+};
+
+static const SCHEMA_TELEMETRY_SAMPLE_STRUCT benchSample = {
+    .temperature = -12,
+};
+
+/* Downlink messages as ThingsBoard sends them */
+static const uint8_t benchProvisionResponse[] =
+    "{\"credentialsType\":\"ACCESS_TOKEN\",\"credentialsValue\":\"Xa8sd7fH3kLm2Qp9Zr1T\",\"status\":\"SUCCESS\"}";
+static const uint8_t benchAttributeUpdate[] =
+    "{\n  \"fwVersion\": \"1.4.2\",\n  \"interval\": 600,\n  \"LED\": true\n}";
+
+/* Malformed downlink messages json_reader must refuse */
+static const char *const benchMalformedJson[] = {
+    "{\"LED\":true,}",
+    "{\"LED\":true , }",
+    "{,}",
+    "{\"LED\":[true,]}",
+    "{\"LED\":{\"a\":1,}}",
+    "{\"LED\":true}}",
+    "{\"LED\" true}",
+    "[true,]",
+};
+
+/* Same downlink messages in the ThingsBoard protobuf format */
+static const uint8_t benchProvisionResponsePb[] = {
+    0x08, 0x01, 0x1a, 0x14, 0x58, 0x61, 0x38, 0x73, 0x64, 0x37, 0x66, 0x48,
+    0x33, 0x6b, 0x4c, 0x6d, 0x32, 0x51, 0x70, 0x39, 0x5a, 0x72, 0x31, 0x54,
+};
+static const uint8_t benchAttributeUpdatePb[] = {
+    0x0a, 0x1d, 0x08, 0x80, 0x80, 0xb3, 0xc1, 0x9c, 0x33, 0x12, 0x14, 0x0a,
+    0x09, 0x66, 0x77, 0x56, 0x65, 0x72, 0x73, 0x69, 0x6f, 0x6e, 0x10, 0x03,
+    0x32, 0x05, 0x31, 0x2e, 0x34, 0x2e, 0x32, 0x0a, 0x18, 0x08, 0x80, 0x80,
+    0xb3, 0xc1, 0x9c, 0x33, 0x12, 0x0f, 0x0a, 0x08, 0x69, 0x6e, 0x74, 0x65,
+    0x72, 0x76, 0x61, 0x6c, 0x10, 0x01, 0x20, 0xd8, 0x04, 0x0a, 0x10, 0x08,
+    0x80, 0x80, 0xb3, 0xc1, 0x9c, 0x33, 0x12, 0x07, 0x0a, 0x03, 0x4c, 0x45,
+    0x44, 0x18, 0x01,
+};
+
+static const SCHEMA_PROVISION_REQUEST_STRUCT benchProvisionRequest = {
+    .deviceName = "351358811234567",
+    .provisionDeviceKey = "obvk0jffzweh332vf3a5",
+    .provisionDeviceSecret = "0trne28dmb79s9hhjnbb",
+};
+
+static SCHEMA_BENCH_HEAP_STRUCT benchHeap;
+
+static uint8_t benchReference[SCHEMA_BENCH_BUFFER_SIZE];
+static uint8_t benchBuffer[SCHEMA_BENCH_BUFFER_SIZE];
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Wear report with the generated encoder.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeWearSchema(uint8_t *buffer, uint32_t size)
+{
+    return schema_encode_wear_report(&benchWearReport, buffer, size);
+}
+
+/**@brief           Wear report with snprintf, the format used before the schema.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeWearSnprintf(uint8_t *buffer, uint32_t size)
+{
+    const SCHEMA_WEAR_REPORT_STRUCT *r = &benchWearReport;
+    int32_t len = 0;
+
+    len = snprintf(buffer, size,
+                    "{\"flashEraseMax\":%u,\"flashEraseMaxSector\":\"%s\",\"flashEraseTotal\":%u,"
+                    "\"flashBootErases\":%u,\"flashBootProgBytes\":%u,"
+                    "\"storageQueueMax\":%u,\"storageFailed\":%u,\"storageServiceMaxUs\":%u,\"storageServiceAvgUs\":%u,"
+                    "\"bootCounter\":%u,\"warmBoots\":%u,\"resetCause\":%u,\"publishFailures\":%u}",
+                    r->flashEraseMax, r->flashEraseMaxSector, r->flashEraseTotal, r->flashBootErases,
+                    r->flashBootProgBytes, r->storageQueueMax, r->storageFailed, r->storageServiceMaxUs,
+                    r->storageServiceAvgUs, r->bootCounter, r->warmBoots, r->resetCause, r->publishFailures);
+
+    return ((len < 0) || ((uint32_t)len >= size)) ? -ENOMEM : len;
+}
+
+/**@brief           Wear report with cJSON, tree on the heap printed into the buffer.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeWearCjson(uint8_t *buffer, uint32_t size)
+{
+    const SCHEMA_WEAR_REPORT_STRUCT *r = &benchWearReport;
+    cJSON *root = cJSON_CreateObject();
+    int32_t ret = -ENOMEM;
+
+    if (root == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    cJSON_AddNumberToObject(root, "flashEraseMax", r->flashEraseMax);
+    cJSON_AddStringToObject(root, "flashEraseMaxSector", r->flashEraseMaxSector);
+    cJSON_AddNumberToObject(root, "flashEraseTotal", r->flashEraseTotal);
+    cJSON_AddNumberToObject(root, "flashBootErases", r->flashBootErases);
+    cJSON_AddNumberToObject(root, "flashBootProgBytes", r->flashBootProgBytes);
+    cJSON_AddNumberToObject(root, "storageQueueMax", r->storageQueueMax);
+    cJSON_AddNumberToObject(root, "storageFailed", r->storageFailed);
+    cJSON_AddNumberToObject(root, "storageServiceMaxUs", r->storageServiceMaxUs);
+    cJSON_AddNumberToObject(root, "storageServiceAvgUs", r->storageServiceAvgUs);
+    cJSON_AddNumberToObject(root, "bootCounter", r->bootCounter);
+    cJSON_AddNumberToObject(root, "warmBoots", r->warmBoots);
+    cJSON_AddNumberToObject(root, "resetCause", r->resetCause);
+    cJSON_AddNumberToObject(root, "publishFailures", r->publishFailures);
+
+    if (cJSON_PrintPreallocated(root, buffer, size, false))
+    {
+        ret = strlen(buffer);
+    }
+
+    cJSON_Delete(root);
+
+    return ret;
+}
+
+/**@brief           Telemetry sample with the generated encoder.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeSampleSchema(uint8_t *buffer, uint32_t size)
+{
+    return schema_encode_telemetry_sample(&benchSample, buffer, size);
+}
+
+/**@brief           Telemetry sample with snprintf.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeSampleSnprintf(uint8_t *buffer, uint32_t size)
+{
+    int32_t len = snprintf(buffer, size, "{\"temperature\":%d}", benchSample.temperature);
+
+    return ((len < 0) || ((uint32_t)len >= size)) ? -ENOMEM : len;
+}
+
+/**@brief           Telemetry sample with cJSON.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeSampleCjson(uint8_t *buffer, uint32_t size)
+{
+    cJSON *root = cJSON_CreateObject();
+    int32_t ret = -ENOMEM;
+
+    if (root == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    cJSON_AddNumberToObject(root, "temperature", benchSample.temperature);
+
+    if (cJSON_PrintPreallocated(root, buffer, size, false))
+    {
+        ret = strlen(buffer);
+    }
+
+    cJSON_Delete(root);
+
+    return ret;
+}
+
+/**@brief           Wear report with the generated protobuf encoder.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeWearProtobuf(uint8_t *buffer, uint32_t size)
+{
+    return schema_pb_encode_wear_report(&benchWearReport, buffer, size);
+}
+
+/**@brief           Telemetry sample with the generated protobuf encoder.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeSampleProtobuf(uint8_t *buffer, uint32_t size)
+{
+    return schema_pb_encode_telemetry_sample(&benchSample, buffer, size);
+}
+
+/**@brief           Provisioning request with the generated encoder.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeProvisionSchema(uint8_t *buffer, uint32_t size)
+{
+    return schema_encode_provision_request(&benchProvisionRequest, buffer, size);
+}
+
+/**@brief           Provisioning request as ThingsBoard ProvisionDeviceRequestMsg.
+ *
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Payload length, negative on error.
+ *
+*/
+static int32_t encodeProvisionProtobuf(uint8_t *buffer, uint32_t size)
+{
+    return tb_pb_encode_provision_request(&benchProvisionRequest, buffer, size);
+}
+
+/**@brief           Counting allocator for cJSON.
+ *
+ * param[in]        size: Bytes to allocate.
+ *
+ * @return          Allocated memory, NULL if the heap is full.
+ *
+*/
+static void *benchMalloc(size_t size)
+{
+    // Size is kept in front of the block for the free
+    uint64_t *block = k_malloc(size + sizeof(uint64_t));
+
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    block[0] = size;
+    benchHeap.allocations++;
+    benchHeap.currentBytes += size;
+    benchHeap.peakBytes = MAX(benchHeap.peakBytes, benchHeap.currentBytes);
+
+    return &block[1];
+}
+
+/**@brief           Counting free for cJSON.
+ *
+ * param[in]        ptr: Memory from benchMalloc.
+ *
+ * @return          None.
+ *
+*/
+static void benchFree(void *ptr)
+{
+    uint64_t *block = ptr;
+
+    if (block == NULL)
+    {
+        return;
+    }
+
+    block--;
+    benchHeap.currentBytes -= (uint32_t)block[0];
+    k_free(block);
+}
+
+/**@brief           Handler of the provisioning status.
+ *
+ * param[in]        value: Status value.
+ * param[in]        ctx: Provisioning response.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onProvisionStatus(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    SCHEMA_BENCH_PROVISION_STRUCT *response = ctx;
+    uint8_t status[sizeof("SUCCESS")];
+
+    response->isSuccess = (json_reader_get_string(value, status, sizeof(status)) >= 0) && (strcmp(status, "SUCCESS") == 0);
+
+    return 0;
+}
+
+/**@brief           Handler of the provisioned credentials.
+ *
+ * param[in]        value: Credentials value.
+ * param[in]        ctx: Provisioning response.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t onProvisionCredentials(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    SCHEMA_BENCH_PROVISION_STRUCT *response = ctx;
+    int32_t ret = json_reader_get_string(value, response->username, response->size);
+
+    return (ret < 0) ? ret : 0;
+}
+
+/**@brief           Handler of the LED attribute.
+ *
+ * param[in]        value: Attribute value.
+ * param[in]        ctx: LED state.
+ *
+ * @return          0 if successful, negative if not a bool.
+ *
+*/
+static int32_t onLedAttribute(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    return json_reader_get_bool(value, ctx);
+}
+
+/**@brief           Provisioning response with json_reader.
+ *
+ * param[in]        json: Message.
+ * param[in]        length: Message length.
+ * param[in]        result: Username output.
+ * param[in]        size: Output size.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t parseProvisionReader(const uint8_t *json, uint32_t length, uint8_t *result, uint32_t size)
+{
+    static const JSON_READER_KEY_STRUCT keys[] = {
+        {.key = "status", .handler = onProvisionStatus},
+        {.key = "credentialsValue", .handler = onProvisionCredentials},
+    };
+    uint8_t username[SCHEMA_BENCH_USERNAME_SIZE] = {0};
+    SCHEMA_BENCH_PROVISION_STRUCT response = {.username = username, .size = sizeof(username)};
+    int32_t ret = 0;
+
+    ret = json_reader_parse_object(json, length, keys, ARRAY_SIZE(keys), &response);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    if (!response.isSuccess)
+    {
+        return -EACCES;
+    }
+
+    snprintf(result, size, "%s", username);
+
+    return 0;
+}
+
+/**@brief           Provisioning response with cJSON, the parse used before json_reader.
+ *
+ * param[in]        json: Message, zero terminated.
+ * param[in]        length: Message length.
+ * param[in]        result: Username output.
+ * param[in]        size: Output size.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t parseProvisionCjson(const uint8_t *json, uint32_t length, uint8_t *result, uint32_t size)
+{
+    cJSON *root = cJSON_Parse(json);
+    cJSON *status = NULL;
+    cJSON *credentials = NULL;
+    int32_t ret = -EACCES;
+
+    ARG_UNUSED(length);
+
+    if (root == NULL)
+    {
+        return -EBADMSG;
+    }
+
+    status = cJSON_GetObjectItem(root, "status");
+    credentials = cJSON_GetObjectItem(root, "credentialsValue");
+    if ((status != NULL) && (status->valuestring != NULL) && (strcmp(status->valuestring, "SUCCESS") == 0) &&
+        (credentials != NULL) && (credentials->valuestring != NULL) &&
+        (strlen(credentials->valuestring) < SCHEMA_BENCH_USERNAME_SIZE))
+    {
+        snprintf(result, size, "%s", credentials->valuestring);
+        ret = 0;
+    }
+
+    cJSON_Delete(root);
+
+    return ret;
+}
+
+/**@brief           Attribute update with json_reader.
+ *
+ * param[in]        json: Message.
+ * param[in]        length: Message length.
+ * param[in]        result: LED state output.
+ * param[in]        size: Output size.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t parseAttributeReader(const uint8_t *json, uint32_t length, uint8_t *result, uint32_t size)
+{
+    static const JSON_READER_KEY_STRUCT keys[] = {
+        {.key = "LED", .handler = onLedAttribute},
+    };
+    bool led = false;
+    int32_t ret = 0;
+
+    ret = json_reader_parse_object(json, length, keys, ARRAY_SIZE(keys), &led);
+    if (ret <= 0)
+    {
+        return (ret < 0) ? ret : -ENOENT;
+    }
+
+    snprintf(result, size, "%s", led ? "true" : "false");
+
+    return 0;
+}
+
+/**@brief           Attribute update with cJSON.
+ *
+ * param[in]        json: Message, zero terminated.
+ * param[in]        length: Message length.
+ * param[in]        result: LED state output.
+ * param[in]        size: Output size.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t parseAttributeCjson(const uint8_t *json, uint32_t length, uint8_t *result, uint32_t size)
+{
+    cJSON *root = cJSON_Parse(json);
+    cJSON *led = NULL;
+    int32_t ret = -ENOENT;
+
+    ARG_UNUSED(length);
+
+    if (root == NULL)
+    {
+        return -EBADMSG;
+    }
+
+    led = cJSON_GetObjectItem(root, "LED");
+    if (cJSON_IsBool(led))
+    {
+        snprintf(result, size, "%s", cJSON_IsTrue(led) ? "true" : "false");
+        ret = 0;
+    }
+
+    cJSON_Delete(root);
+
+    return ret;
+}
+
+/**@brief           Provisioning response with the protobuf reader.
+ *
+ * param[in]        message: Message.
+ * param[in]        length: Message length.
+ * param[in]        result: Username output.
+ * param[in]        size: Output size.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t parseProvisionProtobuf(const uint8_t *message, uint32_t length, uint8_t *result, uint32_t size)
+{
+    uint8_t username[SCHEMA_BENCH_USERNAME_SIZE] = {0};
+    int32_t ret = 0;
+
+    ret = tb_pb_parse_provision_response(message, length, username, sizeof(username));
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    snprintf(result, size, "%s", username);
+
+    return 0;
+}
+
+/**@brief           Handler of the LED attribute in a protobuf update.
+ *
+ * param[in]        attribute: Updated attribute.
+ * param[in]        ctx: LED state.
+ *
+ * @return          0 if successful, -EINVAL if not a bool.
+ *
+*/
+static int32_t onLedAttributePb(const TB_PB_ATTRIBUTE_STRUCT *attribute, void *ctx)
+{
+    bool *led = ctx;
+
+    if (attribute->type != TB_PB_VALUE_BOOL)
+    {
+        return -EINVAL;
+    }
+
+    *led = attribute->boolValue;
+
+    return 0;
+}
+
+/**@brief           Attribute update with the protobuf reader.
+ *
+ * param[in]        message: Message.
+ * param[in]        length: Message length.
+ * param[in]        result: LED state output.
+ * param[in]        size: Output size.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t parseAttributeProtobuf(const uint8_t *message, uint32_t length, uint8_t *result, uint32_t size)
+{
+    static const TB_PB_ATTRIBUTE_KEY_STRUCT keys[] = {
+        {.key = "LED", .handler = onLedAttributePb},
+    };
+    bool led = false;
+    int32_t ret = 0;
+
+    ret = tb_pb_parse_attribute_update(message, length, keys, ARRAY_SIZE(keys), &led);
+    if (ret <= 0)
+    {
+        return (ret < 0) ? ret : -ENOENT;
+    }
+
+    snprintf(result, size, "%s", led ? "true" : "false");
+
+    return 0;
+}
+
+/**@brief           Function to run the parsers of one message.
+ *
+ * @details         First parser is the reference, the result of the others must match it.
+ *                  Heap peak and allocations per parse are counted through the cJSON hooks.
+ *
+ * param[in]        message: Message name.
+ * param[in]        json: Message, JSON ones zero terminated.
+ * param[in]        length: Message length.
+ * param[in]        cases: Parsers.
+ * param[in]        count: Number of parsers.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t runParse(const char *message, const uint8_t *json, uint32_t length,
+                        const SCHEMA_BENCH_PARSE_CASE_STRUCT *cases, uint32_t count)
+{
+    cJSON_Hooks hooks = {.malloc_fn = benchMalloc, .free_fn = benchFree};
+    uint32_t startCycles = 0;
+    uint64_t elapsedNs = 0;
+    int32_t ret = 0;
+    int32_t err = 0;
+
+    cJSON_InitHooks(&hooks);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memset(&benchHeap, 0, sizeof(benchHeap));
+
+        err = cases[i].parser(json, length, (i == 0) ? benchReference : benchBuffer, SCHEMA_BENCH_BUFFER_SIZE);
+        if (err < 0)
+        {
+            printk("Parse %s %s failed: %d\n", message, cases[i].name, err);
+            ret = err;
+            continue;
+        }
+
+        if ((i > 0) && (strcmp(benchBuffer, benchReference) != 0))
+        {
+            printk("Parse %s %s result differs: %s, %s\n", message, cases[i].name, benchBuffer, benchReference);
+            ret = -EINVAL;
+        }
+
+        startCycles = k_cycle_get_32();
+        for (uint32_t n = 0; n < SCHEMA_BENCH_ITERATIONS; n++)
+        {
+            (void)cases[i].parser(json, length, benchBuffer, SCHEMA_BENCH_BUFFER_SIZE);
+        }
+        elapsedNs = k_cyc_to_ns_floor64(k_cycle_get_32() - startCycles);
+
+        printk("Parse  %-16s %-8s %4u B %8u parses/s  %6u ns/parse  heap %u B peak in %u allocs\n", message,
+                cases[i].name, length,
+                (uint32_t)((elapsedNs > 0) ? (SCHEMA_BENCH_ITERATIONS * 1000000000ULL / elapsedNs) : 0),
+                (uint32_t)(elapsedNs / SCHEMA_BENCH_ITERATIONS), benchHeap.peakBytes,
+                benchHeap.allocations / (SCHEMA_BENCH_ITERATIONS + 1));
+    }
+
+    // Back to the system heap
+    hooks.malloc_fn = k_malloc;
+    hooks.free_fn = k_free;
+    cJSON_InitHooks(&hooks);
+
+    return ret;
+}
+
+/**@brief           Member handler that accepts every member.
+ *
+ * param[in]        key: Member key.
+ * param[in]        value: Member value.
+ * param[in]        ctx: Not used.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onAnyMember(const JSON_READER_VALUE_STRUCT *key, const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    ARG_UNUSED(key);
+    ARG_UNUSED(value);
+    ARG_UNUSED(ctx);
+
+    return 0;
+}
+
+/**@brief           Function to check that json_reader refuses malformed messages.
+ *
+ * @details         Downlink payloads come from the network, a message cJSON would refuse must
+ *                  not reach the handlers either.
+ *
+ * param[in]        None.
+ *
+ * @return          0 if every message is refused, -EINVAL otherwise.
+ *
+*/
+static int32_t runMalformed(void)
+{
+    JSON_READER_VALUE_STRUCT value;
+    const char *json = NULL;
+    int32_t ret = 0;
+    int32_t err = 0;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(benchMalformedJson); i++)
+    {
+        json = benchMalformedJson[i];
+        err = (json[0] == '{') ? json_reader_parse_members(json, strlen(json), onAnyMember, NULL) :
+                json_reader_parse_value(json, strlen(json), &value);
+        if (err != -EBADMSG)
+        {
+            printk("Parse malformed %s not refused: %d\n", json, err);
+            ret = -EINVAL;
+        }
+    }
+
+    printk("Parse  malformed        reader   %u messages %s\n", (uint32_t)ARRAY_SIZE(benchMalformedJson),
+            (ret < 0) ? "NOT all refused" : "refused");
+
+    return ret;
+}
+
+/**@brief           Function to run the encoders of one message.
+ *
+ * @details         First encoder is the reference, the output of the others must match it.
+ *
+ * param[in]        message: Message name.
+ * param[in]        cases: Encoders.
+ * param[in]        count: Number of encoders.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t runMessage(const char *message, const SCHEMA_BENCH_CASE_STRUCT *cases, uint32_t count)
+{
+    uint32_t startCycles = 0;
+    uint64_t elapsedNs = 0;
+    int32_t length = 0;
+    int32_t ret = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        length = cases[i].encoder((i == 0) ? benchReference : benchBuffer, SCHEMA_BENCH_BUFFER_SIZE);
+        if (length < 0)
+        {
+            printk("Encode %s %s failed: %d\n", message, cases[i].name, length);
+            ret = length;
+            continue;
+        }
+
+        if ((i > 0) && (strcmp(benchBuffer, benchReference) != 0))
+        {
+            printk("Encode %s %s output differs:\n  %s\n  %s\n", message, cases[i].name, benchBuffer, benchReference);
+            ret = -EINVAL;
+        }
+
+        startCycles = k_cycle_get_32();
+        for (uint32_t n = 0; n < SCHEMA_BENCH_ITERATIONS; n++)
+        {
+            (void)cases[i].encoder(benchBuffer, SCHEMA_BENCH_BUFFER_SIZE);
+        }
+        elapsedNs = k_cyc_to_ns_floor64(k_cycle_get_32() - startCycles);
+
+        printk("Encode %-16s %-8s %4d B %8u encodes/s %6u ns/encode\n", message, cases[i].name, length,
+                (uint32_t)((elapsedNs > 0) ? (SCHEMA_BENCH_ITERATIONS * 1000000000ULL / elapsedNs) : 0),
+                (uint32_t)(elapsedNs / SCHEMA_BENCH_ITERATIONS));
+    }
+
+    return ret;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to run the message encoder and parser benchmarks.
+ *
+ * @details         Every schema message is encoded with the generated encoder, snprintf and
+ *                  cJSON. Provisioning response and attribute update are parsed with json_reader
+ *                  and cJSON, with the heap use of each. Same messages are then encoded and parsed
+ *                  in the protobuf payload mode for the size and time against JSON. Malformed
+ *                  messages are checked to be refused. Results are printed on the console.
+ *
+ * param[in]        None.
+ *
+ * @return          0 if successful, negative if an encoder failed or outputs differ.
+ *
+*/
+int32_t schema_bench_run(void)
+{
+    static const SCHEMA_BENCH_CASE_STRUCT wearCases[] = {
+        {.name = "schema", .encoder = encodeWearSchema},
+        {.name = "snprintf", .encoder = encodeWearSnprintf},
+        {.name = "cJSON", .encoder = encodeWearCjson},
+    };
+    static const SCHEMA_BENCH_CASE_STRUCT sampleCases[] = {
+        {.name = "schema", .encoder = encodeSampleSchema},
+        {.name = "snprintf", .encoder = encodeSampleSnprintf},
+        {.name = "cJSON", .encoder = encodeSampleCjson},
+    };
+    static const SCHEMA_BENCH_CASE_STRUCT provisionRequestCases[] = {
+        {.name = "schema", .encoder = encodeProvisionSchema},
+    };
+    static const SCHEMA_BENCH_CASE_STRUCT wearProtobufCases[] = {
+        {.name = "protobuf", .encoder = encodeWearProtobuf},
+    };
+    static const SCHEMA_BENCH_CASE_STRUCT sampleProtobufCases[] = {
+        {.name = "protobuf", .encoder = encodeSampleProtobuf},
+    };
+    static const SCHEMA_BENCH_CASE_STRUCT provisionRequestProtobufCases[] = {
+        {.name = "protobuf", .encoder = encodeProvisionProtobuf},
+    };
+    static const SCHEMA_BENCH_PARSE_CASE_STRUCT provisionProtobufCases[] = {
+        {.name = "protobuf", .parser = parseProvisionProtobuf},
+    };
+    static const SCHEMA_BENCH_PARSE_CASE_STRUCT attributeProtobufCases[] = {
+        {.name = "protobuf", .parser = parseAttributeProtobuf},
+    };
+    static const SCHEMA_BENCH_PARSE_CASE_STRUCT provisionCases[] = {
+        {.name = "reader", .parser = parseProvisionReader},
+        {.name = "cJSON", .parser = parseProvisionCjson},
+    };
+    static const SCHEMA_BENCH_PARSE_CASE_STRUCT attributeCases[] = {
+        {.name = "reader", .parser = parseAttributeReader},
+        {.name = "cJSON", .parser = parseAttributeCjson},
+    };
+    int32_t ret = 0;
+    int32_t err = 0;
+
+    printk("Message encoder and parser benchmark, %u runs per case\n", SCHEMA_BENCH_ITERATIONS);
+
+    err = runMessage("wear_report", wearCases, ARRAY_SIZE(wearCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runMessage("telemetry_sample", sampleCases, ARRAY_SIZE(sampleCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runMessage("provision_req", provisionRequestCases, ARRAY_SIZE(provisionRequestCases));
+    ret = (err < 0) ? err : ret;
+
+    // Binary payload mode, output differs from JSON so each runs on its own
+    err = runMessage("wear_report", wearProtobufCases, ARRAY_SIZE(wearProtobufCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runMessage("telemetry_sample", sampleProtobufCases, ARRAY_SIZE(sampleProtobufCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runMessage("provision_req", provisionRequestProtobufCases, ARRAY_SIZE(provisionRequestProtobufCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runParse("provision", benchProvisionResponse, strlen(benchProvisionResponse), provisionCases,
+                    ARRAY_SIZE(provisionCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runParse("attribute", benchAttributeUpdate, strlen(benchAttributeUpdate), attributeCases,
+                    ARRAY_SIZE(attributeCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runParse("provision", benchProvisionResponsePb, sizeof(benchProvisionResponsePb), provisionProtobufCases,
+                    ARRAY_SIZE(provisionProtobufCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runParse("attribute", benchAttributeUpdatePb, sizeof(benchAttributeUpdatePb), attributeProtobufCases,
+                    ARRAY_SIZE(attributeProtobufCases));
+    ret = (err < 0) ? err : ret;
+
+    err = runMalformed();
+    ret = (err < 0) ? err : ret;
+
+    return ret;
+}
+/* End of file -------------------------------------------------------- */
@@ -0,0 +1,29 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SCHEMA_BENCH_H
+#define __SCHEMA_BENCH_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* Exported constants --------------------------------------------------------*/
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t schema_bench_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCHEMA_BENCH_H */
@@ -0,0 +1,701 @@
+/* Includes ----------------------------------------------------------- */
+#include "thingsboard_pb.h"
+#include "pb_reader.h"
+#include <errno.h>
+#include <string.h>
+#include <zephyr/sys/util.h>
+
+/* Private defines ---------------------------------------------------- */
+/* Field numbers of the ThingsBoard transport.proto messages:
+ *
+ *   message ProvisionDeviceRequestMsg {
+ *     string deviceName = 1;
+ *     CredentialsType credentialsType = 2;
+ *     ProvisionDeviceCredentialsMsg provisionDeviceCredentialsMsg = 3;
+ *   }
+ *   message ProvisionDeviceCredentialsMsg {
+ *     string provisionDeviceKey = 1;
+ *     string provisionDeviceSecret = 2;
+ *   }
+ *   message ProvisionDeviceResponseMsg {
+ *     ResponseStatus status = 1;
+ *     CredentialsType credentialsType = 2;
+ *     string credentialsValue = 3;
+ *   }
+ *   message AttributeUpdateNotificationMsg {
+ *     repeated TsKvProto sharedUpdated = 1;
+ *     repeated string sharedDeleted = 2;
+ *   }
+ *   message TsKvProto { int64 ts = 1; KeyValueProto kv = 2; }
+ *   message KeyValueProto {
+ *     string key = 1; KeyValueType type = 2; bool bool_v = 3; int64 long_v = 4;
+ *     double double_v = 5; string string_v = 6; string json_v = 7;
+ *   }
+ */
+#define PROVISION_REQUEST_DEVICE_NAME       1
+#define PROVISION_REQUEST_CREDENTIALS_TYPE  2
+#define PROVISION_REQUEST_CREDENTIALS       3
+#define PROVISION_CREDENTIALS_KEY           1
+#define PROVISION_CREDENTIALS_SECRET        2
+#define PROVISION_RESPONSE_STATUS           1
+#define PROVISION_RESPONSE_CREDENTIALS      3
+
+#define ATTRIBUTE_UPDATE_SHARED_UPDATED     1
+#define TS_KV_KV                            2
+#define KV_KEY                              1
+#define KV_TYPE                             2
+#define KV_BOOL                             3
+#define KV_LONG                             4
+#define KV_DOUBLE                           5
+#define KV_STRING                           6
+#define KV_JSON                             7
+
+#define CREDENTIALS_TYPE_ACCESS_TOKEN       0
+#define RESPONSE_STATUS_SUCCESS             1
+
+/* Device profile telemetry schema, ThingsBoard reads ts and values from its JSON form:
+ *
+ *   message TelemetryEntry {
+ *     optional int64 ts = 1;
+ *     map<string, double> values = 2;
+ *   }
+ */
+#define TELEMETRY_ENTRY_TS                  1
+#define TELEMETRY_ENTRY_VALUES              2
+#define MAP_ENTRY_KEY                       1
+#define MAP_ENTRY_VALUE                     2
+
+/* Default RPC schemas of the device profile protobuf transport:
+ *
+ *   message RpcRequestMsg {
+ *     optional string method = 1;
+ *     optional int32 requestId = 2;
+ *     optional string params = 3;
+ *   }
+ *   message RpcResponseMsg {
+ *     optional string payload = 1;
+ *   }
+ */
+#define RPC_REQUEST_METHOD                  1
+#define RPC_REQUEST_ID                      2
+#define RPC_REQUEST_PARAMS                  3
+#define RPC_RESPONSE_PAYLOAD                1
+
+/* Attribute request of the device API and its response:
+ *
+ *   message AttributesRequest {
+ *     string clientKeys = 1;
+ *     string sharedKeys = 2;
+ *   }
+ *   message GetAttributeResponseMsg {
+ *     int32 requestId = 1;
+ *     repeated TsKvProto clientAttributeList = 2;
+ *     repeated TsKvProto sharedAttributeList = 3;
+ *   }
+ */
+#define ATTRIBUTES_REQUEST_CLIENT_KEYS      1
+#define ATTRIBUTES_REQUEST_SHARED_KEYS      2
+#define ATTRIBUTES_RESPONSE_CLIENT          2
+#define ATTRIBUTES_RESPONSE_SHARED          3
+
+/* Longest provisioning string, as in the provision_request schema */
+#define PROVISION_STRING_MAX_LEN            32
+
+/* Longest telemetry key */
+#define TELEMETRY_KEY_MAX_LEN               127
+
+/* Private enumerate/structure ---------------------------------------- */
+/* Provisioning response fields */
+typedef struct
+{
+    bool isSuccess;
+    int32_t credentialsLength;
+    uint8_t *credentials;
+    uint32_t size;
+}TB_PB_PROVISION_RESPONSE_STRUCT;
+
+/* Attribute update dispatch */
+typedef struct
+{
+    const TB_PB_ATTRIBUTE_KEY_STRUCT *keys;
+    uint32_t keyCount;
+    void *ctx;
+    int32_t handled;
+}TB_PB_ATTRIBUTE_UPDATE_STRUCT;
+
+/* Attribute response dispatch, one per scope */
+typedef struct
+{
+    TB_PB_ATTRIBUTE_UPDATE_STRUCT client;
+    TB_PB_ATTRIBUTE_UPDATE_STRUCT shared;
+}TB_PB_ATTRIBUTES_RESPONSE_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+/* Private variables -------------------------------------------------- */
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Handler of the provisioning status.
+ *
+ * param[in]        value: Status value.
+ * param[in]        ctx: Provisioning response.
+ *
+ * @return          0.
+ *
+*/
+static int32_t onProvisionStatus(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_PROVISION_RESPONSE_STRUCT *response = ctx;
+    int64_t status = 0;
+
+    response->isSuccess = (pb_reader_get_int(value, &status) >= 0) && (status == RESPONSE_STATUS_SUCCESS);
+
+    return 0;
+}
+
+/**@brief           Handler of the provisioned credentials.
+ *
+ * param[in]        value: Credentials value.
+ * param[in]        ctx: Provisioning response.
+ *
+ * @return          0 if successful, negative if not a string or too long.
+ *
+*/
+static int32_t onProvisionCredentials(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_PROVISION_RESPONSE_STRUCT *response = ctx;
+
+    response->credentialsLength = pb_reader_get_string(value, response->credentials, response->size);
+
+    return (response->credentialsLength < 0) ? response->credentialsLength : 0;
+}
+
+/**@brief           Handler of the attribute key.
+ *
+ * param[in]        value: Key value.
+ * param[in]        ctx: Attribute.
+ *
+ * @return          0 if successful, -EBADMSG if not a string.
+ *
+*/
+static int32_t onAttributeKey(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_ATTRIBUTE_STRUCT *attribute = ctx;
+
+    if (value->wireType != PB_WIRE_LENGTH)
+    {
+        return -EBADMSG;
+    }
+
+    attribute->key = value->start;
+    attribute->keyLength = value->length;
+
+    return 0;
+}
+
+/**@brief           Handler of the attribute value type.
+ *
+ * param[in]        value: Type value.
+ * param[in]        ctx: Attribute.
+ *
+ * @return          0 if successful, -EBADMSG if not a varint.
+ *
+*/
+static int32_t onAttributeType(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_ATTRIBUTE_STRUCT *attribute = ctx;
+    int64_t type = 0;
+
+    if (pb_reader_get_int(value, &type) < 0)
+    {
+        return -EBADMSG;
+    }
+
+    attribute->type = (TB_PB_VALUE_TYPE)type;
+
+    return 0;
+}
+
+/**@brief           Handler of the bool attribute value.
+ *
+ * param[in]        value: Bool value.
+ * param[in]        ctx: Attribute.
+ *
+ * @return          0 if successful, -EBADMSG if not a varint.
+ *
+*/
+static int32_t onAttributeBool(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_ATTRIBUTE_STRUCT *attribute = ctx;
+
+    return (pb_reader_get_bool(value, &attribute->boolValue) < 0) ? -EBADMSG : 0;
+}
+
+/**@brief           Handler of the long attribute value.
+ *
+ * param[in]        value: Long value.
+ * param[in]        ctx: Attribute.
+ *
+ * @return          0 if successful, -EBADMSG if not a varint.
+ *
+*/
+static int32_t onAttributeLong(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_ATTRIBUTE_STRUCT *attribute = ctx;
+
+    return (pb_reader_get_int(value, &attribute->longValue) < 0) ? -EBADMSG : 0;
+}
+
+/**@brief           Handler of the double attribute value.
+ *
+ * param[in]        value: Double value.
+ * param[in]        ctx: Attribute.
+ *
+ * @return          0 if successful, -EBADMSG if not a fixed64.
+ *
+*/
+static int32_t onAttributeDouble(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_ATTRIBUTE_STRUCT *attribute = ctx;
+
+    return (pb_reader_get_double(value, &attribute->doubleValue) < 0) ? -EBADMSG : 0;
+}
+
+/**@brief           Handler of the string and JSON attribute values.
+ *
+ * param[in]        value: String value.
+ * param[in]        ctx: Attribute.
+ *
+ * @return          0 if successful, -EBADMSG if not a string.
+ *
+*/
+static int32_t onAttributeString(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_ATTRIBUTE_STRUCT *attribute = ctx;
+
+    if (value->wireType != PB_WIRE_LENGTH)
+    {
+        return -EBADMSG;
+    }
+
+    attribute->stringValue = value->start;
+    attribute->stringLength = value->length;
+
+    return 0;
+}
+
+/**@brief           Handler of the KeyValueProto of an updated attribute.
+ *
+ * @details         Attribute is complete here, the handlers of its key are called.
+ *
+ * param[in]        value: KeyValueProto message.
+ * param[in]        ctx: Attribute update dispatch.
+ *
+ * @return          0 if successful, -EBADMSG if not valid, handler error otherwise.
+ *
+*/
+static int32_t onTsKvValue(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    static const PB_READER_FIELD_STRUCT fields[] = {
+        {.field = KV_KEY, .handler = onAttributeKey},
+        {.field = KV_TYPE, .handler = onAttributeType},
+        {.field = KV_BOOL, .handler = onAttributeBool},
+        {.field = KV_LONG, .handler = onAttributeLong},
+        {.field = KV_DOUBLE, .handler = onAttributeDouble},
+        {.field = KV_STRING, .handler = onAttributeString},
+        {.field = KV_JSON, .handler = onAttributeString},
+    };
+    TB_PB_ATTRIBUTE_UPDATE_STRUCT *update = ctx;
+    TB_PB_ATTRIBUTE_STRUCT attribute = {0};
+    const TB_PB_ATTRIBUTE_KEY_STRUCT *key = NULL;
+    int32_t ret = 0;
+
+    if (value->wireType != PB_WIRE_LENGTH)
+    {
+        return -EBADMSG;
+    }
+
+    ret = pb_reader_parse_message(value->start, value->length, fields, ARRAY_SIZE(fields), &attribute);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    for (uint32_t i = 0; i < update->keyCount; i++)
+    {
+        key = &update->keys[i];
+        if ((strlen(key->key) == attribute.keyLength) && (memcmp(key->key, attribute.key, attribute.keyLength) == 0))
+        {
+            ret = key->handler(&attribute, update->ctx);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            update->handled++;
+        }
+    }
+
+    return 0;
+}
+
+/**@brief           Handler of an attribute in a TsKvProto.
+ *
+ * param[in]        value: TsKvProto message.
+ * param[in]        ctx: Attribute update dispatch.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t onTsKv(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    static const PB_READER_FIELD_STRUCT fields[] = {
+        {.field = TS_KV_KV, .handler = onTsKvValue},
+    };
+    int32_t ret = 0;
+
+    if (value->wireType != PB_WIRE_LENGTH)
+    {
+        return -EBADMSG;
+    }
+
+    ret = pb_reader_parse_message(value->start, value->length, fields, ARRAY_SIZE(fields), ctx);
+
+    return (ret < 0) ? ret : 0;
+}
+
+/**@brief           Handler of a client attribute in an attribute response.
+ *
+ * param[in]        value: TsKvProto message.
+ * param[in]        ctx: Attribute response dispatch.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t onClientAttribute(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_ATTRIBUTES_RESPONSE_STRUCT *response = ctx;
+
+    return onTsKv(value, &response->client);
+}
+
+/**@brief           Handler of a shared attribute in an attribute response.
+ *
+ * param[in]        value: TsKvProto message.
+ * param[in]        ctx: Attribute response dispatch.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+static int32_t onSharedAttribute(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_ATTRIBUTES_RESPONSE_STRUCT *response = ctx;
+
+    return onTsKv(value, &response->shared);
+}
+
+/**@brief           Handler of the RPC method name.
+ *
+ * param[in]        value: Method value.
+ * param[in]        ctx: RPC request.
+ *
+ * @return          0 if successful, -EBADMSG if not a string.
+ *
+*/
+static int32_t onRpcMethod(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_RPC_REQUEST_STRUCT *request = ctx;
+
+    if (value->wireType != PB_WIRE_LENGTH)
+    {
+        return -EBADMSG;
+    }
+
+    request->method = value->start;
+    request->methodLength = value->length;
+
+    return 0;
+}
+
+/**@brief           Handler of the RPC request id.
+ *
+ * param[in]        value: Request id value.
+ * param[in]        ctx: RPC request.
+ *
+ * @return          0 if successful, -EBADMSG if not a varint.
+ *
+*/
+static int32_t onRpcRequestId(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_RPC_REQUEST_STRUCT *request = ctx;
+
+    return (pb_reader_get_int(value, &request->requestId) < 0) ? -EBADMSG : 0;
+}
+
+/**@brief           Handler of the RPC params.
+ *
+ * param[in]        value: Params value, JSON text.
+ * param[in]        ctx: RPC request.
+ *
+ * @return          0 if successful, -EBADMSG if not a string.
+ *
+*/
+static int32_t onRpcParams(const PB_READER_VALUE_STRUCT *value, void *ctx)
+{
+    TB_PB_RPC_REQUEST_STRUCT *request = ctx;
+
+    if (value->wireType != PB_WIRE_LENGTH)
+    {
+        return -EBADMSG;
+    }
+
+    request->params = value->start;
+    request->paramsLength = value->length;
+
+    return 0;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to encode the provisioning request as ProvisionDeviceRequestMsg.
+ *
+ * @details         Device asks for an access token, as the JSON request does.
+ *
+ * param[in]        request: Request fields.
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Message length, negative on error.
+ *
+*/
+int32_t tb_pb_encode_provision_request(const SCHEMA_PROVISION_REQUEST_STRUCT *request, uint8_t *buffer, uint32_t size)
+{
+    PB_WRITER_STRUCT writer;
+    uint32_t credentials = 0;
+
+    pb_writer_init(&writer, buffer, size);
+    pb_writer_string(&writer, PROVISION_REQUEST_DEVICE_NAME, request->deviceName, PROVISION_STRING_MAX_LEN);
+    pb_writer_uint(&writer, PROVISION_REQUEST_CREDENTIALS_TYPE, CREDENTIALS_TYPE_ACCESS_TOKEN);
+
+    credentials = pb_writer_message_start(&writer, PROVISION_REQUEST_CREDENTIALS);
+    pb_writer_string(&writer, PROVISION_CREDENTIALS_KEY, request->provisionDeviceKey,
+                        PROVISION_STRING_MAX_LEN);
+    pb_writer_string(&writer, PROVISION_CREDENTIALS_SECRET, request->provisionDeviceSecret,
+                        PROVISION_STRING_MAX_LEN);
+    pb_writer_message_end(&writer, credentials);
+
+    return pb_writer_finish(&writer);
+}
+
+/**@brief           Function to parse a ProvisionDeviceResponseMsg.
+ *
+ * param[in]        message: Response message.
+ * param[in]        length: Message length.
+ * param[in]        credentials: Output for the credentials value, zero terminated.
+ * param[in]        size: Output size including the terminating zero.
+ *
+ * @return          Credentials length, -EACCES if not SUCCESS or without credentials, negative
+ *                  if the message is not valid or the credentials do not fit.
+ *
+*/
+int32_t tb_pb_parse_provision_response(const uint8_t *message, uint32_t length, uint8_t *credentials, uint32_t size)
+{
+    static const PB_READER_FIELD_STRUCT fields[] = {
+        {.field = PROVISION_RESPONSE_STATUS, .handler = onProvisionStatus},
+        {.field = PROVISION_RESPONSE_CREDENTIALS, .handler = onProvisionCredentials},
+    };
+    TB_PB_PROVISION_RESPONSE_STRUCT response = {.credentials = credentials, .size = size};
+    int32_t ret = 0;
+
+    ret = pb_reader_parse_message(message, length, fields, ARRAY_SIZE(fields), &response);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    if (!response.isSuccess || (response.credentialsLength <= 0))
+    {
+        return -EACCES;
+    }
+
+    return response.credentialsLength;
+}
+
+/**@brief           Function to parse an AttributeUpdateNotificationMsg and dispatch its attributes.
+ *
+ * @details         For every updated shared attribute the handlers of the matching key are
+ *                  called, in message order. Handlers run while parsing: keep the results in
+ *                  ctx and apply them once the parse succeeds. Deleted attributes are skipped.
+ *
+ * param[in]        message: Update message.
+ * param[in]        length: Message length.
+ * param[in]        keys: Key to handler table.
+ * param[in]        keyCount: Number of table entries.
+ * param[in]        ctx: Passed to the handlers.
+ *
+ * @return          Number of handled attributes, -EBADMSG if the message is not valid, handler
+ *                  error otherwise.
+ *
+*/
+int32_t tb_pb_parse_attribute_update(const uint8_t *message, uint32_t length, const TB_PB_ATTRIBUTE_KEY_STRUCT *keys,
+                                        uint32_t keyCount, void *ctx)
+{
+    static const PB_READER_FIELD_STRUCT fields[] = {
+        {.field = ATTRIBUTE_UPDATE_SHARED_UPDATED, .handler = onTsKv},
+    };
+    TB_PB_ATTRIBUTE_UPDATE_STRUCT update = {.keys = keys, .keyCount = keyCount, .ctx = ctx};
+    int32_t ret = 0;
+
+    ret = pb_reader_parse_message(message, length, fields, ARRAY_SIZE(fields), &update);
+
+    return (ret < 0) ? ret : update.handled;
+}
+
+/**@brief           Function to write the timestamp of a TelemetryEntry.
+ *
+ * @details         Leave it out for samples without time, the server time is used then.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        timestamp: Unix time in milliseconds.
+ *
+ * @return          None.
+ *
+*/
+void tb_pb_write_telemetry_ts(PB_WRITER_STRUCT *writer, int64_t timestamp)
+{
+    pb_writer_int(writer, TELEMETRY_ENTRY_TS, timestamp);
+}
+
+/**@brief           Function to write one value of a TelemetryEntry.
+ *
+ * param[in]        writer: Protobuf writer.
+ * param[in]        key: Telemetry key.
+ * param[in]        value: Value.
+ *
+ * @return          None.
+ *
+*/
+void tb_pb_write_telemetry_value(PB_WRITER_STRUCT *writer, const uint8_t *key, double value)
+{
+    uint32_t entry = pb_writer_message_start(writer, TELEMETRY_ENTRY_VALUES);
+
+    pb_writer_string(writer, MAP_ENTRY_KEY, key, TELEMETRY_KEY_MAX_LEN);
+    pb_writer_double(writer, MAP_ENTRY_VALUE, value);
+    pb_writer_message_end(writer, entry);
+}
+
+/**@brief           Function to parse an RpcRequestMsg.
+ *
+ * @details         Parsed in place, method and params point into the message.
+ *
+ * param[in]        message: Request message.
+ * param[in]        length: Message length.
+ * param[in]        request: Request fields, not set fields stay empty.
+ *
+ * @return          0 if successful, -EBADMSG if the message is not valid or has no method.
+ *
+*/
+int32_t tb_pb_parse_rpc_request(const uint8_t *message, uint32_t length, TB_PB_RPC_REQUEST_STRUCT *request)
+{
+    static const PB_READER_FIELD_STRUCT fields[] = {
+        {.field = RPC_REQUEST_METHOD, .handler = onRpcMethod},
+        {.field = RPC_REQUEST_ID, .handler = onRpcRequestId},
+        {.field = RPC_REQUEST_PARAMS, .handler = onRpcParams},
+    };
+    int32_t ret = 0;
+
+    memset(request, 0, sizeof(*request));
+
+    ret = pb_reader_parse_message(message, length, fields, ARRAY_SIZE(fields), request);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    return (request->methodLength == 0) ? -EBADMSG : 0;
+}
+
+/**@brief           Function to encode an RPC response as RpcResponseMsg.
+ *
+ * param[in]        payload: Response, JSON text, zero terminated.
+ * param[in]        maxLength: Longest response.
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Message length, negative on error.
+ *
+*/
+int32_t tb_pb_encode_rpc_response(const uint8_t *payload, uint32_t maxLength, uint8_t *buffer, uint32_t size)
+{
+    PB_WRITER_STRUCT writer;
+
+    pb_writer_init(&writer, buffer, size);
+    pb_writer_string(&writer, RPC_RESPONSE_PAYLOAD, payload, maxLength);
+
+    return pb_writer_finish(&writer);
+}
+
+/**@brief           Function to encode an attribute request as AttributesRequest.
+ *
+ * param[in]        clientKeys: Comma separated client attribute keys, zero terminated. Empty for none.
+ * param[in]        sharedKeys: Comma separated shared attribute keys, zero terminated. Empty for none.
+ * param[in]        maxLength: Longest key list.
+ * param[in]        buffer: Output buffer.
+ * param[in]        size: Output buffer size.
+ *
+ * @return          Message length, negative on error.
+ *
+*/
+int32_t tb_pb_encode_attributes_request(const uint8_t *clientKeys, const uint8_t *sharedKeys, uint32_t maxLength,
+                                        uint8_t *buffer, uint32_t size)
+{
+    PB_WRITER_STRUCT writer;
+
+    pb_writer_init(&writer, buffer, size);
+    if (clientKeys[0] != 0)
+    {
+        pb_writer_string(&writer, ATTRIBUTES_REQUEST_CLIENT_KEYS, clientKeys, maxLength);
+    }
+    if (sharedKeys[0] != 0)
+    {
+        pb_writer_string(&writer, ATTRIBUTES_REQUEST_SHARED_KEYS, sharedKeys, maxLength);
+    }
+
+    return pb_writer_finish(&writer);
+}
+
+/**@brief           Function to parse a GetAttributeResponseMsg and dispatch its attributes.
+ *
+ * @details         Client and shared attributes are dispatched to the handlers of their scope,
+ *                  in message order. Same handler rules as tb_pb_parse_attribute_update.
+ *
+ * param[in]        message: Response message.
+ * param[in]        length: Message length.
+ * param[in]        clientKeys: Key to handler table of the client attributes.
+ * param[in]        clientCount: Number of client table entries.
+ * param[in]        sharedKeys: Key to handler table of the shared attributes.
+ * param[in]        sharedCount: Number of shared table entries.
+ * param[in]        ctx: Passed to the handlers.
+ *
+ * @return          Number of handled attributes, -EBADMSG if the message is not valid, handler
+ *                  error otherwise.
+ *
+*/
+int32_t tb_pb_parse_attributes_response(const uint8_t *message, uint32_t length, const TB_PB_ATTRIBUTE_KEY_STRUCT *clientKeys,
+                                        uint32_t clientCount, const TB_PB_ATTRIBUTE_KEY_STRUCT *sharedKeys,
+                                        uint32_t sharedCount, void *ctx)
+{
+    static const PB_READER_FIELD_STRUCT fields[] = {
+        {.field = ATTRIBUTES_RESPONSE_CLIENT, .handler = onClientAttribute},
+        {.field = ATTRIBUTES_RESPONSE_SHARED, .handler = onSharedAttribute},
+    };
+    TB_PB_ATTRIBUTES_RESPONSE_STRUCT response = {
+        .client = {.keys = clientKeys, .keyCount = clientCount, .ctx = ctx},
+        .shared = {.keys = sharedKeys, .keyCount = sharedCount, .ctx = ctx},
+    };
+    int32_t ret = 0;
+
+    ret = pb_reader_parse_message(message, length, fields, ARRAY_SIZE(fields), &response);
+
+    return (ret < 0) ? ret : (response.client.handled + response.shared.handled);
+}
+/* End of file -------------------------------------------------------- */
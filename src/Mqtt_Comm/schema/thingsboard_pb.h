@@ -0,0 +1,97 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __THINGSBOARD_PB_H
+#define __THINGSBOARD_PB_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "pb_writer.h"
+#include "thingsboard_schema.h"
+
+/* Exported types ------------------------------------------------------------*/
+/* Attribute value types, KeyValueType of the ThingsBoard transport.proto */
+typedef enum
+{
+    TB_PB_VALUE_BOOL = 0,
+    TB_PB_VALUE_LONG,
+    TB_PB_VALUE_DOUBLE,
+    TB_PB_VALUE_STRING,
+    TB_PB_VALUE_JSON,
+}TB_PB_VALUE_TYPE;
+
+/* Updated shared attribute. Key and strings point into the message, not zero terminated */
+typedef struct
+{
+    const uint8_t *key;
+    uint32_t keyLength;
+    TB_PB_VALUE_TYPE type;
+    bool boolValue;
+    int64_t longValue;
+    double doubleValue;
+    const uint8_t *stringValue;     // String and JSON values
+    uint32_t stringLength;
+}TB_PB_ATTRIBUTE_STRUCT;
+
+/* Called for an updated attribute with a matching key. Negative return stops the parse with that error */
+typedef int32_t (*TB_PB_ATTRIBUTE_HANDLER)(const TB_PB_ATTRIBUTE_STRUCT *attribute, void *ctx);
+
+/* Key to handler table entry */
+typedef struct
+{
+    const uint8_t *key;
+    TB_PB_ATTRIBUTE_HANDLER handler;
+}TB_PB_ATTRIBUTE_KEY_STRUCT;
+
+/* RPC request. Method and params point into the message, not zero terminated */
+typedef struct
+{
+    const uint8_t *method;
+    uint32_t methodLength;
+    int64_t requestId;
+    const uint8_t *params;          // JSON text
+    uint32_t paramsLength;
+}TB_PB_RPC_REQUEST_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+/* Worst case of one telemetry entry: ts and one map entry per value */
+#define TB_PB_TELEMETRY_TS_MAX_LEN          11
+#define TB_PB_TELEMETRY_VALUE_MAX_LEN(keyLength) (1 + PB_NESTED_LENGTH_SIZE + 2 + (keyLength) + 9)
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t tb_pb_encode_provision_request(const SCHEMA_PROVISION_REQUEST_STRUCT *request, uint8_t *buffer, uint32_t size);
+int32_t tb_pb_parse_provision_response(const uint8_t *message, uint32_t length, uint8_t *credentials, uint32_t size);
+int32_t tb_pb_parse_attribute_update(const uint8_t *message, uint32_t length, const TB_PB_ATTRIBUTE_KEY_STRUCT *keys,
+                                        uint32_t keyCount, void *ctx);
+void tb_pb_write_telemetry_ts(PB_WRITER_STRUCT *writer, int64_t timestamp);
+void tb_pb_write_telemetry_value(PB_WRITER_STRUCT *writer, const uint8_t *key, double value);
+int32_t tb_pb_parse_rpc_request(const uint8_t *message, uint32_t length, TB_PB_RPC_REQUEST_STRUCT *request);
+int32_t tb_pb_encode_rpc_response(const uint8_t *payload, uint32_t maxLength, uint8_t *buffer, uint32_t size);
+int32_t tb_pb_encode_attributes_request(const uint8_t *clientKeys, const uint8_t *sharedKeys, uint32_t maxLength,
+                                        uint8_t *buffer, uint32_t size);
+int32_t tb_pb_parse_attributes_response(const uint8_t *message, uint32_t length, const TB_PB_ATTRIBUTE_KEY_STRUCT *clientKeys,
+                                        uint32_t clientCount, const TB_PB_ATTRIBUTE_KEY_STRUCT *sharedKeys,
+                                        uint32_t sharedCount, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __THINGSBOARD_PB_H */
@@ -0,0 +1,400 @@
+/* Includes ----------------------------------------------------------- */
+#include "telemetry_batch.h"
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "mqtt_comm.h"
+#include "lte_network.h"
+#include "thingsboard_pb.h"
+
+/* Private defines ---------------------------------------------------- */
+/* Bytes on air model: MQTT 3.1.1 QoS 1 publish and PUBACK, one TLS 1.2 AES-GCM record each,
+ * IPv4 and TCP headers per segment and one bare TCP ACK per direction */
+#define MQTT_PUBACK_SIZE            4
+#define TLS_RECORD_OVERHEAD         29
+#define TCP_IP_HEADER_SIZE          40
+#define TCP_SEGMENT_SIZE            1360
+
+/* Largest batch entry: timestamp wrapper and the values object */
+#define BATCH_ENTRY_MAX_LEN         (TELEMETRY_QUEUE_MAX_VALUES_LEN + 40)
+
+/* Private enumerate/structure ---------------------------------------- */
+/* Sample waiting in the batch. Field names must be static strings */
+typedef struct
+{
+    int64_t timestamp;
+    uint8_t count;
+    TELEMETRY_FIELD_STRUCT fields[TELEMETRY_QUEUE_MAX_FIELDS];
+    uint32_t singleLength;
+}TELEMETRY_BATCH_SAMPLE_STRUCT;
+
+/* Private macros ----------------------------------------------------- */
+/* Public variables --------------------------------------------------- */
+
+/* Private variables -------------------------------------------------- */
+static TELEMETRY_BATCH_SAMPLE_STRUCT batchSamples[CONFIG_TELEMETRY_BATCH_MAX_SAMPLES];
+static uint32_t batchCount = 0;
+static int64_t batchStartTime = 0;
+
+// Batch payload, '[' and the entries. Closing bracket is added on flush
+static uint8_t batchBuffer[MQTT_PUB_BUFF_SIZE + 1] = {0};
+static uint32_t batchLength = 0;
+
+static uint8_t valuesBuffer[TELEMETRY_QUEUE_MAX_VALUES_LEN];
+static uint8_t entryBuffer[BATCH_ENTRY_MAX_LEN];
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+// TelemetryEntry of a single sample. Keys of a sample fit in its JSON values object
+static uint8_t protobufBuffer[TB_PB_TELEMETRY_TS_MAX_LEN + (TELEMETRY_QUEUE_MAX_FIELDS * TB_PB_TELEMETRY_VALUE_MAX_LEN(0)) +
+                                TELEMETRY_QUEUE_MAX_VALUES_LEN];
+#endif
+
+static TELEMETRY_BATCH_STATS_STRUCT batchStats;
+// Radio time of the last published batch, taken at the first sample before any publish
+static uint32_t lastRadioOnMs = 0;
+static bool isRadioBaselineSet = false;
+
+/* Private function prototypes ---------------------------------------- */
+
+/* Private function definitions ---------------------------------------- */
+/**@brief           Function to estimate the bytes on air of a telemetry publish.
+ *
+ * param[in]        payloadLength: Publish payload length.
+ *
+ * @return          Bytes sent and received for the publish.
+ *
+*/
+static uint32_t estimateAirBytes(uint32_t payloadLength)
+{
+    uint32_t remaining = 2 + strlen(TELEMETRY_BATCH_TOPIC) + 2 + payloadLength;
+    uint32_t publishSize = 1 + ((remaining < 128) ? 1 : 2) + remaining;
+    uint32_t recordSize = publishSize + TLS_RECORD_OVERHEAD;
+    uint32_t segments = (recordSize + TCP_SEGMENT_SIZE - 1) / TCP_SEGMENT_SIZE;
+
+    return recordSize + (segments * TCP_IP_HEADER_SIZE) +
+            (MQTT_PUBACK_SIZE + TLS_RECORD_OVERHEAD + TCP_IP_HEADER_SIZE) + (2 * TCP_IP_HEADER_SIZE);
+}
+
+/**@brief           Function to format sample values as JSON object in values buffer.
+ *
+ * param[in]        fields: Sample fields.
+ * param[in]        count: Number of fields.
+ *
+ * @return          Length of the JSON object, negative on error.
+ *
+*/
+static int32_t formatValues(const TELEMETRY_FIELD_STRUCT *fields, uint8_t count)
+{
+    int32_t length = 0;
+    int32_t len = 0;
+
+    valuesBuffer[length++] = '{';
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        // Keep one byte for the closing brace
+        len = snprintf(&valuesBuffer[length], sizeof(valuesBuffer) - length - 1, "%s\"%s\":%.15g",
+                        (i > 0) ? "," : "", fields[i].name, fields[i].value);
+        if ((len < 0) || (len >= (int32_t)(sizeof(valuesBuffer) - length - 1)))
+        {
+            return -ENOMEM;
+        }
+        length += len;
+    }
+
+    valuesBuffer[length++] = '}';
+    valuesBuffer[length] = 0;
+
+    return length;
+}
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+/**@brief           Function to encode a sample as protobuf TelemetryEntry in the protobuf buffer.
+ *
+ * param[in]        sample: Sample to encode.
+ *
+ * @return          Message length, negative on error.
+ *
+*/
+static int32_t encodeProtobufSample(const TELEMETRY_BATCH_SAMPLE_STRUCT *sample)
+{
+    PB_WRITER_STRUCT writer;
+
+    pb_writer_init(&writer, protobufBuffer, sizeof(protobufBuffer));
+
+    if (sample->timestamp > 0)
+    {
+        tb_pb_write_telemetry_ts(&writer, sample->timestamp);
+    }
+
+    for (uint8_t i = 0; i < sample->count; i++)
+    {
+        tb_pb_write_telemetry_value(&writer, sample->fields[i].name, sample->fields[i].value);
+    }
+
+    return pb_writer_finish(&writer);
+}
+#endif
+
+/**@brief           Function to empty the batch.
+ *
+ * param[in]        None.
+ *
+ * @return          None.
+ *
+*/
+static void resetBatch(void)
+{
+    batchCount = 0;
+    batchLength = 0;
+    batchBuffer[batchLength++] = '[';
+    batchBuffer[batchLength] = 0;
+}
+
+/* Global Function definitions ----------------------------------------------- */
+/**@brief           Function to add a sample to the batch.
+ *
+ * @details         Sample is published with the batch as {"ts":..,"values":{..}}. Samples without
+ *                  time are published as plain values object. Field names must be static strings.
+ *
+ * param[in]        timestamp: Unix time in milliseconds, 0 if not known.
+ * param[in]        fields: Sample fields.
+ * param[in]        count: Number of fields.
+ *
+ * @return          0 if added, -ENOSPC if the batch must be flushed first, negative otherwise.
+ *
+*/
+int32_t telemetry_batch_add(int64_t timestamp, const TELEMETRY_FIELD_STRUCT *fields, uint8_t count)
+{
+    TELEMETRY_BATCH_SAMPLE_STRUCT *sample = NULL;
+    int32_t valuesLength = 0;
+    int32_t len = 0;
+
+    if ((count == 0) || (count > TELEMETRY_QUEUE_MAX_FIELDS))
+    {
+        return -EINVAL;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        // JSON has no NaN or infinity
+        if (!isfinite(fields[i].value))
+        {
+            return -EINVAL;
+        }
+    }
+
+    if (batchLength == 0)
+    {
+        resetBatch();
+    }
+
+    if (batchCount >= CONFIG_TELEMETRY_BATCH_MAX_SAMPLES)
+    {
+        return -ENOSPC;
+    }
+
+    valuesLength = formatValues(fields, count);
+    if (valuesLength < 0)
+    {
+        return valuesLength;
+    }
+
+    if (timestamp > 0)
+    {
+        len = snprintf(entryBuffer, sizeof(entryBuffer), "%s{\"ts\":%lld,\"values\":%s}",
+                        (batchCount > 0) ? "," : "", timestamp, valuesBuffer);
+    }
+    else
+    {
+        len = snprintf(entryBuffer, sizeof(entryBuffer), "%s%s", (batchCount > 0) ? "," : "", valuesBuffer);
+    }
+
+    if ((len < 0) || (len >= (int32_t)sizeof(entryBuffer)))
+    {
+        return -ENOMEM;
+    }
+
+    // Keep one byte for the closing bracket
+    if ((batchLength + len + 1) > MQTT_PUB_BUFF_SIZE)
+    {
+        return (batchCount > 0) ? -ENOSPC : -ENOMEM;
+    }
+
+    memcpy(&batchBuffer[batchLength], entryBuffer, len);
+    batchLength += len;
+    batchBuffer[batchLength] = 0;
+
+    sample = &batchSamples[batchCount];
+    sample->timestamp = timestamp;
+    sample->count = count;
+    memcpy(sample->fields, fields, count * sizeof(fields[0]));
+    sample->singleLength = valuesLength;
+
+    if (batchCount == 0)
+    {
+        batchStartTime = k_uptime_get();
+    }
+    // RRC time before the first sample, e.g. the attach, is not time of a batch
+    if (!isRadioBaselineSet)
+    {
+        lastRadioOnMs = lte_network_radio_on_ms();
+        isRadioBaselineSet = true;
+    }
+    batchCount++;
+
+    return 0;
+}
+
+/**@brief           Function to check the flush policy.
+ *
+ * @details         Batch is due when it holds CONFIG_TELEMETRY_BATCH_MAX_SAMPLES samples or the oldest
+ *                  sample waits CONFIG_TELEMETRY_BATCH_MAX_AGE_SEC. A full publish buffer is reported
+ *                  by telemetry_batch_add().
+ *
+ * param[in]        None.
+ *
+ * @return          true if the batch should be flushed.
+ *
+*/
+bool telemetry_batch_is_due(void)
+{
+    if (batchCount == 0)
+    {
+        return false;
+    }
+
+    return (batchCount >= CONFIG_TELEMETRY_BATCH_MAX_SAMPLES) ||
+            ((k_uptime_get() - batchStartTime) >= (CONFIG_TELEMETRY_BATCH_MAX_AGE_SEC * 1000LL));
+}
+
+/**@brief           Function to publish the batch as one ThingsBoard telemetry array.
+ *
+ * @details         Batch is kept if the publish fails. In the protobuf mode a batch of one sample
+ *                  is sent as protobuf TelemetryEntry, protobuf has no top level array.
+ *
+ * param[in]        None.
+ *
+ * @return          0 if successful, negative otherwise.
+ *
+*/
+int32_t telemetry_batch_flush(void)
+{
+    uint32_t radioOnMs = 0;
+    uint32_t airBytes = 0;
+    uint32_t singleAirBytes = 0;
+    uint32_t payloadLength = batchLength + 1;
+    int32_t ret = 0;
+
+    if (batchCount == 0)
+    {
+        return 0;
+    }
+
+    batchBuffer[batchLength] = ']';
+    batchBuffer[batchLength + 1] = 0;
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    if (batchCount == 1)
+    {
+        ret = encodeProtobufSample(&batchSamples[0]);
+        if (ret >= 0)
+        {
+            printk("Telemetry sample: %d B protobuf, %u B JSON\n", ret, payloadLength);
+            payloadLength = ret;
+            ret = MqttPublishPayload(TELEMETRY_BATCH_TOPIC, protobufBuffer, payloadLength);
+        }
+    }
+    else
+#endif
+    {
+        ret = MqttPublishMessage(TELEMETRY_BATCH_TOPIC, batchBuffer);
+    }
+
+    if (ret < 0)
+    {
+        batchBuffer[batchLength] = 0;
+        return ret;
+    }
+
+    airBytes = estimateAirBytes(payloadLength);
+    for (uint32_t i = 0; i < batchCount; i++)
+    {
+        singleAirBytes += estimateAirBytes(batchSamples[i].singleLength);
+    }
+
+    radioOnMs = lte_network_radio_on_ms();
+
+    batchStats.samples += batchCount;
+    batchStats.publishes++;
+    batchStats.payloadBytes += payloadLength;
+    batchStats.airBytes += airBytes;
+    batchStats.singleAirBytes += singleAirBytes;
+    batchStats.radioOnMs += radioOnMs - lastRadioOnMs;
+
+    printk("Telemetry batch: %u samples, %u B payload, %u B on air (%u B/sample, single publish %u B/sample), "
+            "radio on %u ms/sample\n", batchCount, payloadLength, airBytes, airBytes / batchCount,
+            singleAirBytes / batchCount, batchStats.radioOnMs / batchStats.samples);
+
+    lastRadioOnMs = radioOnMs;
+    resetBatch();
+
+    return 0;
+}
+
+/**@brief           Function to move the batch to the telemetry queue.
+ *
+ * @details         Used when the batch can not be published. Queue keeps the samples over resets
+ *                  and sends them with the backlog.
+ *
+ * param[in]        None.
+ *
+ * @return          0 if successful, negative if a sample could not be queued.
+ *
+*/
+int32_t telemetry_batch_spill(void)
+{
+    int32_t ret = 0;
+    int32_t err = 0;
+
+    for (uint32_t i = 0; i < batchCount; i++)
+    {
+        err = telemetry_queue_push(batchSamples[i].timestamp, batchSamples[i].fields, batchSamples[i].count);
+        if (err < 0)
+        {
+            printk("Failed to queue telemetry sample: %d\n", err);
+            ret = err;
+        }
+    }
+
+    resetBatch();
+
+    return ret;
+}
+
+/**@brief           Function to get the number of samples in the batch.
+ *
+ * param[in]        None.
+ *
+ * @return          Number of samples.
+ *
+*/
+uint32_t telemetry_batch_count(void)
+{
+    return batchCount;
+}
+
+/**@brief           Function to get the published batch totals.
+ *
+ * param[in]        stats: Totals to fill.
+ *
+ * @return          None.
+ *
+*/
+void telemetry_batch_get_stats(TELEMETRY_BATCH_STATS_STRUCT *stats)
+{
+    memcpy(stats, &batchStats, sizeof(batchStats));
+}
+/* End of file -------------------------------------------------------- */
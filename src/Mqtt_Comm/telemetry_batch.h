@@ -0,0 +1,55 @@
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TELEMETRY_BATCH_H
+#define __TELEMETRY_BATCH_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "telemetry_queue.h"
+
+/* Exported types ------------------------------------------------------------*/
+/* Published batch totals. Bytes on air include MQTT, TLS and TCP/IP overhead of the publish and its PUBACK */
+typedef struct
+{
+    uint32_t samples;
+    uint32_t publishes;
+    uint32_t payloadBytes;
+    uint32_t airBytes;
+    uint32_t singleAirBytes;    // Same samples sent one {"key":value} publish each
+    uint32_t radioOnMs;         // RRC connected time between the published batches
+}TELEMETRY_BATCH_STATS_STRUCT;
+
+/* Exported constants --------------------------------------------------------*/
+#define TELEMETRY_BATCH_TOPIC "v1/devices/me/telemetry"
+
+/* Exported macro ------------------------------------------------------------*/
+
+/*
+******************************************************************************
+* GLOBAL VARIABLES
+******************************************************************************
+*/
+
+/*
+******************************************************************************
+* GLOBAL Functions
+******************************************************************************
+*/
+int32_t telemetry_batch_add(int64_t timestamp, const TELEMETRY_FIELD_STRUCT *fields, uint8_t count);
+bool telemetry_batch_is_due(void);
+int32_t telemetry_batch_flush(void);
+int32_t telemetry_batch_spill(void);
+uint32_t telemetry_batch_count(void);
+void telemetry_batch_get_stats(TELEMETRY_BATCH_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELEMETRY_BATCH_H */
@@ -3,28 +3,71 @@
 #include <zephyr/kernel.h>
 #include <zephyr/sys/printk.h>
 #include <net/mqtt_helper.h>
-#include <cJSON.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "SystemConfig.h"
 #include "LedHandler.h"
 #include "storage.h"
+#include "storage_cache.h"
+#include "telemetry_queue.h"
+#include "telemetry_batch.h"
+#include "storage_wear.h"
+#include "storage_async.h"
+#include "retained_state.h"
+#include "thingsboard_schema.h"
+#include "json_reader.h"
+#include "thingsboard_pb.h"
+#include "publish_bench.h"
+#include "mqtt_subscriptions.h"
+#include "mqtt_conn_state.h"
+#include "mqtt_reconnect.h"
+#include "rpc_server.h"
+#include "attribute_cache.h"
+#include <date_time.h>
 
 /* Private defines ---------------------------------------------------- */
 #define PUBLISH_TOPIC "v1/devices/me/telemetry"
-#define ATTRIBUTE_TOPIC "v1/devices/me/attributes"
 
 #define MQTT_PROVISION_USERNAME "provision"
 
-/* ID for subscribe topic - Used to verify that a subscription succeeded in on_mqtt_suback(). */
+/* Shared LED attribute switches the LED, the device reports it back as a client attribute */
+#define LED_ATTRIBUTE_KEY "LED"
+/* LED report is sent again after this delay while the in-flight window is full */
+#define LED_REPORT_RETRY_MS 1000
+
+/* Fixed part of the wear report must leave room for the per file counters */
+BUILD_ASSERT(SCHEMA_WEAR_REPORT_MAX_LEN < MQTT_PUB_BUFF_SIZE, "Wear report does not fit in the publish buffer");
 
 /* Private enumerate/structure ---------------------------------------- */
+/* Backlog batch under construction */
+typedef struct
+{
+    uint32_t length;
+    uint32_t count;
+    uint32_t lastSeq;
+}TELEMETRY_BATCH_STRUCT;
+
+/* Provisioning response fields */
+typedef struct
+{
+    bool isSuccess;
+    int32_t usernameLength;
+    uint8_t username[MAX_USERNAME_LENGTH];
+}PROVISION_RESPONSE_STRUCT;
+
 /* Private macros ----------------------------------------------------- */
 /* Public variables --------------------------------------------------- */
 
 /* Private variables -------------------------------------------------- */
 static uint8_t publishPayloadBuffer[MQTT_PUB_BUFF_SIZE + 1] = {0};
-struct mqtt_topic mqtt_sub_topics[MAX_SUBSCRIBE_TOPIC_COUNT];
+/* Backlog records are released from flash on the PUBACK, whatever the telemetry policy */
+static const MQTT_PUBLISH_POLICY_STRUCT backlogPublishPolicy = {
+    .qos = MQTT_QOS_1_AT_LEAST_ONCE,
+    .isRetained = false,
+};
+/* Connect to ready times */
+static uint32_t readyCount = 0;
+static uint64_t readyTotalMs = 0;
 
 
 /* Private function prototypes ---------------------------------------- */
@@ -35,15 +78,197 @@ K_WORK_DELAYABLE_DEFINE(led_off_work, tunoff_led);
 
 static void tunoff_led(struct k_work *work)
 {
+    static uint8_t attributePayload[MAX(SCHEMA_LED_ATTRIBUTE_MAX_LEN, SCHEMA_LED_ATTRIBUTE_PB_MAX_LEN) + 1];
+    SCHEMA_LED_ATTRIBUTE_STRUCT attribute = {.LED = false};
+    int32_t length = 0;
+    int32_t ret = 0;
+
     if (systemConfig.isBrokerConnected)
     {
         SetLedState(0);
 
-        if (MqttPublishMessage(ATTRIBUTE_TOPIC," {\"LED\":false}") < 0)
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+        length = schema_pb_encode_led_attribute(&attribute, attributePayload, sizeof(attributePayload));
+#else
+        length = schema_encode_led_attribute(&attribute, attributePayload, sizeof(attributePayload));
+#endif
+
+        // Never block the system work queue on a window slot, try again later if it is full
+        ret = (length < 0) ? length :
+                MqttPublishPayloadAsync(SCHEMA_LED_ATTRIBUTE_TOPIC, attributePayload, length, NULL, NULL, K_NO_WAIT);
+        if (ret == -EBUSY)
+        {
+            (void)k_work_reschedule(&led_off_work, K_MSEC(LED_REPORT_RETRY_MS));
+        }
+        else if (ret < 0)
         {
             printk("Failed to publish message\n");
         }
+        else
+        {
+            (void)attribute_cache_set(LED_ATTRIBUTE_KEY, ATTRIBUTE_CACHE_SCOPE_CLIENT, "false", strlen("false"));
+        }
+    }
+}
+
+#if !defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+/**@brief           Handler of the provisioning status.
+ * 
+ * param[in]        value: Status value.
+ * param[in]        ctx: Provisioning response.
+ * 
+ * @return          0.
+ * 
+*/
+static int32_t onProvisionStatus(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    PROVISION_RESPONSE_STRUCT *response = ctx;
+    uint8_t status[sizeof("SUCCESS")];
+
+    response->isSuccess = (json_reader_get_string(value, status, sizeof(status)) >= 0) && (strcmp(status, "SUCCESS") == 0);
+
+    return 0;
+}
+
+/**@brief           Handler of the provisioned credentials.
+ * 
+ * param[in]        value: Credentials value.
+ * param[in]        ctx: Provisioning response.
+ * 
+ * @return          0 if successful, negative if not a string or too long for the username.
+ * 
+*/
+static int32_t onProvisionCredentials(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    PROVISION_RESPONSE_STRUCT *response = ctx;
+
+    response->usernameLength = json_reader_get_string(value, response->username, sizeof(response->username));
+
+    return (response->usernameLength < 0) ? response->usernameLength : 0;
+}
+#endif
+
+/**@brief           Function to switch the LED, it is switched off again after a while.
+ * 
+ * param[in]        state: LED on.
+ * 
+ * @return          0 if successful, negative otherwise.
+ * 
+*/
+static int32_t applyLedState(bool state)
+{
+    int32_t ret = SetLedState(state);
+
+    if ((ret >= 0) && state)
+    {
+        (void)k_work_reschedule(&led_off_work, K_SECONDS(MQTT_INTER_MESSAGE_DELAY/2));
+    }
+
+    return ret;
+}
+
+/**@brief           Handler of the shared LED attribute.
+ * 
+ * @details         Called for every pushed value, and for a value changed while the broker
+ *                  session was lost once the attribute request is answered.
+ * 
+ * param[in]        value: Attribute value.
+ * param[in]        ctx: Unused.
+ * 
+ * @return          None.
+ * 
+*/
+static void onLedAttribute(const JSON_READER_VALUE_STRUCT *value, void *ctx)
+{
+    bool state = false;
+
+    ARG_UNUSED(ctx);
+
+    if (json_reader_get_bool(value, &state) < 0)
+    {
+        printk("LED attribute is not a bool\n");
+        return;
+    }
+
+    (void)applyLedState(state);
+}
+
+/**@brief           RPC method setLed, params true or false.
+ * 
+ * param[in]        request: RPC request.
+ * param[in]        response: Response writer.
+ * param[in]        ctx: Unused.
+ * 
+ * @return          0 if successful, negative if the params are not a bool or the LED failed.
+ * 
+*/
+static int32_t onSetLedRpc(const RPC_SERVER_REQUEST_STRUCT *request, JSON_WRITER_STRUCT *response, void *ctx)
+{
+    bool state = false;
+    int32_t ret = 0;
+
+    ARG_UNUSED(ctx);
+
+    ret = json_reader_get_bool(&request->params, &state);
+    if (ret >= 0)
+    {
+        ret = applyLedState(state);
+    }
+    if (ret < 0)
+    {
+        return ret;
     }
+
+    json_writer_object_start(response);
+    json_writer_key(response, "LED");
+    json_writer_bool(response, systemConfig.ledState);
+    json_writer_object_end(response);
+
+    return 0;
+}
+
+/**@brief           RPC method getLed.
+ * 
+ * param[in]        request: RPC request.
+ * param[in]        response: Response writer.
+ * param[in]        ctx: Unused.
+ * 
+ * @return          0.
+ * 
+*/
+static int32_t onGetLedRpc(const RPC_SERVER_REQUEST_STRUCT *request, JSON_WRITER_STRUCT *response, void *ctx)
+{
+    ARG_UNUSED(request);
+    ARG_UNUSED(ctx);
+
+    json_writer_object_start(response);
+    json_writer_key(response, "LED");
+    json_writer_bool(response, systemConfig.ledState);
+    json_writer_object_end(response);
+
+    return 0;
+}
+
+/**@brief           RPC method getTemperature, the last internal temperature.
+ * 
+ * param[in]        request: RPC request.
+ * param[in]        response: Response writer.
+ * param[in]        ctx: Unused.
+ * 
+ * @return          0.
+ * 
+*/
+static int32_t onGetTemperatureRpc(const RPC_SERVER_REQUEST_STRUCT *request, JSON_WRITER_STRUCT *response, void *ctx)
+{
+    ARG_UNUSED(request);
+    ARG_UNUSED(ctx);
+
+    json_writer_object_start(response);
+    json_writer_key(response, "temperature");
+    json_writer_int(response, systemConfig.InternalTemp);
+    json_writer_object_end(response);
+
+    return 0;
 }
 
 /**@brief           Function to check if device is provisioned.
@@ -57,10 +282,13 @@ static uint8_t isDeviceProvisioned(void)
 {
     uint8_t data[MAX_USERNAME_LENGTH] = {0};
     int32_t ret = 0;
+    uint32_t startCycles = 0;
 
     if (!systemConfig.isProvisioned){
         printk("Read username from flash\n");
-        ret = read_file(MQTT_USERNAME_FILE_NAME, data, MAX_USERNAME_LENGTH, DIRECTORY);
+        startCycles = k_cycle_get_32();
+        ret = storage_cache_read(MQTT_USERNAME_FILE_NAME, data, MAX_USERNAME_LENGTH, DIRECTORY);
+        printk("Username read took %u us\n", k_cyc_to_us_floor32(k_cycle_get_32() - startCycles));
         if (ret > 0)
         {
             memcpy(systemConfig.deviceUsername, data, MAX_USERNAME_LENGTH);
@@ -71,6 +299,466 @@ static uint8_t isDeviceProvisioned(void)
     return systemConfig.isProvisioned;
 }
 
+/**@brief           Function to get current sample time.
+ * 
+ * param[in]        None.
+ * 
+ * @return          Unix time in milliseconds, 0 if time is not known yet.
+ * 
+*/
+static int64_t getSampleTime(void)
+{
+    int64_t timestamp = 0;
+
+    if (date_time_now(&timestamp) != 0)
+    {
+        timestamp = 0;
+    }
+
+    return timestamp;
+}
+
+/**@brief           Function to read the current telemetry sample.
+ * 
+ * param[in]        fields: Fields to fill, TELEMETRY_QUEUE_MAX_FIELDS entries.
+ * 
+ * @return          Number of fields.
+ * 
+*/
+static uint8_t readTelemetrySample(TELEMETRY_FIELD_STRUCT *fields)
+{
+    fields[0].name = "temperature";
+    fields[0].value = systemConfig.InternalTemp;
+
+    return 1;
+}
+
+/**@brief           Function to store the current sample in the telemetry queue.
+ * 
+ * @details         Samples waiting in the telemetry batch are queued first to keep the order.
+ * 
+ * param[in]        None.
+ * 
+ * @return          None.
+ * 
+*/
+static void queueTelemetrySample(void)
+{
+    TELEMETRY_FIELD_STRUCT fields[TELEMETRY_QUEUE_MAX_FIELDS];
+    uint8_t count = readTelemetrySample(fields);
+    int32_t ret = 0;
+
+    (void)telemetry_batch_spill();
+
+    ret = telemetry_queue_push(getSampleTime(), fields, count);
+    if (ret < 0)
+    {
+        printk("Failed to queue telemetry sample: %d\n", ret);
+    }
+    else
+    {
+        printk("Telemetry sample queued, backlog: %u\n", telemetry_queue_depth());
+    }
+}
+
+/**@brief           Function to add the current sample to the telemetry batch.
+ * 
+ * @details         Batch is published when it is due or when the sample does not fit.
+ *                  If the publish fails the batch and the sample go to the telemetry queue.
+ * 
+ * param[in]        None.
+ * 
+ * @return          0 if successful, negative if the publish failed.
+ * 
+*/
+static int32_t batchTelemetrySample(void)
+{
+    TELEMETRY_FIELD_STRUCT fields[TELEMETRY_QUEUE_MAX_FIELDS];
+    uint8_t count = readTelemetrySample(fields);
+    int64_t timestamp = getSampleTime();
+    int32_t ret = 0;
+
+    ret = telemetry_batch_add(timestamp, fields, count);
+    if (ret == -ENOSPC)
+    {
+        ret = telemetry_batch_flush();
+        if (ret >= 0)
+        {
+            ret = telemetry_batch_add(timestamp, fields, count);
+        }
+    }
+
+    if (ret < 0)
+    {
+        // Sample is not in the batch, queue it after the batch
+        queueTelemetrySample();
+        return ret;
+    }
+
+    if (telemetry_batch_is_due())
+    {
+        ret = telemetry_batch_flush();
+        if (ret < 0)
+        {
+            (void)telemetry_batch_spill();
+            printk("Telemetry batch queued, backlog: %u\n", telemetry_queue_depth());
+        }
+    }
+
+    return ret;
+}
+
+/**@brief           Function to add a queued record to the backlog batch.
+ * 
+ * param[in]        record: Queued record.
+ * param[in]        ctx: Batch under construction.
+ * 
+ * @return          0 to continue, 1 when the publish buffer is full.
+ * 
+*/
+static int32_t addRecordToBatch(const TELEMETRY_RECORD_STRUCT *record, void *ctx)
+{
+    TELEMETRY_BATCH_STRUCT *batch = ctx;
+    uint32_t space = MQTT_PUB_BUFF_SIZE - batch->length;
+    int32_t len = 0;
+
+    // Keep one byte for the closing bracket
+    if (record->timestamp > 0)
+    {
+        len = snprintf(&publishPayloadBuffer[batch->length], space, "%s{\"ts\":%lld,\"values\":%.*s}",
+                        (batch->count > 0) ? "," : "", record->timestamp, record->length, record->values);
+    }
+    else
+    {
+        len = snprintf(&publishPayloadBuffer[batch->length], space, "%s%.*s",
+                        (batch->count > 0) ? "," : "", record->length, record->values);
+    }
+
+    if ((len < 0) || ((uint32_t)len >= (space - 1)))
+    {
+        publishPayloadBuffer[batch->length] = 0;
+        return 1;
+    }
+
+    batch->length += len;
+    batch->count++;
+    batch->lastSeq = record->seq;
+
+    return 0;
+}
+
+/**@brief           Function to publish the queued telemetry in batches.
+ * 
+ * param[in]        None.
+ * 
+ * @return          0 if backlog is drained, negative otherwise.
+ * 
+*/
+static int32_t drainTelemetryBacklog(void)
+{
+    TELEMETRY_BATCH_STRUCT batch;
+    MQTT_INFLIGHT_STATS_STRUCT publishStats;
+    uint32_t drained = 0;
+    uint32_t elapsed = 0;
+    int64_t startTime = k_uptime_get();
+    int32_t ret = 0;
+
+    while (telemetry_queue_depth() > 0)
+    {
+        memset(&batch, 0, sizeof(batch));
+        publishPayloadBuffer[batch.length++] = '[';
+
+        ret = telemetry_queue_peek(addRecordToBatch, &batch);
+        if ((ret < 0) || (batch.count == 0))
+        {
+            break;
+        }
+
+        publishPayloadBuffer[batch.length++] = ']';
+        publishPayloadBuffer[batch.length] = 0;
+
+        ret = MqttPublishMessageWithPolicy(PUBLISH_TOPIC, publishPayloadBuffer, &backlogPublishPolicy);
+        if (ret < 0)
+        {
+            break;
+        }
+
+        ret = telemetry_queue_ack(batch.lastSeq);
+        if (ret < 0)
+        {
+            break;
+        }
+        drained += batch.count;
+    }
+
+    if (drained > 0)
+    {
+        elapsed = (uint32_t)(k_uptime_get() - startTime);
+        printk("Telemetry backlog: drained %u samples in %u ms (%u samples/s), %u left\n",
+                drained, elapsed, (elapsed > 0) ? (drained * 1000 / elapsed) : drained, telemetry_queue_depth());
+
+        mqtt_inflight_get_stats(&publishStats);
+        printk("PUBACK latency: avg %u ms, max %u ms, %u retransmits, %u failed\n", publishStats.ackLatencyAvgMs,
+                publishStats.ackLatencyMaxMs, publishStats.retransmits, publishStats.failed);
+    }
+
+    return (ret < 0) ? ret : 0;
+}
+
+/**@brief           Function to print the connect to ready time.
+ * 
+ * @details         Ready is when the broker accepted the connection and every subscription is
+ *                  active. Resumed sessions skip the SUBSCRIBE round trip.
+ * 
+ * param[in]        connectTime: Uptime when the connect started.
+ * 
+ * @return          None.
+ * 
+*/
+static void reportReadyTime(int64_t connectTime)
+{
+    MQTT_SUBSCRIPTIONS_STATS_STRUCT stats;
+    MQTT_CONN_STATE_TIMING_STRUCT connecting;
+    uint32_t readyMs = (uint32_t)(k_uptime_get() - connectTime);
+
+    mqtt_subscriptions_get_stats(&stats);
+    mqtt_conn_state_get_timing(MQTT_CONN_STATE_CONNECTING, &connecting);
+
+    readyCount++;
+    readyTotalMs += readyMs;
+
+    printk("Connect to ready: %u ms, avg %u ms over %u connects, %u SUBSCRIBE packets, %u sessions resumed\n",
+            readyMs, (uint32_t)(readyTotalMs / readyCount), readyCount, stats.subscribePackets, stats.sessionsResumed);
+    printk("CONNACK: %u ms, max %u ms\n", connecting.lastMs, connecting.maxMs);
+}
+
+/**@brief           Function to print the attribute cache totals.
+ * 
+ * param[in]        None.
+ * 
+ * @return          None.
+ * 
+*/
+static void reportAttributeCache(void)
+{
+    ATTRIBUTE_CACHE_STATS_STRUCT stats;
+
+    attribute_cache_get_stats(&stats);
+
+    printk("Attribute cache: %u requests, %u keys requested, %u skipped, %u failed, %u hits, %u misses, %llu B saved\n",
+            stats.syncRequests, stats.keysRequested, stats.keysSkipped, stats.syncFailures, stats.hits, stats.misses,
+            stats.bytesSaved);
+}
+
+/**@brief           Storage work queue completion callback.
+ * 
+ * param[in]        result: Request result.
+ * param[in]        user_data: Request description.
+ * 
+ * @return          None.
+ * 
+*/
+static void storageRequestDone(int32_t result, void *user_data)
+{
+    if (result < 0)
+    {
+        printk("Storage %s failed: %d\n", (const char *)user_data, result);
+    }
+}
+
+/**@brief           Function to publish the flash wear counters.
+ * 
+ * @details         Reports the most erased sector, erase totals, the bytes programmed per file
+ *                  since boot, the storage work queue load and the boot state, then saves the
+ *                  lifetime erase counters.
+ * 
+ * param[in]        None.
+ * 
+ * @return          0 on success, negative otherwise.
+ * 
+*/
+static int32_t publishFlashWearReport(void)
+{
+    STORAGE_WEAR_SUMMARY_STRUCT summary;
+    STORAGE_WEAR_ACCOUNT_STRUCT accounts[STORAGE_WEAR_ACCOUNT_COUNT];
+    STORAGE_ASYNC_STATS_STRUCT asyncStats;
+    RETAINED_STATE_BOOT_INFO_STRUCT bootInfo;
+    SCHEMA_WEAR_REPORT_STRUCT report;
+    JSON_WRITER_STRUCT writer;
+    uint8_t sector[16] = {0};
+    uint8_t key[STORAGE_WEAR_ACCOUNT_NAME_MAX_LEN + 16] = {0};
+    int32_t accountCount = 0;
+    uint32_t length = 0;
+    int32_t ret = 0;
+
+    storage_wear_get_summary(&summary);
+    accountCount = storage_wear_get_accounts(accounts, ARRAY_SIZE(accounts));
+    storage_async_get_stats(&asyncStats);
+    retained_state_get_boot_info(&bootInfo);
+
+    snprintf(sector, sizeof(sector), "%s%u", (summary.maxEraseArea == STORAGE_WEAR_AREA_KV) ? "kv" : "lfs",
+                summary.maxEraseSector);
+
+    report.flashEraseMax = summary.maxEraseCount;
+    report.flashEraseMaxSector = sector;
+    report.flashEraseTotal = summary.totalEraseCount;
+    report.flashBootErases = summary.bootEraseOps;
+    report.flashBootProgBytes = summary.bootProgramBytes;
+    report.storageQueueMax = asyncStats.maxDepth;
+    report.storageFailed = asyncStats.failed + asyncStats.rejected;
+    report.storageServiceMaxUs = asyncStats.maxServiceUs;
+    report.storageServiceAvgUs = (uint32_t)(asyncStats.totalServiceUs / MAX(asyncStats.completed, 1));
+    report.bootCounter = bootInfo.bootCounter;
+    report.warmBoots = bootInfo.warmBoots;
+    report.resetCause = bootInfo.resetCause;
+    report.publishFailures = retained_state_get(RETAINED_STATE_VALUE_PUBLISH_FAILURES);
+
+    json_writer_init(&writer, publishPayloadBuffer, sizeof(publishPayloadBuffer));
+    json_writer_object_start(&writer);
+    schema_write_wear_report(&writer, &report);
+
+    for (int32_t i = 0; i < accountCount; i++)
+    {
+        // Telemetry keys can not contain '/' or '*'
+        for (uint8_t *c = accounts[i].name; *c != 0; c++)
+        {
+            if ((*c == '/') || (*c == '*') || (*c == '.'))
+            {
+                *c = '_';
+            }
+        }
+
+        length = writer.length;
+        snprintf(key, sizeof(key), "flashProg_%s", accounts[i].name);
+        json_writer_key(&writer, key);
+        json_writer_uint(&writer, accounts[i].programBytes);
+
+        // Drop the counters that do not fit, keep one byte for the closing brace
+        if ((writer.error == -ENOMEM) || (writer.length >= MQTT_PUB_BUFF_SIZE))
+        {
+            json_writer_truncate(&writer, length);
+            break;
+        }
+    }
+
+    json_writer_object_end(&writer);
+
+    ret = json_writer_finish(&writer);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ret = MqttPublishMessage(SCHEMA_WEAR_REPORT_TOPIC, publishPayloadBuffer);
+    if (ret < 0)
+    {
+        printk("Failed to publish flash wear report\n");
+    }
+
+    (void)storage_wear_save();
+
+    return ret;
+}
+
+
+/**@brief           Function to write the latency histogram of a connect phase.
+ * 
+ * @details         Only the filled buckets are written, key is the phase name with the bucket
+ *                  upper limit, e.g. dnsMs_le250, the last bucket is gt10000.
+ * 
+ * param[in]        writer: Open telemetry object.
+ * param[in]        name: Phase name.
+ * param[in]        stats: Phase latency.
+ * 
+ * @return          None.
+ * 
+*/
+static void writePhaseHistogram(JSON_WRITER_STRUCT *writer, const char *name, const MQTT_CONNECT_PHASE_STATS_STRUCT *stats)
+{
+    uint8_t key[32] = {0};
+
+    for (uint32_t i = 0; i < MQTT_RECONNECT_HISTOGRAM_BUCKETS; i++)
+    {
+        if (stats->buckets[i] == 0)
+        {
+            continue;
+        }
+
+        if (mqtt_reconnect_bucket_limit(i) == UINT32_MAX)
+        {
+            snprintf(key, sizeof(key), "%sMs_gt%u", name, mqtt_reconnect_bucket_limit(i - 1));
+        }
+        else
+        {
+            snprintf(key, sizeof(key), "%sMs_le%u", name, mqtt_reconnect_bucket_limit(i));
+        }
+        json_writer_key(writer, key);
+        json_writer_uint(writer, stats->buckets[i]);
+    }
+}
+
+/**@brief           Function to publish the reconnect counters and the connect latency.
+ * 
+ * @return          0 if successful, otherwise a negative value.
+ * 
+*/
+static int32_t publishConnectionReport(void)
+{
+    static const char *phaseNames[MQTT_CONNECT_PHASE_COUNT] = {
+        [MQTT_CONNECT_PHASE_DNS] = "dns",
+        [MQTT_CONNECT_PHASE_TLS] = "tls",
+        [MQTT_CONNECT_PHASE_CONNACK] = "connack",
+    };
+    MQTT_CONNECT_PHASE_STATS_STRUCT phases[MQTT_CONNECT_PHASE_COUNT];
+    MQTT_RECONNECT_STATS_STRUCT stats;
+    SCHEMA_CONNECTION_REPORT_STRUCT report;
+    JSON_WRITER_STRUCT writer;
+    int32_t ret = 0;
+
+    mqtt_reconnect_get_stats(&stats);
+    for (uint32_t i = 0; i < MQTT_CONNECT_PHASE_COUNT; i++)
+    {
+        mqtt_reconnect_get_phase_stats(i, &phases[i]);
+    }
+
+    report.connAttempts = stats.attempts;
+    report.connFailures = stats.failures;
+    report.connLost = stats.connectionsLost;
+    report.connFastRetries = stats.fastRetries;
+    report.connBackoffs = stats.backoffs;
+    report.connBackoffMaxMs = stats.maxDelayMs;
+    report.dnsAvgMs = (uint32_t)(phases[MQTT_CONNECT_PHASE_DNS].totalMs / MAX(phases[MQTT_CONNECT_PHASE_DNS].count, 1));
+    report.dnsMaxMs = phases[MQTT_CONNECT_PHASE_DNS].maxMs;
+    report.tlsAvgMs = (uint32_t)(phases[MQTT_CONNECT_PHASE_TLS].totalMs / MAX(phases[MQTT_CONNECT_PHASE_TLS].count, 1));
+    report.tlsMaxMs = phases[MQTT_CONNECT_PHASE_TLS].maxMs;
+    report.connackAvgMs = (uint32_t)(phases[MQTT_CONNECT_PHASE_CONNACK].totalMs / MAX(phases[MQTT_CONNECT_PHASE_CONNACK].count, 1));
+    report.connackMaxMs = phases[MQTT_CONNECT_PHASE_CONNACK].maxMs;
+
+    json_writer_init(&writer, publishPayloadBuffer, sizeof(publishPayloadBuffer));
+    json_writer_object_start(&writer);
+    schema_write_connection_report(&writer, &report);
+
+    for (uint32_t i = 0; i < MQTT_CONNECT_PHASE_COUNT; i++)
+    {
+        writePhaseHistogram(&writer, phaseNames[i], &phases[i]);
+    }
+
+    json_writer_object_end(&writer);
+
+    ret = json_writer_finish(&writer);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    ret = MqttPublishMessage(SCHEMA_CONNECTION_REPORT_TOPIC, publishPayloadBuffer);
+    if (ret < 0)
+    {
+        printk("Failed to publish connection report\n");
+    }
+
+    return ret;
+}
 
 /* Global Function definitions ----------------------------------------------- */
 
@@ -84,123 +772,261 @@ static uint8_t isDeviceProvisioned(void)
 void StartDataCommunication(void *p1, void *p2, void *p3)
 {
     int32_t ret = 0;
-    int64_t refTime = 0;
+    int64_t connectTime = 0;
+    int64_t nextSampleTime = 0;
+    int64_t nextWearReportTime = 0;
+    int64_t wakeTime = 0;
+    bool isSampleDue = false;
+    bool isConnectDue = false;
+    bool isBrokerUp = false;
     printk("Starting data communication Task\n");
 
     while(1)
     {
-        // Wait for network to be connected
+        // Wait for network to be connected. Keep sampling in the queue meanwhile.
         if(systemConfig.isNetworkConnected == 0)
         {
+            if (k_uptime_get() >= nextSampleTime)
+            {
+                queueTelemetrySample();
+                nextSampleTime = k_uptime_get() + (MQTT_INTER_MESSAGE_DELAY * 1000LL);
+            }
+
             k_sleep(K_SECONDS(1));
             continue;
         }
 
-        if (!isDeviceProvisioned())
+        ret = 0;
+        isBrokerUp = false;
+        isSampleDue = (k_uptime_get() >= nextSampleTime);
+        // Connect and provisioning attempts wait for the reconnect backoff
+        isConnectDue = !systemConfig.isBrokerConnected && mqtt_reconnect_is_due();
+
+        if (isConnectDue && !isDeviceProvisioned())
         {
             ret = MqttConnect(MQTT_PROVISION_USERNAME);
             if( ret >= 0)
             {
-                refTime = k_uptime_get();
-                while (k_uptime_get() - refTime < MQTT_CONNECT_TIMEOUT)
-                {
-                    if (systemConfig.isBrokerConnected) break;
-                    k_sleep(K_MSEC(100));
-                }
-
                 ret = MqttProvisionRequest();
                 if (ret >= 0)
                 {
                     systemConfig.isProvisioned = 1;
-                    ret = write_file(MQTT_USERNAME_FILE_NAME, systemConfig.deviceUsername, MAX_USERNAME_LENGTH, DIRECTORY);
-                    if (ret < 0)
+                    // Flash write runs on the storage work queue, the connection is not held up
+                    if ((storage_async_write(MQTT_USERNAME_FILE_NAME, systemConfig.deviceUsername, MAX_USERNAME_LENGTH,
+                                                DIRECTORY, storageRequestDone, "username write") < 0) ||
+                        // Credentials must survive a reset, do not wait for the flush policy
+                        (storage_async_flush(storageRequestDone, "username flush") < 0))
                     {
-                        printk("Failed to write username to file\n");
+                        printk("Failed to queue username write\n");
                     }
                 }
 
                 MqttDisconnect();
-                systemConfig.isBrokerConnected = 0;
-                k_sleep(K_SECONDS(1));
             }
+
+            mqtt_reconnect_on_result(ret);
         }
 
         if (systemConfig.isProvisioned)
         {
-            if (!systemConfig.isBrokerConnected) {
+            // Failed provisioning above has moved the next attempt
+            if (isConnectDue && mqtt_reconnect_is_due()) {
+                connectTime = k_uptime_get();
                 ret = MqttConnect(systemConfig.deviceUsername);
 
                 if (ret >= 0)
                 {
-                    refTime = k_uptime_get();
-                    while (k_uptime_get() - refTime < MQTT_CONNECT_TIMEOUT)
+                    // Only what the broker session does not have is subscribed
+                    ret = MqttSubscribe();
+                    if (ret < 0)
                     {
-                        if (systemConfig.isBrokerConnected) break;
-                        k_sleep(K_MSEC(100));
+                        // Subscriptions are sent again with the next connection
+                        MqttDisconnect();
                     }
+                }
+
+                mqtt_reconnect_on_result(ret);
 
-                    // Subscribe to the attribute topic
-                    mqtt_sub_topics[0].topic.utf8 = ATTRIBUTE_TOPIC;
-                    mqtt_sub_topics[0].topic.size = strlen(ATTRIBUTE_TOPIC);
-                    
-                    ret = MqttTopicsSubscribe(mqtt_sub_topics, 1);
+                if (ret >= 0)
+                {
+                    reportReadyTime(connectTime);
+                    // Keys left stale by a failed request are asked for again on the next connect
+                    (void)MqttSyncAttributes();
+                    reportAttributeCache();
+                    (void)publishConnectionReport();
+                }
+
+#if defined(CONFIG_MQTT_PUBLISH_BENCHMARK)
+                static bool isPublishBenchDone = false;
+
+                if ((ret >= 0) && systemConfig.isBrokerConnected && !isPublishBenchDone)
+                {
+                    (void)publish_bench_run();
+                    isPublishBenchDone = true;
                 }
+#endif
             }
             
-            if (ret >= 0)
+            isBrokerUp = systemConfig.isBrokerConnected;
+
+            // Woken for a reconnect only, the sample is not due yet
+            if (isSampleDue)
             {
-                snprintf(publishPayloadBuffer, MQTT_PUB_BUFF_SIZE, "{\"temperature\":%d}", systemConfig.InternalTemp);
-                ret = MqttPublishMessage(PUBLISH_TOPIC, publishPayloadBuffer);
-                if (ret < 0)
+                if ((ret >= 0) && systemConfig.isBrokerConnected)
+                {
+                    // Send the samples stored during the outage first
+                    ret = drainTelemetryBacklog();
+                }
+
+                if ((ret >= 0) && systemConfig.isBrokerConnected)
+                {
+                    ret = batchTelemetrySample();
+                    if (ret < 0)
+                    {
+                        printk("Failed to publish message\n");
+                        retained_state_set(RETAINED_STATE_VALUE_PUBLISH_FAILURES, retained_state_get(RETAINED_STATE_VALUE_PUBLISH_FAILURES) + 1);
+                    }
+                }
+                else
+                {
+                    queueTelemetrySample();
+                }
+
+                if ((ret >= 0) && systemConfig.isBrokerConnected && (CONFIG_STORAGE_WEAR_REPORT_INTERVAL_SEC > 0) &&
+                    (k_uptime_get() >= nextWearReportTime))
                 {
-                    printk("Failed to publish message\n");
+                    (void)publishFlashWearReport();
+                    nextWearReportTime = k_uptime_get() + (CONFIG_STORAGE_WEAR_REPORT_INTERVAL_SEC * 1000LL);
                 }
             }
         }
+        else if (isSampleDue)
+        {
+            queueTelemetrySample();
+        }
+
+        if (isSampleDue)
+        {
+            nextSampleTime = k_uptime_get() + (MQTT_INTER_MESSAGE_DELAY * 1000LL);
+        }
+
+        // Dropped while publishing
+        if (isBrokerUp && !systemConfig.isBrokerConnected)
+        {
+            mqtt_reconnect_on_connection_lost();
+        }
 
-        k_sleep(K_SECONDS(MQTT_INTER_MESSAGE_DELAY));
+        if (systemConfig.isBrokerConnected)
+        {
+            // A lost connection ends the wait at once, the reconnect is jittered by the scheduler
+            (void)mqtt_conn_state_wait(MQTT_CONN_STATE_BIT(MQTT_CONN_STATE_DISCONNECTED), K_TIMEOUT_ABS_MS(nextSampleTime));
+            if (!systemConfig.isBrokerConnected)
+            {
+                mqtt_reconnect_on_connection_lost();
+            }
+        }
+        else
+        {
+            // Next sample or the end of the reconnect backoff, whichever comes first
+            wakeTime = MIN(nextSampleTime, mqtt_reconnect_next_time());
+            k_sleep(K_TIMEOUT_ABS_MS(wakeTime));
+        }
     }
 }
 
-/**@brief           Function to parse the provision response message.
+/**@brief           Function to register the RPC methods of the device.
  * 
- * param[in]        topic_buf: Pointer to the topic buffer.
- * param[in]        payload_buf: Pointer to the payload buffer.
+ * @details         Handlers run in the RPC thread, the response is published as soon as they
+ *                  return.
  * 
- * @return          None.
+ * @return          0 if successful, negative otherwise.
  * 
 */
-void parseAttributeRxMessage(struct mqtt_helper_buf *topic_buf, struct mqtt_helper_buf *payload_buf)
+int32_t registerRpcMethods(void)
 {
-    if (strncmp(payload_buf->ptr, "{\"LED\":false}", payload_buf->size) == 0)
+    int32_t ret = 0;
+
+    ret = rpc_server_register("setLed", onSetLedRpc, NULL);
+    if (ret >= 0)
     {
-        SetLedState(0);
+        ret = rpc_server_register("getLed", onGetLedRpc, NULL);
     }
-    else if (strncmp(payload_buf->ptr, "{\"LED\":true}", payload_buf->size) == 0)
+    if (ret >= 0)
     {
-        SetLedState(1);
-        (void)k_work_reschedule(&led_off_work, K_SECONDS(MQTT_INTER_MESSAGE_DELAY/2));
+        ret = rpc_server_register("getTemperature", onGetTemperatureRpc, NULL);
     }
+
+    return ret;
 }
 
+/**@brief           Function to register the cached attributes of the device.
+ * 
+ * @details         Reads are served from the cache, on connect only the stale keys are
+ *                  requested.
+ * 
+ * @return          0 if successful, negative otherwise.
+ * 
+*/
+int32_t registerAttributes(void)
+{
+    int32_t ret = 0;
+
+    ret = attribute_cache_register(LED_ATTRIBUTE_KEY, ATTRIBUTE_CACHE_SCOPE_SHARED, onLedAttribute, NULL);
+    if (ret >= 0)
+    {
+        ret = attribute_cache_register(LED_ATTRIBUTE_KEY, ATTRIBUTE_CACHE_SCOPE_CLIENT, NULL, NULL);
+    }
+
+    return ret;
+}
 
-/**@brief           parse the json string and get the value of the key.
+/**@brief           Function to parse the provision response message.
  * 
- * param[in]        jsonString: Pointer to the json string.
- * param[in]        key: Pointer to the key.
- * param[in]        value: Pointer to the value.
+ * @details         Username is taken only from a SUCCESS response and only if it fits,
+ *                  then the device is marked provisioned.
  * 
- * @return          None.
+ * param[in]        payload_buf: Pointer to the payload buffer.
+ * 
+ * @return          0 if provisioned, negative otherwise.
  * 
 */
-void parseJsonGetStringObject(uint8_t *jsonString, uint8_t *key, uint8_t *value)
+int32_t parseProvisionResponse(struct mqtt_helper_buf *payload_buf)
 {
-    cJSON *root = cJSON_Parse(jsonString);
-    cJSON *item = cJSON_GetObjectItem(root, key);
-    if (item != NULL)
+    PROVISION_RESPONSE_STRUCT response = {0};
+    int32_t ret = 0;
+
+#if defined(CONFIG_MQTT_PAYLOAD_PROTOBUF)
+    ret = tb_pb_parse_provision_response(payload_buf->ptr, payload_buf->size, response.username,
+                                            sizeof(response.username));
+    if ((ret < 0) && (ret != -EACCES))
+    {
+        printk("Invalid provisioning response: %d\n", ret);
+        return ret;
+    }
+    response.isSuccess = (ret >= 0);
+    response.usernameLength = ret;
+#else
+    static const JSON_READER_KEY_STRUCT keys[] = {
+        {.key = "status", .handler = onProvisionStatus},
+        {.key = "credentialsValue", .handler = onProvisionCredentials},
+    };
+
+    ret = json_reader_parse_object(payload_buf->ptr, payload_buf->size, keys, ARRAY_SIZE(keys), &response);
+    if (ret < 0)
     {
-        strcpy(value, item->valuestring);
+        printk("Invalid provisioning response: %d\n", ret);
+        return ret;
     }
-    cJSON_Delete(root);
+#endif
+
+    if (!response.isSuccess || (response.usernameLength <= 0))
+    {
+        return -EACCES;
+    }
+
+    memcpy(systemConfig.deviceUsername, response.username, MAX_USERNAME_LENGTH);
+    systemConfig.isProvisioned = 1;
+
+    return 0;
 }
 /* End of file -------------------------------------------------------- */
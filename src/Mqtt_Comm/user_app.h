@@ -31,8 +31,9 @@ extern "C"
 ******************************************************************************
 */
 void StartDataCommunication(void *p1, void *p2, void *p3);
-void parseAttributeRxMessage(struct mqtt_helper_buf *topic_buf, struct mqtt_helper_buf *payload_buf);
-void parseJsonGetStringObject(uint8_t *jsonString, uint8_t *key, uint8_t *value);
+int32_t parseProvisionResponse(struct mqtt_helper_buf *payload_buf);
+int32_t registerRpcMethods(void);
+int32_t registerAttributes(void);
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,11 @@
 /* Private macros ----------------------------------------------------- */
 /* Public variables --------------------------------------------------- */
 /* Private variables -------------------------------------------------- */
+/* Radio on time. RRC connected time of finished connections and start of the current one */
+static struct k_spinlock rrcLock;
+static int64_t rrcConnectedMs = 0;
+static int64_t rrcConnectStart = -1;
+
 static const char cert[] = {
 	#include "ca-root.pem"
 };
@@ -71,6 +76,27 @@ static void lte_handler(const struct lte_lc_evt *const evt)
 				systemConfig.isNetworkConnected = 1;
 				break;
 
+		case LTE_LC_EVT_RRC_UPDATE:
+				{
+					k_spinlock_key_t key = k_spin_lock(&rrcLock);
+
+					if (evt->rrc_mode == LTE_LC_RRC_MODE_CONNECTED)
+					{
+						if (rrcConnectStart < 0)
+						{
+							rrcConnectStart = k_uptime_get();
+						}
+					}
+					else if (rrcConnectStart >= 0)
+					{
+						rrcConnectedMs += k_uptime_get() - rrcConnectStart;
+						rrcConnectStart = -1;
+					}
+
+					k_spin_unlock(&rrcLock, key);
+				}
+				break;
+
 		case LTE_LC_EVT_LTE_MODE_UPDATE:
 				printk("LTE mode update: %d: %s\n", evt->lte_mode,
 					evt->lte_mode == LTE_LC_LTE_MODE_NONE ? "None" :
@@ -269,5 +295,44 @@ int lte_network_init(void)
     return err;
 }
 
+/**@brief 				Get radio on time.
+ *
+ * @details 			Sum of the RRC connected time since boot, including the current connection.
+ *
+ * @param[in]	 		None.
+ * @return 				Radio on time in milliseconds.
+ */
+uint32_t lte_network_radio_on_ms(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&rrcLock);
+	int64_t connectedMs = rrcConnectedMs;
+
+	if (rrcConnectStart >= 0)
+	{
+		connectedMs += k_uptime_get() - rrcConnectStart;
+	}
+
+	k_spin_unlock(&rrcLock, key);
+
+	return (uint32_t)connectedMs;
+}
+
+/**@brief 				Get radio state.
+ *
+ * @details 			Radio stays on after the last transfer until the network releases the RRC connection.
+ *
+ * @param[in]	 		None.
+ * @return 				true if RRC connected.
+ */
+bool lte_network_is_radio_on(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&rrcLock);
+	bool isRadioOn = (rrcConnectStart >= 0);
+
+	k_spin_unlock(&rrcLock, key);
+
+	return isRadioOn;
+}
+
 
 /* End of file -------------------------------------------------------- */
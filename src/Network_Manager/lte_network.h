@@ -10,6 +10,7 @@ extern "C"
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include <stdbool.h>
 /* Exported types ------------------------------------------------------------*/
 
 /* Exported constants --------------------------------------------------------*/
@@ -29,6 +30,8 @@ extern "C"
 ******************************************************************************
 */
 int lte_network_init(void);
+uint32_t lte_network_radio_on_ms(void);
+bool lte_network_is_radio_on(void);
 
 
 #ifdef __cplusplus
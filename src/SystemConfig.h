@@ -25,7 +25,6 @@ typedef struct
     uint8_t ledState;
     uint8_t DeviceIMEI[20];
     uint8_t deviceUsername[MAX_USERNAME_LENGTH];
-    uint8_t SubscribedTopicsCount;
 }system_config_struct;
 
 /* Exported constants --------------------------------------------------------*/
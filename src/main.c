@@ -9,12 +9,17 @@
 #include "SystemConfig.h"
 #include "user_app.h"
 #include "storage.h"
+#include "storage_bench.h"
+#include "schema_bench.h"
+#include "router_bench.h"
+#include "rpc_bench.h"
+#include "retained_state.h"
+#include "telemetry_queue.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /* Private defines ---------------------------------------------------- */
-#define BOOT_COUNTER_FILE_NAME "bc"
 /* Private enumerate/structure ---------------------------------------- */
 /* Private macros ----------------------------------------------------- */
 /* Public variables --------------------------------------------------- */
@@ -27,29 +32,32 @@ k_tid_t user_app_tid;
 
 
 /* Private function prototypes ---------------------------------------- */
-static int32_t flashSelfTest(void);
+static int32_t restoreBootState(void);
 
 /* Private function definitions ---------------------------------------- */
-/**@brief           Function to perform flash self test.
+/**@brief           Function to count the boot.
+ * 
+ * @details         Warm resets are counted in retained RAM without flash access. Cold boots read
+ *                  and write the boot counter file once.
  * 
  * param[in]        None.
  * 
  * @return          0 if successful, negative otherwise.
  * 
  */
-static int32_t flashSelfTest(void)
+static int32_t restoreBootState(void)
 {
 	int32_t ret = 0;
-	uint32_t bootCounter = 0;
-	
-	for (uint32_t i = 0; i < 3; i++)
-	{
-		ret = read_file(BOOT_COUNTER_FILE_NAME, (uint8_t*)&bootCounter, sizeof(bootCounter), DIRECTORY);
-		bootCounter++;
-		ret = write_file(BOOT_COUNTER_FILE_NAME, (uint8_t*)&bootCounter, sizeof(bootCounter), DIRECTORY);
-		if(ret >= 0) break;
-	}
-	
+	RETAINED_STATE_BOOT_INFO_STRUCT bootInfo;
+	uint32_t startCycles = k_cycle_get_32();
+
+	ret = retained_state_init();
+	retained_state_get_boot_info(&bootInfo);
+
+	printk("Boot counter %u (%s boot, %u warm, reset cause 0x%x), took %u us\n", bootInfo.bootCounter,
+			bootInfo.isWarmBoot ? "warm" : "cold", bootInfo.warmBoots, bootInfo.resetCause,
+			k_cyc_to_us_floor32(k_cycle_get_32() - startCycles));
+
 	return ret;
 }
 
@@ -64,13 +72,49 @@ int main(void)
 	// EraseExternalFlash();
 	// return 0;
 
-	ret = flashSelfTest();
+	ret = storage_init();
+	if (ret < 0)
+	{
+		printk("Failed to mount flash storage\n");
+		return ret;
+	}
+
+#if defined(CONFIG_STORAGE_KV)
+	/* Config records are a few bytes. Keep them out of LittleFS */
+	storage_set_directory_backend(DIRECTORY, STORAGE_BACKEND_KV);
+#endif
+
+#if defined(CONFIG_STORAGE_BENCHMARK)
+	storage_bench_run();
+#endif
+
+#if defined(CONFIG_SCHEMA_BENCHMARK)
+	schema_bench_run();
+#endif
+
+#if defined(CONFIG_TOPIC_ROUTER_BENCHMARK)
+	/* Before mqtt_comm_init, the benchmark removes all routes */
+	router_bench_run();
+#endif
+
+#if defined(CONFIG_RPC_BENCHMARK)
+	/* Before mqtt_comm_init, the benchmark removes all routes and methods */
+	rpc_bench_run();
+#endif
+
+	ret = restoreBootState();
 	if (ret < 0)
 	{
 		printk("Failed to initialize flash storage\n");
 		return ret;
 	}
 
+	ret = telemetry_queue_init();
+	if (ret < 0)
+	{
+		printk("Failed to initialize telemetry queue\n");
+	}
+
 	ret = mqtt_comm_init();
 	if (ret != 0)
 	{
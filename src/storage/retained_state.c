@@ -0,0 +1,345 @@
+/**
+ * @file retained_state.c
+ * @brief Boot counter and hot state in RAM retained over warm resets.
+ *
+ * @details State lives in a no-init RAM section protected by a magic, a layout header and a
+ * CRC. The header holds the layout version, the size and the address of the block, so a
+ * block left by an image with another layout, or found at another address after the image
+ * layout changed, is never taken for valid state. RAM keeps
+ * its content over a warm reset, so the boot counter is counted there without touching
+ * flash. A power-on reset, a brown-out or a wrong CRC (RAM overwritten by the bootloader)
+ * is a cold boot: the boot counter is read from flash once and written back. Warm boot
+ * counts reach flash on the next checkpoint, so a power loss can lose at most one
+ * checkpoint interval of warm boots.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/crc.h>
+#if defined(CONFIG_HWINFO)
+#include <zephyr/drivers/hwinfo.h>
+#endif
+#include "storage.h"
+#include "storage_cache.h"
+#include "storage_async.h"
+#include "retained_state.h"
+
+#define RETAINED_STATE_MAGIC            0x52544E44
+/* Bump when a field of RETAINED_STATE_STRUCT is added, removed or moved */
+#define RETAINED_STATE_LAYOUT_VERSION   2
+#define RETAINED_STATE_FLASH_RETRIES    3
+
+/* Retained RAM layout. Header fields stay first in every layout version */
+typedef struct
+{
+	uint32_t magic;
+	uint16_t layoutVersion;
+	uint16_t size;					/* Size of the block */
+	uint32_t address;				/* Address of the block when sealed */
+	uint32_t bootCounter;
+	uint32_t flashBootCounter;		/* Boot counter value in flash */
+	uint32_t warmBoots;
+	uint32_t resetCause;
+	uint32_t values[RETAINED_STATE_VALUE_COUNT];
+	uint32_t crc;
+}RETAINED_STATE_STRUCT;
+
+BUILD_ASSERT(sizeof(RETAINED_STATE_STRUCT) <= UINT16_MAX, "Retained state size is kept in 16 bits");
+
+static void checkpointWorkHandler(struct k_work *work);
+
+/* Retained state Mutex to synchronize */
+K_MUTEX_DEFINE(RetainedStateMutex);
+K_WORK_DELAYABLE_DEFINE(retained_state_checkpoint_work, checkpointWorkHandler);
+
+/* Not cleared at boot */
+static __noinit RETAINED_STATE_STRUCT retainedState;
+
+static bool isWarmBoot = false;
+static bool isStateRestored = false;
+
+/**@brief 				Function to get the CRC of the retained state
+ *
+ * @param[in]	 		state				Retained state.
+ * @param[out]   		uint32_t			returns CRC of all fields before crc.
+ */
+static uint32_t stateCrc(const RETAINED_STATE_STRUCT *state)
+{
+	return crc32_ieee((const uint8_t *)state, offsetof(RETAINED_STATE_STRUCT, crc));
+}
+
+/**@brief 				Function to seal the retained state after a change
+ *
+ * @details 			Retained state lock must be held by the caller.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		None.
+ */
+static void sealState(void)
+{
+	retainedState.magic = RETAINED_STATE_MAGIC;
+	retainedState.layoutVersion = RETAINED_STATE_LAYOUT_VERSION;
+	retainedState.size = sizeof(retainedState);
+	retainedState.address = (uint32_t)(uintptr_t)&retainedState;
+	retainedState.crc = stateCrc(&retainedState);
+}
+
+/**@brief 				Function to get the reset cause of this boot
+ *
+ * @details 			Reset cause register keeps flags of earlier resets until cleared.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		uint32_t			returns hwinfo RESET_* flags, 0 if unknown.
+ */
+static uint32_t readResetCause(void)
+{
+	uint32_t cause = 0;
+
+#if defined(CONFIG_HWINFO)
+	if (hwinfo_get_reset_cause(&cause) < 0)
+	{
+		cause = 0;
+	}
+	(void)hwinfo_clear_reset_cause();
+#endif
+
+	return cause;
+}
+
+/**@brief 				Function to check if retained RAM survived the reset
+ *
+ * @param[in]	 		resetCause			hwinfo RESET_* flags of this boot.
+ * @param[out]   		bool				returns true if the retained state is valid.
+ */
+static bool isStateValid(uint32_t resetCause)
+{
+#if defined(CONFIG_HWINFO)
+	/* RAM content is undefined after power loss, even if the CRC matches */
+	if ((resetCause & (RESET_POR | RESET_BROWNOUT)) != 0)
+	{
+		return false;
+	}
+#else
+	ARG_UNUSED(resetCause);
+#endif
+
+	if (retainedState.magic != RETAINED_STATE_MAGIC)
+	{
+		return false;
+	}
+
+	/* No-init section has no reserved region, a new image may place it elsewhere or change it */
+	if ((retainedState.layoutVersion != RETAINED_STATE_LAYOUT_VERSION) ||
+		(retainedState.size != sizeof(retainedState)) ||
+		(retainedState.address != (uint32_t)(uintptr_t)&retainedState))
+	{
+		printk("Retained state layout changed, version %u size %u\n", retainedState.layoutVersion, retainedState.size);
+		return false;
+	}
+
+	return retainedState.crc == stateCrc(&retainedState);
+}
+
+/**@brief 				Function to write the boot counter to flash
+ *
+ * @details 			Retained state lock must be held by the caller.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t writeBootCounter(void)
+{
+	uint32_t bootCounter = retainedState.bootCounter;
+	int32_t rc = 0;
+
+	for (uint32_t i = 0; i < RETAINED_STATE_FLASH_RETRIES; i++)
+	{
+		rc = storage_cache_write(RETAINED_STATE_BOOT_COUNTER_FILE_NAME, (uint8_t *)&bootCounter, sizeof(bootCounter), DIRECTORY);
+		if (rc >= 0)
+		{
+			rc = storage_cache_sync();
+		}
+		if (rc >= 0)
+		{
+			break;
+		}
+	}
+
+	if (rc >= 0)
+	{
+		retainedState.flashBootCounter = bootCounter;
+		sealState();
+	}
+
+	return rc;
+}
+
+/**@brief 				Checkpoint work handler
+ *
+ * @details 			Runs on the storage work queue.
+ *
+ * @param[in]	 		work				Checkpoint work.
+ * @param[out]   		None.
+ */
+static void checkpointWorkHandler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	if (retained_state_checkpoint() < 0)
+	{
+		printk("Retained state checkpoint failed\n");
+	}
+
+	(void)k_work_schedule_for_queue(storage_async_queue(), &retained_state_checkpoint_work,
+									K_SECONDS(CONFIG_RETAINED_STATE_CHECKPOINT_INTERVAL_SEC));
+}
+
+/**@brief 				Function to restore the retained state at boot
+ *
+ * @details 			On a warm reset the boot counter is counted in retained RAM without flash access.
+ * 						On a cold boot, or if the retained RAM checksum is wrong, the boot counter is read
+ * 						from flash and written back. Call once after storage_init().
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t retained_state_init(void)
+{
+	uint32_t resetCause = readResetCause();
+	uint32_t bootCounter = 0;
+	int32_t rc = 0;
+
+	k_mutex_lock(&RetainedStateMutex, K_FOREVER);
+
+	if (isStateRestored)
+	{
+		k_mutex_unlock(&RetainedStateMutex);
+		return 0;
+	}
+
+	isWarmBoot = isStateValid(resetCause);
+	if (isWarmBoot)
+	{
+		retainedState.bootCounter++;
+		retainedState.warmBoots++;
+		retainedState.resetCause = resetCause;
+		sealState();
+	}
+	else
+	{
+		rc = storage_cache_read(RETAINED_STATE_BOOT_COUNTER_FILE_NAME, (uint8_t *)&bootCounter, sizeof(bootCounter), DIRECTORY);
+		if ((rc == -ENOENT) || ((rc >= 0) && (rc != sizeof(bootCounter))))
+		{
+			/* First boot or unreadable counter, count from 0 */
+			bootCounter = 0;
+			rc = 0;
+		}
+
+		if (rc >= 0)
+		{
+			memset(&retainedState, 0, sizeof(retainedState));
+			retainedState.bootCounter = bootCounter + 1;
+			retainedState.resetCause = resetCause;
+			sealState();
+
+			rc = writeBootCounter();
+		}
+	}
+
+	isStateRestored = (rc >= 0);
+
+	k_mutex_unlock(&RetainedStateMutex);
+
+	if (isStateRestored && (CONFIG_RETAINED_STATE_CHECKPOINT_INTERVAL_SEC > 0))
+	{
+		(void)k_work_schedule_for_queue(storage_async_queue(), &retained_state_checkpoint_work,
+										K_SECONDS(CONFIG_RETAINED_STATE_CHECKPOINT_INTERVAL_SEC));
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to get the boot information
+ *
+ * @param[in]	 		info				Information to fill.
+ * @param[out]   		None.
+ */
+void retained_state_get_boot_info(RETAINED_STATE_BOOT_INFO_STRUCT *info)
+{
+	k_mutex_lock(&RetainedStateMutex, K_FOREVER);
+
+	info->bootCounter = retainedState.bootCounter;
+	info->warmBoots = retainedState.warmBoots;
+	info->resetCause = retainedState.resetCause;
+	info->isWarmBoot = isWarmBoot;
+
+	k_mutex_unlock(&RetainedStateMutex);
+}
+
+/**@brief 				Function to get an application value
+ *
+ * @param[in]	 		id					Value id.
+ * @param[out]   		uint32_t			returns value. 0 after a cold boot.
+ */
+uint32_t retained_state_get(RETAINED_STATE_VALUE id)
+{
+	uint32_t value = 0;
+
+	if (id >= RETAINED_STATE_VALUE_COUNT)
+	{
+		return 0;
+	}
+
+	k_mutex_lock(&RetainedStateMutex, K_FOREVER);
+	value = retainedState.values[id];
+	k_mutex_unlock(&RetainedStateMutex);
+
+	return value;
+}
+
+/**@brief 				Function to set an application value
+ *
+ * @param[in]	 		id					Value id.
+ * @param[in]	 		value				New value.
+ * @param[out]   		None.
+ */
+void retained_state_set(RETAINED_STATE_VALUE id, uint32_t value)
+{
+	if (id >= RETAINED_STATE_VALUE_COUNT)
+	{
+		return;
+	}
+
+	k_mutex_lock(&RetainedStateMutex, K_FOREVER);
+	retainedState.values[id] = value;
+	sealState();
+	k_mutex_unlock(&RetainedStateMutex);
+}
+
+/**@brief 				Function to write the boot counter to flash
+ *
+ * @details 			Nothing is written if flash is up to date. Runs every
+ * 						CONFIG_RETAINED_STATE_CHECKPOINT_INTERVAL_SEC and before the storage is suspended.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t retained_state_checkpoint(void)
+{
+	int32_t rc = 0;
+
+	k_mutex_lock(&RetainedStateMutex, K_FOREVER);
+
+	if (isStateRestored && (retainedState.flashBootCounter != retainedState.bootCounter))
+	{
+		rc = writeBootCounter();
+	}
+
+	k_mutex_unlock(&RetainedStateMutex);
+
+	return rc;
+}
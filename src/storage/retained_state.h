@@ -0,0 +1,87 @@
+/**
+ * @file retained_state.h
+ * @brief Boot counter and hot state in RAM retained over warm resets.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+
+#ifndef RetainedState_h
+#define RetainedState_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Boot counter file, written on cold boot and on checkpoints */
+#define RETAINED_STATE_BOOT_COUNTER_FILE_NAME   "bc"
+
+/* Application values kept in retained RAM only */
+typedef enum
+{
+	RETAINED_STATE_VALUE_PUBLISH_FAILURES = 0,		/* Telemetry publish failures since cold boot */
+	RETAINED_STATE_VALUE_COUNT,
+}RETAINED_STATE_VALUE;
+
+/* Boot information */
+typedef struct
+{
+	uint32_t bootCounter;			/* All boots */
+	uint32_t warmBoots;				/* Boots since the last cold boot */
+	uint32_t resetCause;			/* hwinfo RESET_* flags of this boot */
+	bool isWarmBoot;				/* Retained RAM was valid at boot */
+}RETAINED_STATE_BOOT_INFO_STRUCT;
+
+/**@brief 				Function to restore the retained state at boot
+ *
+ * @details 			On a warm reset the boot counter is counted in retained RAM without flash access.
+ * 						On a cold boot, or if the retained RAM checksum is wrong, the boot counter is read
+ * 						from flash and written back. Call once after storage_init().
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t retained_state_init(void);
+
+/**@brief 				Function to get the boot information
+ *
+ * @param[in]	 		info				Information to fill.
+ * @param[out]   		None.
+ */
+void retained_state_get_boot_info(RETAINED_STATE_BOOT_INFO_STRUCT *info);
+
+/**@brief 				Function to get an application value
+ *
+ * @param[in]	 		id					Value id.
+ * @param[out]   		uint32_t			returns value. 0 after a cold boot.
+ */
+uint32_t retained_state_get(RETAINED_STATE_VALUE id);
+
+/**@brief 				Function to set an application value
+ *
+ * @param[in]	 		id					Value id.
+ * @param[in]	 		value				New value.
+ * @param[out]   		None.
+ */
+void retained_state_set(RETAINED_STATE_VALUE id, uint32_t value);
+
+/**@brief 				Function to write the boot counter to flash
+ *
+ * @details 			Nothing is written if flash is up to date. Runs every
+ * 						CONFIG_RETAINED_STATE_CHECKPOINT_INTERVAL_SEC and before the storage is suspended.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t retained_state_checkpoint(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
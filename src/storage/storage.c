@@ -13,6 +13,11 @@
 #include <zephyr/fs/littlefs.h>
 #include <zephyr/sys/printk.h>
 #include "storage.h"
+#include "storage_cache.h"
+#include "storage_kv.h"
+#include "storage_wear.h"
+#include "storage_async.h"
+#include "retained_state.h"
 
 /* File System configuratoin */
 FS_LITTLEFS_DECLARE_DEFAULT_CONFIG(storage);
@@ -26,12 +31,405 @@ static struct fs_mount_t lfs_storage_mnt = {
 /* File system mount point and other information*/
 static struct fs_mount_t *littleFsMountInfo = &lfs_storage_mnt;
 
-/* External Flash storage Mutex to synchronize */
+/* External Flash storage reader/writer lock. Reads share the file system, writes and mount changes
+ * are exclusive. StorageMutex only guards the lock state */
 K_MUTEX_DEFINE(StorageMutex);
+K_CONDVAR_DEFINE(StorageCondvar);
+static uint32_t activeReaders = 0;
+static uint32_t waitingWriters = 0;
+static bool isWriterActive = false;
+
+/* File system mount state. File system stays mounted between the storage calls */
+static bool isFileSystemMounted = false;
+static bool isStorageShutdown = false;
+
+/* File kept open between offset/append calls on the same file */
+static struct fs_file_t openFile;
+static uint8_t openFilePath[STORAGE_FILE_MAX_PATH_LEN] = {0};
+static bool isOpenFileValid = false;
+
+/* Number of open streams. File system can not be unmounted while a stream is open */
+static uint32_t openStreamCount = 0;
+
+/* Flash operations counters. LittleFS block device callbacks are wrapped after every mount.
+ * Callbacks of shared readers are serialized by the file system mount lock */
+static STORAGE_FLASH_COUNTERS_STRUCT flashCounters;
+static int (*lfsProg)(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size);
+static int (*lfsErase)(const struct lfs_config *c, lfs_block_t block);
+static int (*lfsRead)(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size);
+
+/* Wear account of the file operation holding the storage lock */
+static int32_t currentAccount = STORAGE_WEAR_ACCOUNT_OTHER;
+
+/* Directories served by a backend other than LittleFS */
+typedef struct
+{
+	uint8_t directory[STORAGE_BACKEND_DIRECTORY_MAX_LEN + 1];
+	STORAGE_BACKEND backend;
+}STORAGE_DIRECTORY_BACKEND_STRUCT;
+
+static STORAGE_DIRECTORY_BACKEND_STRUCT directoryBackends[STORAGE_BACKEND_MAX_DIRECTORIES];
+
+static int32_t eraseLittleFsFile(const uint8_t *name, const uint8_t* directory);
+static int32_t storageMount(void);
 
 #define APP_CORE_DFU_PARTITION_ID FIXED_PARTITION_ID(slot1_partition)
 #define NET_CORE_DFU_PARTITION_ID FIXED_PARTITION_ID(slot3_partition)
 
+/**@brief 				Function to lock the storage
+ *
+ * @details 			Take the storage lock exclusive if mutex locking is enabled. Waits until
+ * 						running readers and writers are done. Lock is not recursive.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		None.
+ */
+static void storageLock(void)
+{
+	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
+		k_mutex_lock(&StorageMutex, K_FOREVER);
+
+		waitingWriters++;
+		while (isWriterActive || (activeReaders > 0))
+		{
+			k_condvar_wait(&StorageCondvar, &StorageMutex, K_FOREVER);
+		}
+		waitingWriters--;
+		isWriterActive = true;
+
+		k_mutex_unlock(&StorageMutex);
+	#endif
+}
+
+/**@brief 				Function to unlock the storage
+ *
+ * @details 			Release the exclusive storage lock if mutex locking is enabled
+ *
+ * @param[in]	 		None.
+ * @param[out]   		None.
+ */
+static void storageUnlock(void)
+{
+	currentAccount = STORAGE_WEAR_ACCOUNT_OTHER;
+
+	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
+		k_mutex_lock(&StorageMutex, K_FOREVER);
+		isWriterActive = false;
+		k_condvar_broadcast(&StorageCondvar);
+		k_mutex_unlock(&StorageMutex);
+	#endif
+}
+
+/**@brief 				Function to lock the storage shared
+ *
+ * @details 			Readers run in parallel and wait only for writers. Waiting writers go first so
+ * 						readers can not starve them. Exclusive if shared reads are disabled.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		None.
+ */
+static void storageSharedLock(void)
+{
+	#if defined(CONFIG_STORAGE_SHARED_READ_LOCK) && (FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1)
+		k_mutex_lock(&StorageMutex, K_FOREVER);
+
+		while (isWriterActive || (waitingWriters > 0))
+		{
+			k_condvar_wait(&StorageCondvar, &StorageMutex, K_FOREVER);
+		}
+		activeReaders++;
+
+		k_mutex_unlock(&StorageMutex);
+	#else
+		storageLock();
+	#endif
+}
+
+/**@brief 				Function to unlock the shared storage lock
+ *
+ * @param[in]	 		None.
+ * @param[out]   		None.
+ */
+static void storageSharedUnlock(void)
+{
+	#if defined(CONFIG_STORAGE_SHARED_READ_LOCK) && (FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1)
+		k_mutex_lock(&StorageMutex, K_FOREVER);
+
+		activeReaders--;
+		if (activeReaders == 0)
+		{
+			k_condvar_broadcast(&StorageCondvar);
+		}
+
+		k_mutex_unlock(&StorageMutex);
+	#else
+		storageUnlock();
+	#endif
+}
+
+/**@brief 				Function to lock the storage for reading
+ *
+ * @details 			Take the storage lock shared with the file system mounted. Mounting changes the
+ * 						storage state, so it is done under the exclusive lock. Lock is held on success only.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 on success or negative ERROR code incase of an error.
+ */
+static int32_t storageReadLock(void)
+{
+	int32_t rc = 0;
+
+	storageSharedLock();
+
+	while (!isFileSystemMounted && (rc >= 0))
+	{
+		storageSharedUnlock();
+
+		storageLock();
+		rc = storageMount();
+		storageUnlock();
+
+		storageSharedLock();
+	}
+
+	if (rc < 0)
+	{
+		storageSharedUnlock();
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to check if a directory is served by the key/value store
+ *
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		bool				returns true if the directory uses STORAGE_BACKEND_KV.
+ */
+static bool isKvDirectory(const uint8_t *directory)
+{
+	for (uint32_t i = 0; i < STORAGE_BACKEND_MAX_DIRECTORIES; i++)
+	{
+		if ((directoryBackends[i].backend == STORAGE_BACKEND_KV) &&
+			(strcmp(directoryBackends[i].directory, directory) == 0))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**@brief 				Function to charge flash operations to a file
+ *
+ * @details 			Flash operations until storageUnlock() are counted in the wear account of the file.
+ * 						Storage lock must be held by the caller.
+ *
+ * @param[in]	 		path				File path. Temporary suffix is ignored.
+ * @param[out]   		None.
+ */
+static void storageSetAccount(const uint8_t *path)
+{
+	uint8_t name[STORAGE_FILE_MAX_PATH_LEN] = {0};
+	uint32_t mountLen = strlen(littleFsMountInfo->mnt_point);
+	uint32_t suffixLen = strlen(STORAGE_STREAM_TEMP_SUFFIX);
+	uint32_t len;
+
+	if ((strncmp(path, littleFsMountInfo->mnt_point, mountLen) == 0) && (path[mountLen] == '/'))
+	{
+		path += mountLen + 1;
+	}
+
+	len = strlen(path);
+	if ((len > suffixLen) && (strcmp(&path[len - suffixLen], STORAGE_STREAM_TEMP_SUFFIX) == 0))
+	{
+		len -= suffixLen;
+	}
+
+	memcpy(name, path, MIN(len, sizeof(name) - 1));
+	currentAccount = storage_wear_account(name);
+}
+
+/**@brief 				LittleFS program callback wrapper
+ *
+ * @details 			Count programmed bytes and forward to the LittleFS block device callback.
+ */
+static int countingProg(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+	flashCounters.programOps++;
+	flashCounters.programBytes += size;
+	storage_wear_record_program(STORAGE_WEAR_AREA_LITTLEFS, block, size, currentAccount);
+
+	return lfsProg(c, block, off, buffer, size);
+}
+
+/**@brief 				LittleFS erase callback wrapper
+ *
+ * @details 			Count erased blocks and forward to the LittleFS block device callback.
+ */
+static int countingErase(const struct lfs_config *c, lfs_block_t block)
+{
+	flashCounters.eraseOps++;
+	storage_wear_record_erase(STORAGE_WEAR_AREA_LITTLEFS, block, currentAccount);
+
+	return lfsErase(c, block);
+}
+
+/**@brief 				LittleFS read callback wrapper
+ *
+ * @details 			Count read bytes and forward to the LittleFS block device callback.
+ */
+static int countingRead(const struct lfs_config *c, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
+{
+	flashCounters.readOps++;
+	flashCounters.readBytes += size;
+
+	return lfsRead(c, block, off, buffer, size);
+}
+
+/**@brief 				Function to install flash counters
+ *
+ * @details 			LittleFS block device callbacks are set again on every mount, wrap them after the mount.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		None.
+ */
+static void installFlashCounters(void)
+{
+	if (storage.cfg.prog != countingProg)
+	{
+		lfsProg = storage.cfg.prog;
+		storage.cfg.prog = countingProg;
+	}
+
+	if (storage.cfg.erase != countingErase)
+	{
+		lfsErase = storage.cfg.erase;
+		storage.cfg.erase = countingErase;
+	}
+
+	if (storage.cfg.read != countingRead)
+	{
+		lfsRead = storage.cfg.read;
+		storage.cfg.read = countingRead;
+	}
+}
+
+/**@brief 				Function to close the kept open file
+ *
+ * @details 			Storage lock must be held by the caller.
+ *
+ * @param[in]	 		path				Close only if the open file has this path. NULL to close any file.
+ * @param[out]   		None.
+ */
+static void closeOpenFile(const uint8_t *path)
+{
+	if (isOpenFileValid && ((path == NULL) || (strcmp(openFilePath, path) == 0)))
+	{
+		fs_close(&openFile);
+		isOpenFileValid = false;
+		openFilePath[0] = 0;
+	}
+}
+
+/**@brief 				Function to get an open handle for a file
+ *
+ * @details 			Handle is kept open so repeated offset/append calls on the same file skip the open.
+ * 						Storage lock must be held by the caller and file system must be mounted.
+ *
+ * @param[in]	 		path				Full file path.
+ * @param[in]	 		create				Create the file incase not existed.
+ * @param[out]   		int32_t				returns 0 on success or negative ERROR code incase of an error.
+ */
+static int32_t getOpenFile(const uint8_t *path, bool create)
+{
+	int32_t rc = 0;
+
+	if (isOpenFileValid && (strcmp(openFilePath, path) == 0))
+	{
+		return 0;
+	}
+
+	closeOpenFile(NULL);
+
+	fs_file_t_init(&openFile);
+	rc = fs_open(&openFile, path, create ? (FS_O_CREATE | FS_O_RDWR) : FS_O_RDWR);
+	if (rc >= 0)
+	{
+		strncpy(openFilePath, path, sizeof(openFilePath) - 1);
+		isOpenFileValid = true;
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to mount the file system
+ *
+ * @details 			Mount the file system if it is not mounted yet. Storage lock must be held by the caller.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 on success or negative ERROR code incase of an error.
+ */
+static int32_t storageMount(void)
+{
+	int32_t rc = 0;
+
+	if (isStorageShutdown)
+	{
+		return -ESHUTDOWN;
+	}
+
+	if (!isFileSystemMounted)
+	{
+		rc = fs_mount(littleFsMountInfo);
+		if (rc == -EBUSY)
+		{
+			/* Already mounted by someone else */
+			rc = 0;
+		}
+
+		if (rc >= 0)
+		{
+			isFileSystemMounted = true;
+			installFlashCounters();
+		}
+		else
+		{
+			printk("FAIL: unable to mount %s: %d\n", littleFsMountInfo->mnt_point, rc);
+		}
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to unmount the file system
+ *
+ * @details 			Unmount the file system if it is mounted. Storage lock must be held by the caller.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 on success, -EBUSY if a stream is open or negative ERROR code incase of an error.
+ */
+static int32_t storageUnmount(void)
+{
+	int32_t rc = 0;
+
+	if (openStreamCount > 0)
+	{
+		return -EBUSY;
+	}
+
+	if (isFileSystemMounted)
+	{
+		closeOpenFile(NULL);
+		rc = fs_unmount(littleFsMountInfo);
+		if (rc >= 0)
+		{
+			isFileSystemMounted = false;
+		}
+	}
+
+	return rc;
+}
+
 /**@brief 				Function to initialize required directory
  *
  * @details 			Verify the required directory already exist otherwise create it
@@ -68,9 +466,11 @@ static int32_t initializeDirectory(const uint8_t* directory)
  * @param[in]	 		data				buffer to fill with read data. 
  * @param[in]	 		data_size			Max number of bytes to read. 
  * @param[in]	 		directory			Directory name.
+ * @param[in]	 		fileSize			Filled with the file size.
  * @param[out]   		int32_t				returns number of data bytes read from file system. Negative ERROR code incase of an error.
  */
-int32_t read_file(const uint8_t *filename, uint8_t *data, uint32_t data_size, const uint8_t* directory) {
+static int32_t readLittleFsFile(const uint8_t *filename, uint8_t *data, uint32_t data_size, const uint8_t* directory, uint32_t *fileSize)
+{
 	struct fs_dirent dirent;
 	struct fs_file_t file;
 
@@ -84,22 +484,20 @@ int32_t read_file(const uint8_t *filename, uint8_t *data, uint32_t data_size, co
 		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
 	}
 
-	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
-		k_mutex_lock(&StorageMutex, K_FOREVER);
-	#endif
-
 	/* File system file path and name*/
 	snprintf(file_path, STORAGE_FILE_MAX_PATH_LEN, "%s/%s/%s", littleFsMountInfo->mnt_point, directory, filename);
 	printk("File Path: %s\n", file_path);
 
-	/*Mount File system before any operation*/
-	rc = fs_mount(littleFsMountInfo);
+	/*Readers share the file system. Mount File system if not mounted yet*/
+	rc = storageReadLock();
 	if (rc >= 0)
 	{
 		/*Retrieve Blob information with respect to key*/
 		rc = fs_stat(file_path, &dirent);
 		if (rc >= 0)
 		{
+			*fileSize = dirent.size;
+
 			/*Open file Read only mode*/
 			fs_file_t_init(&file);
 			rc = fs_open(&file, file_path, FS_O_READ);
@@ -108,23 +506,55 @@ int32_t read_file(const uint8_t *filename, uint8_t *data, uint32_t data_size, co
 				rc = fs_read(&file, data, MIN(dirent.size, data_size));
 			}
 
-			printk("Read file: %s\n", filename);
-			printk("Data: %s\n", data);
+			printk("Read file: %s, %d bytes\n", filename, rc);
 
 			fs_close(&file);
 		}
-		
-		/*Unmount file system before exit*/
-		fs_unmount(littleFsMountInfo);
-	}
 
-	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
-		k_mutex_unlock(&StorageMutex);
-	#endif
+		storageSharedUnlock();
+	}
 
 	return rc;
 }
 
+/**@brief 				Function to retrieve the Blob information from file system
+ *
+ * @details 			Read file system for blob data referencing provided key value. Files of a key/value
+ * 						directory not found in the store are moved there from LittleFS on first read.
+ *
+ * @param[in]	 		filename			File to read.
+ * @param[in]	 		data				buffer to fill with read data. 
+ * @param[in]	 		data_size			Max number of bytes to read. 
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes read from file system. Negative ERROR code incase of an error.
+ */
+int32_t read_file(const uint8_t *filename, uint8_t *data, uint32_t data_size, const uint8_t* directory)
+{
+	uint32_t fileSize = 0;
+
+#if defined(CONFIG_STORAGE_KV)
+	if (isKvDirectory(directory))
+	{
+		int32_t rc = storage_kv_read(filename, data, data_size, directory);
+		if (rc != -ENOENT)
+		{
+			return rc;
+		}
+
+		rc = readLittleFsFile(filename, data, data_size, directory, &fileSize);
+		if ((rc >= 0) && (rc == fileSize) && (storage_kv_write(filename, data, rc, directory) == rc))
+		{
+			printk("Moved %s/%s to key/value store\n", directory, filename);
+			eraseLittleFsFile(filename, directory);
+		}
+
+		return rc;
+	}
+#endif
+
+	return readLittleFsFile(filename, data, data_size, directory, &fileSize);
+}
+
 /**@brief 				Function to write a file.
  *
  * @details 			write file in file system to store blob data referencing provided key value
@@ -135,7 +565,7 @@ int32_t read_file(const uint8_t *filename, uint8_t *data, uint32_t data_size, co
  * @param[in]	 		directory			Directory name.
  * @param[out]   		int32_t				returns number of data bytes written in file system. Negative ERROR code incase of an error.
  */
-int32_t write_file(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t* directory)
+static int32_t writeLittleFsFile(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t* directory)
 {
 	struct fs_file_t file;
 	uint8_t file_path[STORAGE_FILE_MAX_PATH_LEN] = {0};
@@ -146,17 +576,19 @@ int32_t write_file(const uint8_t *filename, const uint8_t *data, uint32_t data_s
 		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
 	}
 
-	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
-		k_mutex_lock(&StorageMutex, K_FOREVER);
-	#endif
+	storageLock();
 
 	/* File system file path and name*/
 	snprintf(file_path, STORAGE_FILE_MAX_PATH_LEN, "%s/%s/%s", littleFsMountInfo->mnt_point, directory, filename);
+	storageSetAccount(file_path);
 
-	/*Mount File system before any operation*/
-	rc = fs_mount(littleFsMountInfo);
+	/*Mount File system if not mounted yet*/
+	rc = storageMount();
 	if (rc >= 0)
 	{
+		/*File is rewritten through its own handle*/
+		closeOpenFile(file_path);
+
 		rc = initializeDirectory(directory);
 		if (rc >= 0)
 		{
@@ -169,25 +601,240 @@ int32_t write_file(const uint8_t *filename, const uint8_t *data, uint32_t data_s
 				rc = fs_write(&file, data, data_size);
 			}
 
-			printk("Write file: %s\n", filename);
-			printk("Data: %s\n", data);
+			printk("Write file: %s, %d bytes\n", filename, rc);
 
 			/*Close file */
 			fs_close(&file);
 		}
-
-		/*Unmount file system before exit*/
-		fs_unmount(littleFsMountInfo);
 	}
 
-	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
-		k_mutex_unlock(&StorageMutex);
-	#endif
+	storageUnlock();
 	return rc;
 }
 
-
-/**@brief 				Function to remove the Blob information from file system
+/**@brief 				Function to write a file.
+ *
+ * @details 			write file in file system to store blob data referencing provided key value
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		data				buffer with data to write. 
+ * @param[in]	 		data_size			Number of bytes to write. 
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written in file system. Negative ERROR code incase of an error.
+ */
+int32_t write_file(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t* directory)
+{
+#if defined(CONFIG_STORAGE_KV)
+	if (isKvDirectory(directory))
+	{
+		return storage_kv_write(filename, data, data_size, directory);
+	}
+#endif
+
+	return writeLittleFsFile(filename, data, data_size, directory);
+}
+
+
+/**@brief 				Function to append data to a file.
+ *
+ * @details 			Append blob data at the end of the file. File will be created incase not existed.
+ * 						Existing data is not rewritten and data is committed before return.
+ *
+ * @param[in]	 		filename			File to append.
+ * @param[in]	 		data				buffer with data to append. 
+ * @param[in]	 		data_size			Number of bytes to append. 
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written in file system. Negative ERROR code incase of an error.
+ */
+int32_t append_file(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t* directory)
+{
+	uint8_t file_path[STORAGE_FILE_MAX_PATH_LEN] = {0};
+	int32_t rc;
+
+	if( (strlen(filename) + strlen(directory) + 2) > INPUT_NAME_MAX_LENGTH)	{
+		printk("Provided file name is too long\n");
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
+
+	if (isKvDirectory(directory))
+	{
+		/* Key/value store holds whole values only */
+		return -ENOTSUP;
+	}
+
+	storageLock();
+
+	/* File system file path and name*/
+	snprintf(file_path, STORAGE_FILE_MAX_PATH_LEN, "%s/%s/%s", littleFsMountInfo->mnt_point, directory, filename);
+	storageSetAccount(file_path);
+
+	/*Mount File system if not mounted yet*/
+	rc = storageMount();
+	if (rc >= 0)
+	{
+		rc = initializeDirectory(directory);
+		if (rc >= 0)
+		{
+			rc = getOpenFile(file_path, true);
+		}
+
+		if (rc >= 0)
+		{
+			rc = fs_seek(&openFile, 0, FS_SEEK_END);
+		}
+
+		if (rc >= 0)
+		{
+			rc = fs_write(&openFile, data, data_size);
+		}
+
+		if (rc >= 0)
+		{
+			/*Commit appended data*/
+			int32_t syncRc = fs_sync(&openFile);
+			rc = (syncRc < 0) ? syncRc : rc;
+		}
+
+		if (rc < 0)
+		{
+			closeOpenFile(NULL);
+		}
+	}
+
+	storageUnlock();
+	return rc;
+}
+
+/**@brief 				Function to write data at an offset in a file.
+ *
+ * @details 			Overwrite part of the file without rewriting the rest. File will be created incase not existed.
+ * 						Data is committed before return.
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		offset				Offset in the file to write at.
+ * @param[in]	 		data				buffer with data to write. 
+ * @param[in]	 		data_size			Number of bytes to write. 
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written in file system. Negative ERROR code incase of an error.
+ */
+int32_t write_file_at(const uint8_t *filename, uint32_t offset, const uint8_t *data, uint32_t data_size, const uint8_t* directory)
+{
+	uint8_t file_path[STORAGE_FILE_MAX_PATH_LEN] = {0};
+	int32_t rc;
+
+	if( (strlen(filename) + strlen(directory) + 2) > INPUT_NAME_MAX_LENGTH)	{
+		printk("Provided file name is too long\n");
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
+
+	if (isKvDirectory(directory))
+	{
+		/* Key/value store holds whole values only */
+		return -ENOTSUP;
+	}
+
+	storageLock();
+
+	/* File system file path and name*/
+	snprintf(file_path, STORAGE_FILE_MAX_PATH_LEN, "%s/%s/%s", littleFsMountInfo->mnt_point, directory, filename);
+	storageSetAccount(file_path);
+
+	/*Mount File system if not mounted yet*/
+	rc = storageMount();
+	if (rc >= 0)
+	{
+		rc = initializeDirectory(directory);
+		if (rc >= 0)
+		{
+			rc = getOpenFile(file_path, true);
+		}
+
+		if (rc >= 0)
+		{
+			rc = fs_seek(&openFile, offset, FS_SEEK_SET);
+		}
+
+		if (rc >= 0)
+		{
+			rc = fs_write(&openFile, data, data_size);
+		}
+
+		if (rc >= 0)
+		{
+			/*Commit written data*/
+			int32_t syncRc = fs_sync(&openFile);
+			rc = (syncRc < 0) ? syncRc : rc;
+		}
+
+		if (rc < 0)
+		{
+			closeOpenFile(NULL);
+		}
+	}
+
+	storageUnlock();
+	return rc;
+}
+
+/**@brief 				Function to read data at an offset in a file.
+ *
+ * @details 			Read part of the file without reading the rest. Storage lock is taken exclusive
+ * 						since the read moves the kept open file shared with the writers.
+ *
+ * @param[in]	 		filename			File to read.
+ * @param[in]	 		offset				Offset in the file to read from.
+ * @param[in]	 		data				buffer to fill with read data. 
+ * @param[in]	 		data_size			Max number of bytes to read. 
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes read. 0 at end of file. Negative ERROR code incase of an error.
+ */
+int32_t read_file_at(const uint8_t *filename, uint32_t offset, uint8_t *data, uint32_t data_size, const uint8_t* directory)
+{
+	uint8_t file_path[STORAGE_FILE_MAX_PATH_LEN] = {0};
+	int32_t rc;
+
+	if( (strlen(filename) + strlen(directory) + 2) > INPUT_NAME_MAX_LENGTH)	{
+		printk("Provided file name is too long\n");
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
+
+	if (isKvDirectory(directory))
+	{
+		/* Key/value store holds whole values only */
+		return -ENOTSUP;
+	}
+
+	storageLock();
+
+	/* File system file path and name*/
+	snprintf(file_path, STORAGE_FILE_MAX_PATH_LEN, "%s/%s/%s", littleFsMountInfo->mnt_point, directory, filename);
+
+	/*Mount File system if not mounted yet*/
+	rc = storageMount();
+	if (rc >= 0)
+	{
+		rc = getOpenFile(file_path, false);
+		if (rc >= 0)
+		{
+			rc = fs_seek(&openFile, offset, FS_SEEK_SET);
+		}
+
+		if (rc >= 0)
+		{
+			rc = fs_read(&openFile, data, data_size);
+		}
+
+		if (rc < 0)
+		{
+			closeOpenFile(NULL);
+		}
+	}
+
+	storageUnlock();
+	return rc;
+}
+
+/**@brief 				Function to remove the Blob information from file system
  *
  * @details 			Delete the file in file system to remove blob data referencing provided key value
  *
@@ -195,7 +842,7 @@ int32_t write_file(const uint8_t *filename, const uint8_t *data, uint32_t data_s
  * @param[in]	 		directory			Char array to provide target directory
  * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
  */
-int32_t eraseFile(uint8_t *name, uint8_t* directory)
+static int32_t eraseLittleFsFile(const uint8_t *name, const uint8_t* directory)
 {
 	uint8_t fileName[STORAGE_FILE_MAX_PATH_LEN] = {0};
 	int32_t rc;
@@ -207,15 +854,14 @@ int32_t eraseFile(uint8_t *name, uint8_t* directory)
 		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
 	}
 
-	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
-		k_mutex_lock(&StorageMutex, K_FOREVER);
-	#endif
+	storageLock();
 
 	/*File system path and name buffer*/
 	snprintf(fileName, STORAGE_FILE_MAX_PATH_LEN, "%s/%s/%s", littleFsMountInfo->mnt_point, directory, name);
+	storageSetAccount(fileName);
 
-	/*Mount File system before any operation*/
-	rc = fs_mount(littleFsMountInfo);
+	/*Mount File system if not mounted yet*/
+	rc = storageMount();
 	if (rc >= 0)
 	{
 		/*Retrieve Blob information with respect to key*/
@@ -223,133 +869,856 @@ int32_t eraseFile(uint8_t *name, uint8_t* directory)
 		if (rc >= 0)
 		{
 			/*Erase the file from file system*/
+			closeOpenFile(fileName);
 			rc = fs_unlink(fileName);
 		} else if (rc == -ENOENT)
 		{
 			rc = 0;
 		}
-		
-		/*Unmount file system before exit*/
-		fs_unmount(littleFsMountInfo);
 	}
 
-	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
-		k_mutex_unlock(&StorageMutex);
-	#endif
+	storageUnlock();
 	return rc;
 }
 
-/**@brief 				Function to list the Blob files available in file system
+/**@brief 				Function to remove the Blob information from file system
  *
- * @details 			List all the files name available int the file system. Indicating the available Blobs.
+ * @details 			Delete the file in file system to remove blob data referencing provided key value
  *
- * @param[in]	 		FileListBuffer		Char array to store the files name. File names will be stored in TLV format
+ * @param[in]	 		name				filename to erase.
  * @param[in]	 		directory			Char array to provide target directory
- * @param[out]   		int32_t				returns the number of bytes written in buffer or negative ERROR code incase of an error.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
  */
-int32_t listBlobFiles(uint8_t *FileListBuffer, uint8_t* directory)
+int32_t eraseFile(uint8_t *name, uint8_t* directory)
 {
-    struct fs_dir_t dir;
-    int32_t rc = 0;
-	int32_t index = 0;
-	uint8_t  totalNumberOfFiles = 0;
-
-	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
-		k_mutex_lock(&StorageMutex, K_FOREVER);
-	#endif
+#if defined(CONFIG_STORAGE_KV)
+	if (isKvDirectory(directory))
+	{
+		int32_t rc = storage_kv_erase(name, directory);
 
-	/*File system path and name buffer*/
-	uint8_t directoryName[STORAGE_FILE_MAX_PATH_LEN] = {0};
+		if (rc < 0)
+		{
+			return rc;
+		}
 
-	snprintf(directoryName, STORAGE_FILE_MAX_PATH_LEN, "%s/%s", littleFsMountInfo->mnt_point, directory);
+		/* File may still be in LittleFS if it was never read */
+	}
+#endif
 
-	/*Add start byte at the start of the buffer*/
-	FileListBuffer[0] = START_BYTE;
-	FileListBuffer[1] = TOTAL_FILES_TAG;
-	FileListBuffer[2] = 1;		// Length of Total files value. Max 255
-	FileListBuffer[3] = 0;		// Number of file names in buffer. Need to overwrite it later.
-	index += 4;
+	return eraseLittleFsFile(name, directory);
+}
 
-	/*Mount File system before any operation*/
-	rc = fs_mount(littleFsMountInfo);
-	if (rc >= 0)
+/**@brief 				Function to initialize a directory cursor
+ *
+ * @details 			Cursor starts before the first entry of the directory.
+ *
+ * @param[in]	 		cursor				Cursor to initialize.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_dir_cursor_init(STORAGE_DIR_CURSOR_STRUCT *cursor, const uint8_t *directory)
+{
+	if ((strlen(directory) + 1) > INPUT_NAME_MAX_LENGTH)
 	{
-		// Open the directory
-		fs_dir_t_init(&dir);
-		rc = fs_opendir(&dir, directoryName);
-		if (rc != 0) {
-			printk("FAIL: unable to open the directory \"/lfs\"\n");
-			return rc;
-		}
-
-		// Read the names of the files in the directory
-		struct fs_dirent entry;
-		while ((rc = fs_readdir(&dir, &entry)) == 0) 
-		{
-			/* Stop Reading at the end of directory*/
-			if (entry.name[0] == 0){
-				break;
-			}
+		printk("Provided directory name is too long\n");
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
 
-			/*Add the Tag for Blob file*/
-			FileListBuffer[index++] = BLOB_FILE_TAG;
+	if (isKvDirectory(directory))
+	{
+		/* Key/value store directories can not be listed */
+		return -ENOTSUP;
+	}
 
-			/*Copy file name Length in buffer*/
-			FileListBuffer[index++] = (uint8_t) strlen(entry.name);
+	memset(cursor, 0, sizeof(*cursor));
+	snprintf(cursor->path, STORAGE_FILE_MAX_PATH_LEN, "%s/%s", littleFsMountInfo->mnt_point, directory);
 
-			/*Copy the File name in buffer*/
-			memcpy(&FileListBuffer[index], entry.name, strlen(entry.name));
-			index += strlen(entry.name);
+	return 0;
+}
 
-			printk("File: %s", entry.name);
-			/*Count the number of files in directory*/
-			totalNumberOfFiles++;
-		}
+/**@brief 				Function to insert an entry in a page
+ *
+ * @details 			Page is kept sorted by name. Entry is dropped if page is full and all entries sort before it.
+ * 						Name must fit in STORAGE_DIR_ENTRY_NAME_MAX_LEN.
+ *
+ * @param[in]	 		entries				Page entries.
+ * @param[in]	 		count				Number of entries in page.
+ * @param[in]	 		max_entries			Page size.
+ * @param[in]	 		dirent				Directory entry to insert.
+ * @param[out]   		uint32_t			returns number of entries in page.
+ */
+static uint32_t insertPageEntry(STORAGE_DIR_ENTRY_STRUCT *entries, uint32_t count, uint32_t max_entries, const struct fs_dirent *dirent)
+{
+	uint32_t pos = count;
 
-		/* Update the Number of files count in buffer*/
-		FileListBuffer[3] = totalNumberOfFiles;
+	while ((pos > 0) && (strcmp(entries[pos - 1].name, dirent->name) > 0))
+	{
+		pos--;
+	}
 
-		/*Add buffer data end byte*/
-		FileListBuffer[index] = END_BYTE;
+	if (pos >= max_entries)
+	{
+		return count;
+	}
 
-		// Close the directory and unmount file system
-		fs_closedir(&dir);
-		fs_unmount(littleFsMountInfo);
+	if (count == max_entries)
+	{
+		/*Last entry falls out of the page*/
+		count--;
 	}
 
-	#if FLASH_STORAGE_MUTEX_LOCK_ENABLED == 1
-		k_mutex_unlock(&StorageMutex);
-	#endif
+	memmove(&entries[pos + 1], &entries[pos], (count - pos) * sizeof(entries[0]));
 
-    return (rc >= 0)? (index + 1) : rc;
+	memset(&entries[pos], 0, sizeof(entries[0]));
+	strcpy(entries[pos].name, dirent->name);
+	entries[pos].size = dirent->size;
+	entries[pos].isDirectory = (dirent->type == FS_DIR_ENTRY_DIR) ? 1 : 0;
+
+	return count + 1;
 }
 
-/**@brief 				Function to erase the external flash
+/**@brief 				Function to read next page of a directory
  *
- * @details 			Erase the external flash storage
+ * @details 			Entries are returned in name order, page by page. Storage lock is taken shared from open to
+ * 						close of the directory, the file system can not be unmounted under the open handle. Writers
+ * 						wait for one page only. Entries added or removed between pages may or may not be returned,
+ * 						but no entry is returned twice. Entries with a name longer than STORAGE_DIR_ENTRY_NAME_MAX_LEN
+ * 						are skipped and counted in the cursor, their truncated name would sort before the full name
+ * 						and bring the entry back on the next page.
  *
- * @param[in]	 		None.
- * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ * @param[in]	 		cursor				Cursor initialized by storage_dir_cursor_init().
+ * @param[in]	 		entries				Buffer for the page entries.
+ * @param[in]	 		max_entries			Number of entries that fit in buffer.
+ * @param[out]   		int32_t				returns number of entries in page, 0 at the end of directory or negative ERROR code incase of an error.
  */
-int32_t EraseExternalFlash()
+int32_t storage_dir_read_page(STORAGE_DIR_CURSOR_STRUCT *cursor, STORAGE_DIR_ENTRY_STRUCT *entries, uint32_t max_entries)
 {
-	unsigned int id = (uintptr_t)littleFsMountInfo->storage_dev;
-	const struct flash_area *pfa;
+	struct fs_dir_t dir;
+	struct fs_dirent dirent;
+	uint32_t count = 0;
+	int32_t rc;
 
-	int rc = flash_area_open(id, &pfa);
+	if (cursor->isDone || (max_entries == 0))
+	{
+		return 0;
+	}
+
+	/*Mount File system if not mounted yet*/
+	rc = storageReadLock();
 	if (rc < 0)
 	{
-		printk("FAIL: unable to find flash area %u: %d\n", id, rc);
 		return rc;
 	}
 
-	printk("Flash area %u: %u bytes\n", id, pfa->fa_size);
+	fs_dir_t_init(&dir);
+	rc = fs_opendir(&dir, cursor->path);
+	if (rc < 0)
+	{
+		storageSharedUnlock();
+		return rc;
+	}
 
-	printk("Erasing flash area ... ");
-	rc = flash_area_erase(pfa, 0, pfa->fa_size);
-	printk("%d\n", rc);
+	cursor->skippedNames = 0;
 
-	flash_area_close(pfa);
+	while (1)
+	{
+		rc = fs_readdir(&dir, &dirent);
 
-	return rc;
-}
\ No newline at end of file
+		/* Stop Reading at the end of directory*/
+		if ((rc < 0) || (dirent.name[0] == 0))
+		{
+			break;
+		}
+
+		if (strlen(dirent.name) > STORAGE_DIR_ENTRY_NAME_MAX_LEN)
+		{
+			cursor->skippedNames++;
+			continue;
+		}
+
+		/*Skip entries returned by previous pages*/
+		if (cursor->hasLastName && (strcmp(dirent.name, cursor->lastName) <= 0))
+		{
+			continue;
+		}
+
+		count = insertPageEntry(entries, count, max_entries, &dirent);
+	}
+
+	fs_closedir(&dir);
+	storageSharedUnlock();
+
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	if (count < max_entries)
+	{
+		cursor->isDone = 1;
+	}
+
+	if (count > 0)
+	{
+		strcpy(cursor->lastName, entries[count - 1].name);
+		cursor->hasLastName = 1;
+	}
+
+	return count;
+}
+
+/**@brief 				Function to list the Blob files available in file system
+ *
+ * @details 			List the files name available in the directory. Indicating the available Blobs.
+ * 						Names which do not fit in the buffer are left out. Use storage_dir_read_page() for big directories.
+ *
+ * @param[in]	 		FileListBuffer		Char array to store the files name. File names will be stored in TLV format
+ * @param[in]	 		bufferSize			Size of FileListBuffer.
+ * @param[in]	 		directory			Char array to provide target directory
+ * @param[out]   		int32_t				returns the number of bytes written in buffer or negative ERROR code incase of an error.
+ */
+int32_t listBlobFiles(uint8_t *FileListBuffer, uint32_t bufferSize, uint8_t* directory)
+{
+	STORAGE_DIR_CURSOR_STRUCT cursor;
+	STORAGE_DIR_ENTRY_STRUCT entries[STORAGE_LIST_PAGE_ENTRIES];
+	int32_t rc = 0;
+	uint32_t index = 0;
+	uint32_t nameLength;
+	uint8_t totalNumberOfFiles = 0;
+	bool isFull = false;
+
+	/*Start, total files TLV and end bytes*/
+	if (bufferSize < 5)
+	{
+		return -ENOMEM;
+	}
+
+	rc = storage_dir_cursor_init(&cursor, directory);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	/*Add start byte at the start of the buffer*/
+	FileListBuffer[0] = START_BYTE;
+	FileListBuffer[1] = TOTAL_FILES_TAG;
+	FileListBuffer[2] = 1;		// Length of Total files value. Max 255
+	FileListBuffer[3] = 0;		// Number of file names in buffer. Need to overwrite it later.
+	index += 4;
+
+	while (!isFull && ((rc = storage_dir_read_page(&cursor, entries, ARRAY_SIZE(entries))) > 0))
+	{
+		for (int32_t i = 0; i < rc; i++)
+		{
+			nameLength = strlen(entries[i].name);
+
+			/*Keep one byte for the end byte*/
+			if ((totalNumberOfFiles == UINT8_MAX) || ((index + 2 + nameLength + 1) > bufferSize))
+			{
+				isFull = true;
+				break;
+			}
+
+			/*Add the Tag for Blob file*/
+			FileListBuffer[index++] = BLOB_FILE_TAG;
+
+			/*Copy file name Length in buffer*/
+			FileListBuffer[index++] = (uint8_t) nameLength;
+
+			/*Copy the File name in buffer*/
+			memcpy(&FileListBuffer[index], entries[i].name, nameLength);
+			index += nameLength;
+
+			/*Count the number of files in directory*/
+			totalNumberOfFiles++;
+		}
+	}
+
+	if (rc < 0)
+	{
+		printk("FAIL: unable to list the directory \"%s\": %d\n", cursor.path, rc);
+		return rc;
+	}
+
+	/* Update the Number of files count in buffer*/
+	FileListBuffer[3] = totalNumberOfFiles;
+
+	/*Add buffer data end byte*/
+	FileListBuffer[index] = END_BYTE;
+
+	return (index + 1);
+}
+
+/**@brief 				Function to erase the external flash
+ *
+ * @details 			Erase the external flash storage
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t EraseExternalFlash()
+{
+	unsigned int id = (uintptr_t)littleFsMountInfo->storage_dev;
+	const struct flash_area *pfa;
+
+	storageLock();
+
+	/*File system must not be mounted while the flash area is erased*/
+	int rc = storageUnmount();
+	if (rc < 0)
+	{
+		printk("FAIL: unable to unmount %s: %d\n", littleFsMountInfo->mnt_point, rc);
+		storageUnlock();
+		return rc;
+	}
+
+	rc = flash_area_open(id, &pfa);
+	if (rc < 0)
+	{
+		printk("FAIL: unable to find flash area %u: %d\n", id, rc);
+		storageUnlock();
+		return rc;
+	}
+
+	printk("Flash area %u: %u bytes\n", id, pfa->fa_size);
+
+	printk("Erasing flash area ... ");
+	rc = flash_area_erase(pfa, 0, pfa->fa_size);
+	printk("%d\n", rc);
+
+	if ((rc >= 0) && (storage.cfg.block_size > 0))
+	{
+		for (uint32_t block = 0; block < (pfa->fa_size / storage.cfg.block_size); block++)
+		{
+			storage_wear_record_erase(STORAGE_WEAR_AREA_LITTLEFS, block, STORAGE_WEAR_ACCOUNT_OTHER);
+		}
+	}
+
+	flash_area_close(pfa);
+
+	storageUnlock();
+
+#if defined(CONFIG_STORAGE_KV)
+	if (rc >= 0)
+	{
+		rc = storage_kv_format();
+	}
+#endif
+
+	/*Cached files are gone with the erase*/
+	storage_cache_invalidate();
+
+	return rc;
+}
+
+/**@brief 				Function to initialize the storage
+ *
+ * @details 			Mount the file system once for the session and create the default directory.
+ * 						File system stays mounted until storage_suspend() or storage_shutdown() is called.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_init(void)
+{
+	int32_t rc = 0;
+
+	storageLock();
+
+	isStorageShutdown = false;
+
+	rc = storageMount();
+	if (rc >= 0)
+	{
+		rc = initializeDirectory(DIRECTORY);
+	}
+
+	storageUnlock();
+
+#if defined(CONFIG_STORAGE_KV)
+	if (rc >= 0)
+	{
+		rc = storage_kv_init();
+	}
+#endif
+
+	if (rc >= 0)
+	{
+		/*Missing counters file is not an error*/
+		(void)storage_wear_load();
+
+		rc = storage_async_init();
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to select the backend of a directory
+ *
+ * @details 			Directories use LittleFS unless selected otherwise. Select before the first access.
+ *
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		backend				Backend for the files of the directory.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_set_directory_backend(const uint8_t *directory, STORAGE_BACKEND backend)
+{
+	STORAGE_DIRECTORY_BACKEND_STRUCT *entry = NULL;
+
+	if (strlen(directory) > STORAGE_BACKEND_DIRECTORY_MAX_LEN)
+	{
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
+
+#if !defined(CONFIG_STORAGE_KV)
+	if (backend == STORAGE_BACKEND_KV)
+	{
+		return -ENOTSUP;
+	}
+#endif
+
+	storageLock();
+
+	for (uint32_t i = 0; i < STORAGE_BACKEND_MAX_DIRECTORIES; i++)
+	{
+		if ((directoryBackends[i].backend != STORAGE_BACKEND_LITTLEFS) &&
+			(strcmp(directoryBackends[i].directory, directory) == 0))
+		{
+			entry = &directoryBackends[i];
+			break;
+		}
+
+		if ((entry == NULL) && (directoryBackends[i].backend == STORAGE_BACKEND_LITTLEFS))
+		{
+			entry = &directoryBackends[i];
+		}
+	}
+
+	if (entry != NULL)
+	{
+		strcpy(entry->directory, directory);
+		entry->backend = backend;
+	}
+
+	storageUnlock();
+
+	return (entry != NULL) ? 0 : -ENOMEM;
+}
+
+/**@brief 				Function to suspend the storage
+ *
+ * @details 			Unmount the file system before the device goes to sleep. Next storage call or
+ * 						storage_resume() will mount the file system again.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_suspend(void)
+{
+	int32_t rc = 0;
+
+	/*Write queued requests, boot counter, cached files and wear counters before the file system goes away*/
+	(void)storage_async_drain();
+	(void)retained_state_checkpoint();
+	(void)storage_cache_sync();
+	(void)storage_wear_save();
+
+	storageLock();
+	rc = storageUnmount();
+	storageUnlock();
+
+	return rc;
+}
+
+/**@brief 				Function to resume the storage
+ *
+ * @details 			Mount the file system again after storage_suspend().
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_resume(void)
+{
+	int32_t rc = 0;
+
+	storageLock();
+	rc = storageMount();
+	storageUnlock();
+
+	return rc;
+}
+
+/**@brief 				Function to shutdown the storage
+ *
+ * @details 			Unmount the file system before power down. All storage calls fail with -ESHUTDOWN
+ * 						until storage_init() is called again.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_shutdown(void)
+{
+	int32_t rc = 0;
+
+	/*Write queued requests, boot counter, cached files and wear counters before the file system goes away*/
+	(void)storage_async_drain();
+	(void)retained_state_checkpoint();
+	(void)storage_cache_sync();
+	(void)storage_wear_save();
+
+	storageLock();
+	rc = storageUnmount();
+	if (rc >= 0)
+	{
+		isStorageShutdown = true;
+	}
+	storageUnlock();
+
+	return rc;
+}
+
+/**@brief 				Function to open a stream
+ *
+ * @details 			STORAGE_STREAM_WRITE writes to a temporary file which replaces the target file on close,
+ * 						so readers never see a partially written file. STORAGE_STREAM_APPEND writes at the end
+ * 						of the target file. File system stays mounted while any stream is open.
+ *
+ * @param[in]	 		stream				Stream to open.
+ * @param[in]	 		filename			File name.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		mode				STORAGE_STREAM_READ, STORAGE_STREAM_WRITE or STORAGE_STREAM_APPEND.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_stream_open(STORAGE_STREAM_STRUCT *stream, const uint8_t *filename, const uint8_t *directory, uint8_t mode)
+{
+	uint8_t open_path[STORAGE_FILE_MAX_PATH_LEN] = {0};
+	fs_mode_t flags;
+	int32_t rc;
+
+	if( (strlen(filename) + strlen(directory) + 2 + sizeof(STORAGE_STREAM_TEMP_SUFFIX)) > INPUT_NAME_MAX_LENGTH)	{
+		printk("Provided file name is too long\n");
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
+
+	if (isKvDirectory(directory))
+	{
+		/* Key/value store holds whole values only */
+		return -ENOTSUP;
+	}
+
+	memset(stream, 0, sizeof(*stream));
+	stream->mode = mode;
+	snprintf(stream->path, STORAGE_FILE_MAX_PATH_LEN, "%s/%s/%s", littleFsMountInfo->mnt_point, directory, filename);
+
+	switch (mode)
+	{
+		case STORAGE_STREAM_READ:
+			flags = FS_O_READ;
+			strcpy(open_path, stream->path);
+			break;
+		case STORAGE_STREAM_WRITE:
+			flags = FS_O_CREATE | FS_O_WRITE;
+			snprintf(open_path, STORAGE_FILE_MAX_PATH_LEN, "%s%s", stream->path, STORAGE_STREAM_TEMP_SUFFIX);
+			break;
+		case STORAGE_STREAM_APPEND:
+			flags = FS_O_CREATE | FS_O_WRITE | FS_O_APPEND;
+			strcpy(open_path, stream->path);
+			break;
+		default:
+			return -EINVAL;
+	}
+
+	storageLock();
+
+	if (mode != STORAGE_STREAM_READ)
+	{
+		storageSetAccount(stream->path);
+	}
+
+	/*Mount File system if not mounted yet*/
+	rc = storageMount();
+	if ((rc >= 0) && (mode != STORAGE_STREAM_READ))
+	{
+		rc = initializeDirectory(directory);
+	}
+
+	if (rc >= 0)
+	{
+		fs_file_t_init(&stream->file);
+		rc = fs_open(&stream->file, open_path, flags);
+	}
+
+	if ((rc >= 0) && (mode == STORAGE_STREAM_WRITE))
+	{
+		/*Temporary file may be left over from an aborted stream*/
+		rc = fs_truncate(&stream->file, 0);
+		if (rc < 0)
+		{
+			fs_close(&stream->file);
+		}
+	}
+
+	if (rc >= 0)
+	{
+		stream->isOpen = 1;
+		openStreamCount++;
+	}
+
+	storageUnlock();
+
+	return rc;
+}
+
+/**@brief 				Function to read next chunk from a stream
+ *
+ * @param[in]	 		stream				Stream opened with STORAGE_STREAM_READ.
+ * @param[in]	 		data				buffer to fill with read data.
+ * @param[in]	 		data_size			Max number of bytes to read.
+ * @param[out]   		int32_t				returns number of data bytes read. 0 at end of file. Negative ERROR code incase of an error.
+ */
+int32_t storage_stream_read(STORAGE_STREAM_STRUCT *stream, uint8_t *data, uint32_t data_size)
+{
+	int32_t rc;
+
+	if (!stream->isOpen || (stream->mode != STORAGE_STREAM_READ))
+	{
+		return -EBADF;
+	}
+
+	storageSharedLock();
+	rc = fs_read(&stream->file, data, data_size);
+	storageSharedUnlock();
+
+	if (rc > 0)
+	{
+		stream->position += rc;
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to write next chunk to a stream
+ *
+ * @param[in]	 		stream				Stream opened with STORAGE_STREAM_WRITE or STORAGE_STREAM_APPEND.
+ * @param[in]	 		data				buffer with data to write.
+ * @param[in]	 		data_size			Number of bytes to write.
+ * @param[out]   		int32_t				returns number of data bytes written. Negative ERROR code incase of an error.
+ */
+int32_t storage_stream_write(STORAGE_STREAM_STRUCT *stream, const uint8_t *data, uint32_t data_size)
+{
+	int32_t rc;
+
+	if (!stream->isOpen || (stream->mode == STORAGE_STREAM_READ))
+	{
+		return -EBADF;
+	}
+
+	storageLock();
+	storageSetAccount(stream->path);
+	rc = fs_write(&stream->file, data, data_size);
+	storageUnlock();
+
+	if (rc > 0)
+	{
+		stream->position += rc;
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to close a stream
+ *
+ * @details 			STORAGE_STREAM_WRITE stream replaces the target file with the written data.
+ *
+ * @param[in]	 		stream				Stream to close.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_stream_close(STORAGE_STREAM_STRUCT *stream)
+{
+	uint8_t temp_path[STORAGE_FILE_MAX_PATH_LEN] = {0};
+	int32_t rc;
+
+	if (!stream->isOpen)
+	{
+		return -EBADF;
+	}
+
+	storageLock();
+
+	if (stream->mode != STORAGE_STREAM_READ)
+	{
+		storageSetAccount(stream->path);
+	}
+
+	rc = fs_close(&stream->file);
+	if ((rc >= 0) && (stream->mode == STORAGE_STREAM_WRITE))
+	{
+		/*Kept open handle of the target file would see the old data*/
+		closeOpenFile(stream->path);
+
+		snprintf(temp_path, STORAGE_FILE_MAX_PATH_LEN, "%s%s", stream->path, STORAGE_STREAM_TEMP_SUFFIX);
+		rc = fs_rename(temp_path, stream->path);
+	}
+
+	stream->isOpen = 0;
+	openStreamCount--;
+
+	storageUnlock();
+
+	return rc;
+}
+
+/**@brief 				Function to abort a stream
+ *
+ * @details 			STORAGE_STREAM_WRITE stream discards the written data and keeps the target file unchanged.
+ *
+ * @param[in]	 		stream				Stream to abort.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_stream_abort(STORAGE_STREAM_STRUCT *stream)
+{
+	uint8_t temp_path[STORAGE_FILE_MAX_PATH_LEN] = {0};
+	int32_t rc;
+
+	if (!stream->isOpen)
+	{
+		return -EBADF;
+	}
+
+	storageLock();
+
+	rc = fs_close(&stream->file);
+	if (stream->mode == STORAGE_STREAM_WRITE)
+	{
+		snprintf(temp_path, STORAGE_FILE_MAX_PATH_LEN, "%s%s", stream->path, STORAGE_STREAM_TEMP_SUFFIX);
+		rc = fs_unlink(temp_path);
+	}
+
+	stream->isOpen = 0;
+	openStreamCount--;
+
+	storageUnlock();
+
+	return rc;
+}
+
+/**@brief 				Function to read a file chunk by chunk
+ *
+ * @details 			File is read in the caller buffer and handed to the callback one chunk at a time,
+ * 						so any file size is handled with a fixed amount of RAM.
+ *
+ * @param[in]	 		filename			File to read.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		buffer				Chunk buffer.
+ * @param[in]	 		buffer_size			Chunk buffer size.
+ * @param[in]	 		callback			Called for every chunk.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[out]   		int32_t				returns total number of bytes read or negative ERROR code incase of an error.
+ */
+int32_t storage_read_chunks(const uint8_t *filename, const uint8_t *directory, uint8_t *buffer, uint32_t buffer_size,
+							storage_chunk_sink_cb callback, void *ctx)
+{
+	STORAGE_STREAM_STRUCT stream;
+	uint32_t total = 0;
+	int32_t rc;
+
+	rc = storage_stream_open(&stream, filename, directory, STORAGE_STREAM_READ);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	while ((rc = storage_stream_read(&stream, buffer, buffer_size)) > 0)
+	{
+		int32_t cbRc = callback(buffer, rc, total, ctx);
+		total += rc;
+		if (cbRc != 0)
+		{
+			rc = (cbRc < 0) ? cbRc : 0;
+			break;
+		}
+	}
+
+	storage_stream_close(&stream);
+
+	return (rc < 0) ? rc : (int32_t)total;
+}
+
+/**@brief 				Function to write a file chunk by chunk
+ *
+ * @details 			Callback fills the caller buffer one chunk at a time until it returns 0. File is
+ * 						replaced only when all chunks are written.
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		buffer				Chunk buffer.
+ * @param[in]	 		buffer_size			Chunk buffer size.
+ * @param[in]	 		callback			Called to fill every chunk.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[out]   		int32_t				returns total number of bytes written or negative ERROR code incase of an error.
+ */
+int32_t storage_write_chunks(const uint8_t *filename, const uint8_t *directory, uint8_t *buffer, uint32_t buffer_size,
+							storage_chunk_source_cb callback, void *ctx)
+{
+	STORAGE_STREAM_STRUCT stream;
+	uint32_t total = 0;
+	int32_t length;
+	int32_t rc;
+
+	rc = storage_stream_open(&stream, filename, directory, STORAGE_STREAM_WRITE);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	while ((length = callback(buffer, buffer_size, total, ctx)) > 0)
+	{
+		rc = storage_stream_write(&stream, buffer, length);
+		if (rc < 0)
+		{
+			break;
+		}
+		total += rc;
+	}
+
+	if (length < 0)
+	{
+		rc = length;
+	}
+
+	if (rc < 0)
+	{
+		storage_stream_abort(&stream);
+		return rc;
+	}
+
+	rc = storage_stream_close(&stream);
+
+	return (rc < 0) ? rc : (int32_t)total;
+}
+
+/**@brief 				Function to get flash operation counters
+ *
+ * @details 			Counters include every flash program, erase and read done by the file system and the
+ * 						key/value store since boot.
+ *
+ * @param[in]	 		counters			Counters to fill.
+ * @param[out]   		None.
+ */
+void storage_get_flash_counters(STORAGE_FLASH_COUNTERS_STRUCT *counters)
+{
+	storageLock();
+	memcpy(counters, &flashCounters, sizeof(flashCounters));
+	storageUnlock();
+
+#if defined(CONFIG_STORAGE_KV)
+	STORAGE_KV_STATS_STRUCT kvStats;
+
+	storage_kv_get_stats(&kvStats);
+	counters->programOps += kvStats.programOps;
+	counters->programBytes += kvStats.programBytes;
+	counters->eraseOps += kvStats.eraseOps;
+	counters->readOps += kvStats.readOps;
+	counters->readBytes += kvStats.readBytes;
+#endif
+}
@@ -15,6 +15,9 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <zephyr/fs/fs.h>
+
 /* Maximum file name length in little FS */
 #define STORAGE_FILE_MAX_PATH_LEN 255
 #define INPUT_NAME_MAX_LENGTH     245
@@ -35,6 +38,87 @@ extern "C" {
 /* Flag to enable/disable Mutex Locking in storage api*/
 #define FLASH_STORAGE_MUTEX_LOCK_ENABLED        1
 
+/* Backend of a directory. See storage_set_directory_backend() */
+typedef enum
+{
+	STORAGE_BACKEND_LITTLEFS = 0,		/* Files in LittleFS */
+	STORAGE_BACKEND_KV,					/* Whole values in the key/value store. read_file/write_file/eraseFile only */
+}STORAGE_BACKEND;
+
+#define STORAGE_BACKEND_MAX_DIRECTORIES     4
+#define STORAGE_BACKEND_DIRECTORY_MAX_LEN   8
+
+/* Flash operations done by the file system */
+typedef struct
+{
+	uint32_t programOps;
+	uint32_t programBytes;
+	uint32_t eraseOps;
+	uint32_t readOps;
+	uint32_t readBytes;
+}STORAGE_FLASH_COUNTERS_STRUCT;
+
+/* Directory listing. Entries with longer names are skipped, they could not be told apart
+ * from their prefix when the next page is read */
+#define STORAGE_DIR_ENTRY_NAME_MAX_LEN  32
+#define STORAGE_LIST_PAGE_ENTRIES       8
+
+/* Directory entry returned by storage_dir_read_page() */
+typedef struct
+{
+	uint8_t name[STORAGE_DIR_ENTRY_NAME_MAX_LEN + 1];
+	uint8_t isDirectory;
+	uint32_t size;
+}STORAGE_DIR_ENTRY_STRUCT;
+
+/* Directory listing position between pages */
+typedef struct
+{
+	uint8_t path[STORAGE_FILE_MAX_PATH_LEN];
+	uint8_t lastName[STORAGE_DIR_ENTRY_NAME_MAX_LEN + 1];
+	uint8_t hasLastName;
+	uint8_t isDone;
+	uint32_t skippedNames;		/* Names longer than STORAGE_DIR_ENTRY_NAME_MAX_LEN seen by the last page read */
+}STORAGE_DIR_CURSOR_STRUCT;
+
+/* Stream modes */
+#define STORAGE_STREAM_READ         0x01
+#define STORAGE_STREAM_WRITE        0x02
+#define STORAGE_STREAM_APPEND       0x03
+
+/* Suffix of the temporary file written by a STORAGE_STREAM_WRITE stream */
+#define STORAGE_STREAM_TEMP_SUFFIX  ".tmp"
+
+/* Stream for moving large files through a small buffer */
+typedef struct
+{
+	struct fs_file_t file;
+	uint8_t path[STORAGE_FILE_MAX_PATH_LEN];
+	uint8_t mode;
+	uint8_t isOpen;
+	uint32_t position;
+}STORAGE_STREAM_STRUCT;
+
+/**@brief 				Chunk sink callback for storage_read_chunks().
+ *
+ * @param[in]	 		chunk				Chunk data.
+ * @param[in]	 		size				Number of bytes in chunk.
+ * @param[in]	 		offset				Offset of the chunk in the file.
+ * @param[in]	 		ctx					User context.
+ * @param[out]   		int32_t				0 to continue, positive value to stop, negative ERROR code to abort.
+ */
+typedef int32_t (*storage_chunk_sink_cb)(const uint8_t *chunk, uint32_t size, uint32_t offset, void *ctx);
+
+/**@brief 				Chunk source callback for storage_write_chunks().
+ *
+ * @param[in]	 		chunk				Buffer to fill.
+ * @param[in]	 		size				Buffer size.
+ * @param[in]	 		offset				Offset of the chunk in the file.
+ * @param[in]	 		ctx					User context.
+ * @param[out]   		int32_t				number of bytes filled, 0 at the end of data or negative ERROR code to abort.
+ */
+typedef int32_t (*storage_chunk_source_cb)(uint8_t *chunk, uint32_t size, uint32_t offset, void *ctx);
+
 /**@brief 				Function to retrieve the Blob information from file system
  *
  * @details 			Read file system for blob data referencing provided key value
@@ -59,6 +143,46 @@ int32_t read_file(const uint8_t *filename, uint8_t *data, uint32_t data_size, co
  */
 int32_t write_file(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t* directory);
 
+/**@brief 				Function to append data to a file.
+ *
+ * @details 			Append blob data at the end of the file. File will be created incase not existed.
+ * 						Existing data is not rewritten and data is committed before return.
+ *
+ * @param[in]	 		filename			File to append.
+ * @param[in]	 		data				buffer with data to append. 
+ * @param[in]	 		data_size			Number of bytes to append. 
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written in file system. Negative ERROR code incase of an error.
+ */
+int32_t append_file(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t* directory);
+
+/**@brief 				Function to write data at an offset in a file.
+ *
+ * @details 			Overwrite part of the file without rewriting the rest. File will be created incase not existed.
+ * 						Data is committed before return.
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		offset				Offset in the file to write at.
+ * @param[in]	 		data				buffer with data to write. 
+ * @param[in]	 		data_size			Number of bytes to write. 
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written in file system. Negative ERROR code incase of an error.
+ */
+int32_t write_file_at(const uint8_t *filename, uint32_t offset, const uint8_t *data, uint32_t data_size, const uint8_t* directory);
+
+/**@brief 				Function to read data at an offset in a file.
+ *
+ * @details 			Read part of the file without reading the rest.
+ *
+ * @param[in]	 		filename			File to read.
+ * @param[in]	 		offset				Offset in the file to read from.
+ * @param[in]	 		data				buffer to fill with read data. 
+ * @param[in]	 		data_size			Max number of bytes to read. 
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes read. 0 at end of file. Negative ERROR code incase of an error.
+ */
+int32_t read_file_at(const uint8_t *filename, uint32_t offset, uint8_t *data, uint32_t data_size, const uint8_t* directory);
+
 /**@brief 				Function to remove the Blob information from file system
  *
  * @details 			Delete the file in file system to remove blob data referencing provided key value
@@ -69,17 +193,192 @@ int32_t write_file(const uint8_t *filename, const uint8_t *data, uint32_t data_s
  */
 int32_t eraseFile(uint8_t *name, uint8_t* directory);
 
+/**@brief 				Function to initialize a directory cursor
+ *
+ * @details 			Cursor starts before the first entry of the directory.
+ *
+ * @param[in]	 		cursor				Cursor to initialize.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_dir_cursor_init(STORAGE_DIR_CURSOR_STRUCT *cursor, const uint8_t *directory);
+
+/**@brief 				Function to read next page of a directory
+ *
+ * @details 			Entries are returned in name order, page by page. Storage lock is taken shared for one
+ * 						page, so writers wait for a page only. Entries added or removed between pages may or
+ * 						may not be returned, but no entry is returned twice. Entries with a name longer than
+ * 						STORAGE_DIR_ENTRY_NAME_MAX_LEN are skipped and counted in the cursor.
+ *
+ * @param[in]	 		cursor				Cursor initialized by storage_dir_cursor_init().
+ * @param[in]	 		entries				Buffer for the page entries.
+ * @param[in]	 		max_entries			Number of entries that fit in buffer.
+ * @param[out]   		int32_t				returns number of entries in page, 0 at the end of directory or negative ERROR code incase of an error.
+ */
+int32_t storage_dir_read_page(STORAGE_DIR_CURSOR_STRUCT *cursor, STORAGE_DIR_ENTRY_STRUCT *entries, uint32_t max_entries);
+
 /**@brief 				Function to list the Blob files available in file system
  *
- * @details 			List all the files name available int the file system. Indicating the available Blobs.
+ * @details 			List the files name available in the directory. Indicating the available Blobs.
+ * 						Names which do not fit in the buffer are left out. Use storage_dir_read_page() for big directories.
  *
  * @param[in]	 		FileListBuffer		Char array to store the files name. File names will be stored in TLV format
+ * @param[in]	 		bufferSize			Size of FileListBuffer.
  * @param[in]	 		directory			Char array to provide target directory
  * @param[out]   		int32_t				returns the number of bytes written in buffer or negative ERROR code incase of an error.
  */
-int32_t listBlobFiles(uint8_t *FileListBuffer, uint8_t* directory);
+int32_t listBlobFiles(uint8_t *FileListBuffer, uint32_t bufferSize, uint8_t* directory);
+
+/**@brief 				Function to erase the external flash
+ *
+ * @details 			Unmount the file system and erase the external flash storage
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
 int32_t EraseExternalFlash();
 
+/**@brief 				Function to initialize the storage
+ *
+ * @details 			Mount the file system once for the session and create the default directory.
+ * 						File system stays mounted until storage_suspend() or storage_shutdown() is called.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_init(void);
+
+/**@brief 				Function to select the backend of a directory
+ *
+ * @details 			Directories use LittleFS unless selected otherwise. Select before the first access.
+ *
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		backend				Backend for the files of the directory.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_set_directory_backend(const uint8_t *directory, STORAGE_BACKEND backend);
+
+/**@brief 				Function to suspend the storage
+ *
+ * @details 			Unmount the file system before the device goes to sleep. Next storage call or
+ * 						storage_resume() will mount the file system again.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_suspend(void);
+
+/**@brief 				Function to resume the storage
+ *
+ * @details 			Mount the file system again after storage_suspend().
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_resume(void);
+
+/**@brief 				Function to shutdown the storage
+ *
+ * @details 			Unmount the file system before power down. All storage calls fail with -ESHUTDOWN
+ * 						until storage_init() is called again.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_shutdown(void);
+
+/**@brief 				Function to open a stream
+ *
+ * @details 			STORAGE_STREAM_WRITE writes to a temporary file which replaces the target file on close,
+ * 						so readers never see a partially written file. STORAGE_STREAM_APPEND writes at the end
+ * 						of the target file. File system stays mounted while any stream is open.
+ *
+ * @param[in]	 		stream				Stream to open.
+ * @param[in]	 		filename			File name.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		mode				STORAGE_STREAM_READ, STORAGE_STREAM_WRITE or STORAGE_STREAM_APPEND.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_stream_open(STORAGE_STREAM_STRUCT *stream, const uint8_t *filename, const uint8_t *directory, uint8_t mode);
+
+/**@brief 				Function to read next chunk from a stream
+ *
+ * @param[in]	 		stream				Stream opened with STORAGE_STREAM_READ.
+ * @param[in]	 		data				buffer to fill with read data.
+ * @param[in]	 		data_size			Max number of bytes to read.
+ * @param[out]   		int32_t				returns number of data bytes read. 0 at end of file. Negative ERROR code incase of an error.
+ */
+int32_t storage_stream_read(STORAGE_STREAM_STRUCT *stream, uint8_t *data, uint32_t data_size);
+
+/**@brief 				Function to write next chunk to a stream
+ *
+ * @param[in]	 		stream				Stream opened with STORAGE_STREAM_WRITE or STORAGE_STREAM_APPEND.
+ * @param[in]	 		data				buffer with data to write.
+ * @param[in]	 		data_size			Number of bytes to write.
+ * @param[out]   		int32_t				returns number of data bytes written. Negative ERROR code incase of an error.
+ */
+int32_t storage_stream_write(STORAGE_STREAM_STRUCT *stream, const uint8_t *data, uint32_t data_size);
+
+/**@brief 				Function to close a stream
+ *
+ * @details 			STORAGE_STREAM_WRITE stream replaces the target file with the written data.
+ *
+ * @param[in]	 		stream				Stream to close.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_stream_close(STORAGE_STREAM_STRUCT *stream);
+
+/**@brief 				Function to abort a stream
+ *
+ * @details 			STORAGE_STREAM_WRITE stream discards the written data and keeps the target file unchanged.
+ *
+ * @param[in]	 		stream				Stream to abort.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_stream_abort(STORAGE_STREAM_STRUCT *stream);
+
+/**@brief 				Function to read a file chunk by chunk
+ *
+ * @details 			File is read in the caller buffer and handed to the callback one chunk at a time,
+ * 						so any file size is handled with a fixed amount of RAM.
+ *
+ * @param[in]	 		filename			File to read.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		buffer				Chunk buffer.
+ * @param[in]	 		buffer_size			Chunk buffer size.
+ * @param[in]	 		callback			Called for every chunk.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[out]   		int32_t				returns total number of bytes read or negative ERROR code incase of an error.
+ */
+int32_t storage_read_chunks(const uint8_t *filename, const uint8_t *directory, uint8_t *buffer, uint32_t buffer_size,
+							storage_chunk_sink_cb callback, void *ctx);
+
+/**@brief 				Function to write a file chunk by chunk
+ *
+ * @details 			Callback fills the caller buffer one chunk at a time until it returns 0. File is
+ * 						replaced only when all chunks are written.
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		buffer				Chunk buffer.
+ * @param[in]	 		buffer_size			Chunk buffer size.
+ * @param[in]	 		callback			Called to fill every chunk.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[out]   		int32_t				returns total number of bytes written or negative ERROR code incase of an error.
+ */
+int32_t storage_write_chunks(const uint8_t *filename, const uint8_t *directory, uint8_t *buffer, uint32_t buffer_size,
+							storage_chunk_source_cb callback, void *ctx);
+
+/**@brief 				Function to get flash operation counters
+ *
+ * @details 			Counters include every flash program, erase and read done by the file system and the
+ * 						key/value store since boot.
+ *
+ * @param[in]	 		counters			Counters to fill.
+ * @param[out]   		None.
+ */
+void storage_get_flash_counters(STORAGE_FLASH_COUNTERS_STRUCT *counters);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,337 @@
+/**
+ * @file storage_async.c
+ * @brief Storage work queue for flash writes off the caller thread.
+ *
+ * @details Writes, erases and cache flushes are copied into a request from a fixed pool
+ * and served in order by a dedicated work queue thread, so network callbacks and the
+ * application thread never wait for a flash erase or a mount. Completion is reported with
+ * a callback or a future. Queue depth, wait and service time are kept for diagnostics.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <stdio.h>
+#include "storage.h"
+#include "storage_cache.h"
+#include "storage_async.h"
+
+/* Request types */
+typedef enum
+{
+	STORAGE_ASYNC_OP_WRITE = 0,
+	STORAGE_ASYNC_OP_ERASE,
+	STORAGE_ASYNC_OP_FLUSH,
+}STORAGE_ASYNC_OP;
+
+typedef struct
+{
+	struct k_work work;
+	STORAGE_ASYNC_OP op;
+	uint8_t directory[STORAGE_ASYNC_DIRECTORY_MAX_LEN + 1];
+	uint8_t name[STORAGE_ASYNC_NAME_MAX_LEN + 1];
+	uint8_t data[CONFIG_STORAGE_ASYNC_DATA_MAX_LEN];
+	uint32_t length;
+	uint32_t submitCycles;
+	STORAGE_ASYNC_CALLBACK callback;
+	void *userData;
+}STORAGE_ASYNC_REQUEST_STRUCT;
+
+/* Async stats Mutex to synchronize */
+K_MUTEX_DEFINE(StorageAsyncMutex);
+K_MEM_SLAB_DEFINE_STATIC(storageAsyncSlab, sizeof(STORAGE_ASYNC_REQUEST_STRUCT), CONFIG_STORAGE_ASYNC_QUEUE_DEPTH, 4);
+static K_THREAD_STACK_DEFINE(storage_async_stack_area, CONFIG_STORAGE_ASYNC_STACK_SIZE);
+
+static struct k_work_q storageAsyncQueue;
+static bool isAsyncStarted = false;
+static STORAGE_ASYNC_STATS_STRUCT asyncStats;
+
+/**@brief 				Function to serve one request
+ *
+ * @details 			Request goes back to the pool before the callback, so the callback can queue the next one.
+ *
+ * @param[in]	 		work				Work item of the request.
+ * @param[out]   		None.
+ */
+static void requestWorkHandler(struct k_work *work)
+{
+	STORAGE_ASYNC_REQUEST_STRUCT *request = CONTAINER_OF(work, STORAGE_ASYNC_REQUEST_STRUCT, work);
+	STORAGE_ASYNC_CALLBACK callback = request->callback;
+	void *userData = request->userData;
+	uint32_t startCycles = k_cycle_get_32();
+	uint32_t waitUs = k_cyc_to_us_floor32(startCycles - request->submitCycles);
+	uint32_t serviceUs;
+	int32_t rc;
+
+	switch (request->op)
+	{
+		case STORAGE_ASYNC_OP_WRITE:
+			rc = storage_cache_write(request->name, request->data, request->length, request->directory);
+			break;
+
+		case STORAGE_ASYNC_OP_ERASE:
+			rc = storage_cache_erase(request->name, request->directory);
+			break;
+
+		default:
+			rc = storage_cache_sync();
+			break;
+	}
+
+	serviceUs = k_cyc_to_us_floor32(k_cycle_get_32() - startCycles);
+
+	k_mem_slab_free(&storageAsyncSlab, request);
+
+	k_mutex_lock(&StorageAsyncMutex, K_FOREVER);
+	asyncStats.depth--;
+	asyncStats.completed++;
+	asyncStats.failed += (rc < 0) ? 1 : 0;
+	asyncStats.maxWaitUs = MAX(asyncStats.maxWaitUs, waitUs);
+	asyncStats.maxServiceUs = MAX(asyncStats.maxServiceUs, serviceUs);
+	asyncStats.totalServiceUs += serviceUs;
+	k_mutex_unlock(&StorageAsyncMutex);
+
+	if (callback != NULL)
+	{
+		callback(rc, userData);
+	}
+}
+
+/**@brief 				Function to queue a request
+ *
+ * @param[in]	 		op					Request type.
+ * @param[in]	 		filename			File name. NULL for a flush.
+ * @param[in]	 		data				Data to write. NULL if none.
+ * @param[in]	 		data_size			Number of bytes to write.
+ * @param[in]	 		directory			Directory name. NULL for a flush.
+ * @param[in]	 		callback			Completion callback.
+ * @param[in]	 		user_data			Passed to callback.
+ * @param[out]   		int32_t				returns 0 if queued or negative ERROR code incase of an error.
+ */
+static int32_t submitRequest(STORAGE_ASYNC_OP op, const uint8_t *filename, const uint8_t *data, uint32_t data_size,
+							const uint8_t *directory, STORAGE_ASYNC_CALLBACK callback, void *user_data)
+{
+	STORAGE_ASYNC_REQUEST_STRUCT *request = NULL;
+	int32_t rc = 0;
+
+	if (!isAsyncStarted)
+	{
+		return -ENODEV;
+	}
+
+	if (((filename != NULL) && (strlen(filename) > STORAGE_ASYNC_NAME_MAX_LEN)) ||
+		((directory != NULL) && (strlen(directory) > STORAGE_ASYNC_DIRECTORY_MAX_LEN)))
+	{
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
+
+	if (data_size > CONFIG_STORAGE_ASYNC_DATA_MAX_LEN)
+	{
+		return -ERROR_STORAGE_ASYNC_DATA_TOO_LARGE;
+	}
+
+	if (k_mem_slab_alloc(&storageAsyncSlab, (void **)&request, K_NO_WAIT) < 0)
+	{
+		k_mutex_lock(&StorageAsyncMutex, K_FOREVER);
+		asyncStats.rejected++;
+		k_mutex_unlock(&StorageAsyncMutex);
+		return -EBUSY;
+	}
+
+	memset(request, 0, sizeof(*request));
+	k_work_init(&request->work, requestWorkHandler);
+	request->op = op;
+	snprintf(request->name, sizeof(request->name), "%s", (filename != NULL) ? filename : (const uint8_t *)"");
+	snprintf(request->directory, sizeof(request->directory), "%s", (directory != NULL) ? directory : (const uint8_t *)"");
+	if (data_size > 0)
+	{
+		memcpy(request->data, data, data_size);
+	}
+	request->length = data_size;
+	request->callback = callback;
+	request->userData = user_data;
+	request->submitCycles = k_cycle_get_32();
+
+	/*Count before submit, the request may be served right away*/
+	k_mutex_lock(&StorageAsyncMutex, K_FOREVER);
+	asyncStats.submitted++;
+	asyncStats.depth++;
+	asyncStats.maxDepth = MAX(asyncStats.maxDepth, asyncStats.depth);
+	k_mutex_unlock(&StorageAsyncMutex);
+
+	rc = k_work_submit_to_queue(&storageAsyncQueue, &request->work);
+	if (rc < 0)
+	{
+		k_mutex_lock(&StorageAsyncMutex, K_FOREVER);
+		asyncStats.submitted--;
+		asyncStats.depth--;
+		k_mutex_unlock(&StorageAsyncMutex);
+
+		k_mem_slab_free(&storageAsyncSlab, request);
+		return rc;
+	}
+
+	return 0;
+}
+
+/**@brief 				Function to start the storage work queue
+ *
+ * @details 			Called by storage_init(). Later calls do nothing.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_async_init(void)
+{
+	struct k_work_queue_config config = {.name = "storage_async"};
+
+	if (isAsyncStarted)
+	{
+		return 0;
+	}
+
+	k_work_queue_init(&storageAsyncQueue);
+	k_work_queue_start(&storageAsyncQueue, storage_async_stack_area, K_THREAD_STACK_SIZEOF(storage_async_stack_area),
+						CONFIG_STORAGE_ASYNC_PRIORITY, &config);
+	isAsyncStarted = true;
+
+	return 0;
+}
+
+/**@brief 				Function to get the storage work queue
+ *
+ * @details 			Other storage modules run their deferred flash work on this queue.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		struct k_work_q*	returns storage work queue.
+ */
+struct k_work_q *storage_async_queue(void)
+{
+	return &storageAsyncQueue;
+}
+
+/**@brief 				Function to queue a file write
+ *
+ * @details 			Data is copied, the buffer can be reused on return. File is written through the
+ * 						storage cache. Requests are served in submit order.
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		data				buffer with data to write.
+ * @param[in]	 		data_size			Number of bytes to write. Max CONFIG_STORAGE_ASYNC_DATA_MAX_LEN.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		callback			Called with the write result. NULL for none.
+ * @param[in]	 		user_data			Passed to callback.
+ * @param[out]   		int32_t				returns 0 if queued, -EBUSY if the queue is full or negative ERROR code incase of an error.
+ */
+int32_t storage_async_write(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t *directory,
+							STORAGE_ASYNC_CALLBACK callback, void *user_data)
+{
+	return submitRequest(STORAGE_ASYNC_OP_WRITE, filename, data, data_size, directory, callback, user_data);
+}
+
+/**@brief 				Function to queue a file erase
+ *
+ * @param[in]	 		filename			File to erase.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		callback			Called with the erase result. NULL for none.
+ * @param[in]	 		user_data			Passed to callback.
+ * @param[out]   		int32_t				returns 0 if queued, -EBUSY if the queue is full or negative ERROR code incase of an error.
+ */
+int32_t storage_async_erase(const uint8_t *filename, const uint8_t *directory, STORAGE_ASYNC_CALLBACK callback, void *user_data)
+{
+	return submitRequest(STORAGE_ASYNC_OP_ERASE, filename, NULL, 0, directory, callback, user_data);
+}
+
+/**@brief 				Function to queue a storage cache flush
+ *
+ * @details 			Flush runs after all requests queued before it.
+ *
+ * @param[in]	 		callback			Called with the flush result. NULL for none.
+ * @param[in]	 		user_data			Passed to callback.
+ * @param[out]   		int32_t				returns 0 if queued, -EBUSY if the queue is full or negative ERROR code incase of an error.
+ */
+int32_t storage_async_flush(STORAGE_ASYNC_CALLBACK callback, void *user_data)
+{
+	return submitRequest(STORAGE_ASYNC_OP_FLUSH, NULL, NULL, 0, NULL, callback, user_data);
+}
+
+/**@brief 				Function to wait until all queued requests are done
+ *
+ * @details 			Used before the file system is unmounted. Can not be called from the storage work queue.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_async_drain(void)
+{
+	if (!isAsyncStarted)
+	{
+		return 0;
+	}
+
+	if (k_current_get() == k_work_queue_thread_get(&storageAsyncQueue))
+	{
+		return -EDEADLK;
+	}
+
+	return k_work_queue_drain(&storageAsyncQueue, false);
+}
+
+/**@brief 				Function to prepare a future
+ *
+ * @param[in]	 		future				Future to prepare.
+ * @param[out]   		None.
+ */
+void storage_async_future_init(STORAGE_ASYNC_FUTURE_STRUCT *future)
+{
+	k_sem_init(&future->done, 0, 1);
+	future->result = -EINPROGRESS;
+}
+
+/**@brief 				Completion callback of a future
+ *
+ * @param[in]	 		result				Request result.
+ * @param[in]	 		user_data			Future.
+ * @param[out]   		None.
+ */
+void storage_async_future_complete(int32_t result, void *user_data)
+{
+	STORAGE_ASYNC_FUTURE_STRUCT *future = user_data;
+
+	future->result = result;
+	k_sem_give(&future->done);
+}
+
+/**@brief 				Function to wait for the result of a future
+ *
+ * @param[in]	 		future				Future passed with storage_async_future_complete.
+ * @param[in]	 		timeout				Max wait time.
+ * @param[out]   		int32_t				returns request result or -EAGAIN if the request is not done.
+ */
+int32_t storage_async_future_wait(STORAGE_ASYNC_FUTURE_STRUCT *future, k_timeout_t timeout)
+{
+	if (k_sem_take(&future->done, timeout) < 0)
+	{
+		return -EAGAIN;
+	}
+
+	/*Keep the future done for later waits*/
+	k_sem_give(&future->done);
+
+	return future->result;
+}
+
+/**@brief 				Function to get the work queue statistics
+ *
+ * @param[in]	 		stats				Statistics to fill.
+ * @param[out]   		None.
+ */
+void storage_async_get_stats(STORAGE_ASYNC_STATS_STRUCT *stats)
+{
+	k_mutex_lock(&StorageAsyncMutex, K_FOREVER);
+	memcpy(stats, &asyncStats, sizeof(asyncStats));
+	k_mutex_unlock(&StorageAsyncMutex);
+}
@@ -0,0 +1,148 @@
+/**
+ * @file storage_async.h
+ * @brief Storage work queue for flash writes off the caller thread.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+
+#ifndef StorageAsync_h
+#define StorageAsync_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+
+/* Request limits. Data is copied into the request */
+#define STORAGE_ASYNC_NAME_MAX_LEN          16
+#define STORAGE_ASYNC_DIRECTORY_MAX_LEN     8
+
+#define ERROR_STORAGE_ASYNC_DATA_TOO_LARGE  4300
+
+/* Completion callback. Runs on the storage work queue thread, must not wait on storage requests */
+typedef void (*STORAGE_ASYNC_CALLBACK)(int32_t result, void *user_data);
+
+/* Result of a request for callers which wait for it. Pass storage_async_future_complete and the future as callback */
+typedef struct
+{
+	struct k_sem done;
+	int32_t result;
+}STORAGE_ASYNC_FUTURE_STRUCT;
+
+/* Work queue statistics */
+typedef struct
+{
+	uint32_t submitted;
+	uint32_t completed;
+	uint32_t failed;				/* Completed with an error */
+	uint32_t rejected;				/* Not queued, queue full */
+	uint32_t depth;					/* Requests queued or running */
+	uint32_t maxDepth;
+	uint32_t maxWaitUs;				/* Submit to start of service */
+	uint32_t maxServiceUs;
+	uint64_t totalServiceUs;
+}STORAGE_ASYNC_STATS_STRUCT;
+
+/**@brief 				Function to start the storage work queue
+ *
+ * @details 			Called by storage_init(). Later calls do nothing.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_async_init(void);
+
+/**@brief 				Function to get the storage work queue
+ *
+ * @details 			Other storage modules run their deferred flash work on this queue.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		struct k_work_q*	returns storage work queue.
+ */
+struct k_work_q *storage_async_queue(void);
+
+/**@brief 				Function to queue a file write
+ *
+ * @details 			Data is copied, the buffer can be reused on return. File is written through the
+ * 						storage cache. Requests are served in submit order.
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		data				buffer with data to write.
+ * @param[in]	 		data_size			Number of bytes to write. Max CONFIG_STORAGE_ASYNC_DATA_MAX_LEN.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		callback			Called with the write result. NULL for none.
+ * @param[in]	 		user_data			Passed to callback.
+ * @param[out]   		int32_t				returns 0 if queued, -EBUSY if the queue is full or negative ERROR code incase of an error.
+ */
+int32_t storage_async_write(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t *directory,
+							STORAGE_ASYNC_CALLBACK callback, void *user_data);
+
+/**@brief 				Function to queue a file erase
+ *
+ * @param[in]	 		filename			File to erase.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		callback			Called with the erase result. NULL for none.
+ * @param[in]	 		user_data			Passed to callback.
+ * @param[out]   		int32_t				returns 0 if queued, -EBUSY if the queue is full or negative ERROR code incase of an error.
+ */
+int32_t storage_async_erase(const uint8_t *filename, const uint8_t *directory, STORAGE_ASYNC_CALLBACK callback, void *user_data);
+
+/**@brief 				Function to queue a storage cache flush
+ *
+ * @details 			Flush runs after all requests queued before it.
+ *
+ * @param[in]	 		callback			Called with the flush result. NULL for none.
+ * @param[in]	 		user_data			Passed to callback.
+ * @param[out]   		int32_t				returns 0 if queued, -EBUSY if the queue is full or negative ERROR code incase of an error.
+ */
+int32_t storage_async_flush(STORAGE_ASYNC_CALLBACK callback, void *user_data);
+
+/**@brief 				Function to wait until all queued requests are done
+ *
+ * @details 			Used before the file system is unmounted. Can not be called from the storage work queue.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_async_drain(void);
+
+/**@brief 				Function to prepare a future
+ *
+ * @param[in]	 		future				Future to prepare.
+ * @param[out]   		None.
+ */
+void storage_async_future_init(STORAGE_ASYNC_FUTURE_STRUCT *future);
+
+/**@brief 				Completion callback of a future
+ *
+ * @param[in]	 		result				Request result.
+ * @param[in]	 		user_data			Future.
+ * @param[out]   		None.
+ */
+void storage_async_future_complete(int32_t result, void *user_data);
+
+/**@brief 				Function to wait for the result of a future
+ *
+ * @param[in]	 		future				Future passed with storage_async_future_complete.
+ * @param[in]	 		timeout				Max wait time.
+ * @param[out]   		int32_t				returns request result or -EAGAIN if the request is not done.
+ */
+int32_t storage_async_future_wait(STORAGE_ASYNC_FUTURE_STRUCT *future, k_timeout_t timeout);
+
+/**@brief 				Function to get the work queue statistics
+ *
+ * @param[in]	 		stats				Statistics to fill.
+ * @param[out]   		None.
+ */
+void storage_async_get_stats(STORAGE_ASYNC_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,741 @@
+/**
+ * @file storage_bench.c
+ * @brief Flash storage benchmarks.
+ *
+ * @details Runs read_file/write_file/eraseFile/listBlobFiles workloads at several file sizes
+ * and counts, compares the truncate-and-rewrite path (write_file) with the offset/append
+ * path (append_file, write_file_at), and compares a small config record in LittleFS with
+ * the key/value store. Every case reports ops/s, p50/p99 latency, bytes programmed and
+ * erases per logical operation from the flash counters. Telemetry encoding cases compare
+ * the JSON upload form with ts_codec in bytes per sample and encode/decode cost. The
+ * contention case runs reader threads next to a writer thread and reports the worst
+ * read wait, to compare the shared read lock with an exclusive storage lock. The cache erase
+ * case erases a file while a flush of it is in progress and checks it stays erased on flash.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <stdio.h>
+#include "storage.h"
+#include "storage_bench.h"
+#include "storage_cache.h"
+#include "storage_wear.h"
+#include "ts_codec.h"
+
+#define BENCH_LOG_FILE_NAME         "log"
+#define BENCH_RECORD_FILE_NAME      "rec"
+#define BENCH_LOG_RECORD_SIZE       32
+#define BENCH_LOG_UPDATES           32
+#define BENCH_RECORD_SIZE           1024
+#define BENCH_RECORD_PATCH_OFFSET   512
+#define BENCH_RECORD_PATCH_SIZE     4
+#define BENCH_RECORD_UPDATES        16
+#define BENCH_MAX_SAMPLES           64
+#define BENCH_MAX_FILE_SIZE         2048
+#define BENCH_LIST_BUFFER_SIZE      512
+#define BENCH_FILE_NAME_LEN         8
+#define BENCH_CONFIG_FILE_NAME      "cfg"
+#define BENCH_CONFIG_UPDATES        32
+#define BENCH_TS_SAMPLES            256
+#define BENCH_TS_FIELDS             2
+#define BENCH_TS_START_MS           1700000000000LL
+#define BENCH_TS_INTERVAL_MS        30000
+#define BENCH_CONTENTION_FILE_NAME  "shared"
+#define BENCH_CONTENTION_WRITE_NAME "busy"
+#define BENCH_CONTENTION_READ_SIZE  256
+#define BENCH_CONTENTION_READERS    3
+#define BENCH_CONTENTION_READS      32
+#define BENCH_CONTENTION_STACK_SIZE 2048
+#define BENCH_CACHE_ERASE_NAME      "erased"
+#define BENCH_CACHE_ERASE_ROUNDS    16
+
+/* File sizes and file counts of the workload matrix */
+static const uint32_t benchFileSizes[] = {32, 256, BENCH_MAX_FILE_SIZE};
+static const uint32_t benchFileCounts[] = {4, 16};
+
+/* Measurement of one benchmark case */
+typedef struct
+{
+	STORAGE_FLASH_COUNTERS_STRUCT startCounters;
+	uint32_t startCycles;
+	uint32_t opStartCycles;
+	uint32_t ops;
+	uint32_t samples;
+	uint32_t maxLatencyUs;
+	uint32_t latencyUs[BENCH_MAX_SAMPLES];
+}BENCH_MEASUREMENT_STRUCT;
+
+static uint8_t benchBuffer[MAX(BENCH_LOG_RECORD_SIZE * BENCH_LOG_UPDATES, BENCH_MAX_FILE_SIZE)];
+static uint8_t benchListBuffer[BENCH_LIST_BUFFER_SIZE];
+static BENCH_MEASUREMENT_STRUCT measurement;
+
+/* Contention case threads. Samples of the reader threads go to measurement under BenchMutex */
+K_MUTEX_DEFINE(BenchMutex);
+K_THREAD_STACK_ARRAY_DEFINE(benchContentionStacks, BENCH_CONTENTION_READERS + 1, BENCH_CONTENTION_STACK_SIZE);
+static struct k_thread benchContentionThreads[BENCH_CONTENTION_READERS + 1];
+static uint8_t benchContentionBuffers[BENCH_CONTENTION_READERS + 1][BENCH_CONTENTION_READ_SIZE];
+static int32_t benchContentionResults[BENCH_CONTENTION_READERS + 1];
+static atomic_t benchContentionStop;
+
+/**@brief 				Function to start a measurement
+ *
+ * @param[in]	 		measurement			Measurement to start.
+ * @param[out]   		None.
+ */
+static void benchStart(BENCH_MEASUREMENT_STRUCT *measurement)
+{
+	measurement->ops = 0;
+	measurement->samples = 0;
+	measurement->maxLatencyUs = 0;
+	storage_get_flash_counters(&measurement->startCounters);
+	measurement->startCycles = k_cycle_get_32();
+}
+
+/**@brief 				Function to mark the start of one logical operation
+ *
+ * @param[in]	 		measurement			Running measurement.
+ * @param[out]   		None.
+ */
+static void benchOpStart(BENCH_MEASUREMENT_STRUCT *measurement)
+{
+	measurement->opStartCycles = k_cycle_get_32();
+}
+
+/**@brief 				Function to add the latency of one logical operation
+ *
+ * @details 			Latency of the first BENCH_MAX_SAMPLES operations is kept for percentiles.
+ *
+ * @param[in]	 		measurement			Running measurement.
+ * @param[in]	 		latencyUs			Operation latency in microseconds.
+ * @param[out]   		None.
+ */
+static void benchAddSample(BENCH_MEASUREMENT_STRUCT *measurement, uint32_t latencyUs)
+{
+	uint32_t pos = measurement->samples;
+
+	measurement->ops++;
+	measurement->maxLatencyUs = MAX(measurement->maxLatencyUs, latencyUs);
+
+	if (pos == BENCH_MAX_SAMPLES)
+	{
+		return;
+	}
+
+	/* Insert sorted so percentiles are a lookup */
+	while ((pos > 0) && (measurement->latencyUs[pos - 1] > latencyUs))
+	{
+		measurement->latencyUs[pos] = measurement->latencyUs[pos - 1];
+		pos--;
+	}
+	measurement->latencyUs[pos] = latencyUs;
+	measurement->samples++;
+}
+
+/**@brief 				Function to mark the end of one logical operation
+ *
+ * @param[in]	 		measurement			Running measurement.
+ * @param[out]   		None.
+ */
+static void benchOpEnd(BENCH_MEASUREMENT_STRUCT *measurement)
+{
+	benchAddSample(measurement, k_cyc_to_us_floor32(k_cycle_get_32() - measurement->opStartCycles));
+}
+
+/**@brief 				Function to get a latency percentile
+ *
+ * @param[in]	 		measurement			Stopped measurement.
+ * @param[in]	 		percent				Percentile, 0 to 100.
+ * @param[out]   		uint32_t			returns latency in microseconds.
+ */
+static uint32_t benchPercentile(const BENCH_MEASUREMENT_STRUCT *measurement, uint32_t percent)
+{
+	if (measurement->samples == 0)
+	{
+		return 0;
+	}
+
+	return measurement->latencyUs[((measurement->samples - 1) * percent + 50) / 100];
+}
+
+/**@brief 				Function to stop a measurement and print the result
+ *
+ * @param[in]	 		measurement			Measurement started by benchStart().
+ * @param[in]	 		name				Benchmark case name.
+ * @param[in]	 		size				Logical bytes per operation.
+ * @param[in]	 		files				Number of files in the case.
+ * @param[out]   		None.
+ */
+static void benchStop(BENCH_MEASUREMENT_STRUCT *measurement, const char *name, uint32_t size, uint32_t files)
+{
+	STORAGE_FLASH_COUNTERS_STRUCT counters;
+	uint32_t elapsedUs = k_cyc_to_us_floor32(k_cycle_get_32() - measurement->startCycles);
+	uint32_t ops = MAX(measurement->ops, 1);
+	uint32_t erases;
+
+	storage_get_flash_counters(&counters);
+	erases = counters.eraseOps - measurement->startCounters.eraseOps;
+
+	printk("%-16s %5u %5u %5u %8u %8u %8u %8u %4u.%02u\n",
+			name, size, files, measurement->ops,
+			(uint32_t)(((uint64_t)measurement->ops * USEC_PER_SEC) / MAX(elapsedUs, 1)),
+			benchPercentile(measurement, 50),
+			benchPercentile(measurement, 99),
+			(counters.programBytes - measurement->startCounters.programBytes) / ops,
+			erases / ops, ((erases * 100) / ops) % 100);
+}
+
+/**@brief 				Function to make a benchmark file name
+ *
+ * @param[in]	 		index				File index.
+ * @param[in]	 		name				Buffer for the name. Must be BENCH_FILE_NAME_LEN + 1 bytes.
+ * @param[out]   		None.
+ */
+static void benchFileName(uint32_t index, uint8_t *name)
+{
+	snprintf(name, BENCH_FILE_NAME_LEN + 1, "f%03u", index);
+}
+
+/**@brief 				Benchmark basic file operations
+ *
+ * @details 			Create, overwrite, read, list and erase a set of equally sized files.
+ *
+ * @param[in]	 		size				File size in bytes.
+ * @param[in]	 		files				Number of files.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t benchFileOps(uint32_t size, uint32_t files)
+{
+	uint8_t name[BENCH_FILE_NAME_LEN + 1];
+	int32_t rc = 0;
+
+	memset(benchBuffer, 0x5A, size);
+
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < files) && (rc >= 0); i++)
+	{
+		benchFileName(i, name);
+		benchOpStart(&measurement);
+		rc = write_file(name, benchBuffer, size, STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "write new", size, files);
+
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < files) && (rc >= 0); i++)
+	{
+		benchFileName(i, name);
+		benchOpStart(&measurement);
+		rc = write_file(name, benchBuffer, size, STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "write overwrite", size, files);
+
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < files) && (rc >= 0); i++)
+	{
+		benchFileName(i, name);
+		benchOpStart(&measurement);
+		rc = read_file(name, benchBuffer, size, STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "read", size, files);
+
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < files) && (rc >= 0); i++)
+	{
+		benchOpStart(&measurement);
+		rc = listBlobFiles(benchListBuffer, sizeof(benchListBuffer), STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "list", size, files);
+
+	benchStart(&measurement);
+	for (uint32_t i = 0; i < files; i++)
+	{
+		benchFileName(i, name);
+		benchOpStart(&measurement);
+		eraseFile(name, STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "erase", size, files);
+
+	return (rc < 0) ? rc : 0;
+}
+
+/**@brief 				Benchmark a growing log
+ *
+ * @details 			Add a record per update with a full rewrite and with append.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t benchLogGrowth(void)
+{
+	int32_t rc = 0;
+
+	/* Truncate and rewrite whole log for every record */
+	eraseFile(BENCH_LOG_FILE_NAME, STORAGE_BENCH_DIRECTORY);
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < BENCH_LOG_UPDATES) && (rc >= 0); i++)
+	{
+		memset(&benchBuffer[i * BENCH_LOG_RECORD_SIZE], i, BENCH_LOG_RECORD_SIZE);
+		benchOpStart(&measurement);
+		rc = write_file(BENCH_LOG_FILE_NAME, benchBuffer, (i + 1) * BENCH_LOG_RECORD_SIZE, STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "log rewrite", BENCH_LOG_RECORD_SIZE, 1);
+
+	/* Append only the new record */
+	eraseFile(BENCH_LOG_FILE_NAME, STORAGE_BENCH_DIRECTORY);
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < BENCH_LOG_UPDATES) && (rc >= 0); i++)
+	{
+		benchOpStart(&measurement);
+		rc = append_file(BENCH_LOG_FILE_NAME, &benchBuffer[i * BENCH_LOG_RECORD_SIZE], BENCH_LOG_RECORD_SIZE, STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "log append", BENCH_LOG_RECORD_SIZE, 1);
+
+	eraseFile(BENCH_LOG_FILE_NAME, STORAGE_BENCH_DIRECTORY);
+
+	return (rc < 0) ? rc : 0;
+}
+
+/**@brief 				Benchmark a partial record update
+ *
+ * @details 			Patch a few bytes in the middle of a record with a full rewrite and with offset write.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t benchRecordPatch(void)
+{
+	uint32_t value = 0;
+	int32_t rc = 0;
+
+	memset(benchBuffer, 0xA5, BENCH_RECORD_SIZE);
+
+	/* Truncate and rewrite whole record for every patch */
+	rc = write_file(BENCH_RECORD_FILE_NAME, benchBuffer, BENCH_RECORD_SIZE, STORAGE_BENCH_DIRECTORY);
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < BENCH_RECORD_UPDATES) && (rc >= 0); i++)
+	{
+		value = i;
+		memcpy(&benchBuffer[BENCH_RECORD_PATCH_OFFSET], &value, BENCH_RECORD_PATCH_SIZE);
+		benchOpStart(&measurement);
+		rc = write_file(BENCH_RECORD_FILE_NAME, benchBuffer, BENCH_RECORD_SIZE, STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "record rewrite", BENCH_RECORD_PATCH_SIZE, 1);
+
+	/* Write only the patched bytes */
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < BENCH_RECORD_UPDATES) && (rc >= 0); i++)
+	{
+		value = i;
+		benchOpStart(&measurement);
+		rc = write_file_at(BENCH_RECORD_FILE_NAME, BENCH_RECORD_PATCH_OFFSET, (uint8_t *)&value, BENCH_RECORD_PATCH_SIZE, STORAGE_BENCH_DIRECTORY);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, "record at offset", BENCH_RECORD_PATCH_SIZE, 1);
+
+	eraseFile(BENCH_RECORD_FILE_NAME, STORAGE_BENCH_DIRECTORY);
+
+	return (rc < 0) ? rc : 0;
+}
+
+/**@brief 				Benchmark a small config record
+ *
+ * @details 			Update and read a counter sized record as done for the boot counter.
+ *
+ * @param[in]	 		directory			Directory of the record. Selects the backend.
+ * @param[in]	 		writeName			Benchmark case name for updates.
+ * @param[in]	 		readName			Benchmark case name for reads.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t benchConfigRecord(const uint8_t *directory, const char *writeName, const char *readName)
+{
+	uint32_t value = 0;
+	int32_t rc = 0;
+
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < BENCH_CONFIG_UPDATES) && (rc >= 0); i++)
+	{
+		value = i;
+		benchOpStart(&measurement);
+		rc = write_file(BENCH_CONFIG_FILE_NAME, (uint8_t *)&value, sizeof(value), directory);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, writeName, sizeof(value), 1);
+
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < BENCH_CONFIG_UPDATES) && (rc >= 0); i++)
+	{
+		benchOpStart(&measurement);
+		rc = read_file(BENCH_CONFIG_FILE_NAME, (uint8_t *)&value, sizeof(value), directory);
+		benchOpEnd(&measurement);
+	}
+	benchStop(&measurement, readName, sizeof(value), 1);
+
+	eraseFile(BENCH_CONFIG_FILE_NAME, (uint8_t *)directory);
+
+	return (rc < 0) ? rc : 0;
+}
+
+/**@brief 				Function to make a telemetry sample
+ *
+ * @details 			30 s sample interval with a few ms of jitter, slowly changing temperature and voltage.
+ *
+ * @param[in]	 		index				Sample index.
+ * @param[in]	 		timestamp			Filled with sample time.
+ * @param[in]	 		values				Filled with BENCH_TS_FIELDS values.
+ * @param[out]   		None.
+ */
+static void benchTsSample(uint32_t index, int64_t *timestamp, double *values)
+{
+	*timestamp = BENCH_TS_START_MS + ((int64_t)index * BENCH_TS_INTERVAL_MS) + (int32_t)((index * 37) % 15) - 7;
+	values[0] = 23 + ((index / 16) % 3);
+	values[1] = 3712 - (index / 8);
+}
+
+/**@brief 				Benchmark telemetry encoding
+ *
+ * @details 			Encode a sample series as ThingsBoard JSON and with ts_codec, then decode it back.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t benchTsCodec(void)
+{
+	TS_CODEC_STRUCT codec;
+	int64_t timestamp;
+	int64_t decodedTimestamp;
+	double values[BENCH_TS_FIELDS];
+	double decoded[BENCH_TS_FIELDS];
+	uint32_t jsonBytes = 0;
+	uint32_t encodedBytes = 0;
+	uint32_t offset = 0;
+	int32_t rc = 0;
+
+	benchStart(&measurement);
+	for (uint32_t i = 0; i < BENCH_TS_SAMPLES; i++)
+	{
+		benchTsSample(i, &timestamp, values);
+		benchOpStart(&measurement);
+		rc = snprintf(benchListBuffer, sizeof(benchListBuffer), "{\"ts\":%lld,\"values\":{\"temperature\":%d,\"voltage\":%d}}",
+						timestamp, (int32_t)values[0], (int32_t)values[1]);
+		benchOpEnd(&measurement);
+		jsonBytes += rc;
+	}
+	benchStop(&measurement, "ts json encode", jsonBytes / BENCH_TS_SAMPLES, 0);
+
+	/* Encoded samples are kept back to back */
+	ts_codec_init(&codec, BENCH_TS_FIELDS);
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < BENCH_TS_SAMPLES) && (rc >= 0); i++)
+	{
+		benchTsSample(i, &timestamp, values);
+		benchOpStart(&measurement);
+		rc = ts_codec_encode(&codec, timestamp, values, &benchBuffer[offset], sizeof(benchBuffer) - offset);
+		benchOpEnd(&measurement);
+		if (rc > 0)
+		{
+			offset += rc;
+		}
+	}
+	encodedBytes = offset;
+	benchStop(&measurement, "ts encode", encodedBytes / BENCH_TS_SAMPLES, 0);
+
+	ts_codec_init(&codec, BENCH_TS_FIELDS);
+	offset = 0;
+	benchStart(&measurement);
+	for (uint32_t i = 0; (i < BENCH_TS_SAMPLES) && (rc >= 0); i++)
+	{
+		benchOpStart(&measurement);
+		rc = ts_codec_decode(&codec, &benchBuffer[offset], encodedBytes - offset, &decodedTimestamp, decoded);
+		benchOpEnd(&measurement);
+		if (rc > 0)
+		{
+			offset += rc;
+
+			benchTsSample(i, &timestamp, values);
+			if ((decodedTimestamp != timestamp) || (memcmp(decoded, values, sizeof(values)) != 0))
+			{
+				rc = -EILSEQ;
+			}
+		}
+	}
+	benchStop(&measurement, "ts decode", encodedBytes / BENCH_TS_SAMPLES, 0);
+
+	printk("ts codec: %u samples, json %u B/sample, encoded %u.%02u B/sample\n", BENCH_TS_SAMPLES,
+			jsonBytes / BENCH_TS_SAMPLES, encodedBytes / BENCH_TS_SAMPLES, ((encodedBytes * 100) / BENCH_TS_SAMPLES) % 100);
+
+	return (rc < 0) ? rc : 0;
+}
+
+/**@brief 				Contention writer thread
+ *
+ * @details 			Rewrites a large file from benchBuffer until the readers are done.
+ *
+ * @param[in]	 		p1					Thread index.
+ * @param[out]   		None.
+ */
+static void benchContentionWriter(void *p1, void *p2, void *p3)
+{
+	uint32_t index = (uint32_t)(uintptr_t)p1;
+	int32_t rc = 0;
+
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (!atomic_get(&benchContentionStop) && (rc >= 0))
+	{
+		rc = write_file(BENCH_CONTENTION_WRITE_NAME, benchBuffer, BENCH_MAX_FILE_SIZE, STORAGE_BENCH_DIRECTORY);
+	}
+
+	benchContentionResults[index] = rc;
+}
+
+/**@brief 				Contention reader thread
+ *
+ * @details 			Reads a small file BENCH_CONTENTION_READS times and records every read latency.
+ *
+ * @param[in]	 		p1					Thread index.
+ * @param[out]   		None.
+ */
+static void benchContentionReader(void *p1, void *p2, void *p3)
+{
+	uint32_t index = (uint32_t)(uintptr_t)p1;
+	uint32_t startCycles;
+	uint32_t latencyUs;
+	int32_t rc = 0;
+
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (uint32_t i = 0; (i < BENCH_CONTENTION_READS) && (rc >= 0); i++)
+	{
+		startCycles = k_cycle_get_32();
+		rc = read_file(BENCH_CONTENTION_FILE_NAME, benchContentionBuffers[index], BENCH_CONTENTION_READ_SIZE, STORAGE_BENCH_DIRECTORY);
+		latencyUs = k_cyc_to_us_floor32(k_cycle_get_32() - startCycles);
+
+		k_mutex_lock(&BenchMutex, K_FOREVER);
+		benchAddSample(&measurement, latencyUs);
+		k_mutex_unlock(&BenchMutex);
+
+		/* Give the other threads a turn between reads */
+		k_yield();
+	}
+
+	benchContentionResults[index] = rc;
+}
+
+/**@brief 				Benchmark reads contending with a writer
+ *
+ * @details 			Reader threads and one writer thread run at the priority of the caller. Worst read
+ * 						wait shows how long readers are stalled by the writer and by each other. Build with
+ * 						CONFIG_STORAGE_SHARED_READ_LOCK=n to compare with an exclusive storage lock.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t benchContention(void)
+{
+	int priority = k_thread_priority_get(k_current_get());
+	int32_t rc;
+
+	memset(benchBuffer, 0xA5, BENCH_CONTENTION_READ_SIZE);
+	rc = write_file(BENCH_CONTENTION_FILE_NAME, benchBuffer, BENCH_CONTENTION_READ_SIZE, STORAGE_BENCH_DIRECTORY);
+	if (rc < 0)
+	{
+		return rc;
+	}
+	memset(benchBuffer, 0x5A, BENCH_MAX_FILE_SIZE);
+
+	atomic_set(&benchContentionStop, 0);
+	benchStart(&measurement);
+
+	/* Thread 0 is the writer */
+	k_thread_create(&benchContentionThreads[0], benchContentionStacks[0], K_THREAD_STACK_SIZEOF(benchContentionStacks[0]),
+			benchContentionWriter, (void *)0, NULL, NULL, priority, 0, K_NO_WAIT);
+	for (uint32_t i = 1; i <= BENCH_CONTENTION_READERS; i++)
+	{
+		k_thread_create(&benchContentionThreads[i], benchContentionStacks[i], K_THREAD_STACK_SIZEOF(benchContentionStacks[i]),
+				benchContentionReader, (void *)(uintptr_t)i, NULL, NULL, priority, 0, K_NO_WAIT);
+	}
+
+	for (uint32_t i = 1; i <= BENCH_CONTENTION_READERS; i++)
+	{
+		k_thread_join(&benchContentionThreads[i], K_FOREVER);
+	}
+	atomic_set(&benchContentionStop, 1);
+	k_thread_join(&benchContentionThreads[0], K_FOREVER);
+
+	benchStop(&measurement, "contended read", BENCH_CONTENTION_READ_SIZE, BENCH_CONTENTION_READERS);
+
+	printk("contention: %u readers, 1 writer, %s lock, worst read wait %u us\n", BENCH_CONTENTION_READERS,
+			IS_ENABLED(CONFIG_STORAGE_SHARED_READ_LOCK) ? "shared" : "exclusive", measurement.maxLatencyUs);
+
+	for (uint32_t i = 0; i <= BENCH_CONTENTION_READERS; i++)
+	{
+		if (benchContentionResults[i] < 0)
+		{
+			rc = benchContentionResults[i];
+		}
+	}
+
+	eraseFile(BENCH_CONTENTION_WRITE_NAME, STORAGE_BENCH_DIRECTORY);
+	eraseFile(BENCH_CONTENTION_FILE_NAME, STORAGE_BENCH_DIRECTORY);
+
+	return (rc < 0) ? rc : 0;
+}
+
+/**@brief 				Cache flush thread
+ *
+ * @param[in]	 		p1					Thread index.
+ * @param[out]   		None.
+ */
+static void benchCacheFlusher(void *p1, void *p2, void *p3)
+{
+	uint32_t index = (uint32_t)(uintptr_t)p1;
+
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	benchContentionResults[index] = storage_cache_sync();
+}
+
+/**@brief 				Check a cache erase racing with a flush
+ *
+ * @details 			A flush thread writes the dirty file while this thread erases it. The file must be
+ * 						gone from flash afterwards, a flushed copy must not be written back after the erase.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t benchCacheErase(void)
+{
+	int priority = k_thread_priority_get(k_current_get());
+	uint32_t value;
+	uint32_t resurrected = 0;
+	int32_t rc = 0;
+
+	for (uint32_t i = 0; (i < BENCH_CACHE_ERASE_ROUNDS) && (rc >= 0); i++)
+	{
+		value = i;
+		rc = storage_cache_write(BENCH_CACHE_ERASE_NAME, (uint8_t *)&value, sizeof(value), STORAGE_BENCH_DIRECTORY);
+		if (rc < 0)
+		{
+			break;
+		}
+
+		k_thread_create(&benchContentionThreads[0], benchContentionStacks[0], K_THREAD_STACK_SIZEOF(benchContentionStacks[0]),
+				benchCacheFlusher, (void *)0, NULL, NULL, priority, 0, K_NO_WAIT);
+
+		/* Let the flush start, then erase. Rounds land on both sides of the flash write */
+		k_busy_wait(i * 100);
+		k_yield();
+		rc = storage_cache_erase(BENCH_CACHE_ERASE_NAME, STORAGE_BENCH_DIRECTORY);
+		k_thread_join(&benchContentionThreads[0], K_FOREVER);
+
+		if ((rc < 0) && (rc != -ENOENT))
+		{
+			break;
+		}
+		rc = benchContentionResults[0];
+
+		/* Flash, not the cache, tells whether the erase held */
+		if (read_file(BENCH_CACHE_ERASE_NAME, (uint8_t *)&value, sizeof(value), STORAGE_BENCH_DIRECTORY) != -ENOENT)
+		{
+			resurrected++;
+		}
+	}
+
+	printk("cache erase: %u rounds, %u files written back after erase\n", BENCH_CACHE_ERASE_ROUNDS, resurrected);
+
+	storage_cache_invalidate();
+	eraseFile(BENCH_CACHE_ERASE_NAME, STORAGE_BENCH_DIRECTORY);
+
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	return (resurrected > 0) ? -EIO : 0;
+}
+
+/**@brief 				Function to run the storage benchmarks
+ *
+ * @details 			Results are printed on the console.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_bench_run(void)
+{
+	int32_t rc = 0;
+	STORAGE_WEAR_ACCOUNT_STRUCT accounts[STORAGE_WEAR_ACCOUNT_COUNT];
+	int32_t accountCount;
+
+	/*Benchmark files are counted in one wear account*/
+	(void)storage_wear_aggregate_directory(STORAGE_BENCH_DIRECTORY);
+
+	printk("Storage benchmark start\n");
+	printk("%-16s %5s %5s %5s %8s %8s %8s %8s %7s\n",
+			"case", "size", "files", "ops", "ops/s", "p50 us", "p99 us", "prog B", "erases");
+
+	for (uint32_t i = 0; (i < ARRAY_SIZE(benchFileSizes)) && (rc >= 0); i++)
+	{
+		for (uint32_t j = 0; (j < ARRAY_SIZE(benchFileCounts)) && (rc >= 0); j++)
+		{
+			rc = benchFileOps(benchFileSizes[i], benchFileCounts[j]);
+		}
+	}
+
+	if (rc >= 0)
+	{
+		rc = benchLogGrowth();
+	}
+	if (rc >= 0)
+	{
+		rc = benchRecordPatch();
+	}
+	if (rc >= 0)
+	{
+		rc = benchConfigRecord(STORAGE_BENCH_DIRECTORY, "config lfs write", "config lfs read");
+	}
+	if (rc >= 0)
+	{
+		rc = benchTsCodec();
+	}
+	if (rc >= 0)
+	{
+		rc = benchContention();
+	}
+	if (rc >= 0)
+	{
+		rc = benchCacheErase();
+	}
+#if defined(CONFIG_STORAGE_KV)
+	if (rc >= 0)
+	{
+		storage_set_directory_backend(STORAGE_BENCH_KV_DIRECTORY, STORAGE_BACKEND_KV);
+		rc = benchConfigRecord(STORAGE_BENCH_KV_DIRECTORY, "config kv write", "config kv read");
+	}
+#endif
+
+	accountCount = storage_wear_get_accounts(accounts, ARRAY_SIZE(accounts));
+	for (int32_t i = 0; i < accountCount; i++)
+	{
+		printk("wear %-16s prog ops %6u prog B %8u erases %5u\n", accounts[i].name,
+				accounts[i].programOps, accounts[i].programBytes, accounts[i].eraseOps);
+	}
+
+	printk("Storage benchmark done: %d\n", rc);
+
+	return rc;
+}
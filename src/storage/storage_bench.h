@@ -0,0 +1,37 @@
+/**
+ * @file storage_bench.h
+ * @brief Flash storage benchmarks.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+
+#ifndef StorageBench_h
+#define StorageBench_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Directory for benchmark files. Removed at the end of the run */
+#define STORAGE_BENCH_DIRECTORY     "bench"
+#define STORAGE_BENCH_KV_DIRECTORY  "benchkv"
+
+/**@brief 				Function to run the storage benchmarks
+ *
+ * @details 			Results are printed on the console.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_bench_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
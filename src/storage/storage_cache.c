@@ -0,0 +1,516 @@
+/**
+ * @file storage_cache.c
+ * @brief Write-back RAM cache for small key/value files.
+ *
+ * @details Entries are looked up by directory and file name. A file which does not exist
+ * on flash is cached too, so repeated reads of a missing file do not touch flash. Dirty
+ * entries are written with write_file() according to the flush policy. Writes to a dirty
+ * entry before it is flushed only update RAM.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <stdio.h>
+#include "storage.h"
+#include "storage_cache.h"
+#include "storage_async.h"
+
+/* Cache entry states */
+#define CACHE_ENTRY_VALID       0x01
+#define CACHE_ENTRY_DIRTY       0x02
+#define CACHE_ENTRY_ABSENT      0x04
+#define CACHE_ENTRY_FLUSHING    0x08
+
+typedef struct
+{
+	uint8_t flags;
+	uint8_t directory[STORAGE_CACHE_DIRECTORY_MAX_LEN + 1];
+	uint8_t name[STORAGE_CACHE_NAME_MAX_LEN + 1];
+	uint8_t data[STORAGE_CACHE_VALUE_MAX_LEN];
+	uint32_t length;
+	uint32_t generation;
+	int64_t lastUsed;
+}STORAGE_CACHE_ENTRY_STRUCT;
+
+static void flushWorkHandler(struct k_work *work);
+
+/* Cache Mutex to synchronize. Flush Mutex allows one flush at a time, and keeps erases and
+ * write-throughs from running while a flushed copy is being written. Taken before Cache Mutex */
+K_MUTEX_DEFINE(StorageCacheMutex);
+K_MUTEX_DEFINE(StorageCacheFlushMutex);
+K_WORK_DELAYABLE_DEFINE(storage_cache_flush_work, flushWorkHandler);
+
+static STORAGE_CACHE_ENTRY_STRUCT cacheEntries[STORAGE_CACHE_ENTRY_COUNT];
+static STORAGE_CACHE_STATS_STRUCT cacheStats;
+
+/* Counts writes, erases and invalidations. A flash read on a miss is not cached if it changed
+ * meanwhile. Write-throughs count before and after the flash write */
+static uint32_t changeCount;
+
+/* Copy of the entry being written to flash */
+static STORAGE_CACHE_ENTRY_STRUCT flushEntry;
+
+#if defined(CONFIG_STORAGE_CACHE_FLUSH_POLICY_EXPLICIT)
+static STORAGE_CACHE_FLUSH_POLICY flushPolicy = STORAGE_CACHE_FLUSH_EXPLICIT;
+#elif defined(CONFIG_STORAGE_CACHE_FLUSH_POLICY_BEFORE_SLEEP)
+static STORAGE_CACHE_FLUSH_POLICY flushPolicy = STORAGE_CACHE_FLUSH_BEFORE_SLEEP;
+#else
+static STORAGE_CACHE_FLUSH_POLICY flushPolicy = STORAGE_CACHE_FLUSH_INTERVAL;
+#endif
+static uint32_t flushIntervalMs = CONFIG_STORAGE_CACHE_FLUSH_INTERVAL_SEC * 1000;
+
+/**@brief 				Function to check if a file can be cached
+ *
+ * @param[in]	 		filename			File name.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		bool				returns true if names fit in a cache entry.
+ */
+static bool isCacheable(const uint8_t *filename, const uint8_t *directory)
+{
+	return (strlen(filename) <= STORAGE_CACHE_NAME_MAX_LEN) && (strlen(directory) <= STORAGE_CACHE_DIRECTORY_MAX_LEN);
+}
+
+/**@brief 				Function to find a cache entry
+ *
+ * @details 			Cache lock must be held by the caller.
+ *
+ * @param[in]	 		filename			File name.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		STORAGE_CACHE_ENTRY_STRUCT*		returns entry or NULL if file is not cached.
+ */
+static STORAGE_CACHE_ENTRY_STRUCT *findEntry(const uint8_t *filename, const uint8_t *directory)
+{
+	for (uint32_t i = 0; i < STORAGE_CACHE_ENTRY_COUNT; i++)
+	{
+		if ((cacheEntries[i].flags & CACHE_ENTRY_VALID) &&
+			(strcmp(cacheEntries[i].name, filename) == 0) &&
+			(strcmp(cacheEntries[i].directory, directory) == 0))
+		{
+			cacheEntries[i].lastUsed = k_uptime_get();
+			return &cacheEntries[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**@brief 				Function to allocate a cache entry
+ *
+ * @details 			Free entry is used first, otherwise the least recently used clean entry.
+ * 						Cache lock must be held by the caller.
+ *
+ * @param[in]	 		filename			File name.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		STORAGE_CACHE_ENTRY_STRUCT*		returns entry or NULL if all entries are dirty or being flushed.
+ */
+static STORAGE_CACHE_ENTRY_STRUCT *allocateEntry(const uint8_t *filename, const uint8_t *directory)
+{
+	STORAGE_CACHE_ENTRY_STRUCT *entry = NULL;
+
+	for (uint32_t i = 0; i < STORAGE_CACHE_ENTRY_COUNT; i++)
+	{
+		if (!(cacheEntries[i].flags & CACHE_ENTRY_VALID))
+		{
+			entry = &cacheEntries[i];
+			break;
+		}
+
+		if (!(cacheEntries[i].flags & (CACHE_ENTRY_DIRTY | CACHE_ENTRY_FLUSHING)) &&
+			((entry == NULL) || (cacheEntries[i].lastUsed < entry->lastUsed)))
+		{
+			entry = &cacheEntries[i];
+		}
+	}
+
+	if (entry != NULL)
+	{
+		memset(entry, 0, sizeof(*entry));
+		strcpy(entry->name, filename);
+		strcpy(entry->directory, directory);
+		entry->flags = CACHE_ENTRY_VALID;
+		entry->lastUsed = k_uptime_get();
+	}
+
+	return entry;
+}
+
+/**@brief 				Function to copy the content of a cache entry
+ *
+ * @details 			Cache lock must be held by the caller.
+ *
+ * @param[in]	 		entry				Cache entry.
+ * @param[in]	 		data				buffer to fill with the content.
+ * @param[in]	 		data_size			Max number of bytes to copy.
+ * @param[out]   		int32_t				returns number of bytes copied, -ENOENT if the file does not exist.
+ */
+static int32_t copyEntry(const STORAGE_CACHE_ENTRY_STRUCT *entry, uint8_t *data, uint32_t data_size)
+{
+	int32_t rc;
+
+	if (entry->flags & CACHE_ENTRY_ABSENT)
+	{
+		return -ENOENT;
+	}
+
+	rc = MIN(entry->length, data_size);
+	memcpy(data, entry->data, rc);
+
+	return rc;
+}
+
+/**@brief 				Function to write dirty entries to flash
+ *
+ * @details 			Entry is copied under the cache lock and written without it, so cache reads are not
+ * 						blocked by flash. Entry stays dirty if it was updated again during the write.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t flushDirtyEntries(void)
+{
+	int32_t rc = 0;
+	int32_t ret;
+
+	k_mutex_lock(&StorageCacheFlushMutex, K_FOREVER);
+
+	for (uint32_t i = 0; i < STORAGE_CACHE_ENTRY_COUNT; i++)
+	{
+		k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+		if ((cacheEntries[i].flags & (CACHE_ENTRY_VALID | CACHE_ENTRY_DIRTY)) != (CACHE_ENTRY_VALID | CACHE_ENTRY_DIRTY))
+		{
+			k_mutex_unlock(&StorageCacheMutex);
+			continue;
+		}
+		memcpy(&flushEntry, &cacheEntries[i], sizeof(flushEntry));
+		cacheEntries[i].flags &= ~CACHE_ENTRY_DIRTY;
+		cacheEntries[i].flags |= CACHE_ENTRY_FLUSHING;
+		k_mutex_unlock(&StorageCacheMutex);
+
+		ret = write_file(flushEntry.name, flushEntry.data, flushEntry.length, flushEntry.directory);
+
+		k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+		cacheEntries[i].flags &= ~CACHE_ENTRY_FLUSHING;
+		if (ret < 0)
+		{
+			printk("Storage cache: failed to flush %s/%s: %d\n", flushEntry.directory, flushEntry.name, ret);
+			rc = ret;
+
+			/* Keep it dirty for next flush unless it was updated or erased meanwhile */
+			if ((cacheEntries[i].flags & CACHE_ENTRY_VALID) && (cacheEntries[i].generation == flushEntry.generation))
+			{
+				cacheEntries[i].flags |= CACHE_ENTRY_DIRTY;
+			}
+		}
+		else
+		{
+			cacheStats.flashWrites++;
+		}
+		k_mutex_unlock(&StorageCacheMutex);
+	}
+
+	k_mutex_unlock(&StorageCacheFlushMutex);
+
+	return rc;
+}
+
+/**@brief 				Flush work handler
+ *
+ * @param[in]	 		work				Work item.
+ * @param[out]   		None.
+ */
+static void flushWorkHandler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	(void)flushDirtyEntries();
+}
+
+/**@brief 				Function to read a file through the cache
+ *
+ * @details 			Serve the file from RAM. File is read from flash on a cache miss only, without the
+ * 						cache lock.
+ *
+ * @param[in]	 		filename			File to read.
+ * @param[in]	 		data				buffer to fill with read data.
+ * @param[in]	 		data_size			Max number of bytes to read.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes read. Negative ERROR code incase of an error.
+ */
+int32_t storage_cache_read(const uint8_t *filename, uint8_t *data, uint32_t data_size, const uint8_t* directory)
+{
+	STORAGE_CACHE_ENTRY_STRUCT *entry;
+	uint8_t buffer[STORAGE_CACHE_VALUE_MAX_LEN];
+	uint32_t count;
+	int32_t rc;
+
+	if (!isCacheable(filename, directory))
+	{
+		return read_file(filename, data, data_size, directory);
+	}
+
+	k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+
+	entry = findEntry(filename, directory);
+	if (entry != NULL)
+	{
+		cacheStats.hits++;
+		rc = copyEntry(entry, data, data_size);
+		k_mutex_unlock(&StorageCacheMutex);
+		return rc;
+	}
+
+	/* Read through on miss without the lock, cache hits are not blocked by flash */
+	cacheStats.misses++;
+	cacheStats.flashReads++;
+	count = changeCount;
+	k_mutex_unlock(&StorageCacheMutex);
+
+	rc = read_file(filename, buffer, sizeof(buffer), directory);
+	if (rc == sizeof(buffer))
+	{
+		/* File may be bigger than an entry, do not cache it */
+		return read_file(filename, data, data_size, directory);
+	}
+
+	k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+
+	/* Filled or written meanwhile, the entry is not older than the flash read */
+	entry = findEntry(filename, directory);
+	if (entry != NULL)
+	{
+		rc = copyEntry(entry, data, data_size);
+		k_mutex_unlock(&StorageCacheMutex);
+		return rc;
+	}
+
+	/* Do not cache flash errors or content which may have changed during the read */
+	if ((count == changeCount) && ((rc >= 0) || (rc == -ENOENT)))
+	{
+		entry = allocateEntry(filename, directory);
+	}
+
+	if (entry != NULL)
+	{
+		if (rc == -ENOENT)
+		{
+			entry->flags |= CACHE_ENTRY_ABSENT;
+		}
+		else
+		{
+			memcpy(entry->data, buffer, rc);
+			entry->length = rc;
+		}
+	}
+
+	k_mutex_unlock(&StorageCacheMutex);
+
+	if (rc > 0)
+	{
+		rc = MIN(rc, data_size);
+		memcpy(data, buffer, rc);
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to write a file through the cache
+ *
+ * @details 			Update the file in RAM and mark it dirty. Flash is written according to the flush policy.
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		data				buffer with data to write.
+ * @param[in]	 		data_size			Number of bytes to write.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written. Negative ERROR code incase of an error.
+ */
+int32_t storage_cache_write(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t* directory)
+{
+	STORAGE_CACHE_ENTRY_STRUCT *entry;
+
+	int32_t rc;
+
+	if (!isCacheable(filename, directory) || (data_size >= STORAGE_CACHE_VALUE_MAX_LEN))
+	{
+		/* Drop a stale entry and write through. A flush in progress would overwrite the new content */
+		k_mutex_lock(&StorageCacheFlushMutex, K_FOREVER);
+		k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+		entry = isCacheable(filename, directory) ? findEntry(filename, directory) : NULL;
+		if (entry != NULL)
+		{
+			entry->flags = 0;
+		}
+		changeCount++;
+		k_mutex_unlock(&StorageCacheMutex);
+
+		rc = write_file(filename, data, data_size, directory);
+
+		k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+		changeCount++;
+		k_mutex_unlock(&StorageCacheMutex);
+		k_mutex_unlock(&StorageCacheFlushMutex);
+
+		return rc;
+	}
+
+	k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+
+	entry = findEntry(filename, directory);
+	if (entry != NULL)
+	{
+		if (entry->flags & CACHE_ENTRY_DIRTY)
+		{
+			/* Previous write is not flushed yet, only the latest one reaches flash */
+			cacheStats.coalescedWrites++;
+		}
+		else if (!(entry->flags & CACHE_ENTRY_ABSENT) && (entry->length == data_size) &&
+				(memcmp(entry->data, data, data_size) == 0))
+		{
+			/* File content is not changed, skip flash program */
+			cacheStats.coalescedWrites++;
+			k_mutex_unlock(&StorageCacheMutex);
+			return data_size;
+		}
+	}
+	else
+	{
+		entry = allocateEntry(filename, directory);
+	}
+
+	if (entry == NULL)
+	{
+		/* All entries are dirty */
+		changeCount++;
+		k_mutex_unlock(&StorageCacheMutex);
+
+		rc = write_file(filename, data, data_size, directory);
+
+		k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+		changeCount++;
+		k_mutex_unlock(&StorageCacheMutex);
+
+		return rc;
+	}
+
+	memcpy(entry->data, data, data_size);
+	entry->length = data_size;
+	entry->flags = CACHE_ENTRY_VALID | CACHE_ENTRY_DIRTY;
+	entry->generation++;
+	changeCount++;
+
+	k_mutex_unlock(&StorageCacheMutex);
+
+	if (flushPolicy == STORAGE_CACHE_FLUSH_INTERVAL)
+	{
+		/* Schedule is not moved if a flush is already pending, writes within the window are coalesced.
+		 * Flush runs on the storage work queue, not on the system work queue */
+		(void)k_work_schedule_for_queue(storage_async_queue(), &storage_cache_flush_work, K_MSEC(flushIntervalMs));
+	}
+
+	return data_size;
+}
+
+/**@brief 				Function to erase a file through the cache
+ *
+ * @details 			Erase the file from flash and remember in RAM that it does not exist. Waits for a flush
+ * 						in progress, its copy of the file would be written back after the erase.
+ *
+ * @param[in]	 		filename			File to erase.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_cache_erase(const uint8_t *filename, const uint8_t* directory)
+{
+	STORAGE_CACHE_ENTRY_STRUCT *entry = NULL;
+	int32_t rc;
+
+	k_mutex_lock(&StorageCacheFlushMutex, K_FOREVER);
+	k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+
+	if (isCacheable(filename, directory))
+	{
+		entry = findEntry(filename, directory);
+		if (entry == NULL)
+		{
+			entry = allocateEntry(filename, directory);
+		}
+	}
+
+	rc = eraseFile((uint8_t *)filename, (uint8_t *)directory);
+
+	if (entry != NULL)
+	{
+		entry->flags = (rc >= 0) ? (CACHE_ENTRY_VALID | CACHE_ENTRY_ABSENT) : 0;
+		entry->length = 0;
+		entry->generation++;
+	}
+	changeCount++;
+
+	k_mutex_unlock(&StorageCacheMutex);
+	k_mutex_unlock(&StorageCacheFlushMutex);
+
+	return rc;
+}
+
+/**@brief 				Function to flush all dirty entries to flash
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_cache_sync(void)
+{
+	(void)k_work_cancel_delayable(&storage_cache_flush_work);
+
+	return flushDirtyEntries();
+}
+
+/**@brief 				Function to drop all cache entries
+ *
+ * @details 			Dirty entries are dropped without flush. Used after the flash is erased.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		None.
+ */
+void storage_cache_invalidate(void)
+{
+	(void)k_work_cancel_delayable(&storage_cache_flush_work);
+
+	k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+	memset(cacheEntries, 0, sizeof(cacheEntries));
+	changeCount++;
+	k_mutex_unlock(&StorageCacheMutex);
+}
+
+/**@brief 				Function to set the flush policy
+ *
+ * @param[in]	 		policy				Flush policy.
+ * @param[in]	 		intervalMs			Flush interval for STORAGE_CACHE_FLUSH_INTERVAL policy.
+ * @param[out]   		None.
+ */
+void storage_cache_set_policy(STORAGE_CACHE_FLUSH_POLICY policy, uint32_t intervalMs)
+{
+	k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+	flushPolicy = policy;
+	flushIntervalMs = intervalMs;
+	k_mutex_unlock(&StorageCacheMutex);
+
+	if (policy != STORAGE_CACHE_FLUSH_INTERVAL)
+	{
+		(void)k_work_cancel_delayable(&storage_cache_flush_work);
+	}
+}
+
+/**@brief 				Function to get cache statistics
+ *
+ * @param[in]	 		stats				Statistics to fill.
+ * @param[out]   		None.
+ */
+void storage_cache_get_stats(STORAGE_CACHE_STATS_STRUCT *stats)
+{
+	k_mutex_lock(&StorageCacheMutex, K_FOREVER);
+	memcpy(stats, &cacheStats, sizeof(cacheStats));
+	k_mutex_unlock(&StorageCacheMutex);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file storage_cache.h
+ * @brief Write-back RAM cache for small key/value files.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+
+#ifndef StorageCache_h
+#define StorageCache_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Cache size. Files bigger than the value size bypass the cache */
+#define STORAGE_CACHE_ENTRY_COUNT           8
+#define STORAGE_CACHE_NAME_MAX_LEN          16
+#define STORAGE_CACHE_DIRECTORY_MAX_LEN     8
+#define STORAGE_CACHE_VALUE_MAX_LEN         64
+
+/* Flush policy for dirty entries */
+typedef enum
+{
+	STORAGE_CACHE_FLUSH_INTERVAL = 0,		/* Flush once the interval expires after first dirty write */
+	STORAGE_CACHE_FLUSH_EXPLICIT,			/* Flush only on storage_cache_sync() */
+	STORAGE_CACHE_FLUSH_BEFORE_SLEEP,		/* Flush on storage_suspend()/storage_shutdown() or storage_cache_sync() */
+}STORAGE_CACHE_FLUSH_POLICY;
+
+/* Cache statistics */
+typedef struct
+{
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t flashReads;
+	uint32_t flashWrites;
+	uint32_t coalescedWrites;
+}STORAGE_CACHE_STATS_STRUCT;
+
+/**@brief 				Function to read a file through the cache
+ *
+ * @details 			Serve the file from RAM. File is read from flash on a cache miss only.
+ *
+ * @param[in]	 		filename			File to read.
+ * @param[in]	 		data				buffer to fill with read data.
+ * @param[in]	 		data_size			Max number of bytes to read.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes read. Negative ERROR code incase of an error.
+ */
+int32_t storage_cache_read(const uint8_t *filename, uint8_t *data, uint32_t data_size, const uint8_t* directory);
+
+/**@brief 				Function to write a file through the cache
+ *
+ * @details 			Update the file in RAM and mark it dirty. Flash is written according to the flush policy.
+ *
+ * @param[in]	 		filename			File to write.
+ * @param[in]	 		data				buffer with data to write.
+ * @param[in]	 		data_size			Number of bytes to write.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written. Negative ERROR code incase of an error.
+ */
+int32_t storage_cache_write(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t* directory);
+
+/**@brief 				Function to erase a file through the cache
+ *
+ * @details 			Erase the file from flash and remember in RAM that it does not exist. Waits for a flush
+ * 						in progress.
+ *
+ * @param[in]	 		filename			File to erase.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_cache_erase(const uint8_t *filename, const uint8_t* directory);
+
+/**@brief 				Function to flush all dirty entries to flash
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_cache_sync(void);
+
+/**@brief 				Function to drop all cache entries
+ *
+ * @details 			Dirty entries are dropped without flush. Used after the flash is erased.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		None.
+ */
+void storage_cache_invalidate(void);
+
+/**@brief 				Function to set the flush policy
+ *
+ * @param[in]	 		policy				Flush policy.
+ * @param[in]	 		intervalMs			Flush interval for STORAGE_CACHE_FLUSH_INTERVAL policy.
+ * @param[out]   		None.
+ */
+void storage_cache_set_policy(STORAGE_CACHE_FLUSH_POLICY policy, uint32_t intervalMs);
+
+/**@brief 				Function to get cache statistics
+ *
+ * @param[in]	 		stats				Statistics to fill.
+ * @param[out]   		None.
+ */
+void storage_cache_get_stats(STORAGE_CACHE_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,933 @@
+/**
+ * @file storage_kv.c
+ * @brief Log-structured key/value store on a raw flash area.
+ *
+ * @details Small records are appended to a ring of flash sectors without a file system.
+ * Every sector starts with a header holding its generation number, and every record
+ * carries a CRC so a record torn by a power loss is detected. The newest record of a
+ * key wins, and an erase appends a tombstone. A RAM index of the live records is built
+ * from the log on init.
+ *
+ * One sector is always kept erased. When the active sector is full the spare sector
+ * becomes active, the live records of the oldest sector are copied into it and the
+ * oldest sector is erased to become the new spare.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/crc.h>
+#include <stdio.h>
+#include "storage.h"
+#include "storage_kv.h"
+#include "storage_wear.h"
+
+/* Flash area of the store. Boards without a kv_storage partition use the free external flash */
+#if FIXED_PARTITION_EXISTS(kv_storage)
+#define STORAGE_KV_PARTITION_ID         FIXED_PARTITION_ID(kv_storage)
+#else
+#define STORAGE_KV_PARTITION_ID         FIXED_PARTITION_ID(external_flash)
+#endif
+
+#define STORAGE_KV_SECTOR_SIZE          CONFIG_STORAGE_KV_SECTOR_SIZE
+#define STORAGE_KV_SECTOR_COUNT         CONFIG_STORAGE_KV_SECTOR_COUNT
+#define STORAGE_KV_SECTOR_MAGIC         0x4B565331
+#define STORAGE_KV_RECORD_MAGIC         0x4B56
+#define STORAGE_KV_RECORD_TOMBSTONE     0x01
+#define STORAGE_KV_MAX_WRITE_ALIGN      8
+
+BUILD_ASSERT(STORAGE_KV_SECTOR_COUNT >= 3, "Key/value store needs at least 3 sectors");
+BUILD_ASSERT(STORAGE_KV_SECTOR_SIZE <= UINT16_MAX + 1, "Record offsets are 16 bit");
+
+/* Sector header at the start of every used sector */
+typedef struct __packed
+{
+	uint32_t magic;
+	uint32_t seq;
+	uint16_t crc;
+}STORAGE_KV_SECTOR_HEADER_STRUCT;
+
+/* Record header. Key and value follow the header */
+typedef struct __packed
+{
+	uint16_t magic;
+	uint8_t keyLength;
+	uint8_t flags;
+	uint16_t valueLength;
+	uint16_t crc;
+}STORAGE_KV_RECORD_HEADER_STRUCT;
+
+/* RAM index entry of a live record */
+typedef struct
+{
+	uint8_t key[STORAGE_KV_KEY_MAX_LEN + 1];
+	uint8_t sector;
+	uint16_t offset;
+	uint16_t valueLength;
+}STORAGE_KV_INDEX_ENTRY_STRUCT;
+
+/* Store Mutex to synchronize */
+K_MUTEX_DEFINE(StorageKvMutex);
+
+static const struct flash_area *kvArea = NULL;
+static bool isKvReady = false;
+static uint32_t writeAlign = 1;
+static uint8_t erasedValue = 0xFF;
+
+/* Sector state */
+static bool isSectorUsed[STORAGE_KV_SECTOR_COUNT];
+static uint32_t sectorSeq[STORAGE_KV_SECTOR_COUNT];
+static uint32_t activeSector = 0;
+static uint32_t writeOffset = 0;
+
+/* Live records */
+static STORAGE_KV_INDEX_ENTRY_STRUCT kvIndex[STORAGE_KV_MAX_KEYS];
+static uint32_t kvKeyCount = 0;
+
+static STORAGE_KV_STATS_STRUCT kvStats;
+
+/* Wear account of the key being written. Garbage collection is charged to the key which triggered it */
+static int32_t kvAccount = STORAGE_WEAR_ACCOUNT_OTHER;
+
+/* Buffer for one record including write alignment padding */
+static uint8_t recordBuffer[sizeof(STORAGE_KV_RECORD_HEADER_STRUCT) + STORAGE_KV_KEY_MAX_LEN + STORAGE_KV_VALUE_MAX_LEN + STORAGE_KV_MAX_WRITE_ALIGN];
+
+/**@brief 				Function to get size of a record on flash
+ *
+ * @param[in]	 		keyLength			Key length.
+ * @param[in]	 		valueLength			Value length.
+ * @param[out]   		uint32_t			returns record size rounded up to the flash write block.
+ */
+static uint32_t recordSize(uint32_t keyLength, uint32_t valueLength)
+{
+	return ROUND_UP(sizeof(STORAGE_KV_RECORD_HEADER_STRUCT) + keyLength + valueLength, writeAlign);
+}
+
+/**@brief 				Function to get size of the sector header on flash
+ *
+ * @param[in]	 		None.
+ * @param[out]   		uint32_t			returns sector header size rounded up to the flash write block.
+ */
+static uint32_t sectorHeaderSize(void)
+{
+	return ROUND_UP(sizeof(STORAGE_KV_SECTOR_HEADER_STRUCT), writeAlign);
+}
+
+/**@brief 				Function to read from the store flash area
+ *
+ * @param[in]	 		offset				Offset in the flash area.
+ * @param[in]	 		data				buffer to fill.
+ * @param[in]	 		size				Number of bytes to read.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t kvFlashRead(uint32_t offset, void *data, uint32_t size)
+{
+	kvStats.readOps++;
+	kvStats.readBytes += size;
+
+	return flash_area_read(kvArea, offset, data, size);
+}
+
+/**@brief 				Function to program the store flash area
+ *
+ * @param[in]	 		offset				Offset in the flash area.
+ * @param[in]	 		data				Data to program. Size must be a multiple of the write block.
+ * @param[in]	 		size				Number of bytes to program.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t kvFlashWrite(uint32_t offset, const void *data, uint32_t size)
+{
+	kvStats.programOps++;
+	kvStats.programBytes += size;
+	storage_wear_record_program(STORAGE_WEAR_AREA_KV, offset / STORAGE_KV_SECTOR_SIZE, size, kvAccount);
+
+	return flash_area_write(kvArea, offset, data, size);
+}
+
+/**@brief 				Function to erase a sector
+ *
+ * @param[in]	 		sector				Sector index.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t kvEraseSector(uint32_t sector)
+{
+	int32_t rc;
+
+	kvStats.eraseOps++;
+	storage_wear_record_erase(STORAGE_WEAR_AREA_KV, sector, kvAccount);
+
+	rc = flash_area_erase(kvArea, sector * STORAGE_KV_SECTOR_SIZE, STORAGE_KV_SECTOR_SIZE);
+	if (rc >= 0)
+	{
+		isSectorUsed[sector] = false;
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to find the end of programmed data in a sector
+ *
+ * @param[in]	 		sector				Sector index.
+ * @param[out]   		int32_t				returns offset after the last programmed byte or negative ERROR code incase of an error.
+ */
+static int32_t sectorProgrammedEnd(uint32_t sector)
+{
+	uint8_t chunk[32];
+	int32_t end = STORAGE_KV_SECTOR_SIZE;
+	int32_t rc;
+
+	while (end > 0)
+	{
+		uint32_t size = MIN(sizeof(chunk), (uint32_t)end);
+
+		rc = kvFlashRead((sector * STORAGE_KV_SECTOR_SIZE) + end - size, chunk, size);
+		if (rc < 0)
+		{
+			return rc;
+		}
+
+		for (int32_t i = size - 1; i >= 0; i--)
+		{
+			if (chunk[i] != erasedValue)
+			{
+				return end - size + i + 1;
+			}
+		}
+
+		end -= size;
+	}
+
+	return 0;
+}
+
+/**@brief 				Function to read a sector header
+ *
+ * @param[in]	 		sector				Sector index.
+ * @param[in]	 		seq					Filled with the sector generation number.
+ * @param[out]   		bool				returns true if the sector has a valid header.
+ */
+static bool readSectorHeader(uint32_t sector, uint32_t *seq)
+{
+	STORAGE_KV_SECTOR_HEADER_STRUCT header;
+
+	if (kvFlashRead(sector * STORAGE_KV_SECTOR_SIZE, &header, sizeof(header)) < 0)
+	{
+		return false;
+	}
+
+	if ((header.magic != STORAGE_KV_SECTOR_MAGIC) ||
+		(crc16_ccitt(0xFFFF, (const uint8_t *)&header, offsetof(STORAGE_KV_SECTOR_HEADER_STRUCT, crc)) != header.crc))
+	{
+		return false;
+	}
+
+	*seq = header.seq;
+
+	return true;
+}
+
+/**@brief 				Function to start using an erased sector
+ *
+ * @param[in]	 		sector				Sector index.
+ * @param[in]	 		seq					Sector generation number.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t writeSectorHeader(uint32_t sector, uint32_t seq)
+{
+	STORAGE_KV_SECTOR_HEADER_STRUCT *header = (STORAGE_KV_SECTOR_HEADER_STRUCT *)recordBuffer;
+	int32_t rc;
+
+	memset(recordBuffer, erasedValue, sectorHeaderSize());
+	header->magic = STORAGE_KV_SECTOR_MAGIC;
+	header->seq = seq;
+	header->crc = crc16_ccitt(0xFFFF, (const uint8_t *)header, offsetof(STORAGE_KV_SECTOR_HEADER_STRUCT, crc));
+
+	rc = kvFlashWrite(sector * STORAGE_KV_SECTOR_SIZE, recordBuffer, sectorHeaderSize());
+	if (rc >= 0)
+	{
+		isSectorUsed[sector] = true;
+		sectorSeq[sector] = seq;
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to find a key in the index
+ *
+ * @param[in]	 		key					Key.
+ * @param[out]   		int32_t				returns index entry number or -1 if key is not stored.
+ */
+static int32_t findKey(const uint8_t *key)
+{
+	for (uint32_t i = 0; i < kvKeyCount; i++)
+	{
+		if (strcmp(kvIndex[i].key, key) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**@brief 				Function to update the index with a record
+ *
+ * @param[in]	 		key					Key.
+ * @param[in]	 		flags				Record flags.
+ * @param[in]	 		sector				Sector of the record.
+ * @param[in]	 		offset				Offset of the record in the sector.
+ * @param[in]	 		valueLength			Value length.
+ * @param[out]   		int32_t				returns 0 for success and -ENOSPC if the index is full.
+ */
+static int32_t updateIndex(const uint8_t *key, uint8_t flags, uint32_t sector, uint32_t offset, uint32_t valueLength)
+{
+	int32_t entry = findKey(key);
+
+	if (flags & STORAGE_KV_RECORD_TOMBSTONE)
+	{
+		if (entry >= 0)
+		{
+			kvIndex[entry] = kvIndex[--kvKeyCount];
+		}
+		return 0;
+	}
+
+	if (entry < 0)
+	{
+		if (kvKeyCount == STORAGE_KV_MAX_KEYS)
+		{
+			return -ENOSPC;
+		}
+		entry = kvKeyCount++;
+		strcpy(kvIndex[entry].key, key);
+	}
+
+	kvIndex[entry].sector = sector;
+	kvIndex[entry].offset = offset;
+	kvIndex[entry].valueLength = valueLength;
+
+	return 0;
+}
+
+/**@brief 				Function to read and check a record in the record buffer
+ *
+ * @param[in]	 		sector				Sector index.
+ * @param[in]	 		offset				Offset of the record in the sector.
+ * @param[out]   		int32_t				returns record size, 0 at the end of the log or -EILSEQ for a broken record.
+ */
+static int32_t loadRecord(uint32_t sector, uint32_t offset)
+{
+	STORAGE_KV_RECORD_HEADER_STRUCT *header = (STORAGE_KV_RECORD_HEADER_STRUCT *)recordBuffer;
+	uint32_t address = (sector * STORAGE_KV_SECTOR_SIZE) + offset;
+	uint32_t size;
+	uint16_t crc;
+	int32_t rc;
+
+	if ((offset + sizeof(*header)) > STORAGE_KV_SECTOR_SIZE)
+	{
+		return 0;
+	}
+
+	rc = kvFlashRead(address, header, sizeof(*header));
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	if ((header->magic == ((erasedValue << 8) | erasedValue)) && (header->keyLength == erasedValue))
+	{
+		return 0;
+	}
+
+	size = recordSize(header->keyLength, header->valueLength);
+	if ((header->magic != STORAGE_KV_RECORD_MAGIC) ||
+		(header->keyLength == 0) || (header->keyLength > STORAGE_KV_KEY_MAX_LEN) ||
+		(header->valueLength > STORAGE_KV_VALUE_MAX_LEN) ||
+		((offset + size) > STORAGE_KV_SECTOR_SIZE))
+	{
+		return -EILSEQ;
+	}
+
+	rc = kvFlashRead(address + sizeof(*header), &recordBuffer[sizeof(*header)], header->keyLength + header->valueLength);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	crc = crc16_ccitt(0xFFFF, recordBuffer, offsetof(STORAGE_KV_RECORD_HEADER_STRUCT, crc));
+	crc = crc16_ccitt(crc, &recordBuffer[sizeof(*header)], header->keyLength + header->valueLength);
+	if (crc != header->crc)
+	{
+		return -EILSEQ;
+	}
+
+	/* Padding is programmed as erased when the record is copied */
+	memset(&recordBuffer[sizeof(*header) + header->keyLength + header->valueLength], erasedValue,
+			size - (sizeof(*header) + header->keyLength + header->valueLength));
+
+	return size;
+}
+
+/**@brief 				Function to apply the records of a sector to the index
+ *
+ * @details 			A record torn by a power loss is skipped. Scan continues with the next valid
+ * 						record up to the last programmed byte of the sector.
+ *
+ * @param[in]	 		sector				Sector index.
+ * @param[out]   		int32_t				returns end of the log in the sector or negative ERROR code incase of an error.
+ */
+static int32_t scanSector(uint32_t sector)
+{
+	STORAGE_KV_RECORD_HEADER_STRUCT *header = (STORAGE_KV_RECORD_HEADER_STRUCT *)recordBuffer;
+	uint8_t key[STORAGE_KV_KEY_MAX_LEN + 1];
+	uint32_t offset = sectorHeaderSize();
+	int32_t programmedEnd = -1;
+	int32_t rc;
+
+	while (offset < STORAGE_KV_SECTOR_SIZE)
+	{
+		rc = loadRecord(sector, offset);
+		if (rc > 0)
+		{
+			memcpy(key, &recordBuffer[sizeof(*header)], header->keyLength);
+			key[header->keyLength] = 0;
+
+			if (updateIndex(key, header->flags, sector, offset, header->valueLength) < 0)
+			{
+				printk("Key/value store: index full, dropping %s\n", key);
+			}
+
+			offset += rc;
+			continue;
+		}
+
+		if ((rc == 0) && (programmedEnd < 0))
+		{
+			/* End of the log */
+			break;
+		}
+
+		if ((rc < 0) && (rc != -EILSEQ))
+		{
+			return rc;
+		}
+
+		if (programmedEnd < 0)
+		{
+			printk("Key/value store: skipping torn record in sector %u\n", sector);
+			programmedEnd = sectorProgrammedEnd(sector);
+			if (programmedEnd < 0)
+			{
+				return programmedEnd;
+			}
+			programmedEnd = ROUND_UP(programmedEnd, writeAlign);
+		}
+
+		offset += writeAlign;
+		if (offset >= programmedEnd)
+		{
+			offset = programmedEnd;
+			break;
+		}
+	}
+
+	return offset;
+}
+
+/**@brief 				Function to move live records out of a sector and erase it
+ *
+ * @details 			Records are copied to the end of the active sector.
+ *
+ * @param[in]	 		sector				Sector index.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t collectSector(uint32_t sector)
+{
+	int32_t rc;
+
+	for (uint32_t i = 0; i < kvKeyCount; i++)
+	{
+		if (kvIndex[i].sector != sector)
+		{
+			continue;
+		}
+
+		rc = loadRecord(sector, kvIndex[i].offset);
+		if (rc <= 0)
+		{
+			return (rc < 0) ? rc : -EILSEQ;
+		}
+
+		if ((writeOffset + rc) > STORAGE_KV_SECTOR_SIZE)
+		{
+			return -ENOSPC;
+		}
+
+		rc = kvFlashWrite((activeSector * STORAGE_KV_SECTOR_SIZE) + writeOffset, recordBuffer, rc);
+		if (rc < 0)
+		{
+			return rc;
+		}
+
+		kvIndex[i].sector = activeSector;
+		kvIndex[i].offset = writeOffset;
+		writeOffset += recordSize(strlen(kvIndex[i].key), kvIndex[i].valueLength);
+	}
+
+	kvStats.gcRuns++;
+
+	return kvEraseSector(sector);
+}
+
+/**@brief 				Function to switch to the spare sector
+ *
+ * @details 			Spare sector becomes active, then the oldest sector is collected into it.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t rotateSector(void)
+{
+	uint32_t spare = (activeSector + 1) % STORAGE_KV_SECTOR_COUNT;
+	int32_t rc;
+
+	rc = writeSectorHeader(spare, sectorSeq[activeSector] + 1);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	activeSector = spare;
+	writeOffset = sectorHeaderSize();
+
+	return collectSector((activeSector + 1) % STORAGE_KV_SECTOR_COUNT);
+}
+
+/**@brief 				Function to append a record to the log
+ *
+ * @param[in]	 		key					Key.
+ * @param[in]	 		flags				Record flags.
+ * @param[in]	 		value				Value. NULL for a tombstone.
+ * @param[in]	 		valueLength			Value length.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t appendRecord(const uint8_t *key, uint8_t flags, const uint8_t *value, uint32_t valueLength)
+{
+	STORAGE_KV_RECORD_HEADER_STRUCT *header = (STORAGE_KV_RECORD_HEADER_STRUCT *)recordBuffer;
+	uint32_t keyLength = strlen(key);
+	uint32_t size = recordSize(keyLength, valueLength);
+	uint32_t offset;
+	int32_t rc;
+
+	/* Every rotation frees the garbage of one sector */
+	for (uint32_t i = 0; (writeOffset + size) > STORAGE_KV_SECTOR_SIZE; i++)
+	{
+		if (i == (STORAGE_KV_SECTOR_COUNT - 1))
+		{
+			return -ENOSPC;
+		}
+
+		rc = rotateSector();
+		if (rc < 0)
+		{
+			return rc;
+		}
+	}
+
+	memset(recordBuffer, erasedValue, size);
+	header->magic = STORAGE_KV_RECORD_MAGIC;
+	header->keyLength = keyLength;
+	header->flags = flags;
+	header->valueLength = valueLength;
+	memcpy(&recordBuffer[sizeof(*header)], key, keyLength);
+	if (valueLength > 0)
+	{
+		memcpy(&recordBuffer[sizeof(*header) + keyLength], value, valueLength);
+	}
+	header->crc = crc16_ccitt(0xFFFF, recordBuffer, offsetof(STORAGE_KV_RECORD_HEADER_STRUCT, crc));
+	header->crc = crc16_ccitt(header->crc, &recordBuffer[sizeof(*header)], keyLength + valueLength);
+
+	offset = writeOffset;
+	rc = kvFlashWrite((activeSector * STORAGE_KV_SECTOR_SIZE) + offset, recordBuffer, size);
+
+	/* A failed program may leave partial data behind. Skip it either way */
+	writeOffset += size;
+
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	return updateIndex(key, flags, activeSector, offset, valueLength);
+}
+
+/**@brief 				Function to make the key of a file
+ *
+ * @param[in]	 		filename			File name.
+ * @param[in]	 		directory			Directory name.
+ * @param[in]	 		key					Buffer for the key. Must be STORAGE_KV_KEY_MAX_LEN + 1 bytes.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code if the key is too long.
+ */
+static int32_t makeKey(const uint8_t *filename, const uint8_t *directory, uint8_t *key)
+{
+	if ((strlen(directory) + strlen(filename) + 1) > STORAGE_KV_KEY_MAX_LEN)
+	{
+		printk("Provided file name is too long\n");
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
+
+	snprintf(key, STORAGE_KV_KEY_MAX_LEN + 1, "%s/%s", directory, filename);
+
+	return 0;
+}
+
+/**@brief 				Function to erase all sectors and start a new log
+ *
+ * @details 			Store lock must be held by the caller.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t formatStore(void)
+{
+	int32_t rc;
+
+	kvKeyCount = 0;
+
+	for (uint32_t i = 0; i < STORAGE_KV_SECTOR_COUNT; i++)
+	{
+		rc = kvEraseSector(i);
+		if (rc < 0)
+		{
+			return rc;
+		}
+	}
+
+	activeSector = 0;
+	writeOffset = sectorHeaderSize();
+
+	return writeSectorHeader(activeSector, 1);
+}
+
+/**@brief 				Function to open the store and build the index
+ *
+ * @details 			Store lock must be held by the caller.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t openStore(void)
+{
+	bool isFormatted = false;
+	uint32_t spare;
+	int32_t rc;
+
+	if (isKvReady)
+	{
+		return 0;
+	}
+
+	if (kvArea == NULL)
+	{
+		rc = flash_area_open(STORAGE_KV_PARTITION_ID, &kvArea);
+		if (rc < 0)
+		{
+			printk("FAIL: unable to open key/value flash area: %d\n", rc);
+			return rc;
+		}
+	}
+
+	if (kvArea->fa_size < (STORAGE_KV_SECTOR_COUNT * STORAGE_KV_SECTOR_SIZE))
+	{
+		printk("FAIL: key/value flash area too small: %u bytes\n", kvArea->fa_size);
+		return -ENOSPC;
+	}
+
+	writeAlign = MAX(flash_area_align(kvArea), 1);
+	if (writeAlign > STORAGE_KV_MAX_WRITE_ALIGN)
+	{
+		return -ENOTSUP;
+	}
+	erasedValue = flash_area_erased_val(kvArea);
+
+	/* Newest sector is the active one */
+	for (uint32_t i = 0; i < STORAGE_KV_SECTOR_COUNT; i++)
+	{
+		isSectorUsed[i] = readSectorHeader(i, &sectorSeq[i]);
+		if (isSectorUsed[i] && (!isFormatted || (sectorSeq[i] > sectorSeq[activeSector])))
+		{
+			activeSector = i;
+			isFormatted = true;
+		}
+	}
+
+	if (!isFormatted)
+	{
+		printk("Key/value store: formatting\n");
+		rc = formatStore();
+		if (rc >= 0)
+		{
+			isKvReady = true;
+		}
+		return rc;
+	}
+
+	/* Replay the log oldest sector first */
+	kvKeyCount = 0;
+	for (uint32_t i = 1; i <= STORAGE_KV_SECTOR_COUNT; i++)
+	{
+		uint32_t sector = (activeSector + i) % STORAGE_KV_SECTOR_COUNT;
+
+		if (!isSectorUsed[sector])
+		{
+			continue;
+		}
+
+		rc = scanSector(sector);
+		if (rc < 0)
+		{
+			return rc;
+		}
+
+		if (sector == activeSector)
+		{
+			writeOffset = rc;
+		}
+	}
+
+	/* Spare sector is still in use if a rotation was interrupted */
+	isKvReady = true;
+	spare = (activeSector + 1) % STORAGE_KV_SECTOR_COUNT;
+	if (isSectorUsed[spare])
+	{
+		printk("Key/value store: finishing interrupted collection\n");
+		rc = collectSector(spare);
+	}
+	else
+	{
+		rc = sectorProgrammedEnd(spare);
+		if (rc > 0)
+		{
+			rc = kvEraseSector(spare);
+		}
+	}
+
+	if (rc < 0)
+	{
+		isKvReady = false;
+		return rc;
+	}
+
+	printk("Key/value store: %u keys, sector %u at %u\n", kvKeyCount, activeSector, writeOffset);
+
+	return 0;
+}
+
+/**@brief 				Function to initialize the key/value store
+ *
+ * @details 			Open the flash area and build the RAM index from the record log.
+ * 						An unformatted area is formatted.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_kv_init(void)
+{
+	int32_t rc;
+
+	k_mutex_lock(&StorageKvMutex, K_FOREVER);
+	rc = openStore();
+	k_mutex_unlock(&StorageKvMutex);
+
+	return rc;
+}
+
+/**@brief 				Function to read a value
+ *
+ * @param[in]	 		filename			Key name.
+ * @param[in]	 		data				buffer to fill with read data.
+ * @param[in]	 		data_size			Max number of bytes to read.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes read. -ENOENT if key does not exist. Negative ERROR code incase of an error.
+ */
+int32_t storage_kv_read(const uint8_t *filename, uint8_t *data, uint32_t data_size, const uint8_t *directory)
+{
+	uint8_t key[STORAGE_KV_KEY_MAX_LEN + 1];
+	int32_t entry;
+	uint32_t size;
+	int32_t rc;
+
+	rc = makeKey(filename, directory, key);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	k_mutex_lock(&StorageKvMutex, K_FOREVER);
+
+	rc = openStore();
+	if (rc >= 0)
+	{
+		entry = findKey(key);
+		if (entry < 0)
+		{
+			rc = -ENOENT;
+		}
+		else
+		{
+			size = MIN(data_size, kvIndex[entry].valueLength);
+			rc = kvFlashRead((kvIndex[entry].sector * STORAGE_KV_SECTOR_SIZE) + kvIndex[entry].offset +
+							sizeof(STORAGE_KV_RECORD_HEADER_STRUCT) + strlen(key), data, size);
+			if (rc >= 0)
+			{
+				rc = size;
+			}
+		}
+	}
+
+	k_mutex_unlock(&StorageKvMutex);
+
+	return rc;
+}
+
+/**@brief 				Function to write a value
+ *
+ * @details 			Append a new record for the key. Writing the stored value again is skipped.
+ *
+ * @param[in]	 		filename			Key name.
+ * @param[in]	 		data				buffer with data to write.
+ * @param[in]	 		data_size			Number of bytes to write.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written. Negative ERROR code incase of an error.
+ */
+int32_t storage_kv_write(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t *directory)
+{
+	uint8_t key[STORAGE_KV_KEY_MAX_LEN + 1];
+	int32_t entry;
+	int32_t rc;
+
+	if (data_size > STORAGE_KV_VALUE_MAX_LEN)
+	{
+		return -ERROR_STORAGE_KV_VALUE_TOO_LARGE;
+	}
+
+	rc = makeKey(filename, directory, key);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	k_mutex_lock(&StorageKvMutex, K_FOREVER);
+
+	kvAccount = storage_wear_account(key);
+
+	rc = openStore();
+	if (rc >= 0)
+	{
+		entry = findKey(key);
+		if ((entry < 0) && (kvKeyCount == STORAGE_KV_MAX_KEYS))
+		{
+			rc = -ENOSPC;
+		}
+		else if ((entry >= 0) && (kvIndex[entry].valueLength == data_size) &&
+				(loadRecord(kvIndex[entry].sector, kvIndex[entry].offset) > 0) &&
+				(memcmp(&recordBuffer[sizeof(STORAGE_KV_RECORD_HEADER_STRUCT) + strlen(key)], data, data_size) == 0))
+		{
+			/* Value is already stored */
+			kvStats.skippedWrites++;
+		}
+		else
+		{
+			rc = appendRecord(key, 0, data, data_size);
+		}
+	}
+
+	kvAccount = STORAGE_WEAR_ACCOUNT_OTHER;
+
+	k_mutex_unlock(&StorageKvMutex);
+
+	return (rc < 0) ? rc : (int32_t)data_size;
+}
+
+/**@brief 				Function to erase a value
+ *
+ * @details 			Append a tombstone record for the key.
+ *
+ * @param[in]	 		filename			Key name.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_kv_erase(const uint8_t *filename, const uint8_t *directory)
+{
+	uint8_t key[STORAGE_KV_KEY_MAX_LEN + 1];
+	int32_t rc;
+
+	rc = makeKey(filename, directory, key);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	k_mutex_lock(&StorageKvMutex, K_FOREVER);
+
+	kvAccount = storage_wear_account(key);
+
+	rc = openStore();
+	if ((rc >= 0) && (findKey(key) >= 0))
+	{
+		rc = appendRecord(key, STORAGE_KV_RECORD_TOMBSTONE, NULL, 0);
+	}
+
+	kvAccount = STORAGE_WEAR_ACCOUNT_OTHER;
+
+	k_mutex_unlock(&StorageKvMutex);
+
+	return rc;
+}
+
+/**@brief 				Function to erase all values
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_kv_format(void)
+{
+	int32_t rc;
+
+	k_mutex_lock(&StorageKvMutex, K_FOREVER);
+
+	rc = openStore();
+	if (rc >= 0)
+	{
+		rc = formatStore();
+	}
+
+	k_mutex_unlock(&StorageKvMutex);
+
+	return rc;
+}
+
+/**@brief 				Function to get store statistics
+ *
+ * @param[in]	 		stats				Statistics to fill.
+ * @param[out]   		None.
+ */
+void storage_kv_get_stats(STORAGE_KV_STATS_STRUCT *stats)
+{
+	k_mutex_lock(&StorageKvMutex, K_FOREVER);
+
+	memcpy(stats, &kvStats, sizeof(kvStats));
+	stats->keys = kvKeyCount;
+	stats->usedBytes = 0;
+	for (uint32_t i = 0; i < kvKeyCount; i++)
+	{
+		stats->usedBytes += recordSize(strlen(kvIndex[i].key), kvIndex[i].valueLength);
+	}
+	stats->freeBytes = isKvReady ? (STORAGE_KV_SECTOR_SIZE - writeOffset) : 0;
+
+	k_mutex_unlock(&StorageKvMutex);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file storage_kv.h
+ * @brief Log-structured key/value store on a raw flash area.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+
+#ifndef StorageKv_h
+#define StorageKv_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Store limits. Key is "<directory>/<filename>" */
+#define STORAGE_KV_KEY_MAX_LEN          32
+#define STORAGE_KV_VALUE_MAX_LEN        128
+#define STORAGE_KV_MAX_KEYS             16
+
+/*API ERROR Codes*/
+#define ERROR_STORAGE_KV_VALUE_TOO_LARGE    4200
+
+/* Store statistics. Flash counters include garbage collection */
+typedef struct
+{
+	uint32_t keys;
+	uint32_t usedBytes;
+	uint32_t freeBytes;
+	uint32_t gcRuns;
+	uint32_t skippedWrites;
+	uint32_t programOps;
+	uint32_t programBytes;
+	uint32_t eraseOps;
+	uint32_t readOps;
+	uint32_t readBytes;
+}STORAGE_KV_STATS_STRUCT;
+
+/**@brief 				Function to initialize the key/value store
+ *
+ * @details 			Open the flash area and build the RAM index from the record log.
+ * 						An unformatted area is formatted.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_kv_init(void);
+
+/**@brief 				Function to read a value
+ *
+ * @param[in]	 		filename			Key name.
+ * @param[in]	 		data				buffer to fill with read data.
+ * @param[in]	 		data_size			Max number of bytes to read.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes read. -ENOENT if key does not exist. Negative ERROR code incase of an error.
+ */
+int32_t storage_kv_read(const uint8_t *filename, uint8_t *data, uint32_t data_size, const uint8_t *directory);
+
+/**@brief 				Function to write a value
+ *
+ * @details 			Append a new record for the key. Writing the stored value again is skipped.
+ *
+ * @param[in]	 		filename			Key name.
+ * @param[in]	 		data				buffer with data to write.
+ * @param[in]	 		data_size			Number of bytes to write.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns number of data bytes written. Negative ERROR code incase of an error.
+ */
+int32_t storage_kv_write(const uint8_t *filename, const uint8_t *data, uint32_t data_size, const uint8_t *directory);
+
+/**@brief 				Function to erase a value
+ *
+ * @details 			Append a tombstone record for the key.
+ *
+ * @param[in]	 		filename			Key name.
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_kv_erase(const uint8_t *filename, const uint8_t *directory);
+
+/**@brief 				Function to erase all values
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_kv_format(void);
+
+/**@brief 				Function to get store statistics
+ *
+ * @param[in]	 		stats				Statistics to fill.
+ * @param[out]   		None.
+ */
+void storage_kv_get_stats(STORAGE_KV_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,436 @@
+/**
+ * @file storage_wear.c
+ * @brief Flash wear instrumentation.
+ *
+ * @details Counts erases and programmed bytes per erase sector and per file account.
+ * Storage backends report every flash program and erase together with the account of
+ * the file operation which caused it, so garbage collection and metadata writes are
+ * charged to the file that triggered them. Lifetime erase counts are kept in flash.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <stdio.h>
+#include "storage.h"
+#include "storage_wear.h"
+
+#define STORAGE_WEAR_FILE_MAGIC             0x57454152
+
+/* Lifetime erase counters file header. Counters of every area follow the header */
+typedef struct __packed
+{
+	uint32_t magic;
+	uint16_t sectorCount[STORAGE_WEAR_AREA_COUNT];
+}STORAGE_WEAR_FILE_HEADER_STRUCT;
+
+/* Wear Mutex to synchronize */
+K_MUTEX_DEFINE(StorageWearMutex);
+
+/* Serializes load and save of the counters file. Taken before StorageWearMutex */
+K_MUTEX_DEFINE(StorageWearFileMutex);
+
+/* Erase counts loaded from flash at boot */
+static uint32_t baseEraseCount[STORAGE_WEAR_AREA_COUNT][STORAGE_WEAR_MAX_SECTORS];
+
+/* Counters since boot */
+static uint32_t bootEraseCount[STORAGE_WEAR_AREA_COUNT][STORAGE_WEAR_MAX_SECTORS];
+static uint32_t bootProgramBytes[STORAGE_WEAR_AREA_COUNT][STORAGE_WEAR_MAX_SECTORS];
+
+/* Highest sector seen per area */
+static uint32_t sectorCount[STORAGE_WEAR_AREA_COUNT];
+
+static STORAGE_WEAR_ACCOUNT_STRUCT accounts[STORAGE_WEAR_ACCOUNT_COUNT] = {
+	[STORAGE_WEAR_ACCOUNT_OTHER] = {.name = "other"},
+};
+static uint32_t accountCount = 1;
+
+static uint8_t aggregateDirectories[STORAGE_WEAR_AGGREGATE_DIRECTORIES][STORAGE_WEAR_ACCOUNT_NAME_MAX_LEN + 1];
+
+/* Lifetime counters are loaded once per boot. Loading again would count the boot erases twice */
+static bool isWearLoaded = false;
+
+/* Total erases at the last save */
+static uint32_t savedEraseOps = 0;
+static uint32_t totalEraseOps = 0;
+
+static uint8_t wearFileBuffer[sizeof(STORAGE_WEAR_FILE_HEADER_STRUCT) + (STORAGE_WEAR_AREA_COUNT * STORAGE_WEAR_MAX_SECTORS * sizeof(uint32_t))];
+
+/**@brief 				Function to get the counter slot of a sector
+ *
+ * @details 			Wear lock must be held by the caller.
+ *
+ * @param[in]	 		area				Flash area.
+ * @param[in]	 		sector				Erase sector in the area.
+ * @param[out]   		uint32_t			returns counter slot.
+ */
+static uint32_t sectorSlot(STORAGE_WEAR_AREA area, uint32_t sector)
+{
+	sector = MIN(sector, STORAGE_WEAR_MAX_SECTORS - 1);
+	sectorCount[area] = MAX(sectorCount[area], sector + 1);
+
+	return sector;
+}
+
+/**@brief 				Function to check if an account is valid
+ *
+ * @param[in]	 		account				Account number.
+ * @param[out]   		int32_t				returns account number or STORAGE_WEAR_ACCOUNT_OTHER.
+ */
+static int32_t validAccount(int32_t account)
+{
+	return ((account >= 0) && ((uint32_t)account < accountCount)) ? account : STORAGE_WEAR_ACCOUNT_OTHER;
+}
+
+/**@brief 				Function to get the account of a file
+ *
+ * @details 			Files of an aggregated directory share the directory account. Files which do not
+ * 						fit in the account table are counted in STORAGE_WEAR_ACCOUNT_OTHER.
+ *
+ * @param[in]	 		name				"<directory>/<filename>".
+ * @param[out]   		int32_t				returns account number.
+ */
+int32_t storage_wear_account(const uint8_t *name)
+{
+	uint8_t accountName[STORAGE_WEAR_ACCOUNT_NAME_MAX_LEN + 1];
+	const uint8_t *separator = strchr(name, '/');
+	int32_t account = STORAGE_WEAR_ACCOUNT_OTHER;
+
+	snprintf(accountName, sizeof(accountName), "%s", name);
+
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	if (separator != NULL)
+	{
+		for (uint32_t i = 0; i < STORAGE_WEAR_AGGREGATE_DIRECTORIES; i++)
+		{
+			if ((strlen(aggregateDirectories[i]) == (uint32_t)(separator - name)) &&
+				(strncmp(aggregateDirectories[i], name, separator - name) == 0))
+			{
+				snprintf(accountName, sizeof(accountName), "%s/*", aggregateDirectories[i]);
+				break;
+			}
+		}
+	}
+
+	for (uint32_t i = 1; i < accountCount; i++)
+	{
+		if (strcmp(accounts[i].name, accountName) == 0)
+		{
+			account = i;
+			break;
+		}
+	}
+
+	if ((account == STORAGE_WEAR_ACCOUNT_OTHER) && (accountCount < STORAGE_WEAR_ACCOUNT_COUNT))
+	{
+		account = accountCount++;
+		strcpy(accounts[account].name, accountName);
+	}
+
+	k_mutex_unlock(&StorageWearMutex);
+
+	return account;
+}
+
+/**@brief 				Function to count all files of a directory in one account
+ *
+ * @details 			Used for directories with many short lived files like queue segments.
+ *
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_wear_aggregate_directory(const uint8_t *directory)
+{
+	int32_t rc = -ENOMEM;
+
+	if ((strlen(directory) + 2) > STORAGE_WEAR_ACCOUNT_NAME_MAX_LEN)
+	{
+		return -ERROR_FILE_LENGTH_NOT_SUPPORTED;
+	}
+
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	for (uint32_t i = 0; i < STORAGE_WEAR_AGGREGATE_DIRECTORIES; i++)
+	{
+		if ((aggregateDirectories[i][0] == 0) || (strcmp(aggregateDirectories[i], directory) == 0))
+		{
+			strcpy(aggregateDirectories[i], directory);
+			rc = 0;
+			break;
+		}
+	}
+
+	k_mutex_unlock(&StorageWearMutex);
+
+	return rc;
+}
+
+/**@brief 				Function to count a flash program
+ *
+ * @param[in]	 		area				Flash area.
+ * @param[in]	 		sector				Erase sector in the area.
+ * @param[in]	 		bytes				Number of bytes programmed.
+ * @param[in]	 		account				Account of the file operation.
+ * @param[out]   		None.
+ */
+void storage_wear_record_program(STORAGE_WEAR_AREA area, uint32_t sector, uint32_t bytes, int32_t account)
+{
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	bootProgramBytes[area][sectorSlot(area, sector)] += bytes;
+
+	account = validAccount(account);
+	accounts[account].programOps++;
+	accounts[account].programBytes += bytes;
+
+	k_mutex_unlock(&StorageWearMutex);
+}
+
+/**@brief 				Function to count a sector erase
+ *
+ * @param[in]	 		area				Flash area.
+ * @param[in]	 		sector				Erase sector in the area.
+ * @param[in]	 		account				Account of the file operation.
+ * @param[out]   		None.
+ */
+void storage_wear_record_erase(STORAGE_WEAR_AREA area, uint32_t sector, int32_t account)
+{
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	bootEraseCount[area][sectorSlot(area, sector)]++;
+	totalEraseOps++;
+
+	account = validAccount(account);
+	accounts[account].eraseOps++;
+
+	k_mutex_unlock(&StorageWearMutex);
+}
+
+/**@brief 				Function to get the wear of the sectors of an area
+ *
+ * @param[in]	 		area				Flash area.
+ * @param[in]	 		sectors				Sectors to fill.
+ * @param[in]	 		max_sectors			Size of sectors.
+ * @param[out]   		int32_t				returns number of sectors filled or negative ERROR code incase of an error.
+ */
+int32_t storage_wear_get_sectors(STORAGE_WEAR_AREA area, STORAGE_WEAR_SECTOR_STRUCT *sectors, uint32_t max_sectors)
+{
+	uint32_t count;
+
+	if (area >= STORAGE_WEAR_AREA_COUNT)
+	{
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	count = MIN(sectorCount[area], max_sectors);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sectors[i].eraseCount = baseEraseCount[area][i] + bootEraseCount[area][i];
+		sectors[i].bootEraseCount = bootEraseCount[area][i];
+		sectors[i].bootProgramBytes = bootProgramBytes[area][i];
+	}
+
+	k_mutex_unlock(&StorageWearMutex);
+
+	return count;
+}
+
+/**@brief 				Function to get the accounts
+ *
+ * @param[in]	 		accountList			Accounts to fill.
+ * @param[in]	 		max_accounts		Size of accountList.
+ * @param[out]   		int32_t				returns number of accounts filled.
+ */
+int32_t storage_wear_get_accounts(STORAGE_WEAR_ACCOUNT_STRUCT *accountList, uint32_t max_accounts)
+{
+	uint32_t count;
+
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	count = MIN(accountCount, max_accounts);
+	memcpy(accountList, accounts, count * sizeof(accounts[0]));
+
+	k_mutex_unlock(&StorageWearMutex);
+
+	return count;
+}
+
+/**@brief 				Function to get the wear summary
+ *
+ * @param[in]	 		summary				Summary to fill.
+ * @param[out]   		None.
+ */
+void storage_wear_get_summary(STORAGE_WEAR_SUMMARY_STRUCT *summary)
+{
+	uint32_t eraseCount;
+
+	memset(summary, 0, sizeof(*summary));
+
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	for (uint32_t area = 0; area < STORAGE_WEAR_AREA_COUNT; area++)
+	{
+		for (uint32_t i = 0; i < sectorCount[area]; i++)
+		{
+			eraseCount = baseEraseCount[area][i] + bootEraseCount[area][i];
+			if (eraseCount > summary->maxEraseCount)
+			{
+				summary->maxEraseCount = eraseCount;
+				summary->maxEraseSector = i;
+				summary->maxEraseArea = area;
+			}
+
+			summary->totalEraseCount += eraseCount;
+			summary->bootEraseOps += bootEraseCount[area][i];
+			summary->bootProgramBytes += bootProgramBytes[area][i];
+		}
+	}
+
+	k_mutex_unlock(&StorageWearMutex);
+}
+
+/**@brief 				Function to load the lifetime erase counters from flash
+ *
+ * @details 			Only the first call after boot reads the counters file.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_wear_load(void)
+{
+	STORAGE_WEAR_FILE_HEADER_STRUCT header;
+	const uint8_t *counters = &wearFileBuffer[sizeof(header)];
+	uint32_t expectedSize = sizeof(header);
+	int32_t rc;
+
+	k_mutex_lock(&StorageWearFileMutex, K_FOREVER);
+
+	if (isWearLoaded)
+	{
+		k_mutex_unlock(&StorageWearFileMutex);
+		return 0;
+	}
+
+	rc = read_file(STORAGE_WEAR_FILE_NAME, wearFileBuffer, sizeof(wearFileBuffer), STORAGE_WEAR_DIRECTORY);
+
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	if (rc >= (int32_t)sizeof(header))
+	{
+		memcpy(&header, wearFileBuffer, sizeof(header));
+		for (uint32_t area = 0; area < STORAGE_WEAR_AREA_COUNT; area++)
+		{
+			expectedSize += MIN(header.sectorCount[area], STORAGE_WEAR_MAX_SECTORS) * sizeof(uint32_t);
+		}
+
+		if ((header.magic == STORAGE_WEAR_FILE_MAGIC) && (rc == (int32_t)expectedSize))
+		{
+			for (uint32_t area = 0; area < STORAGE_WEAR_AREA_COUNT; area++)
+			{
+				uint32_t count = MIN(header.sectorCount[area], STORAGE_WEAR_MAX_SECTORS);
+
+				memcpy(baseEraseCount[area], counters, count * sizeof(uint32_t));
+				counters += count * sizeof(uint32_t);
+				sectorCount[area] = MAX(sectorCount[area], count);
+			}
+			rc = 0;
+		}
+		else
+		{
+			rc = -EILSEQ;
+		}
+	}
+	else if (rc >= 0)
+	{
+		rc = -EILSEQ;
+	}
+
+	if (rc == -ENOENT)
+	{
+		/* First boot with wear counters */
+		rc = 0;
+	}
+
+	/* Counters file is replaced by the next save if it could not be read */
+	isWearLoaded = (rc >= 0) || (rc == -EILSEQ);
+
+	k_mutex_unlock(&StorageWearMutex);
+	k_mutex_unlock(&StorageWearFileMutex);
+
+	return rc;
+}
+
+/**@brief 				Function to save the lifetime erase counters to flash
+ *
+ * @details 			Nothing is written if no sector was erased since the last save. Stored counters are
+ * 						loaded first if the load at boot failed. Nothing is written until they could be read,
+ * 						the counts of this boot alone would replace the lifetime counts.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_wear_save(void)
+{
+	STORAGE_WEAR_FILE_HEADER_STRUCT header = {.magic = STORAGE_WEAR_FILE_MAGIC};
+	uint32_t size = sizeof(header);
+	uint32_t eraseOps;
+	uint32_t counter;
+	int32_t rc;
+
+	rc = storage_wear_load();
+
+	k_mutex_lock(&StorageWearFileMutex, K_FOREVER);
+
+	if (!isWearLoaded)
+	{
+		k_mutex_unlock(&StorageWearFileMutex);
+		printk("Storage wear: counters not saved, stored counters not loaded: %d\n", rc);
+		return rc;
+	}
+
+	k_mutex_lock(&StorageWearMutex, K_FOREVER);
+
+	eraseOps = totalEraseOps;
+	if (eraseOps == savedEraseOps)
+	{
+		k_mutex_unlock(&StorageWearMutex);
+		k_mutex_unlock(&StorageWearFileMutex);
+		return 0;
+	}
+
+	for (uint32_t area = 0; area < STORAGE_WEAR_AREA_COUNT; area++)
+	{
+		header.sectorCount[area] = sectorCount[area];
+		for (uint32_t i = 0; i < sectorCount[area]; i++)
+		{
+			counter = baseEraseCount[area][i] + bootEraseCount[area][i];
+			memcpy(&wearFileBuffer[size], &counter, sizeof(counter));
+			size += sizeof(counter);
+		}
+	}
+	memcpy(wearFileBuffer, &header, sizeof(header));
+
+	k_mutex_unlock(&StorageWearMutex);
+
+	/* Flash operations of the write report back to the wear counters */
+	rc = write_file(STORAGE_WEAR_FILE_NAME, wearFileBuffer, size, STORAGE_WEAR_DIRECTORY);
+	if (rc == (int32_t)size)
+	{
+		savedEraseOps = eraseOps;
+		rc = 0;
+	}
+	else if (rc >= 0)
+	{
+		rc = -EIO;
+	}
+
+	k_mutex_unlock(&StorageWearFileMutex);
+
+	return rc;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file storage_wear.h
+ * @brief Flash wear instrumentation.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+
+#ifndef StorageWear_h
+#define StorageWear_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Directory and file of the lifetime erase counters */
+#define STORAGE_WEAR_DIRECTORY              "wr"
+#define STORAGE_WEAR_FILE_NAME              "erase"
+
+/* Instrumentation limits. Sectors past the limit are counted in the last sector */
+#define STORAGE_WEAR_MAX_SECTORS            64
+#define STORAGE_WEAR_ACCOUNT_COUNT          12
+#define STORAGE_WEAR_ACCOUNT_NAME_MAX_LEN   24
+#define STORAGE_WEAR_AGGREGATE_DIRECTORIES  4
+
+/* Account of flash operations done outside of any file operation */
+#define STORAGE_WEAR_ACCOUNT_OTHER          0
+
+/* Flash areas with wear counters */
+typedef enum
+{
+	STORAGE_WEAR_AREA_LITTLEFS = 0,
+	STORAGE_WEAR_AREA_KV,
+	STORAGE_WEAR_AREA_COUNT,
+}STORAGE_WEAR_AREA;
+
+/* Wear of one erase sector */
+typedef struct
+{
+	uint32_t eraseCount;			/* Lifetime erases */
+	uint32_t bootEraseCount;		/* Erases since boot */
+	uint32_t bootProgramBytes;		/* Bytes programmed since boot */
+}STORAGE_WEAR_SECTOR_STRUCT;
+
+/* Flash operations caused by one file or directory since boot */
+typedef struct
+{
+	uint8_t name[STORAGE_WEAR_ACCOUNT_NAME_MAX_LEN + 1];
+	uint32_t programOps;
+	uint32_t programBytes;
+	uint32_t eraseOps;
+}STORAGE_WEAR_ACCOUNT_STRUCT;
+
+/* Wear summary over all areas */
+typedef struct
+{
+	uint32_t maxEraseCount;
+	uint32_t maxEraseSector;
+	uint8_t maxEraseArea;
+	uint32_t totalEraseCount;
+	uint32_t bootEraseOps;
+	uint32_t bootProgramBytes;
+}STORAGE_WEAR_SUMMARY_STRUCT;
+
+/**@brief 				Function to get the account of a file
+ *
+ * @details 			Files of an aggregated directory share the directory account. Files which do not
+ * 						fit in the account table are counted in STORAGE_WEAR_ACCOUNT_OTHER.
+ *
+ * @param[in]	 		name				"<directory>/<filename>".
+ * @param[out]   		int32_t				returns account number.
+ */
+int32_t storage_wear_account(const uint8_t *name);
+
+/**@brief 				Function to count all files of a directory in one account
+ *
+ * @details 			Used for directories with many short lived files like queue segments.
+ *
+ * @param[in]	 		directory			Directory name.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_wear_aggregate_directory(const uint8_t *directory);
+
+/**@brief 				Function to count a flash program
+ *
+ * @param[in]	 		area				Flash area.
+ * @param[in]	 		sector				Erase sector in the area.
+ * @param[in]	 		bytes				Number of bytes programmed.
+ * @param[in]	 		account				Account of the file operation.
+ * @param[out]   		None.
+ */
+void storage_wear_record_program(STORAGE_WEAR_AREA area, uint32_t sector, uint32_t bytes, int32_t account);
+
+/**@brief 				Function to count a sector erase
+ *
+ * @param[in]	 		area				Flash area.
+ * @param[in]	 		sector				Erase sector in the area.
+ * @param[in]	 		account				Account of the file operation.
+ * @param[out]   		None.
+ */
+void storage_wear_record_erase(STORAGE_WEAR_AREA area, uint32_t sector, int32_t account);
+
+/**@brief 				Function to get the wear of the sectors of an area
+ *
+ * @param[in]	 		area				Flash area.
+ * @param[in]	 		sectors				Sectors to fill.
+ * @param[in]	 		max_sectors			Size of sectors.
+ * @param[out]   		int32_t				returns number of sectors filled or negative ERROR code incase of an error.
+ */
+int32_t storage_wear_get_sectors(STORAGE_WEAR_AREA area, STORAGE_WEAR_SECTOR_STRUCT *sectors, uint32_t max_sectors);
+
+/**@brief 				Function to get the accounts
+ *
+ * @param[in]	 		accountList			Accounts to fill.
+ * @param[in]	 		max_accounts		Size of accountList.
+ * @param[out]   		int32_t				returns number of accounts filled.
+ */
+int32_t storage_wear_get_accounts(STORAGE_WEAR_ACCOUNT_STRUCT *accountList, uint32_t max_accounts);
+
+/**@brief 				Function to get the wear summary
+ *
+ * @param[in]	 		summary				Summary to fill.
+ * @param[out]   		None.
+ */
+void storage_wear_get_summary(STORAGE_WEAR_SUMMARY_STRUCT *summary);
+
+/**@brief 				Function to load the lifetime erase counters from flash
+ *
+ * @details 			Only the first call after boot reads the counters file.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_wear_load(void);
+
+/**@brief 				Function to save the lifetime erase counters to flash
+ *
+ * @details 			Nothing is written if no sector was erased since the last save.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t storage_wear_save(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
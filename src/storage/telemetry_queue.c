@@ -0,0 +1,897 @@
+/**
+ * @file telemetry_queue.c
+ * @brief Flash backed store-and-forward telemetry queue.
+ *
+ * @details Records are appended to segment files in TELEMETRY_QUEUE_DIRECTORY. Segment file
+ * name is the hex sequence number of its first record. A segment starts with a header holding
+ * the field names, followed by samples compressed with ts_codec. Every sample is encoded
+ * relative to the previous sample of the segment and carries a CRC so a sample torn by a
+ * power loss is detected and dropped on init. Samples are decoded to a JSON values object
+ * when read. Segments written before compression hold JSON records and are still read.
+ * Last delivered sequence number is kept in the ack file.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/crc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "storage.h"
+#include "telemetry_queue.h"
+#include "storage_wear.h"
+
+#define TELEMETRY_QUEUE_ACK_FILE_NAME       "ack"
+#define TELEMETRY_QUEUE_RECORD_MAGIC        0x5451
+#define TELEMETRY_QUEUE_SEGMENT_MAGIC       0x5443
+#define TELEMETRY_QUEUE_SEGMENT_NAME_LEN    8
+
+/* Longest decoded value, "%.15g" of a double */
+#define TELEMETRY_QUEUE_VALUE_TEXT_LEN      22
+
+/* Record header of segments written before compression. JSON values follow the header */
+typedef struct __packed
+{
+	uint16_t magic;
+	uint16_t length;
+	uint32_t seq;
+	int64_t timestamp;
+	uint16_t crc;
+}TELEMETRY_RECORD_HEADER_STRUCT;
+
+/* Segment header. Field names follow the header, each one NUL terminated */
+typedef struct __packed
+{
+	uint16_t magic;
+	uint8_t fieldCount;
+	uint8_t namesLength;
+	uint16_t crc;
+}TELEMETRY_SEGMENT_HEADER_STRUCT;
+
+/* Sample header. ts_codec encoded sample follows the header */
+typedef struct __packed
+{
+	uint8_t length;
+	uint8_t crc;
+}TELEMETRY_SAMPLE_HEADER_STRUCT;
+
+/* Field names and codec state after the last sample of a segment */
+typedef struct
+{
+	TS_CODEC_STRUCT codec;
+	uint8_t fieldCount;
+	uint8_t namesLength;
+	uint8_t names[TELEMETRY_QUEUE_FIELD_NAMES_LEN];
+}TELEMETRY_SEGMENT_STATE_STRUCT;
+
+/* Queue Mutex to synchronize */
+K_MUTEX_DEFINE(TelemetryQueueMutex);
+
+/* First sequence number of every segment, oldest first */
+static uint32_t segmentFirstSeq[TELEMETRY_QUEUE_MAX_SEGMENTS];
+static uint32_t segmentCount = 0;
+
+/* Bytes used in the newest segment */
+static uint32_t tailSegmentSize = 0;
+
+static uint32_t nextSeq = 1;
+static uint32_t ackedSeq = 0;
+static uint32_t droppedRecords = 0;
+
+/* Buffer for segment read */
+static uint8_t segmentBuffer[TELEMETRY_QUEUE_SEGMENT_SIZE];
+
+/* Newest segment state to continue the encoding and state of the segment being read */
+static TELEMETRY_SEGMENT_STATE_STRUCT tailState;
+static TELEMETRY_SEGMENT_STATE_STRUCT walkState;
+
+/* Decoded values handed to the peek callback */
+static uint8_t valuesBuffer[TELEMETRY_QUEUE_MAX_VALUES_LEN + 1];
+
+/**@brief 				Function to calculate record CRC
+ *
+ * @param[in]	 		header				Record header.
+ * @param[in]	 		values				Record values.
+ * @param[out]   		uint16_t			returns CRC of header fields and values.
+ */
+static uint16_t recordCrc(const TELEMETRY_RECORD_HEADER_STRUCT *header, const uint8_t *values)
+{
+	uint16_t crc = crc16_ccitt(0xFFFF, (const uint8_t *)header, offsetof(TELEMETRY_RECORD_HEADER_STRUCT, crc));
+
+	return crc16_ccitt(crc, values, header->length);
+}
+
+/**@brief 				Function to calculate segment header CRC
+ *
+ * @param[in]	 		header				Segment header.
+ * @param[in]	 		names				Field names.
+ * @param[out]   		uint16_t			returns CRC of header fields and names.
+ */
+static uint16_t segmentHeaderCrc(const TELEMETRY_SEGMENT_HEADER_STRUCT *header, const uint8_t *names)
+{
+	uint16_t crc = crc16_ccitt(0xFFFF, (const uint8_t *)header, offsetof(TELEMETRY_SEGMENT_HEADER_STRUCT, crc));
+
+	return crc16_ccitt(crc, names, header->namesLength);
+}
+
+/**@brief 				Function to calculate sample CRC
+ *
+ * @param[in]	 		header				Sample header.
+ * @param[in]	 		data				Encoded sample.
+ * @param[out]   		uint8_t				returns CRC of sample length and data.
+ */
+static uint8_t sampleCrc(const TELEMETRY_SAMPLE_HEADER_STRUCT *header, const uint8_t *data)
+{
+	uint8_t crc = crc8_ccitt(0xFF, &header->length, sizeof(header->length));
+
+	return crc8_ccitt(crc, data, header->length);
+}
+
+/**@brief 				Function to check field names
+ *
+ * @param[in]	 		names				Field names, each one NUL terminated.
+ * @param[in]	 		length				Number of bytes in names.
+ * @param[out]   		uint32_t			returns number of names.
+ */
+static uint32_t countFieldNames(const uint8_t *names, uint32_t length)
+{
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		if (names[i] == 0)
+		{
+			count++;
+		}
+	}
+
+	/* Trailing bytes without NUL are not a name */
+	return ((length > 0) && (names[length - 1] == 0)) ? count : 0;
+}
+
+/**@brief 				Function to format decoded values as JSON object in values buffer
+ *
+ * @param[in]	 		state				Segment state with the field names.
+ * @param[in]	 		values				Decoded values.
+ * @param[out]   		int32_t				returns length of the JSON object or negative ERROR code incase of an error.
+ */
+static int32_t formatValues(const TELEMETRY_SEGMENT_STATE_STRUCT *state, const double *values)
+{
+	const uint8_t *name = state->names;
+	int32_t length = 0;
+	int32_t len;
+
+	valuesBuffer[length++] = '{';
+
+	for (uint8_t i = 0; i < state->fieldCount; i++)
+	{
+		/* Keep one byte for the closing brace */
+		len = snprintf(&valuesBuffer[length], sizeof(valuesBuffer) - length - 1, "%s\"%s\":%.15g",
+						(i > 0) ? "," : "", name, values[i]);
+		if ((len < 0) || (len >= (int32_t)(sizeof(valuesBuffer) - length - 1)))
+		{
+			return -ERROR_TELEMETRY_QUEUE_RECORD_TOO_LARGE;
+		}
+
+		length += len;
+		name += strlen(name) + 1;
+	}
+
+	valuesBuffer[length++] = '}';
+	valuesBuffer[length] = 0;
+
+	return length;
+}
+
+/**@brief 				Function to make segment file name
+ *
+ * @param[in]	 		firstSeq			Sequence number of first record in segment.
+ * @param[in]	 		name				Buffer for the name. Must be TELEMETRY_QUEUE_SEGMENT_NAME_LEN + 1 bytes.
+ * @param[out]   		None.
+ */
+static void segmentName(uint32_t firstSeq, uint8_t *name)
+{
+	snprintf(name, TELEMETRY_QUEUE_SEGMENT_NAME_LEN + 1, "%08x", firstSeq);
+}
+
+/**@brief 				Function to read a segment in segment buffer
+ *
+ * @param[in]	 		firstSeq			Sequence number of first record in segment.
+ * @param[out]   		int32_t				returns number of bytes read or negative ERROR code incase of an error.
+ */
+static int32_t readSegment(uint32_t firstSeq)
+{
+	uint8_t name[TELEMETRY_QUEUE_SEGMENT_NAME_LEN + 1];
+
+	segmentName(firstSeq, name);
+
+	return read_file(name, segmentBuffer, sizeof(segmentBuffer), TELEMETRY_QUEUE_DIRECTORY);
+}
+
+/**@brief 				Function to remove the oldest segment
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t removeOldestSegment(void)
+{
+	uint8_t name[TELEMETRY_QUEUE_SEGMENT_NAME_LEN + 1];
+	int32_t rc;
+
+	segmentName(segmentFirstSeq[0], name);
+	rc = eraseFile(name, TELEMETRY_QUEUE_DIRECTORY);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	memmove(&segmentFirstSeq[0], &segmentFirstSeq[1], (segmentCount - 1) * sizeof(segmentFirstSeq[0]));
+	segmentCount--;
+
+	if (segmentCount == 0)
+	{
+		tailSegmentSize = 0;
+	}
+
+	return 0;
+}
+
+/**@brief 				Function to walk the JSON records in segment buffer
+ *
+ * @details 			Used for segments written before compression. Stop at the first record with a broken header or CRC.
+ *
+ * @param[in]	 		size				Number of valid bytes in segment buffer.
+ * @param[in]	 		callback			Record callback. NULL to only validate.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[in]	 		lastSeq				Filled with sequence number of the last valid record.
+ * @param[in]	 		accepted			Incremented for every record accepted by callback.
+ * @param[in]	 		stopped				Set when callback stopped the walk. May be NULL when callback is NULL.
+ * @param[out]   		int32_t				returns number of valid bytes walked or negative ERROR code from callback.
+ */
+static int32_t walkRecordSegment(int32_t size, telemetry_queue_record_cb callback, void *ctx, uint32_t *lastSeq, int32_t *accepted, bool *stopped)
+{
+	TELEMETRY_RECORD_HEADER_STRUCT header;
+	TELEMETRY_RECORD_STRUCT record;
+	int32_t offset = 0;
+	int32_t rc;
+
+	while ((offset + (int32_t)sizeof(header)) <= size)
+	{
+		memcpy(&header, &segmentBuffer[offset], sizeof(header));
+
+		if ((header.magic != TELEMETRY_QUEUE_RECORD_MAGIC) ||
+			(header.length > TELEMETRY_QUEUE_MAX_VALUES_LEN) ||
+			((offset + (int32_t)sizeof(header) + header.length) > size) ||
+			(recordCrc(&header, &segmentBuffer[offset + sizeof(header)]) != header.crc))
+		{
+			break;
+		}
+
+		if ((callback != NULL) && (header.seq > ackedSeq))
+		{
+			record.seq = header.seq;
+			record.timestamp = header.timestamp;
+			record.length = header.length;
+			record.values = &segmentBuffer[offset + sizeof(header)];
+
+			rc = callback(&record, ctx);
+			if (rc < 0)
+			{
+				return rc;
+			}
+			else if (rc > 0)
+			{
+				*stopped = true;
+				break;
+			}
+			(*accepted)++;
+		}
+
+		*lastSeq = header.seq;
+		offset += sizeof(header) + header.length;
+	}
+
+	return offset;
+}
+
+/**@brief 				Function to walk the compressed samples in segment buffer
+ *
+ * @details 			Stop at the first sample with a broken header, CRC or encoding. walkState holds
+ * 						the field names and the codec state after the last valid sample.
+ *
+ * @param[in]	 		firstSeq			Sequence number of first record in segment.
+ * @param[in]	 		size				Number of valid bytes in segment buffer.
+ * @param[in]	 		callback			Record callback. NULL to only validate.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[in]	 		lastSeq				Filled with sequence number of the last valid record.
+ * @param[in]	 		accepted			Incremented for every record accepted by callback.
+ * @param[in]	 		stopped				Set when callback stopped the walk. May be NULL when callback is NULL.
+ * @param[out]   		int32_t				returns number of valid bytes walked or negative ERROR code from callback.
+ */
+static int32_t walkSampleSegment(uint32_t firstSeq, int32_t size, telemetry_queue_record_cb callback, void *ctx, uint32_t *lastSeq, int32_t *accepted, bool *stopped)
+{
+	TELEMETRY_SEGMENT_HEADER_STRUCT header;
+	TELEMETRY_SAMPLE_HEADER_STRUCT sample;
+	TELEMETRY_RECORD_STRUCT record;
+	TS_CODEC_STRUCT codec;
+	double values[TELEMETRY_QUEUE_MAX_FIELDS];
+	uint32_t seq = firstSeq;
+	int32_t offset;
+	int32_t rc;
+
+	walkState.fieldCount = 0;
+	walkState.namesLength = 0;
+
+	if (size < (int32_t)sizeof(header))
+	{
+		return 0;
+	}
+
+	memcpy(&header, segmentBuffer, sizeof(header));
+	if ((header.magic != TELEMETRY_QUEUE_SEGMENT_MAGIC) ||
+		(header.namesLength > sizeof(walkState.names)) ||
+		((int32_t)(sizeof(header) + header.namesLength) > size) ||
+		(segmentHeaderCrc(&header, &segmentBuffer[sizeof(header)]) != header.crc) ||
+		(countFieldNames(&segmentBuffer[sizeof(header)], header.namesLength) != header.fieldCount) ||
+		(ts_codec_init(&walkState.codec, header.fieldCount) < 0))
+	{
+		return 0;
+	}
+
+	walkState.fieldCount = header.fieldCount;
+	walkState.namesLength = header.namesLength;
+	memcpy(walkState.names, &segmentBuffer[sizeof(header)], header.namesLength);
+	offset = sizeof(header) + header.namesLength;
+
+	while ((offset + (int32_t)sizeof(sample)) <= size)
+	{
+		const uint8_t *data = &segmentBuffer[offset + sizeof(sample)];
+
+		memcpy(&sample, &segmentBuffer[offset], sizeof(sample));
+
+		if (((offset + (int32_t)sizeof(sample) + sample.length) > size) ||
+			(sampleCrc(&sample, data) != sample.crc))
+		{
+			break;
+		}
+
+		/* Codec state only moves past fully decoded samples */
+		codec = walkState.codec;
+		if (ts_codec_decode(&codec, data, sample.length, &record.timestamp, values) != sample.length)
+		{
+			break;
+		}
+		walkState.codec = codec;
+
+		if ((callback != NULL) && (seq > ackedSeq))
+		{
+			rc = formatValues(&walkState, values);
+			if (rc < 0)
+			{
+				return rc;
+			}
+
+			record.seq = seq;
+			record.length = rc;
+			record.values = valuesBuffer;
+
+			rc = callback(&record, ctx);
+			if (rc < 0)
+			{
+				return rc;
+			}
+			else if (rc > 0)
+			{
+				*stopped = true;
+				break;
+			}
+			(*accepted)++;
+		}
+
+		*lastSeq = seq++;
+		offset += sizeof(sample) + sample.length;
+	}
+
+	return offset;
+}
+
+/**@brief 				Function to walk the records in segment buffer
+ *
+ * @details 			Segment format is selected by the first bytes of the segment.
+ *
+ * @param[in]	 		firstSeq			Sequence number of first record in segment.
+ * @param[in]	 		size				Number of valid bytes in segment buffer.
+ * @param[in]	 		callback			Record callback. NULL to only validate.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[in]	 		lastSeq				Filled with sequence number of the last valid record.
+ * @param[in]	 		accepted			Incremented for every record accepted by callback.
+ * @param[in]	 		stopped				Set when callback stopped the walk. May be NULL when callback is NULL.
+ * @param[out]   		int32_t				returns number of valid bytes walked or negative ERROR code from callback.
+ */
+static int32_t walkSegment(uint32_t firstSeq, int32_t size, telemetry_queue_record_cb callback, void *ctx, uint32_t *lastSeq, int32_t *accepted, bool *stopped)
+{
+	uint16_t magic = 0;
+
+	if (size >= (int32_t)sizeof(magic))
+	{
+		memcpy(&magic, segmentBuffer, sizeof(magic));
+	}
+
+	if (magic == TELEMETRY_QUEUE_RECORD_MAGIC)
+	{
+		/* Not continued by push */
+		walkState.fieldCount = 0;
+		walkState.namesLength = 0;
+
+		return walkRecordSegment(size, callback, ctx, lastSeq, accepted, stopped);
+	}
+
+	return walkSampleSegment(firstSeq, size, callback, ctx, lastSeq, accepted, stopped);
+}
+
+/**@brief 				Function to load segment list from flash
+ *
+ * @details 			Segment names are read from the queue directory and sorted oldest first.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+static int32_t loadSegmentList(void)
+{
+	STORAGE_DIR_CURSOR_STRUCT cursor;
+	STORAGE_DIR_ENTRY_STRUCT entries[STORAGE_LIST_PAGE_ENTRIES];
+	uint32_t firstSeq;
+	char *end;
+	int32_t rc;
+
+	segmentCount = 0;
+
+	rc = storage_dir_cursor_init(&cursor, TELEMETRY_QUEUE_DIRECTORY);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	while ((rc = storage_dir_read_page(&cursor, entries, ARRAY_SIZE(entries))) > 0)
+	{
+		for (int32_t i = 0; i < rc; i++)
+		{
+			if (entries[i].isDirectory || (strlen(entries[i].name) != TELEMETRY_QUEUE_SEGMENT_NAME_LEN))
+			{
+				continue;
+			}
+
+			firstSeq = strtoul(entries[i].name, &end, 16);
+			if ((*end != 0) || (segmentCount == TELEMETRY_QUEUE_MAX_SEGMENTS))
+			{
+				continue;
+			}
+
+			/* Insert sorted */
+			uint32_t pos = segmentCount;
+			while ((pos > 0) && (segmentFirstSeq[pos - 1] > firstSeq))
+			{
+				segmentFirstSeq[pos] = segmentFirstSeq[pos - 1];
+				pos--;
+			}
+			segmentFirstSeq[pos] = firstSeq;
+			segmentCount++;
+		}
+	}
+
+	if (rc == -ENOENT)
+	{
+		/* Nothing queued yet */
+		rc = 0;
+	}
+
+	return rc;
+}
+
+/**@brief 				Function to initialize the telemetry queue
+ *
+ * @details 			Recover queue state from flash. Records with a broken tail are dropped.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t telemetry_queue_init(void)
+{
+	int32_t rc;
+	int32_t size;
+	int32_t validSize;
+	int32_t accepted = 0;
+	uint32_t lastSeq = 0;
+
+	k_mutex_lock(&TelemetryQueueMutex, K_FOREVER);
+
+	ackedSeq = 0;
+	droppedRecords = 0;
+	tailSegmentSize = 0;
+
+	/*Segment files come and go, count their wear in one account*/
+	(void)storage_wear_aggregate_directory(TELEMETRY_QUEUE_DIRECTORY);
+
+	rc = read_file(TELEMETRY_QUEUE_ACK_FILE_NAME, (uint8_t *)&ackedSeq, sizeof(ackedSeq), TELEMETRY_QUEUE_DIRECTORY);
+	if (rc != sizeof(ackedSeq))
+	{
+		ackedSeq = 0;
+	}
+
+	rc = loadSegmentList();
+	if (rc < 0)
+	{
+		printk("Telemetry queue: failed to list segments: %d\n", rc);
+		k_mutex_unlock(&TelemetryQueueMutex);
+		return rc;
+	}
+
+	nextSeq = ackedSeq + 1;
+
+	if (segmentCount > 0)
+	{
+		/* Records older than the oldest segment were evicted */
+		if (ackedSeq < (segmentFirstSeq[0] - 1))
+		{
+			ackedSeq = segmentFirstSeq[0] - 1;
+		}
+
+		/* Find next sequence number and drop a torn record at the end of the newest segment */
+		lastSeq = segmentFirstSeq[segmentCount - 1] - 1;
+		size = readSegment(segmentFirstSeq[segmentCount - 1]);
+		if (size < 0)
+		{
+			size = 0;
+		}
+
+		validSize = walkSegment(segmentFirstSeq[segmentCount - 1], size, NULL, NULL, &lastSeq, &accepted, NULL);
+		if (validSize < size)
+		{
+			uint8_t name[TELEMETRY_QUEUE_SEGMENT_NAME_LEN + 1];
+
+			printk("Telemetry queue: dropping %d torn bytes\n", size - validSize);
+			segmentName(segmentFirstSeq[segmentCount - 1], name);
+			write_file(name, segmentBuffer, validSize, TELEMETRY_QUEUE_DIRECTORY);
+		}
+
+		tailSegmentSize = validSize;
+		tailState = walkState;
+		nextSeq = MAX(lastSeq + 1, ackedSeq + 1);
+
+		/* Remove segments which are already delivered */
+		while ((segmentCount > 1) && ((segmentFirstSeq[1] - 1) <= ackedSeq))
+		{
+			removeOldestSegment();
+		}
+	}
+
+	printk("Telemetry queue: %u segments, %u records queued\n", segmentCount, nextSeq - 1 - ackedSeq);
+
+	k_mutex_unlock(&TelemetryQueueMutex);
+
+	return 0;
+}
+
+/**@brief 				Function to build a sample record in the record buffer
+ *
+ * @param[in]	 		buffer				Record buffer.
+ * @param[in]	 		names				Field names for the segment header. NULL to continue the segment.
+ * @param[in]	 		namesLength			Number of bytes in names.
+ * @param[in]	 		codec				Codec state. Updated with the sample.
+ * @param[in]	 		timestamp			Sample time.
+ * @param[in]	 		values				Sample values.
+ * @param[out]   		int32_t				returns record size or negative ERROR code incase of an error.
+ */
+static int32_t buildSampleRecord(uint8_t *buffer, const uint8_t *names, uint8_t namesLength, TS_CODEC_STRUCT *codec,
+								int64_t timestamp, const double *values)
+{
+	TELEMETRY_SEGMENT_HEADER_STRUCT header;
+	TELEMETRY_SAMPLE_HEADER_STRUCT sample;
+	uint32_t size = 0;
+	int32_t rc;
+
+	if (names != NULL)
+	{
+		header.magic = TELEMETRY_QUEUE_SEGMENT_MAGIC;
+		header.fieldCount = codec->fieldCount;
+		header.namesLength = namesLength;
+		header.crc = segmentHeaderCrc(&header, names);
+
+		memcpy(buffer, &header, sizeof(header));
+		memcpy(&buffer[sizeof(header)], names, namesLength);
+		size = sizeof(header) + namesLength;
+	}
+
+	rc = ts_codec_encode(codec, timestamp, values, &buffer[size + sizeof(sample)], TS_CODEC_MAX_SAMPLE_SIZE);
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	sample.length = rc;
+	sample.crc = sampleCrc(&sample, &buffer[size + sizeof(sample)]);
+	memcpy(&buffer[size], &sample, sizeof(sample));
+
+	return size + sizeof(sample) + sample.length;
+}
+
+/**@brief 				Function to push a telemetry sample in the queue
+ *
+ * @details 			Append a record with next sequence number. Oldest segment is evicted if queue is full.
+ * 						Samples are stored compressed with ts_codec. A change of the field names starts a
+ * 						new segment.
+ *
+ * @param[in]	 		timestamp			Sample time in unix milliseconds. 0 if unknown.
+ * @param[in]	 		fields				Telemetry values.
+ * @param[in]	 		count				Number of fields. Max TELEMETRY_QUEUE_MAX_FIELDS.
+ * @param[out]   		int32_t				returns sequence number of the record or negative ERROR code incase of an error.
+ */
+int32_t telemetry_queue_push(int64_t timestamp, const TELEMETRY_FIELD_STRUCT *fields, uint8_t count)
+{
+	static uint8_t recordBuffer[sizeof(TELEMETRY_SEGMENT_HEADER_STRUCT) + TELEMETRY_QUEUE_FIELD_NAMES_LEN +
+								sizeof(TELEMETRY_SAMPLE_HEADER_STRUCT) + TS_CODEC_MAX_SAMPLE_SIZE];
+	uint8_t names[TELEMETRY_QUEUE_FIELD_NAMES_LEN];
+	uint8_t name[TELEMETRY_QUEUE_SEGMENT_NAME_LEN + 1];
+	double values[TELEMETRY_QUEUE_MAX_FIELDS];
+	uint32_t namesLength = 0;
+	uint32_t valuesLength = 2;
+	uint32_t previousTailSize;
+	TS_CODEC_STRUCT codec;
+	bool newSegment;
+	bool withHeader;
+	int32_t recordSize = 0;
+	int32_t rc;
+
+	if ((count == 0) || (count > TELEMETRY_QUEUE_MAX_FIELDS))
+	{
+		return -EINVAL;
+	}
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		uint32_t nameLength = strlen(fields[i].name);
+
+		if (!isfinite(fields[i].value))
+		{
+			return -EINVAL;
+		}
+
+		if ((namesLength + nameLength + 1) > sizeof(names))
+		{
+			return -ERROR_TELEMETRY_QUEUE_RECORD_TOO_LARGE;
+		}
+
+		memcpy(&names[namesLength], fields[i].name, nameLength + 1);
+		namesLength += nameLength + 1;
+		values[i] = fields[i].value;
+
+		/* Decoded as ,"name":value */
+		valuesLength += nameLength + 4 + TELEMETRY_QUEUE_VALUE_TEXT_LEN;
+	}
+
+	if (valuesLength > TELEMETRY_QUEUE_MAX_VALUES_LEN)
+	{
+		return -ERROR_TELEMETRY_QUEUE_RECORD_TOO_LARGE;
+	}
+
+	k_mutex_lock(&TelemetryQueueMutex, K_FOREVER);
+
+	/* Segment written with other field names or before compression is not continued */
+	newSegment = (segmentCount == 0) ||
+				((tailSegmentSize > 0) && ((tailState.fieldCount != count) || (tailState.namesLength != namesLength) ||
+				(memcmp(tailState.names, names, namesLength) != 0)));
+	withHeader = newSegment || (tailSegmentSize == 0);
+
+	if (!withHeader)
+	{
+		codec = tailState.codec;
+		recordSize = buildSampleRecord(recordBuffer, NULL, 0, &codec, timestamp, values);
+
+		/* Start a new segment when the newest one is full */
+		if ((recordSize >= 0) && ((tailSegmentSize + recordSize) > TELEMETRY_QUEUE_SEGMENT_SIZE))
+		{
+			newSegment = true;
+			withHeader = true;
+		}
+	}
+
+	if (withHeader)
+	{
+		ts_codec_init(&codec, count);
+		recordSize = buildSampleRecord(recordBuffer, names, namesLength, &codec, timestamp, values);
+	}
+
+	if (recordSize < 0)
+	{
+		k_mutex_unlock(&TelemetryQueueMutex);
+		return recordSize;
+	}
+
+	previousTailSize = tailSegmentSize;
+
+	if (newSegment)
+	{
+		if (segmentCount == TELEMETRY_QUEUE_MAX_SEGMENTS)
+		{
+			/* Evict oldest segment. Undelivered records in it are lost */
+			uint32_t evictedLastSeq = segmentFirstSeq[1] - 1;
+
+			rc = removeOldestSegment();
+			if (rc < 0)
+			{
+				k_mutex_unlock(&TelemetryQueueMutex);
+				return rc;
+			}
+
+			if (ackedSeq < evictedLastSeq)
+			{
+				droppedRecords += evictedLastSeq - ackedSeq;
+				printk("Telemetry queue: evicted %u records\n", evictedLastSeq - ackedSeq);
+				ackedSeq = evictedLastSeq;
+			}
+		}
+
+		segmentFirstSeq[segmentCount++] = nextSeq;
+		tailSegmentSize = 0;
+	}
+
+	segmentName(segmentFirstSeq[segmentCount - 1], name);
+	rc = append_file(name, recordBuffer, recordSize, TELEMETRY_QUEUE_DIRECTORY);
+	if (rc == recordSize)
+	{
+		tailSegmentSize += recordSize;
+		tailState.codec = codec;
+		if (withHeader)
+		{
+			tailState.fieldCount = count;
+			tailState.namesLength = namesLength;
+			memcpy(tailState.names, names, namesLength);
+		}
+		rc = nextSeq++;
+	}
+	else if (rc >= 0)
+	{
+		rc = -ENOSPC;
+	}
+
+	if ((rc < 0) && newSegment)
+	{
+		/* Nothing landed in the new segment */
+		segmentCount--;
+		tailSegmentSize = previousTailSize;
+	}
+
+	k_mutex_unlock(&TelemetryQueueMutex);
+
+	return rc;
+}
+
+/**@brief 				Function to read queued records
+ *
+ * @details 			Call the callback for unacknowledged records, oldest first, until callback stops it.
+ *
+ * @param[in]	 		callback			Record callback.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[out]   		int32_t				returns number of records accepted by callback or negative ERROR code incase of an error.
+ */
+int32_t telemetry_queue_peek(telemetry_queue_record_cb callback, void *ctx)
+{
+	int32_t accepted = 0;
+	int32_t size;
+	int32_t rc = 0;
+	uint32_t lastSeq = 0;
+	bool stopped = false;
+
+	k_mutex_lock(&TelemetryQueueMutex, K_FOREVER);
+
+	for (uint32_t i = 0; (i < segmentCount) && !stopped; i++)
+	{
+		/* Skip segments which are fully delivered */
+		if ((i + 1 < segmentCount) && ((segmentFirstSeq[i + 1] - 1) <= ackedSeq))
+		{
+			continue;
+		}
+
+		size = readSegment(segmentFirstSeq[i]);
+		if (size < 0)
+		{
+			rc = size;
+			break;
+		}
+
+		rc = walkSegment(segmentFirstSeq[i], size, callback, ctx, &lastSeq, &accepted, &stopped);
+		if (rc < 0)
+		{
+			break;
+		}
+	}
+
+	k_mutex_unlock(&TelemetryQueueMutex);
+
+	return (rc < 0) ? rc : accepted;
+}
+
+/**@brief 				Function to acknowledge queued records
+ *
+ * @details 			Mark records up to the sequence number as delivered and remove drained segments.
+ *
+ * @param[in]	 		seq					Last delivered sequence number.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t telemetry_queue_ack(uint32_t seq)
+{
+	int32_t rc = 0;
+
+	k_mutex_lock(&TelemetryQueueMutex, K_FOREVER);
+
+	if (seq > (nextSeq - 1))
+	{
+		seq = nextSeq - 1;
+	}
+
+	if (seq > ackedSeq)
+	{
+		ackedSeq = seq;
+
+		/* Remove segments which are fully delivered */
+		while (segmentCount > 0)
+		{
+			uint32_t segmentLastSeq = (segmentCount > 1) ? (segmentFirstSeq[1] - 1) : (nextSeq - 1);
+
+			if (segmentLastSeq > ackedSeq)
+			{
+				break;
+			}
+
+			rc = removeOldestSegment();
+			if (rc < 0)
+			{
+				break;
+			}
+		}
+
+		rc = write_file(TELEMETRY_QUEUE_ACK_FILE_NAME, (uint8_t *)&ackedSeq, sizeof(ackedSeq), TELEMETRY_QUEUE_DIRECTORY);
+	}
+
+	k_mutex_unlock(&TelemetryQueueMutex);
+
+	return (rc < 0) ? rc : 0;
+}
+
+/**@brief 				Function to get number of queued records
+ *
+ * @param[in]	 		None.
+ * @param[out]   		uint32_t			returns number of unacknowledged records.
+ */
+uint32_t telemetry_queue_depth(void)
+{
+	uint32_t depth;
+
+	k_mutex_lock(&TelemetryQueueMutex, K_FOREVER);
+	depth = nextSeq - 1 - ackedSeq;
+	k_mutex_unlock(&TelemetryQueueMutex);
+
+	return depth;
+}
+
+/**@brief 				Function to get queue statistics
+ *
+ * @param[in]	 		stats				Statistics to fill.
+ * @param[out]   		None.
+ */
+void telemetry_queue_get_stats(TELEMETRY_QUEUE_STATS_STRUCT *stats)
+{
+	k_mutex_lock(&TelemetryQueueMutex, K_FOREVER);
+
+	stats->depth = nextSeq - 1 - ackedSeq;
+	stats->segments = segmentCount;
+	stats->oldestSeq = ackedSeq + 1;
+	stats->newestSeq = nextSeq - 1;
+	stats->dropped = droppedRecords;
+
+	k_mutex_unlock(&TelemetryQueueMutex);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file telemetry_queue.h
+ * @brief Flash backed store-and-forward telemetry queue.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+
+#ifndef TelemetryQueue_h
+#define TelemetryQueue_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "ts_codec.h"
+
+/* Directory for queue segments */
+#define TELEMETRY_QUEUE_DIRECTORY           "tq"
+
+/* Queue size limits. Oldest segment is evicted once all segments are full */
+#define TELEMETRY_QUEUE_SEGMENT_SIZE        2048
+#define TELEMETRY_QUEUE_MAX_SEGMENTS        8
+#define TELEMETRY_QUEUE_MAX_VALUES_LEN      128
+#define TELEMETRY_QUEUE_MAX_FIELDS          TS_CODEC_MAX_FIELDS
+#define TELEMETRY_QUEUE_FIELD_NAMES_LEN     48
+
+/*API ERROR Codes*/
+#define ERROR_TELEMETRY_QUEUE_RECORD_TOO_LARGE      4100
+
+/* Numeric telemetry value */
+typedef struct
+{
+	const char *name;
+	double value;
+}TELEMETRY_FIELD_STRUCT;
+
+/* Telemetry record handed to the peek callback. Values are a JSON object */
+typedef struct
+{
+	uint32_t seq;
+	int64_t timestamp;
+	uint16_t length;
+	const uint8_t *values;
+}TELEMETRY_RECORD_STRUCT;
+
+/* Queue statistics */
+typedef struct
+{
+	uint32_t depth;
+	uint32_t segments;
+	uint32_t oldestSeq;
+	uint32_t newestSeq;
+	uint32_t dropped;
+}TELEMETRY_QUEUE_STATS_STRUCT;
+
+/**@brief 				Telemetry record callback.
+ *
+ * @details 			Called for every queued record in sequence order. Callback must not call queue APIs.
+ *
+ * @param[in]	 		record				Queued record. Values are only valid during the callback.
+ * @param[in]	 		ctx					User context.
+ * @param[out]   		int32_t				0 to continue, positive value to stop before this record, negative ERROR code to abort.
+ */
+typedef int32_t (*telemetry_queue_record_cb)(const TELEMETRY_RECORD_STRUCT *record, void *ctx);
+
+/**@brief 				Function to initialize the telemetry queue
+ *
+ * @details 			Recover queue state from flash. Records with a broken tail are dropped.
+ *
+ * @param[in]	 		None.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t telemetry_queue_init(void);
+
+/**@brief 				Function to push a telemetry sample in the queue
+ *
+ * @details 			Append a record with next sequence number. Oldest segment is evicted if queue is full.
+ * 						Samples are stored compressed with ts_codec. A change of the field names starts a
+ * 						new segment.
+ *
+ * @param[in]	 		timestamp			Sample time in unix milliseconds. 0 if unknown.
+ * @param[in]	 		fields				Telemetry values.
+ * @param[in]	 		count				Number of fields. Max TELEMETRY_QUEUE_MAX_FIELDS.
+ * @param[out]   		int32_t				returns sequence number of the record or negative ERROR code incase of an error.
+ */
+int32_t telemetry_queue_push(int64_t timestamp, const TELEMETRY_FIELD_STRUCT *fields, uint8_t count);
+
+/**@brief 				Function to read queued records
+ *
+ * @details 			Call the callback for unacknowledged records, oldest first, until callback stops it.
+ *
+ * @param[in]	 		callback			Record callback.
+ * @param[in]	 		ctx					User context for callback.
+ * @param[out]   		int32_t				returns number of records accepted by callback or negative ERROR code incase of an error.
+ */
+int32_t telemetry_queue_peek(telemetry_queue_record_cb callback, void *ctx);
+
+/**@brief 				Function to acknowledge queued records
+ *
+ * @details 			Mark records up to the sequence number as delivered and remove drained segments.
+ *
+ * @param[in]	 		seq					Last delivered sequence number.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t telemetry_queue_ack(uint32_t seq);
+
+/**@brief 				Function to get number of queued records
+ *
+ * @param[in]	 		None.
+ * @param[out]   		uint32_t			returns number of unacknowledged records.
+ */
+uint32_t telemetry_queue_depth(void);
+
+/**@brief 				Function to get queue statistics
+ *
+ * @param[in]	 		stats				Statistics to fill.
+ * @param[out]   		None.
+ */
+void telemetry_queue_get_stats(TELEMETRY_QUEUE_STATS_STRUCT *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
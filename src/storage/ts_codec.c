@@ -0,0 +1,386 @@
+/**
+ * @file ts_codec.c
+ * @brief Time series codec with delta-of-delta timestamps and XOR values.
+ *
+ * @details Gorilla style encoding. First sample of a stream is stored raw. Next timestamps
+ * store the change of the sample interval in a prefix coded bucket, so a steady sample rate
+ * costs one bit. Values store the XOR with the previous value. An unchanged value costs one
+ * bit, a changed value stores only the bits between the leading and trailing zeros of the XOR.
+ * Every sample is padded to a whole byte so samples can be appended one by one.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <string.h>
+#include "ts_codec.h"
+
+/* Leading zeros are stored in 5 bits */
+#define TS_CODEC_MAX_LEADING            31
+
+/* Window of the previous value is not set */
+#define TS_CODEC_NO_WINDOW              0xFF
+
+/* Timestamp delta-of-delta buckets: prefix, prefix bits and value bits */
+typedef struct
+{
+	uint8_t prefix;
+	uint8_t prefixBits;
+	uint8_t valueBits;
+}TS_CODEC_BUCKET_STRUCT;
+
+static const TS_CODEC_BUCKET_STRUCT deltaBuckets[] = {
+	{0x02, 2, 7},
+	{0x06, 3, 9},
+	{0x0E, 4, 12},
+	{0x1E, 5, 32},
+	{0x1F, 5, 64},
+};
+
+/* Bit position in a byte buffer. Bits are filled most significant first */
+typedef struct
+{
+	uint8_t *buffer;
+	const uint8_t *input;
+	uint32_t size;
+	uint32_t bitPos;
+}TS_CODEC_BITS_STRUCT;
+
+/**@brief 				Function to write bits
+ *
+ * @param[in]	 		bits				Bit position.
+ * @param[in]	 		value				Value in the low bits.
+ * @param[in]	 		count				Number of bits, 0 to 64.
+ * @param[out]   		int32_t				returns 0 for success and -ENOMEM if buffer is full.
+ */
+static int32_t writeBits(TS_CODEC_BITS_STRUCT *bits, uint64_t value, uint8_t count)
+{
+	if ((bits->bitPos + count) > (bits->size * 8))
+	{
+		return -ENOMEM;
+	}
+
+	while (count > 0)
+	{
+		uint32_t byte = bits->bitPos / 8;
+		uint8_t room = 8 - (bits->bitPos % 8);
+		uint8_t take = MIN(room, count);
+		uint8_t chunk = (value >> (count - take)) & ((1U << take) - 1);
+
+		if (room == 8)
+		{
+			bits->buffer[byte] = 0;
+		}
+		bits->buffer[byte] |= chunk << (room - take);
+
+		bits->bitPos += take;
+		count -= take;
+	}
+
+	return 0;
+}
+
+/**@brief 				Function to read bits
+ *
+ * @param[in]	 		bits				Bit position.
+ * @param[in]	 		value				Filled with the bits in the low bits.
+ * @param[in]	 		count				Number of bits, 0 to 64.
+ * @param[out]   		int32_t				returns 0 for success and -EILSEQ if input ends.
+ */
+static int32_t readBits(TS_CODEC_BITS_STRUCT *bits, uint64_t *value, uint8_t count)
+{
+	*value = 0;
+
+	if ((bits->bitPos + count) > (bits->size * 8))
+	{
+		return -EILSEQ;
+	}
+
+	while (count > 0)
+	{
+		uint32_t byte = bits->bitPos / 8;
+		uint8_t room = 8 - (bits->bitPos % 8);
+		uint8_t take = MIN(room, count);
+		uint8_t chunk = (bits->input[byte] >> (room - take)) & ((1U << take) - 1);
+
+		*value = (*value << take) | chunk;
+
+		bits->bitPos += take;
+		count -= take;
+	}
+
+	return 0;
+}
+
+/**@brief 				Function to sign extend a value
+ *
+ * @param[in]	 		value				Value in the low bits.
+ * @param[in]	 		count				Number of value bits.
+ * @param[out]   		int64_t				returns signed value.
+ */
+static int64_t signExtend(uint64_t value, uint8_t count)
+{
+	if (count == 64)
+	{
+		return (int64_t)value;
+	}
+
+	return (int64_t)(value << (64 - count)) >> (64 - count);
+}
+
+/**@brief 				Function to reset the codec state
+ *
+ * @param[in]	 		codec				Codec state.
+ * @param[in]	 		field_count			Number of values per sample. Max TS_CODEC_MAX_FIELDS.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t ts_codec_init(TS_CODEC_STRUCT *codec, uint8_t field_count)
+{
+	if ((field_count == 0) || (field_count > TS_CODEC_MAX_FIELDS))
+	{
+		return -EINVAL;
+	}
+
+	memset(codec, 0, sizeof(*codec));
+	memset(codec->leading, TS_CODEC_NO_WINDOW, sizeof(codec->leading));
+	codec->fieldCount = field_count;
+
+	return 0;
+}
+
+/**@brief 				Function to encode a sample
+ *
+ * @details 			Sample is encoded relative to the previous sample and padded to a whole byte, so
+ * 						every sample can be stored on its own. Codec state is updated. Keep a copy of the
+ * 						state if the encoded sample may not be stored.
+ *
+ * @param[in]	 		codec				Codec state.
+ * @param[in]	 		timestamp			Sample time.
+ * @param[in]	 		values				field_count values.
+ * @param[in]	 		buffer				buffer for the encoded sample.
+ * @param[in]	 		buffer_size			Size of buffer. TS_CODEC_MAX_SAMPLE_SIZE always fits.
+ * @param[out]   		int32_t				returns number of encoded bytes or negative ERROR code incase of an error.
+ */
+int32_t ts_codec_encode(TS_CODEC_STRUCT *codec, int64_t timestamp, const double *values, uint8_t *buffer, uint32_t buffer_size)
+{
+	TS_CODEC_BITS_STRUCT bits = {.buffer = buffer, .size = buffer_size};
+	uint64_t value;
+	int32_t rc = 0;
+
+	if (codec->samples == 0)
+	{
+		rc = writeBits(&bits, (uint64_t)timestamp, 64);
+	}
+	else
+	{
+		/* Wrapping arithmetic, any timestamp jump round trips */
+		int64_t delta = (int64_t)((uint64_t)timestamp - (uint64_t)codec->timestamp);
+		int64_t deltaOfDelta = (int64_t)((uint64_t)delta - (uint64_t)codec->delta);
+
+		if (deltaOfDelta == 0)
+		{
+			rc = writeBits(&bits, 0, 1);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < ARRAY_SIZE(deltaBuckets); i++)
+			{
+				const TS_CODEC_BUCKET_STRUCT *bucket = &deltaBuckets[i];
+				int64_t limit = (bucket->valueBits < 64) ? ((int64_t)1 << (bucket->valueBits - 1)) : 0;
+
+				if ((bucket->valueBits == 64) || ((deltaOfDelta >= -limit) && (deltaOfDelta < limit)))
+				{
+					rc = writeBits(&bits, bucket->prefix, bucket->prefixBits);
+					if (rc >= 0)
+					{
+						rc = writeBits(&bits, (uint64_t)deltaOfDelta & ((bucket->valueBits < 64) ? (((uint64_t)1 << bucket->valueBits) - 1) : UINT64_MAX), bucket->valueBits);
+					}
+					break;
+				}
+			}
+		}
+
+		codec->delta = delta;
+	}
+	codec->timestamp = timestamp;
+
+	for (uint8_t i = 0; (i < codec->fieldCount) && (rc >= 0); i++)
+	{
+		memcpy(&value, &values[i], sizeof(value));
+
+		if (codec->samples == 0)
+		{
+			rc = writeBits(&bits, value, 64);
+		}
+		else
+		{
+			uint64_t xorValue = value ^ codec->value[i];
+
+			if (xorValue == 0)
+			{
+				rc = writeBits(&bits, 0, 1);
+			}
+			else
+			{
+				uint8_t leading = MIN(__builtin_clzll(xorValue), TS_CODEC_MAX_LEADING);
+				uint8_t trailing = __builtin_ctzll(xorValue);
+
+				if ((codec->leading[i] != TS_CODEC_NO_WINDOW) && (leading >= codec->leading[i]) && (trailing >= codec->trailing[i]))
+				{
+					/* Meaningful bits fit in the previous window */
+					rc = writeBits(&bits, 0x02, 2);
+					if (rc >= 0)
+					{
+						rc = writeBits(&bits, xorValue >> codec->trailing[i], 64 - codec->leading[i] - codec->trailing[i]);
+					}
+				}
+				else
+				{
+					uint8_t meaningful = 64 - leading - trailing;
+
+					rc = writeBits(&bits, 0x03, 2);
+					if (rc >= 0)
+					{
+						rc = writeBits(&bits, leading, 5);
+					}
+					if (rc >= 0)
+					{
+						rc = writeBits(&bits, meaningful - 1, 6);
+					}
+					if (rc >= 0)
+					{
+						rc = writeBits(&bits, xorValue >> trailing, meaningful);
+					}
+
+					codec->leading[i] = leading;
+					codec->trailing[i] = trailing;
+				}
+			}
+		}
+
+		codec->value[i] = value;
+	}
+
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	codec->samples++;
+
+	return (bits.bitPos + 7) / 8;
+}
+
+/**@brief 				Function to decode a sample
+ *
+ * @param[in]	 		codec				Codec state.
+ * @param[in]	 		buffer				Encoded sample.
+ * @param[in]	 		size				Number of bytes in buffer.
+ * @param[in]	 		timestamp			Filled with sample time.
+ * @param[in]	 		values				Filled with field_count values.
+ * @param[out]   		int32_t				returns number of bytes decoded or negative ERROR code incase of an error.
+ */
+int32_t ts_codec_decode(TS_CODEC_STRUCT *codec, const uint8_t *buffer, uint32_t size, int64_t *timestamp, double *values)
+{
+	TS_CODEC_BITS_STRUCT bits = {.input = buffer, .size = size};
+	uint64_t field;
+	uint64_t bit;
+	int32_t rc = 0;
+
+	if (codec->samples == 0)
+	{
+		rc = readBits(&bits, &field, 64);
+		codec->timestamp = (int64_t)field;
+	}
+	else
+	{
+		int64_t deltaOfDelta = 0;
+
+		rc = readBits(&bits, &bit, 1);
+		if ((rc >= 0) && (bit == 1))
+		{
+			/* Prefix is a run of ones ended by a zero, the last bucket has no zero */
+			uint32_t i = 0;
+
+			while ((rc >= 0) && (i < (ARRAY_SIZE(deltaBuckets) - 1)))
+			{
+				rc = readBits(&bits, &bit, 1);
+				if (bit == 0)
+				{
+					break;
+				}
+				i++;
+			}
+
+			if (rc >= 0)
+			{
+				rc = readBits(&bits, &field, deltaBuckets[i].valueBits);
+				deltaOfDelta = signExtend(field, deltaBuckets[i].valueBits);
+			}
+		}
+
+		codec->delta = (int64_t)((uint64_t)codec->delta + (uint64_t)deltaOfDelta);
+		codec->timestamp = (int64_t)((uint64_t)codec->timestamp + (uint64_t)codec->delta);
+	}
+	*timestamp = codec->timestamp;
+
+	for (uint8_t i = 0; (i < codec->fieldCount) && (rc >= 0); i++)
+	{
+		if (codec->samples == 0)
+		{
+			rc = readBits(&bits, &codec->value[i], 64);
+		}
+		else
+		{
+			rc = readBits(&bits, &bit, 1);
+			if ((rc >= 0) && (bit == 1))
+			{
+				rc = readBits(&bits, &bit, 1);
+				if ((rc >= 0) && (bit == 1))
+				{
+					uint64_t leading;
+					uint64_t meaningful;
+
+					rc = readBits(&bits, &leading, 5);
+					if (rc >= 0)
+					{
+						rc = readBits(&bits, &meaningful, 6);
+					}
+					meaningful++;
+
+					if ((rc >= 0) && ((leading + meaningful) > 64))
+					{
+						rc = -EILSEQ;
+					}
+
+					codec->leading[i] = leading;
+					codec->trailing[i] = 64 - leading - meaningful;
+				}
+				else if ((rc >= 0) && (codec->leading[i] == TS_CODEC_NO_WINDOW))
+				{
+					rc = -EILSEQ;
+				}
+
+				if (rc >= 0)
+				{
+					rc = readBits(&bits, &field, 64 - codec->leading[i] - codec->trailing[i]);
+					codec->value[i] ^= field << codec->trailing[i];
+				}
+			}
+		}
+
+		memcpy(&values[i], &codec->value[i], sizeof(values[i]));
+	}
+
+	if (rc < 0)
+	{
+		return rc;
+	}
+
+	codec->samples++;
+
+	return (bits.bitPos + 7) / 8;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file ts_codec.h
+ * @brief Time series codec with delta-of-delta timestamps and XOR values.
+ *
+ * @copyright Copyright (C) A9S Inc. - All Rights Reserved.
+ Unauthorized copying of this file, via any medium is strictly prohibited.
+ Proprietary and confidential. *
+ */
+
+
+#ifndef TsCodec_h
+#define TsCodec_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Values per sample */
+#define TS_CODEC_MAX_FIELDS             4
+
+/* Largest encoded sample. Raw timestamp escape and full width value for every field */
+#define TS_CODEC_MAX_SAMPLE_SIZE        (((5 + 64) + (TS_CODEC_MAX_FIELDS * (2 + 5 + 6 + 64)) + 7) / 8)
+
+/* Codec state. Encoder and decoder states follow the same samples */
+typedef struct
+{
+	int64_t timestamp;
+	int64_t delta;
+	uint64_t value[TS_CODEC_MAX_FIELDS];
+	uint8_t leading[TS_CODEC_MAX_FIELDS];
+	uint8_t trailing[TS_CODEC_MAX_FIELDS];
+	uint8_t fieldCount;
+	uint32_t samples;
+}TS_CODEC_STRUCT;
+
+/**@brief 				Function to reset the codec state
+ *
+ * @param[in]	 		codec				Codec state.
+ * @param[in]	 		field_count			Number of values per sample. Max TS_CODEC_MAX_FIELDS.
+ * @param[out]   		int32_t				returns 0 for success and negative ERROR code incase of an error.
+ */
+int32_t ts_codec_init(TS_CODEC_STRUCT *codec, uint8_t field_count);
+
+/**@brief 				Function to encode a sample
+ *
+ * @details 			Sample is encoded relative to the previous sample and padded to a whole byte, so
+ * 						every sample can be stored on its own. Codec state is updated. Keep a copy of the
+ * 						state if the encoded sample may not be stored.
+ *
+ * @param[in]	 		codec				Codec state.
+ * @param[in]	 		timestamp			Sample time.
+ * @param[in]	 		values				field_count values.
+ * @param[in]	 		buffer				buffer for the encoded sample.
+ * @param[in]	 		buffer_size			Size of buffer. TS_CODEC_MAX_SAMPLE_SIZE always fits.
+ * @param[out]   		int32_t				returns number of encoded bytes or negative ERROR code incase of an error.
+ */
+int32_t ts_codec_encode(TS_CODEC_STRUCT *codec, int64_t timestamp, const double *values, uint8_t *buffer, uint32_t buffer_size);
+
+/**@brief 				Function to decode a sample
+ *
+ * @param[in]	 		codec				Codec state.
+ * @param[in]	 		buffer				Encoded sample.
+ * @param[in]	 		size				Number of bytes in buffer.
+ * @param[in]	 		timestamp			Filled with sample time.
+ * @param[in]	 		values				Filled with field_count values.
+ * @param[out]   		int32_t				returns number of bytes decoded or negative ERROR code incase of an error.
+ */
+int32_t ts_codec_decode(TS_CODEC_STRUCT *codec, const uint8_t *buffer, uint32_t size, int64_t *timestamp, double *values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif